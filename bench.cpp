@@ -0,0 +1,789 @@
+/**
+   bench.cpp : 索引の性能測定
+
+   使い方 : bench memory|arena|containers|similar|colors|snapshot|tagtree|rules|libraries|parse [ファイル数]
+
+   libraries は一時ディレクトリに実際のファイルを作るため、ファイル数は少なめ(10 万件程度)に指定する。
+**/
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <random>
+#include <chrono>
+#include <memory>
+#include <memory_resource>
+#include <cstdlib>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <atomic>
+
+#include "file.hpp"
+#include "container.hpp"
+#include "similar.hpp"
+#include "color.hpp"
+#include "snapshot.hpp"
+#include "tagtree.hpp"
+#include "tagrules.hpp"
+#include "library.hpp"
+#include "tagparse.hpp"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace fs = boost::filesystem;
+
+/** メモリ使用量の計測 **/
+
+/*
+  並列に動くベンチマーク(parse・libraries など)からも呼ばれるため、確保中のバイト数は atomic で数える。
+  operator delete を呼び出し側に展開させないのは、展開先で operator new の結果に free を呼んでいるように見え、
+  -Wmismatched-new-delete の警告が出るため
+*/
+namespace
+{
+  std::atomic< std::size_t > g_Allocated( 0 ); // 確保中のバイト数
+
+  const std::size_t HEADER_SIZE = alignof( std::max_align_t ); // 確保サイズを記録する領域
+}
+
+void* operator new( std::size_t size )
+{
+  char* p = static_cast< char* >( std::malloc( size + HEADER_SIZE ) );
+  if ( p == nullptr ) throw std::bad_alloc();
+  *reinterpret_cast< std::size_t* >( p ) = size;
+  g_Allocated.fetch_add( size, std::memory_order_relaxed );
+
+  return( p + HEADER_SIZE );
+}
+
+[[gnu::noinline]] void operator delete( void* ptr ) noexcept
+{
+  if ( ptr == nullptr ) return;
+  char* p = static_cast< char* >( ptr ) - HEADER_SIZE;
+  g_Allocated.fetch_sub( *reinterpret_cast< std::size_t* >( p ), std::memory_order_relaxed );
+  std::free( p );
+}
+
+[[gnu::noinline]] void operator delete( void* ptr, std::size_t ) noexcept
+{
+  operator delete( ptr );
+}
+
+namespace
+{
+  const unsigned DIR_FANOUT = 100;   // 各階層のディレクトリ数
+  const unsigned TAG_KINDS = 2000;   // タグの種類
+  const unsigned TAGS_PER_FILE = 8;  // ファイル当たりのタグ数
+
+  /*
+    MakeTree : files 件の合成ファイルと、そのタグを作る
+
+    /library/aXX/bYY/IMG_nnnnnnn.jpg の形で、タグは一様乱数で選ぶ
+  */
+  void MakeTree( std::size_t files, vector< fs::path >* paths, vector< vector< string > >* tags )
+  {
+    std::mt19937 rng( 20261018 );
+    std::uniform_int_distribution< unsigned > pick( 0, TAG_KINDS - 1 );
+
+    paths->reserve( files );
+    tags->resize( files );
+    for ( std::size_t i = 0 ; i < files ; ++i ) {
+      unsigned dir = i % ( DIR_FANOUT * DIR_FANOUT );
+      paths->push_back( fs::path( "/library/a" + std::to_string( dir / DIR_FANOUT ) +
+                                  "/b" + std::to_string( dir % DIR_FANOUT ) +
+                                  "/IMG_" + std::to_string( i ) + ".jpg" ) );
+      for ( unsigned t = 0 ; t < TAGS_PER_FILE ; ++t )
+        ( *tags )[i].push_back( "tag" + std::to_string( pick( rng ) ) );
+    }
+  }
+
+  /*
+    Elapsed : start からの経過時間(秒)を返す
+  */
+  double Elapsed( std::chrono::steady_clock::time_point start )
+  {
+    return( std::chrono::duration< double >( std::chrono::steady_clock::now() - start ).count() );
+  }
+
+  /*
+    Report : 計測結果を出力する
+  */
+  void Report( const string& name, std::size_t bytes, std::size_t files, double seconds )
+  {
+    cout << name << " : " << bytes / ( 1024 * 1024 ) << " MiB ("
+         << static_cast< double >( bytes ) / files << " bytes/file), "
+         << seconds << " s" << endl;
+  }
+
+  /*
+    BenchMemory : パスをキーとする索引と、識別番号で参照する索引のメモリ使用量を比べる
+  */
+  void BenchMemory( std::size_t files )
+  {
+    vector< fs::path > paths;
+    vector< vector< string > > tags;
+    MakeTree( files, &paths, &tags );
+    cout << files << " files, " << TAGS_PER_FILE << " tags/file, " << TAG_KINDS << " tag kinds" << endl;
+
+    // パスをキーとする索引(以前の形式)
+    {
+      std::size_t base = g_Allocated;
+      auto start = std::chrono::steady_clock::now();
+      std::map< fs::path, TagSet > fileData;
+      std::map< string, std::set< fs::path >, StrLess > tagData;
+      for ( std::size_t i = 0 ; i < files ; ++i ) {
+        auto& f = fileData[paths[i]];
+        for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t ) {
+          f.insert( *t );
+          tagData[*t].insert( paths[i] );
+        }
+      }
+      Report( "path keys  ", g_Allocated - base, files, Elapsed( start ) );
+    }
+
+    // 識別番号で参照する索引
+    {
+      std::size_t base = g_Allocated;
+      auto start = std::chrono::steady_clock::now();
+      FileData fileData;
+      TagData tagData;
+      fileData.assign( paths );
+      for ( std::size_t i = 0 ; i < files ; ++i ) {
+        FileId id = fileData.find( paths[i] );
+        auto& f = fileData.edit( id );
+        for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t ) {
+          f.insert( *t );
+          tagData[*t].insert( id );
+        }
+      }
+      Report( "path table ", g_Allocated - base, files, Elapsed( start ) );
+    }
+  }
+
+  /*
+    BenchArena : 索引の構築と破棄にかかる時間を、タグリストを通常のヒープに置く場合と FileData のチャンク毎の領域に置く場合で比べる
+  */
+  void BenchArena( std::size_t files )
+  {
+    vector< fs::path > paths;
+    vector< vector< string > > tags;
+    MakeTree( files, &paths, &tags );
+    cout << files << " files, " << TAGS_PER_FILE << " tags/file, " << TAG_KINDS << " tag kinds" << endl;
+
+    // 通常のヒープ
+    {
+      std::pmr::memory_resource* heap = std::pmr::new_delete_resource();
+      auto fileTags = std::make_unique< std::pmr::vector< TagSet > >( files, heap );
+      auto tagData = std::make_unique< TagData >();
+      auto start = std::chrono::steady_clock::now();
+      for ( std::size_t i = 0 ; i < files ; ++i ) {
+        auto& f = ( *fileTags )[i];
+        for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t ) {
+          f.insert( *t );
+          ( *tagData )[*t].insert( static_cast< FileId >( i ) );
+        }
+      }
+      double build = Elapsed( start );
+      start = std::chrono::steady_clock::now();
+      tagData.reset();
+      fileTags.reset();
+      cout << "heap  : build " << build << " s, release " << Elapsed( start ) << " s" << endl;
+    }
+
+    // チャンク毎の領域
+    {
+      FileData fileData;
+      TagData tagData;
+      fileData.assign( paths );
+      auto start = std::chrono::steady_clock::now();
+      for ( std::size_t i = 0 ; i < files ; ++i ) {
+        auto& f = fileData.edit( static_cast< FileId >( i ) );
+        for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t ) {
+          f.insert( *t );
+          tagData[*t].insert( static_cast< FileId >( i ) );
+        }
+      }
+      double build = Elapsed( start );
+      start = std::chrono::steady_clock::now();
+      tagData.clear();
+      fileData.clear();
+      cout << "arena : build " << build << " s, release " << Elapsed( start ) << " s" << endl;
+    }
+  }
+
+  /*
+    BenchSet : members[i] を要素とする集合 Set を作り、メモリ使用量と構築・検索の時間を出力する
+
+    検索は各集合について probes 個の値を探す
+  */
+  template< class Set >
+  void BenchSet( const string& name, const vector< vector< std::uint32_t > >& members, const vector< std::uint32_t >& probes )
+  {
+    using value_type = typename Set::value_type;
+
+    std::size_t base = g_Allocated;
+    auto start = std::chrono::steady_clock::now();
+    vector< Set > sets( members.size() );
+    for ( std::size_t i = 0 ; i < members.size() ; ++i )
+      for ( auto m = members[i].begin() ; m != members[i].end() ; ++m )
+        sets[i].insert( static_cast< value_type >( *m ) );
+    double build = Elapsed( start );
+    std::size_t bytes = g_Allocated - base;
+
+    start = std::chrono::steady_clock::now();
+    std::size_t hits = 0;
+    for ( std::size_t i = 0 ; i < sets.size() ; ++i )
+      for ( auto p = probes.begin() ; p != probes.end() ; ++p )
+        if ( sets[i].find( static_cast< value_type >( *p ) ) != sets[i].end() ) ++hits;
+    double lookup = Elapsed( start );
+
+    cout << name << " : " << static_cast< double >( bytes ) / sets.size() << " bytes/set, build "
+         << build << " s, lookup " << lookup << " s (" << hits << " hits)" << endl;
+  }
+
+  /*
+    BenchContainers : Tag・Image が持つ ID の集合を、コンテナの方針と ID の幅ごとに比べる
+
+    画像毎のタグ ID の集合(小さい集合が多数)と、タグ毎の画像 ID の集合(大きい集合が少数)を測る。
+  */
+  void BenchContainers( std::size_t files )
+  {
+    vector< fs::path > paths;
+    vector< vector< string > > tags;
+    MakeTree( files, &paths, &tags );
+
+    // タグ名を ID に置き換え、画像毎・タグ毎の集合の要素を作る(ID は 1 から)
+    vector< vector< std::uint32_t > > imageTags( files );
+    vector< vector< std::uint32_t > > tagImages( TAG_KINDS );
+    for ( std::size_t i = 0 ; i < files ; ++i ) {
+      for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t ) {
+        std::uint32_t tagId = std::stoul( t->substr( 3 ) ) + 1;
+        imageTags[i].push_back( tagId );
+        tagImages[tagId - 1].push_back( static_cast< std::uint32_t >( i + 1 ) );
+      }
+    }
+    tags.clear();
+    paths.clear();
+
+    std::mt19937 rng( 20261018 );
+    vector< std::uint32_t > tagProbes( TAGS_PER_FILE );
+    for ( auto p = tagProbes.begin() ; p != tagProbes.end() ; ++p )
+      *p = std::uniform_int_distribution< std::uint32_t >( 1, TAG_KINDS )( rng );
+    vector< std::uint32_t > imageProbes( 1000 );
+    for ( auto p = imageProbes.begin() ; p != imageProbes.end() ; ++p )
+      *p = std::uniform_int_distribution< std::uint32_t >( 1, static_cast< std::uint32_t >( files ) )( rng );
+
+    cout << files << " images, " << TAGS_PER_FILE << " tags/image, " << TAG_KINDS << " tag kinds" << endl;
+    cout << "tag sets of an image" << endl;
+    BenchSet< container_policy::HashSet::container< std::uint16_t > >( "  hash  16", imageTags, tagProbes );
+    BenchSet< container_policy::HashSet::container< std::uint32_t > >( "  hash  32", imageTags, tagProbes );
+    BenchSet< container_policy::FlatSet::container< std::uint16_t > >( "  flat  16", imageTags, tagProbes );
+    BenchSet< container_policy::FlatSet::container< std::uint32_t > >( "  flat  32", imageTags, tagProbes );
+    BenchSet< container_policy::SmallSet< 8 >::container< std::uint16_t > >( "  small 16", imageTags, tagProbes );
+    BenchSet< container_policy::SmallSet< 8 >::container< std::uint32_t > >( "  small 32", imageTags, tagProbes );
+
+    cout << "image sets of a tag" << endl;
+    BenchSet< container_policy::HashSet::container< std::uint32_t > >( "  hash  32", tagImages, imageProbes );
+    BenchSet< container_policy::FlatSet::container< std::uint32_t > >( "  flat  32", tagImages, imageProbes );
+    BenchSet< container_policy::SmallSet< 8 >::container< std::uint32_t > >( "  small 32", tagImages, imageProbes );
+  }
+
+  /*
+    BenchSimilar : 類似画像の検索を、多重索引ハッシュと全件の走査で比べる
+
+    一様乱数のハッシュに、元の 1% を数ビット変えた複製を加えて索引を作る
+  */
+  void BenchSimilar( std::size_t files )
+  {
+    const unsigned RADIUS = 10; // 距離の上限
+    const std::size_t QUERIES = 1000;
+
+    std::mt19937_64 rng( 20261018 );
+    vector< ImageHash > hashes( files );
+    for ( std::size_t i = 0 ; i < files ; ++i ) {
+      if ( i % 100 == 99 ) {
+        hashes[i] = hashes[i - 1];
+        for ( unsigned b = rng() % 6 ; b > 0 ; --b )
+          hashes[i] ^= ImageHash( 1 ) << ( rng() % 64 );
+      } else {
+        hashes[i] = rng();
+      }
+    }
+    cout << files << " images, radius " << RADIUS << ", " << QUERIES << " queries" << endl;
+
+    auto start = std::chrono::steady_clock::now();
+    SimilarIndex index;
+    index.assign( files );
+    for ( std::size_t i = 0 ; i < files ; ++i )
+      index.insert( static_cast< FileId >( i ), hashes[i] );
+    cout << "index build : " << Elapsed( start ) << " s" << endl;
+
+    std::size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t q = 0 ; q < QUERIES ; ++q )
+      found += index.find( static_cast< FileId >( q * ( files / QUERIES ) + 98 ), RADIUS ).size();
+    cout << "index : " << Elapsed( start ) * 1000 / QUERIES << " ms/query (" << found << " found)" << endl;
+
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t q = 0 ; q < QUERIES ; ++q ) {
+      ImageHash hash = hashes[q * ( files / QUERIES ) + 98];
+      for ( std::size_t i = 0 ; i < files ; ++i )
+        if ( HammingDistance( hash, hashes[i] ) <= RADIUS ) ++found;
+    }
+    cout << "scan  : " << Elapsed( start ) * 1000 / QUERIES << " ms/query (" << found - QUERIES << " found)" << endl;
+  }
+
+  /*
+    BenchColors : 色の検索を、列指向の索引と行毎のヒストグラムの走査で比べる
+
+    ヒストグラムは区分の一つを強めた乱数とする
+  */
+  void BenchColors( std::size_t files )
+  {
+    const std::uint8_t SHARE = 64;  // 主な色とみなす割合の下限
+    const std::size_t LIMIT = 100;  // 配色が似た画像の上限
+    const std::size_t QUERIES = 100;
+
+    std::mt19937 rng( 20261018 );
+    vector< ColorHistogram > rows( files );
+    ColorIndex index;
+    index.assign( files );
+    for ( std::size_t i = 0 ; i < files ; ++i ) {
+      for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+        rows[i][b] = rng() % 24;
+      rows[i][rng() % COLOR_BINS] += rng() % 128;
+      index.insert( static_cast< FileId >( i ), rows[i] );
+    }
+    cout << files << " images, " << COLOR_BINS << " bins, " << QUERIES << " queries" << endl;
+
+    std::size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for ( std::size_t q = 0 ; q < QUERIES ; ++q )
+      found += index.dominant( q % COLOR_BINS, SHARE ).size();
+    cout << "dominant index : " << Elapsed( start ) * 1000 / QUERIES << " ms/query (" << found << " found)" << endl;
+
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t q = 0 ; q < QUERIES ; ++q ) {
+      unsigned bin = q % COLOR_BINS;
+      for ( std::size_t i = 0 ; i < files ; ++i )
+        if ( rows[i][bin] >= SHARE && *std::max_element( rows[i].begin(), rows[i].end() ) == rows[i][bin] ) ++found;
+    }
+    cout << "dominant scan  : " << Elapsed( start ) * 1000 / QUERIES << " ms/query (" << found << " found)" << endl;
+
+    std::uint64_t checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t q = 0 ; q < QUERIES ; ++q ) {
+      vector< FileId > nearest = index.nearest( static_cast< FileId >( q * ( files / QUERIES ) ), LIMIT );
+      checksum += nearest.empty() ? 0 : nearest.front();
+    }
+    cout << "nearest index  : " << Elapsed( start ) * 1000 / QUERIES << " ms/query (" << checksum << ")" << endl;
+
+    checksum = 0;
+    start = std::chrono::steady_clock::now();
+    for ( std::size_t q = 0 ; q < QUERIES ; ++q ) {
+      std::size_t file = q * ( files / QUERIES );
+      vector< std::pair< unsigned, FileId > > ranked;
+      ranked.reserve( files );
+      for ( std::size_t i = 0 ; i < files ; ++i ) {
+        if ( i == file ) continue;
+        unsigned distance = 0;
+        for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+          distance += std::abs( static_cast< int >( rows[i][b] ) - rows[file][b] );
+        ranked.emplace_back( distance, static_cast< FileId >( i ) );
+      }
+      std::partial_sort( ranked.begin(), ranked.begin() + LIMIT, ranked.end() );
+      checksum += ranked.front().second;
+    }
+    cout << "nearest scan   : " << Elapsed( start ) * 1000 / QUERIES << " ms/query (" << checksum << ")" << endl;
+  }
+
+  /*
+    BenchSnapshot : 編集毎に版を公開する時間と、読む側が古い版を持ち続けた場合のメモリ使用量を測る
+  */
+  void BenchSnapshot( std::size_t files )
+  {
+    const std::size_t EDITS = 10000; // 編集の回数
+
+    vector< fs::path > paths;
+    vector< vector< string > > tags;
+    MakeTree( files, &paths, &tags );
+    cout << files << " files, " << TAGS_PER_FILE << " tags/file, " << TAG_KINDS << " tag kinds" << endl;
+
+    FileData fileData;
+    TagData tagData;
+    fileData.assign( paths );
+    for ( std::size_t i = 0 ; i < files ; ++i )
+      for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t )
+        AddTag( *t, static_cast< FileId >( i ), &fileData, &tagData );
+
+    TagTree tagTree;
+    TagRules tagRules;
+    IndexVersions versions;
+    versions.publish( fileData, tagData, tagTree, tagRules );
+
+    std::mt19937 rng( 20261018 );
+    std::uniform_int_distribution< FileId > file( 0, static_cast< FileId >( files - 1 ) );
+    auto start = std::chrono::steady_clock::now();
+    for ( std::size_t e = 0 ; e < EDITS ; ++e ) {
+      AddTag( "edited", file( rng ), &fileData, &tagData );
+      versions.publish( fileData, tagData, tagTree, tagRules );
+    }
+    cout << "publish        : " << Elapsed( start ) * 1e6 / EDITS << " us/edit" << endl;
+
+    // 読む側が直前の版を持っている間の編集(共有中のチャンクが複製される)
+    std::shared_ptr< const IndexSnapshot > held = versions.current();
+    std::size_t base = g_Allocated;
+    for ( std::size_t e = 0 ; e < EDITS ; ++e ) {
+      AddTag( "held", file( rng ), &fileData, &tagData );
+      versions.publish( fileData, tagData, tagTree, tagRules );
+    }
+    cout << "held version   : " << ( g_Allocated - base ) / 1024 << " KiB after " << EDITS << " edits" << endl;
+  }
+
+  /*
+    BenchTagTree : タグの階層の集約したファイルリストの作成・更新と、祖先の判定の時間を測る
+
+    タグ 100 種類ずつを group の子にし、group を全て all の子にする(3 階層)
+  */
+  void BenchTagTree( std::size_t files )
+  {
+    const std::size_t EDITS = 100000;  // 編集の回数
+    const unsigned GROUP_SIZE = 100;   // group 1 つ当たりのタグの種類
+
+    vector< fs::path > paths;
+    vector< vector< string > > tags;
+    MakeTree( files, &paths, &tags );
+    cout << files << " files, " << TAGS_PER_FILE << " tags/file, " << TAG_KINDS << " tag kinds" << endl;
+
+    FileData fileData;
+    TagData tagData;
+    fileData.assign( paths );
+    for ( std::size_t i = 0 ; i < files ; ++i )
+      for ( auto t = tags[i].begin() ; t != tags[i].end() ; ++t )
+        AddTag( *t, static_cast< FileId >( i ), &fileData, &tagData );
+
+    TagParents parents;
+    for ( unsigned t = 0 ; t < TAG_KINDS ; ++t ) {
+      string group = "group" + std::to_string( t / GROUP_SIZE );
+      parents["tag" + std::to_string( t )] = group;
+      parents[group] = "all";
+    }
+    TagTree tagTree;
+    auto start = std::chrono::steady_clock::now();
+    tagTree.assign( parents, tagData );
+    cout << "rollup build   : " << Elapsed( start ) << " s (all : " << tagTree.files( "all" )->size() << " files)" << endl;
+
+    // 同じ編集を階層なし・ありで行い、付けて外す
+    std::mt19937 rng( 20261018 );
+    std::uniform_int_distribution< FileId > file( 0, static_cast< FileId >( files - 1 ) );
+    std::uniform_int_distribution< unsigned > pick( 0, TAG_KINDS - 1 );
+    vector< std::pair< FileId, string > > edits;
+    for ( std::size_t e = 0 ; e < EDITS ; ++e )
+      edits.emplace_back( file( rng ), "tag" + std::to_string( pick( rng ) ) );
+    for ( TagTree* tree : { static_cast< TagTree* >( nullptr ), &tagTree } ) {
+      start = std::chrono::steady_clock::now();
+      for ( auto e = edits.begin() ; e != edits.end() ; ++e )
+        if ( AddTag( e->second, e->first, &fileData, &tagData, tree ) )
+          RemoveTag( e->second, e->first, &fileData, &tagData, tree );
+      cout << ( ( tree == nullptr ) ? "edit (flat)    : " : "edit (rollup)  : " )
+           << Elapsed( start ) * 1e6 / EDITS << " us/edit" << endl;
+    }
+
+    // 祖先の判定(番号の比較)
+    std::size_t hits = 0;
+    start = std::chrono::steady_clock::now();
+    for ( auto e = edits.begin() ; e != edits.end() ; ++e )
+      if ( tagTree.contains( "group1", e->second ) ) ++hits;
+    cout << "contains       : " << Elapsed( start ) * 1e9 / EDITS << " ns/test (" << hits << " hits)" << endl;
+  }
+
+  /*
+    BenchRules : 含意の閉包の作成時間と、タグの展開を閉包の表で行う場合と含意をたどる場合の時間を測る
+
+    タグ t は t / 2 と t / 3 を含意する(経路が複数ある深さ log2( TAG_KINDS ) 程度の含意)。
+    files は展開の回数とする
+  */
+  void BenchRules( std::size_t files )
+  {
+    TagRuleData data;
+    for ( unsigned t = 2 ; t < TAG_KINDS ; ++t ) {
+      data.implies.emplace( "tag" + std::to_string( t ), "tag" + std::to_string( t / 2 ) );
+      if ( t / 3 > 0 )
+        data.implies.emplace( "tag" + std::to_string( t ), "tag" + std::to_string( t / 3 ) );
+    }
+    cout << TAG_KINDS << " tag kinds, " << data.implies.size() << " implications" << endl;
+
+    TagRules tagRules;
+    auto start = std::chrono::steady_clock::now();
+    tagRules.assign( data );
+    std::size_t closure = 0;
+    for ( unsigned t = 0 ; t < TAG_KINDS ; ++t )
+      closure += tagRules.implied( "tag" + std::to_string( t ) ).size();
+    cout << "closure build  : " << Elapsed( start ) << " s (" << closure << " pairs)" << endl;
+
+    std::mt19937 rng( 20261018 );
+    std::uniform_int_distribution< unsigned > pick( 0, TAG_KINDS - 1 );
+    vector< string > adds;
+    for ( std::size_t i = 0 ; i < files ; ++i )
+      adds.push_back( "tag" + std::to_string( pick( rng ) ) );
+
+    // 閉包の表を引く
+    std::size_t expanded = 0;
+    start = std::chrono::steady_clock::now();
+    for ( auto a = adds.begin() ; a != adds.end() ; ++a )
+      expanded += tagRules.expand( *a ).size();
+    cout << "expand (table) : " << Elapsed( start ) * 1e9 / files << " ns/tag (" << expanded << " tags)" << endl;
+
+    // 直接の含意を毎回たどる
+    expanded = 0;
+    start = std::chrono::steady_clock::now();
+    for ( auto a = adds.begin() ; a != adds.end() ; ++a ) {
+      TagRules::Names seen;
+      vector< string > stack( 1, *a );
+      while ( ! stack.empty() ) {
+        string tag = stack.back();
+        stack.pop_back();
+        if ( ! seen.insert( tag ).second ) continue;
+        const TagRules::Names& next = tagRules.implies( tag );
+        stack.insert( stack.end(), next.begin(), next.end() );
+      }
+      expanded += seen.size();
+    }
+    cout << "expand (walk)  : " << Elapsed( start ) * 1e9 / files << " ns/tag (" << expanded << " tags)" << endl;
+
+    // 規則を 1 件加えたときの閉包の差分更新
+    start = std::chrono::steady_clock::now();
+    tagRules.imply( "tag1", "root" );
+    cout << "imply (update) : " << Elapsed( start ) * 1e6 << " us (root implied by "
+         << tagRules.implying( "root" ).size() << " tags)" << endl;
+  }
+
+  /*
+    BenchLibraries : 大きさの違う 4 つのライブラリについて、1 つずつ順に読み込む場合と並列に読み込む場合を比べる
+
+    ライブラリ i には files * ( i + 1 ) / 10 件の空のファイルを作り、タグファイルに一様乱数で選んだタグを書く
+  */
+  void BenchLibraries( std::size_t files )
+  {
+    const unsigned LIBRARIES = 4;
+    fs::path base = fs::temp_directory_path() / fs::unique_path( "gtag-bench-%%%%%%%%" );
+    std::mt19937 rng( 20261018 );
+    std::uniform_int_distribution< unsigned > pick( 0, TAG_KINDS - 1 );
+    fs::create_directories( base );
+
+    vector< string > tagFiles;
+    for ( unsigned l = 0 ; l < LIBRARIES ; ++l ) {
+      fs::path root = base / ( "library" + std::to_string( l ) );
+      tagFiles.push_back( ( base / ( "library" + std::to_string( l ) + ".tag" ) ).native() );
+      std::ofstream ofs( tagFiles.back() );
+      ofs << "path=" << root.native() << endl;
+      std::size_t count = files * ( l + 1 ) / 10;
+      for ( std::size_t i = 0 ; i < count ; ++i ) {
+        fs::path dir = root / ( "d" + std::to_string( i % DIR_FANOUT ) );
+        string name = "IMG_" + std::to_string( i ) + ".jpg";
+        if ( i < DIR_FANOUT ) fs::create_directories( dir );
+        std::ofstream( ( dir / name ).native() );
+        ofs << "file=" << ( fs::path( "d" + std::to_string( i % DIR_FANOUT ) ) / name ).native() << endl;
+        for ( unsigned t = 0 ; t < TAGS_PER_FILE ; ++t )
+          ofs << "tag=tag" << pick( rng ) << endl;
+      }
+    }
+
+    FileData fileData;
+    TagData tagData;
+    SearchData searchData;
+    TagParents tagParents;
+    TagRuleData tagRules;
+    GroupData groups;
+    HashCache hashCache;
+    Libraries libraries;
+
+    // 1 つずつ順に読み込む
+    double sequential = 0;
+    for ( auto f = tagFiles.begin() ; f != tagFiles.end() ; ++f ) {
+      auto start = std::chrono::steady_clock::now();
+      ReadLibraries( vector< string >( 1, *f ), &libraries, &fileData, &tagData, &searchData, &tagParents, &tagRules,
+                     &groups, &hashCache );
+      double seconds = Elapsed( start );
+      sequential += seconds;
+      cout << "library " << ( f - tagFiles.begin() ) << "      : " << seconds << " s (" << fileData.size() << " files)" << endl;
+    }
+    cout << "sequential     : " << sequential << " s" << endl;
+
+    // まとめて並列に読み込む
+    auto start = std::chrono::steady_clock::now();
+    ReadLibraries( tagFiles, &libraries, &fileData, &tagData, &searchData, &tagParents, &tagRules, &groups, &hashCache );
+    cout << "parallel       : " << Elapsed( start ) << " s (" << fileData.size() << " files, "
+         << tagData.size() << " tags)" << endl;
+
+    tagData.clear();
+    fs::remove_all( base );
+  }
+
+  /*
+    ReadSequential : 並列化する前と同じく、ファイルのレコードを 1 行ずつ読んでタグを付ける(結果の比較用)
+  */
+  void ReadSequential( const string& fileName, const string& rootPath, FileData* fileData, TagData* tagData )
+  {
+    std::ifstream ifs( fileName );
+    string data; // 1行読み込み
+    string file; // 対象ファイル名
+    string tag;  // タグ名
+    FileId id = NO_FILE;
+    while ( std::getline( ifs, data ) ) {
+      if ( GetValueFromKey( data, FILE_KEY, &file ) ) {
+        id = fileData->find( fs::path( rootPath + "/" + file ).lexically_normal() );
+        continue;
+      }
+      if ( GetValueFromKey( data, DIR_KEY, &file ) )
+        break;
+      if ( id != NO_FILE && GetValueFromKey( data, TAG_KEY, &tag ) ) {
+        fileData->edit( id ).insert( tag );
+        ( *tagData )[tag].insert( id );
+      }
+    }
+  }
+
+  /*
+    SameIndex : タグの綴り(大文字・小文字)まで含めて、タグリストとファイルリストが一致するか判定する
+  */
+  bool SameIndex( const FileData& fileData1, const TagData& tagData1, const FileData& fileData2, const TagData& tagData2 )
+  {
+    if ( fileData1.size() != fileData2.size() || tagData1.size() != tagData2.size() ) return( false );
+    for ( FileId id = 0 ; id < fileData1.size() ; ++id )
+      if ( ! std::equal( fileData1[id].begin(), fileData1[id].end(), fileData2[id].begin(), fileData2[id].end() ) )
+        return( false );
+    for ( auto t1 = tagData1.begin(), t2 = tagData2.begin() ; t1 != tagData1.end() ; ++t1, ++t2 ) {
+      if ( t1->first != t2->first ) return( false );
+      if ( ! std::equal( t1->second.begin(), t1->second.end(), t2->second.begin(), t2->second.end() ) ) return( false );
+    }
+
+    return( true );
+  }
+
+  /*
+    BenchParse : 合成したタグファイルのレコードを、スレッド数を 1 から 16 まで変えて並列に読み込む
+
+    区切り・読み込み・突き合わせ・マージまでを測り、ディレクトリの走査は含めない(パスの表は合成したパスから作る)
+    結果は 1 行ずつ読む以前の読み込みと比べる。大文字・小文字だけが違うタグは最初に現れた綴りになるため、
+    綴りを 1 件毎に変えたタグ(区間の境界の両側で綴りが違う)と、1 件に両方の綴りを付けたタグを混ぜておく。
+
+    戻り値 : 全てのスレッド数で結果が一致すれば true
+  */
+  bool BenchParse( std::size_t files )
+  {
+    const string ROOT = "/library";
+    vector< fs::path > paths;
+    vector< vector< string > > tags;
+    MakeTree( files, &paths, &tags );
+
+    // ファイルはパスの順に書く
+    vector< std::size_t > order( files );
+    for ( std::size_t i = 0 ; i < files ; ++i )
+      order[i] = i;
+    std::sort( order.begin(), order.end(), [&paths]( std::size_t a, std::size_t b ) { return( paths[a] < paths[b] ); } );
+
+    fs::path tagFile = fs::temp_directory_path() / fs::unique_path( "gtag-bench-%%%%%%%%.tag" );
+    string header = "path=" + ROOT + "\n";
+    {
+      std::ofstream ofs( tagFile.native() );
+      ofs << header;
+      for ( auto o = order.begin() ; o != order.end() ; ++o ) {
+        ofs << "file=" << paths[*o].lexically_relative( ROOT ).native() << "\n";
+        for ( auto t = tags[*o].begin() ; t != tags[*o].end() ; ++t )
+          ofs << "tag=" << *t << "\n";
+        std::size_t n = o - order.begin();
+        ofs << "tag=" << ( ( n % 2 == 0 ) ? "casetag" : "CaseTag" ) << "\n";
+        if ( n % 1000 == 999 )
+          ofs << "tag=Mixed\ntag=mixed\n";
+      }
+    }
+
+    FileData expectedFiles;
+    expectedFiles.assign( paths );
+    TagData expectedTags;
+    ReadSequential( tagFile.native(), ROOT, &expectedFiles, &expectedTags );
+
+    bool same = true;
+    {
+      MappedFile mapped( tagFile.native() );
+      cout << files << " files, " << mapped.size() / ( 1024 * 1024 ) << " MiB, " << ParseThreads() << " cores" << endl;
+
+      double single = 0; // 1 スレッドの時間
+      for ( unsigned threads = 1 ; threads <= 16 ; threads *= 2 ) {
+        FileData fileData;
+        fileData.assign( paths );
+        TagData tagData;
+
+        // 段階毎の時間
+        auto start = std::chrono::steady_clock::now();
+        vector< RecordChunk > chunks = ParseRecords( mapped.begin() + header.size(), mapped.end(), threads );
+        double parse = Elapsed( start );
+        vector< PartialIndex > partials = IndexRecords( chunks, ROOT, fileData, threads );
+        double index = Elapsed( start ) - parse;
+        FillTagSets( chunks, partials, &fileData, threads );
+        double fill = Elapsed( start ) - parse - index;
+        MergePostings( partials, &tagData, threads );
+        double seconds = Elapsed( start );
+        if ( threads == 1 ) single = seconds;
+
+        std::size_t postings = 0;
+        for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+          postings += t->second.size();
+        bool equal = SameIndex( fileData, tagData, expectedFiles, expectedTags );
+        same = same && equal;
+        cout << "threads " << threads << ( ( threads < 10 ) ? "  " : " " ) << ": parse " << parse << " s, index " << index
+             << " s, fill " << fill << " s, merge " << seconds - parse - index - fill << " s, total " << seconds
+             << " s (x" << single / seconds << ", " << tagData.size() << " tags, " << postings << " postings, "
+             << ( equal ? "same as sequential" : "DIFFERENT from sequential" ) << ")" << endl;
+        tagData.clear();
+      }
+    }
+    expectedTags.clear();
+    fs::remove( tagFile );
+
+    return( same );
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  string name = ( argc > 1 ) ? argv[1] : "";
+  std::size_t files = ( argc > 2 ) ? std::stoul( argv[2] ) : 1000000;
+
+  if ( name == "memory" ) {
+    BenchMemory( files );
+  } else if ( name == "arena" ) {
+    BenchArena( files );
+  } else if ( name == "containers" ) {
+    BenchContainers( files );
+  } else if ( name == "similar" ) {
+    BenchSimilar( files );
+  } else if ( name == "colors" ) {
+    BenchColors( files );
+  } else if ( name == "snapshot" ) {
+    BenchSnapshot( files );
+  } else if ( name == "tagtree" ) {
+    BenchTagTree( files );
+  } else if ( name == "rules" ) {
+    BenchRules( files );
+  } else if ( name == "libraries" ) {
+    BenchLibraries( files );
+  } else if ( name == "parse" ) {
+    if ( ! BenchParse( files ) ) return( 1 );
+  } else {
+    cerr << "usage : bench memory|arena|containers|similar|colors|snapshot|tagtree|rules|libraries|parse [files]" << endl;
+    return( 1 );
+  }
+
+  return( 0 );
+}
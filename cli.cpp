@@ -0,0 +1,653 @@
+/**
+   cli.cpp : タグファイルをコマンドラインから検索・編集する
+
+   使い方 : gtag-cli [--json] タグファイル コマンド [引数...]
+
+     query [検索文字列]        条件を満たすファイルを表示する
+     add タグ ファイル...      ファイルにタグを付ける
+     remove タグ ファイル...   ファイルからタグを外す
+     rename タグ 新しいタグ    タグ名を変更する
+     parent タグ [親タグ]      親タグを設定する(親タグを省略すると親子関係を解く)
+     alias 別名 [タグ]         別名を設定する(タグを省略すると別名を削除する)
+     imply タグ 含意するタグ   タグを付けると含意するタグも付くようにする
+     unimply タグ 含意するタグ 含意を削除する
+     group ファイル...         ファイルを(それぞれが属するグループごと) 1 つのグループにまとめる
+     ungroup ファイル...       ファイルをグループから外す
+     stats                     ファイル数・タグ毎のファイル数を表示する
+     tree [ディレクトリ]       サブディレクトリのファイル数と、直接のファイルのタグを表示する
+     serve ソケット            UNIX ドメインソケットで索引を提供する(server.hpp を参照)
+
+   ファイルはルートパスからの相対パスまたは絶対パスで指定し、"-" は標準入力から 1 行 1 件で読む。
+   add では別名を正式なタグに読み替え、含意されるタグも付ける。
+   --json を指定すると、結果を 1 行 1 件の JSON(NDJSON)で出力する。
+   索引のあるタグファイルでは、query と tree はディレクトリを走査せず、必要なディレクトリのレコードだけを読む
+   (結果は保存時の内容で、移動したファイルの付け直しも行わない)。
+   GTK は初期化しないため、ディスプレイと gTag.ui は不要。
+**/
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <mutex>
+
+#include <signal.h>
+
+#include "file.hpp"
+#include "query.hpp"
+#include "tagtree.hpp"
+#include "group.hpp"
+#include "lazy.hpp"
+#include "server.hpp"
+
+using std::cout;
+using std::cerr;
+using std::cin;
+using std::endl;
+using std::string;
+using std::vector;
+using std::size_t;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const char* const USAGE =
+    "usage : gtag-cli [--json] [--index] tagfile query [text]\n"
+    "        gtag-cli [--json] tagfile add tag file...\n"
+    "        gtag-cli [--json] tagfile remove tag file...\n"
+    "        gtag-cli [--json] tagfile rename tag newtag\n"
+    "        gtag-cli [--json] tagfile parent tag [parenttag]\n"
+    "        gtag-cli [--json] tagfile alias alias [tag]\n"
+    "        gtag-cli [--json] tagfile imply tag impliedtag\n"
+    "        gtag-cli [--json] tagfile unimply tag impliedtag\n"
+    "        gtag-cli [--json] tagfile group file...\n"
+    "        gtag-cli [--json] tagfile ungroup file...\n"
+    "        gtag-cli [--json] tagfile stats\n"
+    "        gtag-cli [--json] tagfile tree [dir]\n"
+    "        gtag-cli tagfile serve socket\n"
+    "  file \"-\" reads paths from standard input, one per line\n"
+    "  --index answers query from the directory index saved in the tag file\n"
+    "  (fast, but files added, removed or moved since the last save are not seen)";
+
+  const int EXIT_USAGE = 2; // 引数の誤り
+  const int EXIT_ERROR = 1; // 処理の失敗(見つからないファイル・タグを含む)
+
+  // 読み込んだタグファイル
+  struct Library
+  {
+    string tagFile;       // タグファイルの名前
+    string rootPath;      // ルートパス
+    FileData fileData;    // ファイルをキーとするタグリスト
+    TagData tagData;      // タグをキーとするファイルリスト
+    SearchData searches;  // 保存した検索条件
+    TagTree tagTree;      // タグの階層
+    TagRules tagRules;    // タグの規則
+    FileGroups groups;    // ファイルのグループ
+    HashCache hashCache;  // 記録されたハッシュ値
+  };
+
+  /*
+    RelativePath : file のルートパスからの相対パスを返す
+  */
+  string RelativePath( const Library& library, FileId file )
+  {
+    return( library.fileData.path( file ).lexically_relative( library.rootPath ).string() );
+  }
+
+  /*
+    CheckTagName : タグとして使える文字列か確認する
+
+    戻り値 : 使えない場合は message にメッセージを入れ、false を返す
+  */
+  bool CheckTagName( const string& tag, string* message )
+  {
+    if ( tag.empty() || tag.find_first_of( " \t\n" ) != string::npos ) {
+      *message = "invalid tag : \"" + tag + "\"";
+      return( false );
+    }
+
+    return( true );
+  }
+
+  /*
+    ResolveFiles : 引数 args のファイルを識別番号にする("-" は標準入力から読む)
+
+    missing : 見つからなかったファイル数を返す変数へのポインタ
+  */
+  vector< FileId > ResolveFiles( const Library& library, const vector< string >& args, size_t* missing )
+  {
+    vector< string > names;
+    for ( auto a = args.begin() ; a != args.end() ; ++a ) {
+      if ( *a != "-" ) {
+        names.push_back( *a );
+        continue;
+      }
+      string line;
+      while ( std::getline( cin, line ) )
+        if ( ! line.empty() ) names.push_back( line );
+    }
+
+    vector< FileId > files;
+    *missing = 0;
+    for ( auto n = names.begin() ; n != names.end() ; ++n ) {
+      fs::path p( *n );
+      if ( p.is_relative() ) p = fs::path( library.rootPath ) / p;
+      FileId id = library.fileData.find( p );
+      if ( id == NO_FILE ) id = library.fileData.find( p.lexically_normal() );
+      if ( id == NO_FILE ) {
+        cerr << "not found : " << *n << endl;
+        ++*missing;
+        continue;
+      }
+      files.push_back( id );
+    }
+
+    return( files );
+  }
+
+  /*
+    Save : タグファイルに書き戻す
+  */
+  void Save( Library* library )
+  {
+    WriteTagData( library->tagFile, library->rootPath, library->fileData, library->searches, library->tagTree.data(),
+                  library->tagRules.data(), library->groups.data(), &library->hashCache );
+  }
+
+  /*
+    RunQuery : text を満たすファイルを出力する
+  */
+  int RunQuery( const Library& library, const string& text, bool json )
+  {
+    FileList result;
+    Query( text ).evaluate( library.fileData, library.tagData, library.tagTree, library.tagRules, &result, CancelToken{ nullptr, 0 } );
+
+    for ( auto f = result.begin() ; f != result.end() ; ++f ) {
+      if ( ! json ) {
+        cout << RelativePath( library, *f ) << '\n';
+        continue;
+      }
+      const TagSet& tags = library.fileData[*f];
+      cout << "{\"path\":" << JsonString( RelativePath( library, *f ) ) << ",\"tags\":[";
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+        cout << ( ( t == tags.begin() ) ? "" : "," ) << JsonString( *t );
+      cout << "]}\n";
+    }
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunEdit : ファイル args にタグ tag を付ける(add が false なら外す)
+
+    付ける場合は規則で展開したタグを全て付ける
+  */
+  int RunEdit( Library* library, bool add, const string& tag, const vector< string >& args, bool json )
+  {
+    string message;
+    if ( add && ! CheckTagName( tag, &message ) ) {
+      cerr << message << endl;
+      return( EXIT_USAGE );
+    }
+
+    size_t missing;
+    vector< FileId > files = ResolveFiles( *library, args, &missing );
+    vector< string > tags = add ? library->tagRules.expand( tag ) : vector< string >( 1, tag );
+    size_t changed = 0;
+    for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+      bool done = false;
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+        if ( add ? AddTag( *t, *f, &library->fileData, &library->tagData, &library->tagTree )
+                 : RemoveTag( *t, *f, &library->fileData, &library->tagData, &library->tagTree ) )
+          done = true;
+      if ( done ) ++changed;
+    }
+    if ( changed > 0 ) Save( library );
+
+    const char* command = add ? "add" : "remove";
+    string implied; // 含意されて付けたタグ
+    for ( auto t = tags.begin() + 1 ; t != tags.end() ; ++t )
+      implied += ( json ? ( ( t == tags.begin() + 1 ) ? "" : "," ) + JsonString( *t ) : " +" + *t );
+    if ( json )
+      cout << "{\"command\":\"" << command << "\",\"tag\":" << JsonString( tags.front() ) << ",\"implied\":["
+           << implied << "],\"files\":" << files.size()
+           << ",\"changed\":" << changed << ",\"missing\":" << missing << "}\n";
+    else
+      cout << command << " " << tags.front() << implied << " : " << changed << " / " << files.size() << " files changed"
+           << ( ( missing > 0 ) ? ", " + std::to_string( missing ) + " not found" : "" ) << '\n';
+
+    return( ( missing > 0 ) ? EXIT_ERROR : EXIT_SUCCESS );
+  }
+
+  /*
+    RunRename : タグ oldTag を newTag に変更する
+  */
+  int RunRename( Library* library, const string& oldTag, const string& newTag, bool json )
+  {
+    string message;
+    if ( ! CheckTagName( newTag, &message ) ) {
+      cerr << message << endl;
+      return( EXIT_USAGE );
+    }
+
+    auto t = library->tagData.find( oldTag );
+    if ( t == library->tagData.end() || t->second.empty() ) {
+      cerr << "no such tag : " << oldTag << endl;
+      return( EXIT_ERROR );
+    }
+    // 大文字と小文字だけの変更は同じタグとして見つかる
+    auto n = library->tagData.find( newTag );
+    if ( n != t && n != library->tagData.end() ) {
+      if ( ! n->second.empty() ) {
+        cerr << "tag already exists : " << newTag << endl;
+        return( EXIT_ERROR );
+      }
+      library->tagData.erase( n );
+    }
+
+    size_t files = t->second.size();
+    ChangeTagName( oldTag, newTag, &library->fileData, &library->tagData, &library->tagTree );
+    Save( library );
+
+    if ( json )
+      cout << "{\"command\":\"rename\",\"tag\":" << JsonString( oldTag ) << ",\"newtag\":" << JsonString( newTag )
+           << ",\"files\":" << files << "}\n";
+    else
+      cout << "rename " << oldTag << " -> " << newTag << " : " << files << " files\n";
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunParent : タグ tag の親を parent にする(parent が空なら親子関係を解く)
+  */
+  int RunParent( Library* library, const string& tag, const string& parent, bool json )
+  {
+    string message;
+    if ( ! CheckTagName( tag, &message ) || ( ! parent.empty() && ! CheckTagName( parent, &message ) ) ) {
+      cerr << message << endl;
+      return( EXIT_USAGE );
+    }
+    if ( ! library->tagTree.setParent( tag, parent, library->tagData ) ) {
+      cerr << "cyclic parent : " << parent << " is " << tag << " or its descendant" << endl;
+      return( EXIT_ERROR );
+    }
+    Save( library );
+
+    // 親タグのファイル数は子孫のタグのファイルを含む
+    const Posting* files = parent.empty() ? nullptr : library->tagTree.files( parent );
+    std::size_t count = ( files == nullptr ) ? 0 : files->size();
+    if ( json )
+      cout << "{\"command\":\"parent\",\"tag\":" << JsonString( tag ) << ",\"parent\":" << JsonString( parent )
+           << ",\"files\":" << count << "}\n";
+    else if ( parent.empty() )
+      cout << "parent " << tag << " : detached\n";
+    else
+      cout << "parent " << tag << " -> " << parent << " : " << count << " files under " << parent << '\n';
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunAlias : alias をタグ tag の別名にする(tag が空なら別名を削除する)
+  */
+  int RunAlias( Library* library, const string& alias, const string& tag, bool json )
+  {
+    string message;
+    if ( ! CheckTagName( alias, &message ) || ( ! tag.empty() && ! CheckTagName( tag, &message ) ) ) {
+      cerr << message << endl;
+      return( EXIT_USAGE );
+    }
+    if ( ! library->tagRules.setAlias( alias, tag ) ) {
+      cerr << "cyclic alias : " << tag << " is " << alias << " or its alias" << endl;
+      return( EXIT_ERROR );
+    }
+    Save( library );
+
+    const string& target = tag.empty() ? tag : library->tagRules.canonical( alias );
+    if ( json )
+      cout << "{\"command\":\"alias\",\"alias\":" << JsonString( alias ) << ",\"tag\":" << JsonString( target ) << "}\n";
+    else if ( tag.empty() )
+      cout << "alias " << alias << " : removed\n";
+    else
+      cout << "alias " << alias << " -> " << target << '\n';
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunImply : タグ tag が implied を含意する規則を加える(add が false なら削除する)
+  */
+  int RunImply( Library* library, bool add, const string& tag, const string& implied, bool json )
+  {
+    string message;
+    if ( ! CheckTagName( tag, &message ) || ! CheckTagName( implied, &message ) ) {
+      cerr << message << endl;
+      return( EXIT_USAGE );
+    }
+    if ( add && ! library->tagRules.imply( tag, implied ) ) {
+      cerr << "cyclic implication : " << implied << " is " << tag << " or implies it" << endl;
+      return( EXIT_ERROR );
+    }
+    if ( ! add && ! library->tagRules.unimply( tag, implied ) ) {
+      cerr << "no such implication : " << tag << " -> " << implied << endl;
+      return( EXIT_ERROR );
+    }
+    Save( library );
+
+    // tag を付けると付くタグ(推移的に含意されるタグ)
+    const TagRules::Names& all = library->tagRules.implied( library->tagRules.canonical( tag ) );
+    const char* command = add ? "imply" : "unimply";
+    if ( json ) {
+      cout << "{\"command\":\"" << command << "\",\"tag\":" << JsonString( tag ) << ",\"implied\":[";
+      for ( auto t = all.begin() ; t != all.end() ; ++t )
+        cout << ( ( t == all.begin() ) ? "" : "," ) << JsonString( *t );
+      cout << "]}\n";
+    } else {
+      cout << command << " " << tag << " -> " << implied << " : " << tag << " implies";
+      for ( auto t = all.begin() ; t != all.end() ; ++t )
+        cout << ' ' << *t;
+      cout << ( all.empty() ? " nothing\n" : "\n" );
+    }
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunGroup : ファイル args を 1 つのグループにまとめる(join が false ならグループから外す)
+  */
+  int RunGroup( Library* library, bool join, const vector< string >& args, bool json )
+  {
+    size_t missing;
+    vector< FileId > files = ResolveFiles( *library, args, &missing );
+    size_t members = 0; // まとめたグループのファイル数
+    if ( join ) {
+      members = library->groups.merge( files );
+    } else {
+      for ( auto f = files.begin() ; f != files.end() ; ++f )
+        library->groups.remove( *f );
+    }
+    if ( ! files.empty() ) Save( library );
+
+    const char* command = join ? "group" : "ungroup";
+    if ( json )
+      cout << "{\"command\":\"" << command << "\",\"files\":" << files.size() << ",\"members\":" << members
+           << ",\"missing\":" << missing << "}\n";
+    else if ( join )
+      cout << command << " : " << members << " files in group"
+           << ( ( missing > 0 ) ? ", " + std::to_string( missing ) + " not found" : "" ) << '\n';
+    else
+      cout << command << " : " << files.size() << " files"
+           << ( ( missing > 0 ) ? ", " + std::to_string( missing ) + " not found" : "" ) << '\n';
+
+    return( ( missing > 0 ) ? EXIT_ERROR : EXIT_SUCCESS );
+  }
+
+  /*
+    RunStats : ファイル数とタグ毎のファイル数を出力する
+  */
+  int RunStats( const Library& library, bool json )
+  {
+    size_t tagged = 0;
+    for ( FileId f = 0 ; f < library.fileData.size() ; ++f )
+      if ( ! library.fileData[f].empty() ) ++tagged;
+    size_t tags = 0;
+    for ( auto t = library.tagData.begin() ; t != library.tagData.end() ; ++t )
+      if ( ! t->second.empty() ) ++tags;
+
+    if ( json )
+      cout << "{\"root\":" << JsonString( library.rootPath ) << ",\"files\":" << library.fileData.size()
+           << ",\"tagged\":" << tagged << ",\"tags\":" << tags << "}\n";
+    else
+      cout << "root   : " << library.rootPath << '\n'
+           << "files  : " << library.fileData.size() << '\n'
+           << "tagged : " << tagged << '\n'
+           << "tags   : " << tags << '\n';
+
+    for ( auto t = library.tagData.begin() ; t != library.tagData.end() ; ++t ) {
+      if ( t->second.empty() ) continue;
+      if ( json )
+        cout << "{\"tag\":" << JsonString( t->first ) << ",\"files\":" << t->second.size() << "}\n";
+      else
+        cout << t->second.size() << '\t' << t->first << '\n';
+    }
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunLazyQuery : 条件を満たしうるディレクトリだけを読み込んで検索し、結果をパスの順に出力する
+  */
+  int RunLazyQuery( LazyTagFile* lazy, const string& text, bool json )
+  {
+    TagTree tagTree;
+    tagTree.assign( lazy->parents(), TagData() );
+    TagRules tagRules;
+    tagRules.assign( lazy->rules() );
+    Query query( text );
+
+    vector< LazyTagFile::Record > result;
+    vector< LazyTagFile::DirIndex > dirs = lazy->candidates( query, tagTree, tagRules );
+    for ( auto d = dirs.begin() ; d != dirs.end() ; ++d ) {
+      LazyTagFile::Records records = lazy->load( *d );
+      for ( auto r = records.begin() ; r != records.end() ; ++r )
+        if ( query.match( r->tags, tagTree, tagRules ) ) result.push_back( *r );
+    }
+    std::sort( result.begin(), result.end(), []( const LazyTagFile::Record& a, const LazyTagFile::Record& b ) {
+        return( fs::path( a.path ) < fs::path( b.path ) ); } );
+
+    for ( auto r = result.begin() ; r != result.end() ; ++r ) {
+      if ( ! json ) {
+        cout << r->path << '\n';
+        continue;
+      }
+      cout << "{\"path\":" << JsonString( r->path ) << ",\"tags\":[";
+      for ( auto t = r->tags.begin() ; t != r->tags.end() ; ++t )
+        cout << ( ( t == r->tags.begin() ) ? "" : "," ) << JsonString( *t );
+      cout << "]}\n";
+    }
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunTree : ディレクトリ dir のサブディレクトリのファイル数と、dir を読み込んで直接のファイルのタグを出力する
+  */
+  int RunTree( LazyTagFile* lazy, const string& dir, bool json )
+  {
+    string path = dir;
+    while ( ! path.empty() && path.back() == '/' )
+      path.pop_back();
+    if ( path == "." ) path.clear();
+    LazyTagFile::DirIndex index = lazy->find( path );
+    if ( index == LazyTagFile::NO_DIR ) {
+      cerr << "not found : " << dir << endl;
+      return( EXIT_ERROR );
+    }
+
+    const LazyTagFile::Directory& d = lazy->directories()[index];
+    for ( auto c = d.children.begin() ; c != d.children.end() ; ++c ) {
+      const LazyTagFile::Directory& child = lazy->directories()[*c];
+      if ( json )
+        cout << "{\"dir\":" << JsonString( child.path ) << ",\"files\":" << child.files
+             << ",\"tagged\":" << child.tagged << "}\n";
+      else
+        cout << child.path << "/\t" << child.files << '\t' << child.tagged << '\n';
+    }
+
+    LazyTagFile::Records records = lazy->load( index );
+    for ( auto r = records.begin() ; r != records.end() ; ++r ) {
+      if ( json ) {
+        cout << "{\"path\":" << JsonString( r->path ) << ",\"tags\":[";
+        for ( auto t = r->tags.begin() ; t != r->tags.end() ; ++t )
+          cout << ( ( t == r->tags.begin() ) ? "" : "," ) << JsonString( *t );
+        cout << "]}\n";
+        continue;
+      }
+      cout << r->path;
+      for ( auto t = r->tags.begin() ; t != r->tags.end() ; ++t )
+        cout << ( ( t == r->tags.begin() ) ? '\t' : ' ' ) << *t;
+      cout << '\n';
+    }
+
+    return( EXIT_SUCCESS );
+  }
+
+  /*
+    RunServe : socketPath で索引を提供し、SIGINT・SIGTERM・SIGHUP を受けたら終了する
+
+    検索は公開済みの版に対して行い、編集と保存だけを排他制御する。
+    編集の度に新しい版を公開する。編集があれば終了時に保存する。
+  */
+  int RunServe( Library* library, const string& socketPath, const sigset_t& signals )
+  {
+    IndexVersions versions;  // 索引の公開済みの版
+    std::mutex mutex;        // 編集と保存(ハッシュ値のキャッシュの更新)の排他制御
+    std::atomic< bool > edited( false );
+    versions.publish( library->fileData, library->tagData, library->tagTree, library->tagRules );
+
+    auto edit = [&]( bool add, const string& tag, const fs::path& file, bool* changed, string* error ) {
+      if ( add && ! CheckTagName( tag, error ) ) return( false );
+      std::lock_guard< std::mutex > lock( mutex );
+      FileId id = library->fileData.find( file );
+      if ( id == NO_FILE ) {
+        *error = "not found : " + file.native();
+        return( false );
+      }
+      vector< string > tags = add ? library->tagRules.expand( tag ) : vector< string >( 1, tag );
+      *changed = false;
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+        if ( add ? AddTag( *t, id, &library->fileData, &library->tagData, &library->tagTree )
+                 : RemoveTag( *t, id, &library->fileData, &library->tagData, &library->tagTree ) )
+          *changed = true;
+      if ( *changed ) {
+        versions.publish( library->fileData, library->tagData, library->tagTree, library->tagRules );
+        edited = true;
+      }
+      return( true );
+    };
+    auto save = [&]( string* error ) {
+      std::lock_guard< std::mutex > lock( mutex );
+      try {
+        Save( library );
+      } catch( std::runtime_error& e ) {
+        *error = e.what();
+        return( false );
+      }
+      edited = false;
+      return( true );
+    };
+
+    TagServer server( versions, edit, save );
+    server.start( socketPath );
+    cerr << "serving " << library->tagFile << " on " << socketPath << endl;
+
+    int signal;
+    ::sigwait( &signals, &signal );
+    server.stop();
+    if ( edited ) Save( library );
+
+    return( EXIT_SUCCESS );
+  }
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+  bool json = false;
+  bool useIndex = false; // query を保存時の索引で答えるか？
+  vector< string > args;
+  for ( int i = 1 ; i < argc ; ++i ) {
+    string arg = argv[i];
+    if ( arg == "--json" )
+      json = true;
+    else if ( arg == "--index" )
+      useIndex = true;
+    else
+      args.push_back( arg );
+  }
+  if ( args.size() < 2 ) {
+    cerr << USAGE << endl;
+    return( EXIT_USAGE );
+  }
+
+  std::ios::sync_with_stdio( false );
+
+  // 終了のシグナルは serve の待機で受け取る(以降に作るスレッドにも引き継がれる)
+  sigset_t signals;
+  sigemptyset( &signals );
+  sigaddset( &signals, SIGINT );
+  sigaddset( &signals, SIGTERM );
+  sigaddset( &signals, SIGHUP );
+  if ( args[1] == "serve" )
+    ::pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+
+  Library library;
+  library.tagFile = args[0];
+  const string& command = args[1];
+  vector< string > params( args.begin() + 2, args.end() );
+
+  try {
+    // 索引は保存時のものでディレクトリを走査しないため、query は --index を指定したときだけ索引で答える
+    if ( ( command == "query" && useIndex ) || ( command == "tree" && params.size() <= 1 ) ) {
+      LazyTagFile lazy;
+      if ( lazy.open( library.tagFile ) ) {
+        cerr << "note : answered from the index saved in " << library.tagFile
+             << " (changes on disk since the last save are not seen)" << endl;
+        if ( command == "tree" )
+          return( RunTree( &lazy, ( params.empty() ) ? string() : params[0], json ) );
+        string text;
+        for ( auto p = params.begin() ; p != params.end() ; ++p )
+          text += ( ( p == params.begin() ) ? "" : " " ) + *p;
+        return( RunLazyQuery( &lazy, text, json ) );
+      }
+      if ( command == "tree" ) {
+        cerr << library.tagFile << " : no directory index (save the tag file again)" << endl;
+        return( EXIT_ERROR );
+      }
+    }
+
+    TagParents parents;
+    TagRuleData rules;
+    GroupData groups;
+    size_t relinked = ReadTagData( library.tagFile, &library.rootPath, &library.fileData, &library.tagData,
+                                   &library.searches, &parents, &rules, &groups, &library.hashCache );
+    library.tagTree.assign( parents, library.tagData );
+    library.tagRules.assign( rules );
+    library.groups.assign( groups );
+    if ( relinked > 0 )
+      cerr << relinked << " moved files relinked" << endl;
+
+    if ( command == "query" ) {
+      string text;
+      for ( auto p = params.begin() ; p != params.end() ; ++p )
+        text += ( ( p == params.begin() ) ? "" : " " ) + *p;
+      return( RunQuery( library, text, json ) );
+    } else if ( ( command == "add" || command == "remove" ) && params.size() >= 2 ) {
+      return( RunEdit( &library, command == "add", params[0], vector< string >( params.begin() + 1, params.end() ), json ) );
+    } else if ( command == "rename" && params.size() == 2 ) {
+      return( RunRename( &library, params[0], params[1], json ) );
+    } else if ( command == "parent" && ( params.size() == 1 || params.size() == 2 ) ) {
+      return( RunParent( &library, params[0], ( params.size() == 2 ) ? params[1] : string(), json ) );
+    } else if ( command == "alias" && ( params.size() == 1 || params.size() == 2 ) ) {
+      return( RunAlias( &library, params[0], ( params.size() == 2 ) ? params[1] : string(), json ) );
+    } else if ( ( command == "imply" || command == "unimply" ) && params.size() == 2 ) {
+      return( RunImply( &library, command == "imply", params[0], params[1], json ) );
+    } else if ( ( command == "group" || command == "ungroup" ) && ! params.empty() ) {
+      return( RunGroup( &library, command == "group", params, json ) );
+    } else if ( command == "stats" && params.empty() ) {
+      return( RunStats( library, json ) );
+    } else if ( command == "serve" && params.size() == 1 ) {
+      return( RunServe( &library, params[0], signals ) );
+    }
+  } catch( std::runtime_error& e ) {
+    cerr << library.tagFile << " : " << e.what() << endl;
+    return( EXIT_ERROR );
+  }
+
+  cerr << USAGE << endl;
+  return( EXIT_USAGE );
+}
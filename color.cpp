@@ -0,0 +1,237 @@
+/**
+   color.cpp : 色のヒストグラムによる検索
+**/
+#include "color.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <limits>
+#include <cstdlib>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using std::vector;
+using std::pair;
+using std::size_t;
+using std::uint8_t;
+
+namespace
+{
+  const unsigned HUE_BINS = 12; // 色相の区分の数
+  const int GRAY_CHROMA = 32;   // これ未満の彩度(最大値 - 最小値)は無彩色とする
+  const int BLACK_VALUE = 40;   // これ未満の明るさは黒とする
+
+  const char* const COLOR_NAMES[COLOR_BINS] = {
+    "赤", "橙", "黄", "黄緑", "緑", "青緑", "水色", "空色", "青", "紫", "赤紫", "桃",
+    "黒", "濃い灰", "淡い灰", "白"
+  };
+
+  /*
+    ColorBin : 画素 (r, g, b) の区分を返す
+  */
+  inline unsigned ColorBin( int r, int g, int b )
+  {
+    int max = std::max( r, std::max( g, b ) );
+    int min = std::min( r, std::min( g, b ) );
+    int chroma = max - min;
+    if ( chroma < GRAY_CHROMA || max < BLACK_VALUE )
+      return( HUE_BINS + std::min( 3, ( max < BLACK_VALUE ) ? 0 : max / 64 ) );
+
+    // 色相(0 〜 360 度)を求め、赤が区分の中央になるよう 15 度ずらす
+    int hue;
+    if ( max == r )
+      hue = ( 60 * ( g - b ) / chroma + 360 ) % 360;
+    else if ( max == g )
+      hue = 60 * ( b - r ) / chroma + 120;
+    else
+      hue = 60 * ( r - g ) / chroma + 240;
+
+    return( ( ( hue + 15 ) % 360 ) / 30 );
+  }
+} // namespace
+
+/*
+  ColorName : 区分 bin の名前を返す
+*/
+const char* ColorName( unsigned bin )
+{
+  return( ( bin < COLOR_BINS ) ? COLOR_NAMES[bin] : "" );
+}
+
+/*
+  ComputeHistogram : 区分毎の画素数を数え、割合を 255 を満点とする値にする
+*/
+ColorHistogram ComputeHistogram( const unsigned char* pixels, int width, int height, int rowstride, int channels )
+{
+  std::uint32_t counts[COLOR_BINS] = {};
+  for ( int y = 0 ; y < height ; ++y ) {
+    const unsigned char* p = pixels + static_cast< size_t >( y ) * rowstride;
+    for ( int x = 0 ; x < width ; ++x, p += channels )
+      ++counts[ColorBin( p[0], p[1], p[2] )];
+  }
+
+  ColorHistogram histogram;
+  std::uint32_t total = std::max( 1, width * height );
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+    histogram[b] = static_cast< uint8_t >( ( counts[b] * 255 + total / 2 ) / total );
+
+  return( histogram );
+}
+
+/*
+  ColorIndex::assign : files 件の空の列を作る
+*/
+void ColorIndex::assign( size_t files )
+{
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+    columns_[b].assign( files, 0 );
+  indexed_.assign( files, 0 );
+}
+
+/*
+  ColorIndex::insert : file の行にヒストグラムを書き込む
+*/
+void ColorIndex::insert( FileId file, const ColorHistogram& histogram )
+{
+  if ( file >= indexed_.size() ) return;
+
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+    columns_[b][file] = histogram[b];
+  indexed_[file] = 1;
+}
+
+/*
+  ColorIndex::erase : file の行を 0 に戻す
+*/
+void ColorIndex::erase( FileId file )
+{
+  if ( file >= indexed_.size() ) return;
+
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+    columns_[b][file] = 0;
+  indexed_[file] = 0;
+}
+
+/*
+  ColorIndex::histogram : file の行を返す
+*/
+ColorHistogram ColorIndex::histogram( FileId file ) const
+{
+  ColorHistogram histogram;
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+    histogram[b] = columns_[b][file];
+
+  return( histogram );
+}
+
+/*
+  ColorIndex::dominant : 列 bin が他のどの列以上で、minShare 以上のファイルを集める
+
+  未登録のファイルは全ての列が 0 のため、minShare が 1 以上なら該当しない
+*/
+vector< FileId > ColorIndex::dominant( unsigned bin, uint8_t minShare ) const
+{
+  vector< FileId > files;
+  size_t n = indexed_.size();
+  size_t i = 0;
+  if ( bin >= COLOR_BINS ) return( files );
+  minShare = std::max< uint8_t >( minShare, 1 );
+
+#ifdef __SSE2__
+  const __m128i threshold = _mm_set1_epi8( static_cast< char >( minShare ) );
+  for ( ; i + 16 <= n ; i += 16 ) {
+    __m128i target = _mm_loadu_si128( reinterpret_cast< const __m128i* >( &columns_[bin][i] ) );
+    // 符号なしの a >= b は max( a, b ) == a で判定する
+    __m128i enough = _mm_cmpeq_epi8( _mm_max_epu8( target, threshold ), target );
+    if ( _mm_movemask_epi8( enough ) == 0 ) continue; // 割合が足りなければ他の列は読まない
+    __m128i others = _mm_setzero_si128();
+    for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+      if ( b != bin )
+        others = _mm_max_epu8( others, _mm_loadu_si128( reinterpret_cast< const __m128i* >( &columns_[b][i] ) ) );
+    __m128i match = _mm_and_si128( _mm_cmpeq_epi8( _mm_max_epu8( target, others ), target ), enough );
+    int mask = _mm_movemask_epi8( match );
+    for ( ; mask != 0 ; mask &= mask - 1 )
+      files.push_back( static_cast< FileId >( i + __builtin_ctz( mask ) ) );
+  }
+#endif
+
+  for ( ; i < n ; ++i ) {
+    uint8_t target = columns_[bin][i];
+    bool match = target >= minShare;
+    for ( unsigned b = 0 ; match && b < COLOR_BINS ; ++b )
+      match = ( b == bin || columns_[b][i] <= target );
+    if ( match )
+      files.push_back( static_cast< FileId >( i ) );
+  }
+
+  return( files );
+}
+
+/*
+  ColorIndex::nearest : file とのヒストグラムの距離(差の絶対値の和)を全ファイルについて求め、近い順に返す
+
+  距離は 16 x 255 以下のため 16 ビットで足りる。
+  上位 limit 件は距離の大きい順のヒープに保ち、その先頭より近いファイルだけをヒープに加える。
+*/
+vector< FileId > ColorIndex::nearest( FileId file, size_t limit ) const
+{
+  vector< FileId > files;
+  if ( ! indexed( file ) || limit == 0 ) return( files );
+
+  ColorHistogram query = histogram( file );
+  size_t n = indexed_.size();
+  vector< pair< std::uint16_t, FileId > > heap;  // 上位のファイル(距離の大きい順のヒープ)
+  std::int16_t bound = std::numeric_limits< std::int16_t >::max(); // これ未満の距離だけが上位に入る
+  auto offer = [&]( size_t f, std::uint16_t distance ) {
+    if ( distance >= bound || ! indexed_[f] || f == file ) return;
+    heap.emplace_back( distance, static_cast< FileId >( f ) );
+    std::push_heap( heap.begin(), heap.end() );
+    if ( heap.size() > limit ) {
+      std::pop_heap( heap.begin(), heap.end() );
+      heap.pop_back();
+    }
+    if ( heap.size() == limit ) bound = heap.front().first;
+  };
+  size_t i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  for ( ; i + 16 <= n ; i += 16 ) {
+    __m128i low = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+    for ( unsigned b = 0 ; b < COLOR_BINS ; ++b ) {
+      __m128i q = _mm_set1_epi8( static_cast< char >( query[b] ) );
+      __m128i v = _mm_loadu_si128( reinterpret_cast< const __m128i* >( &columns_[b][i] ) );
+      __m128i diff = _mm_or_si128( _mm_subs_epu8( v, q ), _mm_subs_epu8( q, v ) );
+      low = _mm_add_epi16( low, _mm_unpacklo_epi8( diff, zero ) );
+      high = _mm_add_epi16( high, _mm_unpackhi_epi8( diff, zero ) );
+    }
+    const __m128i limitDistance = _mm_set1_epi16( bound );
+    int mask = _mm_movemask_epi8( _mm_packs_epi16( _mm_cmplt_epi16( low, limitDistance ),
+                                                   _mm_cmplt_epi16( high, limitDistance ) ) );
+    if ( mask == 0 ) continue;
+    std::uint16_t distances[16];
+    _mm_storeu_si128( reinterpret_cast< __m128i* >( &distances[0] ), low );
+    _mm_storeu_si128( reinterpret_cast< __m128i* >( &distances[8] ), high );
+    for ( ; mask != 0 ; mask &= mask - 1 ) {
+      unsigned k = __builtin_ctz( mask );
+      offer( i + k, distances[k] );
+    }
+  }
+#endif
+
+  for ( ; i < n ; ++i ) {
+    std::uint16_t distance = 0;
+    for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+      distance += std::abs( static_cast< int >( columns_[b][i] ) - query[b] );
+    offer( i, distance );
+  }
+
+  std::sort_heap( heap.begin(), heap.end() );
+  for ( auto h = heap.begin() ; h != heap.end() ; ++h )
+    files.push_back( h->second );
+
+  return( files );
+}
@@ -0,0 +1,103 @@
+/**
+  @file color.hpp
+  @brief 色のヒストグラムによる検索
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef COLOR_HPP_20261018
+#define COLOR_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
+
+#include "pathtable.hpp"
+
+/// @brief 色の区分の数(色相 12 区分と無彩色 4 区分)
+const unsigned COLOR_BINS = 16;
+
+/// @brief 色のヒストグラム(各区分の画素の割合、合計がおよそ 255)
+using ColorHistogram = std::array< std::uint8_t, COLOR_BINS >;
+
+/// @brief 色の区分の名前を返す
+///
+/// @param bin 区分
+/// @return 名前
+const char* ColorName( unsigned bin );
+
+/// @brief 画素から色のヒストグラムを求める
+///
+/// 彩度の低い画素は明るさで無彩色の区分に、それ以外は色相で 30 度毎の区分に数える。
+///
+/// @param pixels 画素(8 ビットの RGB または RGBA)
+/// @param width, height 画像の幅と高さ
+/// @param rowstride 1 行のバイト数
+/// @param channels 1 画素のバイト数(3 または 4)
+/// @return ヒストグラム
+ColorHistogram ComputeHistogram( const unsigned char* pixels, int width, int height, int rowstride, int channels );
+
+/**
+   @brief ファイル毎の色のヒストグラム
+
+   区分毎に、識別番号をインデックスとする 1 バイトの列として持つ。
+   検索は列を 16 ファイルずつまとめて比べる(SSE2 が使えない場合は 1 件ずつ)。
+**/
+class ColorIndex
+{
+public:
+
+  /// @brief files 件のファイルを対象に空にする
+  ///
+  /// @param files ファイル数
+  void assign( std::size_t files );
+
+  /// @brief ヒストグラムを登録する
+  ///
+  /// @param file ファイルの識別番号
+  /// @param histogram ヒストグラム
+  void insert( FileId file, const ColorHistogram& histogram );
+
+  /// @brief ヒストグラムの登録を取り消す
+  ///
+  /// @param file ファイルの識別番号
+  void erase( FileId file );
+
+  /// @brief ヒストグラムが登録済みか？
+  ///
+  /// @param file ファイルの識別番号
+  /// @return 登録済みなら true を返す
+  bool indexed( FileId file ) const
+  { return( file < indexed_.size() && indexed_[file] ); }
+
+  /// @brief ヒストグラムを返す
+  ///
+  /// @param file ファイルの識別番号
+  /// @return ヒストグラム
+  ColorHistogram histogram( FileId file ) const;
+
+  /// @brief bin が最も多く、割合が minShare 以上のファイルを返す
+  ///
+  /// @param bin 色の区分
+  /// @param minShare 割合の下限(1 〜 255)
+  /// @return 該当するファイル(識別番号の順)
+  std::vector< FileId > dominant( unsigned bin, std::uint8_t minShare ) const;
+
+  /// @brief file と配色が近いファイルを返す
+  ///
+  /// ヒストグラムの差の絶対値の和が小さい順に返す。
+  ///
+  /// @param file 基準のファイル(登録済みであること)
+  /// @param limit 返すファイル数の上限
+  /// @return 近いファイル(file 自身を除く)
+  std::vector< FileId > nearest( FileId file, std::size_t limit ) const;
+
+private:
+
+  std::vector< std::uint8_t > columns_[COLOR_BINS]; // 区分毎の割合の列
+  std::vector< std::uint8_t > indexed_;             // 登録済みか？(0 / 1 の列)
+};
+
+#endif
@@ -0,0 +1,115 @@
+/**
+   completion.cpp : タグ入力の補完
+**/
+#include "completion.hpp"
+
+#include <algorithm>
+
+using std::string;
+using std::vector;
+
+namespace
+{
+  /*
+    EntryLess : 索引の要素の比較(キー、タグの順)
+  */
+  bool EntryLess( const CompletionIndex::Entry& e1, const CompletionIndex::Entry& e2 )
+  {
+    int res = e1.key.compare( e2.key );
+
+    return( ( res != 0 ) ? ( res < 0 ) : ( e1.tag < e2.tag ) );
+  }
+} // namespace
+
+/*
+  CompletionIndex::assign : tagData のタグから索引を作り直す
+*/
+void CompletionIndex::assign( const TagData& tagData )
+{
+  entries_.clear();
+  entries_.reserve( tagData.size() );
+  for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+    if ( ! ( t->second ).empty() )
+      entries_.push_back( Entry{ Casefold( t->first ), t->first, ( t->second ).size() } );
+
+  std::sort( entries_.begin(), entries_.end(), EntryLess );
+}
+
+/*
+  CompletionIndex::update : tag のファイル数を count にする(未登録なら整列位置に挿入する)
+*/
+void CompletionIndex::update( const string& tag, std::size_t count )
+{
+  if ( count == 0 ) {
+    erase( tag );
+    return;
+  }
+
+  Entry entry{ Casefold( tag ), tag, count };
+  auto i = std::lower_bound( entries_.begin(), entries_.end(), entry, EntryLess );
+  if ( i != entries_.end() && i->tag == tag )
+    i->count = count;
+  else
+    entries_.insert( i, entry );
+}
+
+/*
+  CompletionIndex::erase : tag を削除する
+*/
+void CompletionIndex::erase( const string& tag )
+{
+  Entry entry{ Casefold( tag ), tag, 0 };
+  auto i = std::lower_bound( entries_.begin(), entries_.end(), entry, EntryLess );
+  if ( i != entries_.end() && i->tag == tag )
+    entries_.erase( i );
+}
+
+/*
+  CompletionIndex::rename : oldTag を newTag に変更する
+*/
+void CompletionIndex::rename( const string& oldTag, const string& newTag )
+{
+  Entry entry{ Casefold( oldTag ), oldTag, 0 };
+  auto i = std::lower_bound( entries_.begin(), entries_.end(), entry, EntryLess );
+  if ( i == entries_.end() || i->tag != oldTag ) return;
+
+  std::size_t count = i->count;
+  entries_.erase( i );
+  update( newTag, count );
+}
+
+/*
+  CompletionIndex::lookup : prefix に前方一致するタグを、ファイル数の多い順(同数はキーの順)に最大 limit 件返す
+*/
+vector< string > CompletionIndex::lookup( const string& prefix, std::size_t limit ) const
+{
+  string key = Casefold( prefix );
+
+  // 前方一致する範囲(キーの先頭 key.length() バイトで比べると、前方一致するキーは key と等しく並ぶ)
+  auto first = std::lower_bound( entries_.begin(), entries_.end(), key,
+                                 []( const Entry& e, const string& k ) { return( e.key < k ); } );
+  auto last = std::upper_bound( first, entries_.end(), key,
+                                []( const string& k, const Entry& e ) { return( e.key.compare( 0, k.length(), k ) > 0 ); } );
+
+  // ファイル数の多い順に上位 limit 件を選ぶ
+  vector< const Entry* > matched;
+  matched.reserve( last - first );
+  for ( auto i = first ; i != last ; ++i )
+    matched.push_back( &( *i ) );
+  // 配列はキーの順に整列しているため、同数の場合はアドレスの順がキーの順になる
+  auto rank = []( const Entry* e1, const Entry* e2 ) {
+    return( ( e1->count != e2->count ) ? ( e1->count > e2->count ) : ( e1 < e2 ) );
+  };
+  if ( matched.size() > limit ) {
+    std::nth_element( matched.begin(), matched.begin() + limit, matched.end(), rank );
+    matched.resize( limit );
+  }
+  std::sort( matched.begin(), matched.end(), rank );
+
+  vector< string > res;
+  res.reserve( matched.size() );
+  for ( auto e = matched.begin() ; e != matched.end() ; ++e )
+    res.push_back( ( *e )->tag );
+
+  return( res );
+}
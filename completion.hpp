@@ -0,0 +1,78 @@
+/**
+  @file completion.hpp
+  @brief タグ入力の補完
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef COMPLETION_HPP_20261018
+#define COMPLETION_HPP_20261018
+
+#include <string>
+#include <vector>
+
+#include "file.hpp"
+
+/**
+   @brief タグ補完用の索引
+
+   casefold したタグをキーとして整列した配列を持つ。
+   前方一致するタグはキーの並びで連続するため、二分探索で範囲を求められる。
+   候補はタグの付いたファイル数の多い順に返す。
+**/
+class CompletionIndex
+{
+public:
+
+  /// @brief 索引の要素
+  struct Entry
+  {
+    std::string key; // casefold したタグ
+    std::string tag; // タグ
+    std::size_t count; // タグの付いたファイル数
+  };
+
+  /// @brief 索引を作り直す
+  ///
+  /// @param tagData タグをキーとするファイルリスト
+  void assign( const TagData& tagData );
+
+  /// @brief タグのファイル数を更新する
+  ///
+  /// 未登録のタグは登録し、ファイル数が 0 になったタグは削除する。
+  ///
+  /// @param tag 対象のタグ
+  /// @param count タグの付いたファイル数
+  void update( const std::string& tag, std::size_t count );
+
+  /// @brief タグを削除する
+  ///
+  /// @param tag 削除するタグ
+  void erase( const std::string& tag );
+
+  /// @brief タグを変更する
+  ///
+  /// @param oldTag 現在のタグ
+  /// @param newTag 新たなタグ
+  void rename( const std::string& oldTag, const std::string& newTag );
+
+  /// @brief 前方一致するタグをファイル数の多い順に返す
+  ///
+  /// @param prefix 入力中の文字列
+  /// @param limit 返すタグの上限
+  /// @return 前方一致するタグ
+  std::vector< std::string > lookup( const std::string& prefix, std::size_t limit ) const;
+
+  /// @brief 登録されているタグの数を返す
+  ///
+  /// @return タグの数
+  std::size_t size() const
+  { return( entries_.size() ); }
+
+private:
+
+  std::vector< Entry > entries_; // キーの順に整列した索引
+};
+
+#endif
@@ -11,8 +11,8 @@
 
 namespace error_message
 {
-  const char* KEY_0_NOT_FOUND = "Key \"%1%\" not found.";
-  const char* KEY_0_EXIST = "Key \"%1%\" already exist.";
+  const char* const KEY_0_NOT_FOUND = "Key \"%1%\" not found.";
+  const char* const KEY_0_EXIST = "Key \"%1%\" already exist.";
 } // namespace error_message
 
 #endif
\ No newline at end of file
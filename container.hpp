@@ -0,0 +1,272 @@
+/**
+  @file container.hpp
+  @brief ID の集合を保持するコンテナとその選択方針
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef CONTAINER_HPP_20261018
+#define CONTAINER_HPP_20261018
+
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <type_traits>
+#include <cstring>
+#include <cstdint>
+
+/**
+   @brief 整列した配列による集合
+
+   要素は昇順に並べ、検索は二分探索で行う。
+   要素数が少なく、追加・削除より検索・走査が多い場合に向く。
+
+   @tparam T 要素の型
+**/
+template< typename T >
+class FlatSet
+{
+public:
+
+  using value_type = T;
+  using iterator = typename std::vector< T >::const_iterator;
+  using const_iterator = iterator;
+  using size_type = std::size_t;
+
+  /// @brief 要素を探す
+  ///
+  /// @param value 探す値
+  /// @return 要素の位置(なければ end())
+  const_iterator find( const T& value ) const
+  {
+    auto i = std::lower_bound( data_.begin(), data_.end(), value );
+
+    return( ( i != data_.end() && *i == value ) ? i : data_.end() );
+  }
+
+  /// @brief 要素を追加する
+  ///
+  /// @param value 追加する値
+  /// @return 追加した場合は true
+  bool insert( const T& value )
+  {
+    auto i = std::lower_bound( data_.begin(), data_.end(), value );
+    if ( i != data_.end() && *i == value ) return( false );
+    data_.insert( i, value );
+
+    return( true );
+  }
+
+  /// @brief 要素を削除する
+  ///
+  /// @param i 削除する要素の位置
+  void erase( const_iterator i )
+  { data_.erase( i ); }
+
+  /// @brief 要素数を返す
+  ///
+  /// @return 要素数
+  size_type size() const
+  { return( data_.size() ); }
+
+  /// @brief 開始位置を返す
+  ///
+  /// @return 開始位置
+  const_iterator begin() const
+  { return( data_.begin() ); }
+
+  /// @brief 末尾の次の位置を返す
+  ///
+  /// @return 末尾の次の位置
+  const_iterator end() const
+  { return( data_.end() ); }
+
+private:
+
+  std::vector< T > data_; // 昇順に並べた要素
+};
+
+/**
+   @brief 内部バッファを持つ整列した配列による集合
+
+   要素数が N 以下の間はオブジェクト内に保持し、ヒープを使わない。
+   N を超えるとヒープに移す。ID のような単純な型専用とする。
+
+   @tparam T 要素の型(トリビアルにコピーできること)
+   @tparam N 内部に保持する要素数
+**/
+template< typename T, std::size_t N >
+class SmallSet
+{
+  static_assert( std::is_trivially_copyable< T >::value, "SmallSet requires a trivially copyable type" );
+  static_assert( N > 0, "SmallSet requires a non-empty buffer" );
+
+public:
+
+  using value_type = T;
+  using iterator = const T*;
+  using const_iterator = const T*;
+  using size_type = std::uint32_t;
+
+  /// @brief デフォルト・コンストラクタ
+  SmallSet() : size_( 0 ), capacity_( N ) {}
+
+  /// @brief コピー・コンストラクタ
+  SmallSet( const SmallSet& other ) : size_( 0 ), capacity_( N )
+  { assign( other ); }
+
+  /// @brief ムーブ・コンストラクタ
+  SmallSet( SmallSet&& other ) noexcept : size_( other.size_ ), capacity_( other.capacity_ )
+  {
+    std::memcpy( &storage_, &( other.storage_ ), sizeof( storage_ ) );
+    other.size_ = 0;
+    other.capacity_ = N;
+  }
+
+  /// @brief 代入
+  SmallSet& operator=( SmallSet other ) noexcept
+  {
+    std::swap( storage_, other.storage_ );
+    std::swap( size_, other.size_ );
+    std::swap( capacity_, other.capacity_ );
+
+    return( *this );
+  }
+
+  /// @brief デストラクタ
+  ~SmallSet()
+  {
+    if ( onHeap() ) delete[] storage_.heap;
+  }
+
+  /// @brief 要素を探す
+  ///
+  /// @param value 探す値
+  /// @return 要素の位置(なければ end())
+  const_iterator find( const T& value ) const
+  {
+    const_iterator i = std::lower_bound( begin(), end(), value );
+
+    return( ( i != end() && *i == value ) ? i : end() );
+  }
+
+  /// @brief 要素を追加する
+  ///
+  /// @param value 追加する値
+  /// @return 追加した場合は true
+  bool insert( const T& value )
+  {
+    size_type pos = std::lower_bound( begin(), end(), value ) - begin();
+    if ( pos < size_ && data()[pos] == value ) return( false );
+
+    if ( size_ == capacity_ ) grow();
+    T* p = data();
+    std::memmove( p + pos + 1, p + pos, ( size_ - pos ) * sizeof( T ) );
+    p[pos] = value;
+    ++size_;
+
+    return( true );
+  }
+
+  /// @brief 要素を削除する
+  ///
+  /// @param i 削除する要素の位置
+  void erase( const_iterator i )
+  {
+    size_type pos = i - begin();
+    T* p = data();
+    std::memmove( p + pos, p + pos + 1, ( size_ - pos - 1 ) * sizeof( T ) );
+    --size_;
+  }
+
+  /// @brief 要素数を返す
+  ///
+  /// @return 要素数
+  size_type size() const
+  { return( size_ ); }
+
+  /// @brief 開始位置を返す
+  ///
+  /// @return 開始位置
+  const_iterator begin() const
+  { return( data() ); }
+
+  /// @brief 末尾の次の位置を返す
+  ///
+  /// @return 末尾の次の位置
+  const_iterator end() const
+  { return( data() + size_ ); }
+
+private:
+
+  union Storage
+  {
+    T local[N]; // 内部バッファ
+    T* heap;    // ヒープ上のバッファ
+  };
+
+  Storage storage_;    // 要素の領域
+  size_type size_;     // 要素数
+  size_type capacity_; // 領域の大きさ(N なら内部バッファ)
+
+  bool onHeap() const
+  { return( capacity_ > N ); }
+
+  T* data()
+  { return( onHeap() ? storage_.heap : storage_.local ); }
+
+  const T* data() const
+  { return( onHeap() ? storage_.heap : storage_.local ); }
+
+  // 領域を倍に広げる
+  void grow()
+  {
+    size_type capacity = capacity_ * 2;
+    T* heap = new T[capacity];
+    std::memcpy( heap, data(), size_ * sizeof( T ) );
+    if ( onHeap() ) delete[] storage_.heap;
+    storage_.heap = heap;
+    capacity_ = capacity;
+  }
+
+  // other の内容を複写する(空の状態から呼ぶ)
+  void assign( const SmallSet& other )
+  {
+    while ( capacity_ < other.size_ ) grow();
+    std::memcpy( data(), other.data(), other.size_ * sizeof( T ) );
+    size_ = other.size_;
+  }
+};
+
+/**
+   @brief コンテナの選択方針
+
+   Tag・Image のテンプレート引数として渡し、ID の集合に使うコンテナを選ぶ。
+**/
+namespace container_policy
+{
+  /// @brief ハッシュ集合(要素数が多く、追加・削除が多い場合)
+  struct HashSet
+  {
+    template< typename T >
+    using container = std::unordered_set< T >;
+  };
+
+  /// @brief 整列した配列
+  struct FlatSet
+  {
+    template< typename T >
+    using container = ::FlatSet< T >;
+  };
+
+  /// @brief 内部バッファを持つ整列した配列(要素数が N 以下になることが多い場合)
+  template< std::size_t N >
+  struct SmallSet
+  {
+    template< typename T >
+    using container = ::SmallSet< T, N >;
+  };
+} // namespace container_policy
+
+#endif
@@ -0,0 +1,200 @@
+/**
+   dirtree.cpp : ディレクトリの木とディレクトリ毎のファイル数
+**/
+#include "dirtree.hpp"
+
+#include <algorithm>
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+namespace fs = boost::filesystem;
+
+const DirectoryTree::NodeId DirectoryTree::NO_NODE;
+
+/*
+  DirectoryTree::assign : ライブラリ毎にファイルをパスの順にたどり、ディレクトリが変わる度に木を下る
+
+  パスの順にたどるため、既にあるディレクトリは必ず親の最後の子になる。
+  以下のファイルの末尾とタグの付いたファイル数は、直接のファイルの分を数えてから、
+  行きがけ順の逆にたどって親に足し込む
+*/
+void DirectoryTree::assign( const FileData& fileData, const Libraries& libraries )
+{
+  clear();
+
+  const PathTable& paths = fileData.paths();
+  tagged_.assign( fileData.size(), false );
+  for ( auto l = libraries.begin() ; l != libraries.end() ; ++l ) {
+    NodeId root = static_cast< NodeId >( nodes_.size() );
+    nodes_.push_back( Node{ l->rootPath, NO_NODE, vector< NodeId >(), l->first, l->first, 0, 0 } );
+    roots_.push_back( root );
+
+    for ( FileId id = l->first ; id < l->last ; ++id ) {
+      DirId dir = paths.dir( id );
+      if ( dir >= dirNodes_.size() )
+        dirNodes_.resize( dir + 1, NO_NODE );
+      if ( dirNodes_[dir] == NO_NODE ) {
+        NodeId n = root;
+        fs::path relative = fs::path( paths.directory( dir ) ).lexically_relative( l->rootPath );
+        for ( auto c = relative.begin() ; c != relative.end() ; ++c ) {
+          if ( *c == "." ) continue;
+          const vector< NodeId >& children = nodes_[n].children;
+          if ( ! children.empty() && nodes_[children.back()].name == c->native() ) {
+            n = children.back();
+            continue;
+          }
+          NodeId child = static_cast< NodeId >( nodes_.size() );
+          nodes_.push_back( Node{ c->native(), n, vector< NodeId >(), id, id, 0, 0 } );
+          nodes_[n].children.push_back( child );
+          n = child;
+        }
+        dirNodes_[dir] = n;
+      }
+
+      Node& node = nodes_[dirNodes_[dir]];
+      node.last = id + 1;
+      ++node.files;
+      if ( ! fileData[id].empty() ) {
+        ++node.tagged;
+        tagged_[id] = true;
+      }
+    }
+  }
+
+  for ( NodeId n = static_cast< NodeId >( nodes_.size() ) ; n-- > 0 ; ) {
+    NodeId parent = nodes_[n].parent;
+    if ( parent == NO_NODE ) continue;
+    nodes_[parent].last = std::max( nodes_[parent].last, nodes_[n].last );
+    nodes_[parent].files += nodes_[n].files;
+    nodes_[parent].tagged += nodes_[n].tagged;
+  }
+}
+
+/*
+  DirectoryTree::assign : 索引のディレクトリを行きがけ順にそのまま節にし、読み込んだディレクトリは予約した範囲のファイルで数える
+
+  節の番号は索引の番号、パスの表の範囲の番号と同じになる。
+  以下のファイルの範囲は、節の範囲から子孫の最後の範囲の末尾まで(予約した空きを含む)とする。
+  読み込んでいないディレクトリの直接のファイル数・タグの付いたファイル数は、索引の以下の数から子の分を引いて求める。
+*/
+void DirectoryTree::assign( const FileData& fileData, const LibraryRoot& library, const LazyLibrary& lazy )
+{
+  clear();
+
+  const vector< LazyTagFile::Directory >& dirs = lazy.file().directories();
+  const PathTable& paths = fileData.paths();
+  tagged_.assign( fileData.size(), false );
+  ranged_ = true;
+  for ( NodeId n = 0 ; n < dirs.size() ; ++n ) {
+    const LazyTagFile::Directory& d = dirs[n];
+    FileId first = paths.rangeFirst( n );
+    size_t files = 0, tagged = 0; // 直接のファイル数、タグの付いたファイル数
+    countOwn( fileData, lazy, n, &files, &tagged );
+    string name = ( d.parent == LazyTagFile::NO_DIR ) ? library.rootPath : fs::path( d.path ).filename().native();
+    nodes_.push_back( Node{ name, d.parent, d.children, first, first + paths.rangeCapacity( n ), files, tagged } );
+  }
+  roots_.push_back( 0 );
+
+  for ( NodeId n = static_cast< NodeId >( nodes_.size() ) ; n-- > 0 ; ) {
+    NodeId parent = nodes_[n].parent;
+    if ( parent == NO_NODE ) continue;
+    nodes_[parent].last = std::max( nodes_[parent].last, nodes_[n].last );
+    nodes_[parent].files += nodes_[n].files;
+    nodes_[parent].tagged += nodes_[n].tagged;
+  }
+}
+
+/*
+  DirectoryTree::recount : 直接のファイル数・タグの付いたファイル数を数え直し、差を根まで足す
+*/
+void DirectoryTree::recount( const FileData& fileData, const LazyLibrary& lazy, NodeId node )
+{
+  Node& n = nodes_[node];
+  size_t own = 0, ownTagged = 0; // 直接のファイル数、タグの付いたファイル数
+  countOwn( fileData, lazy, node, &own, &ownTagged );
+  long files = static_cast< long >( own ) - static_cast< long >( n.files );
+  long tagged = static_cast< long >( ownTagged ) - static_cast< long >( n.tagged );
+  for ( auto c = n.children.begin() ; c != n.children.end() ; ++c ) {
+    files += static_cast< long >( nodes_[*c].files );
+    tagged += static_cast< long >( nodes_[*c].tagged );
+  }
+  if ( files == 0 && tagged == 0 ) return;
+
+  for ( NodeId a = node ; a != NO_NODE ; a = nodes_[a].parent ) {
+    nodes_[a].files += files;
+    nodes_[a].tagged += tagged;
+    changed_.insert( a );
+  }
+}
+
+/*
+  DirectoryTree::countOwn : 読み込んだディレクトリは範囲のファイルで数えて tagged_ を付け直し、
+                            読み込んでいないディレクトリは索引の以下の数から子の分を引いて求める(tagged_ は外す)
+*/
+void DirectoryTree::countOwn( const FileData& fileData, const LazyLibrary& lazy, NodeId node, size_t* files, size_t* tagged )
+{
+  const PathTable& paths = fileData.paths();
+  FileId first = paths.rangeFirst( node );
+  *tagged = 0;
+  if ( lazy.loaded( node ) ) {
+    *files = paths.rangeFiles( node );
+    for ( FileId id = first ; id < first + *files ; ++id ) {
+      tagged_[id] = ! fileData[id].empty();
+      if ( tagged_[id] ) ++( *tagged );
+    }
+    return;
+  }
+
+  const vector< LazyTagFile::Directory >& dirs = lazy.file().directories();
+  const LazyTagFile::Directory& d = dirs[node];
+  *files = lazy.file().ownFiles( node );
+  *tagged = d.tagged;
+  for ( auto c = d.children.begin() ; c != d.children.end() ; ++c )
+    *tagged -= dirs[*c].tagged;
+  std::fill( tagged_.begin() + first, tagged_.begin() + first + paths.rangeCapacity( node ), false );
+}
+
+/*
+  DirectoryTree::clear : 空にする
+*/
+void DirectoryTree::clear()
+{
+  nodes_.clear();
+  roots_.clear();
+  dirNodes_.clear();
+  tagged_.clear();
+  changed_.clear();
+  ranged_ = false;
+}
+
+/*
+  DirectoryTree::update : 数えた状態と変わっていれば、直接のディレクトリから根までのファイル数を増減する
+*/
+void DirectoryTree::update( const FileData& fileData, FileId file )
+{
+  if ( file >= tagged_.size() ) return;
+  bool tagged = ! fileData[file].empty();
+  if ( tagged_[file] == tagged ) return;
+  tagged_[file] = tagged;
+
+  for ( NodeId n = node( fileData, file ) ; n != NO_NODE ; n = nodes_[n].parent ) {
+    if ( tagged )
+      ++nodes_[n].tagged;
+    else
+      --nodes_[n].tagged;
+    changed_.insert( n );
+  }
+}
+
+/*
+  DirectoryTree::takeChanged : 変更のあったディレクトリを取り出す
+*/
+vector< DirectoryTree::NodeId > DirectoryTree::takeChanged()
+{
+  vector< NodeId > res( changed_.begin(), changed_.end() );
+  changed_.clear();
+
+  return( res );
+}
@@ -0,0 +1,139 @@
+/**
+  @file dirtree.hpp
+  @brief ディレクトリの木とディレクトリ毎のファイル数
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef DIRTREE_HPP_20261018
+#define DIRTREE_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdint>
+#include <cstddef>
+
+#include "file.hpp"
+#include "library.hpp"
+#include "lazy.hpp"
+
+/**
+   @brief ライブラリのディレクトリの木
+
+   ファイルの識別番号はパスの順のため、ディレクトリ以下のファイルは連続した範囲 [first, last) になる
+   (遅延読み込み中は予約した範囲の空きを含む)。ファイル数は直接のファイル数を祖先に足し込んで持つ
+   (遅延読み込み中は、読み込んでいないファイルも索引の数で含める)。
+   タグの付いたファイル数はディレクトリ毎に持ち、
+   ファイルのタグが空になった・空でなくなった場合に、祖先のディレクトリの分だけ増減する。
+   変更のあったディレクトリは takeChanged() で取り出せるため、表示側は該当行だけを更新すればよい。
+**/
+class DirectoryTree
+{
+public:
+
+  /// @brief ディレクトリの番号(行きがけ順)
+  using NodeId = std::uint32_t;
+
+  /// @brief 該当するディレクトリがないことを表す番号
+  static const NodeId NO_NODE = static_cast< NodeId >( -1 );
+
+  /// @brief ディレクトリ
+  struct Node
+  {
+    std::string name;               // ディレクトリ名(ライブラリのルートはルートパス)
+    NodeId parent;                  // 親のディレクトリ(ライブラリのルートは NO_NODE)
+    std::vector< NodeId > children; // 子のディレクトリ(パスの順)
+    FileId first;                   // 以下の先頭のファイルの識別番号
+    FileId last;                    // 以下の末尾のファイルの次の識別番号
+    std::size_t files;              // 以下のファイル数
+    std::size_t tagged;             // 以下のタグの付いたファイル数
+  };
+
+  /// @brief デフォルト・コンストラクタ
+  DirectoryTree() : nodes_(), roots_(), dirNodes_(), tagged_(), changed_(), ranged_( false ) {}
+
+  /// @brief 木を作り直し、タグの付いたファイル数を数える
+  ///
+  /// @param fileData ファイルをキーとするタグリスト
+  /// @param libraries 開いているライブラリ
+  void assign( const FileData& fileData, const Libraries& libraries );
+
+  /// @brief 遅延読み込み中のライブラリの索引から木を作り直し、ファイル数を数える
+  ///
+  /// ディレクトリの番号は索引の番号(パスの表の範囲の番号)と同じになるため、読み込む度に作り直しても変わらない。
+  /// 読み込んだディレクトリの直接のファイルは fileData で数え、読み込んでいないディレクトリは索引の数(保存時の数)で数える。
+  /// fileData のパスの表は、ディレクトリ毎に範囲を予約していること。
+  ///
+  /// @param fileData ファイルをキーとするタグリスト(読み込んだファイル)
+  /// @param library 開いているライブラリ
+  /// @param lazy 遅延読み込み中のライブラリ
+  void assign( const FileData& fileData, const LibraryRoot& library, const LazyLibrary& lazy );
+
+  /// @brief 遅延読み込みで読み込んだ・追い出したディレクトリの直接のファイルを数え直す
+  ///
+  /// 読み込んだディレクトリは範囲のファイルで、追い出したディレクトリは索引の数で数え直す。
+  /// 数の変わった祖先のディレクトリは takeChanged() で取り出せる。
+  ///
+  /// @param fileData ファイルをキーとするタグリスト(範囲のファイルを入れ替えた後)
+  /// @param lazy 遅延読み込み中のライブラリ
+  /// @param node 読み込んだ・追い出したディレクトリ
+  void recount( const FileData& fileData, const LazyLibrary& lazy, NodeId node );
+
+  /// @brief 空にする
+  void clear();
+
+  /// @brief ライブラリのルートのディレクトリを返す
+  const std::vector< NodeId >& roots() const
+  { return( roots_ ); }
+
+  /// @brief ディレクトリを返す
+  ///
+  /// @param node ディレクトリの番号
+  /// @return ディレクトリ
+  const Node& operator[]( NodeId node ) const
+  { return( nodes_[node] ); }
+
+  /// @brief ディレクトリ以下のファイル数を返す
+  ///
+  /// @param node ディレクトリの番号
+  /// @return ファイル数
+  std::size_t files( NodeId node ) const
+  { return( nodes_[node].files ); }
+
+  /// @brief ファイルの直接のディレクトリを返す
+  ///
+  /// @param fileData ファイルをキーとするタグリスト
+  /// @param file ファイルの識別番号
+  /// @return ディレクトリの番号
+  NodeId node( const FileData& fileData, FileId file ) const
+  { return( ( ranged_ ) ? static_cast< NodeId >( fileData.paths().range( file ) ) : dirNodes_[fileData.paths().dir( file )] ); }
+
+  /// @brief ファイルのタグの変更を反映する
+  ///
+  /// タグが空になった・空でなくなった場合だけ、祖先のディレクトリのタグの付いたファイル数を増減する。
+  ///
+  /// @param fileData ファイルをキーとするタグリスト(変更後)
+  /// @param file タグが変更されたファイル
+  void update( const FileData& fileData, FileId file );
+
+  /// @brief 前回の呼び出し以降にファイル数・タグの付いたファイル数が変わったディレクトリを取り出す
+  ///
+  /// @return ディレクトリの番号(昇順)
+  std::vector< NodeId > takeChanged();
+
+private:
+
+  // 遅延読み込み中のディレクトリの直接のファイル数・タグの付いたファイル数を求める
+  void countOwn( const FileData& fileData, const LazyLibrary& lazy, NodeId node, std::size_t* files, std::size_t* tagged );
+
+  std::vector< Node > nodes_;      // 行きがけ順のディレクトリ
+  std::vector< NodeId > roots_;    // ライブラリのルートのディレクトリ
+  std::vector< NodeId > dirNodes_; // パスの表のディレクトリ番号をインデックスとするディレクトリ
+  std::vector< bool > tagged_;     // 識別番号をインデックスとする、タグが付いているとして数えたか？
+  std::set< NodeId > changed_;     // ファイル数・タグの付いたファイル数が変わったディレクトリ
+  bool ranged_;                    // 遅延読み込み中の木か？(ディレクトリはパスの表の範囲で求める)
+};
+
+#endif
@@ -0,0 +1,203 @@
+/**
+   editlog.cpp : タグの編集の取り消し・やり直し
+**/
+#include "editlog.hpp"
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+const size_t EditLog::DEFAULT_LIMIT;
+
+/*
+  EditLog::Group::bytes : 操作名・タグ・差分の領域の合計を返す
+*/
+size_t EditLog::Group::bytes() const
+{
+  size_t n = sizeof( Group ) + label.capacity() + deltas.capacity() * sizeof( Delta );
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    n += sizeof( string ) + t->capacity();
+
+  return( n );
+}
+
+/*
+  EditLog::begin : 一番外側の begin() で記録中の操作を始める
+*/
+void EditLog::begin( const string& label )
+{
+  if ( depth_++ > 0 ) return;
+
+  open_ = Group();
+  open_.label = label;
+  openIndex_.clear();
+}
+
+/*
+  EditLog::end : 一番外側の end() で記録中の操作を履歴に加える
+*/
+void EditLog::end()
+{
+  if ( depth_ == 0 || --depth_ > 0 ) return;
+
+  openIndex_.clear();
+  if ( open_.deltas.empty() ) return;
+
+  for ( auto g = redo_.begin() ; g != redo_.end() ; ++g )
+    bytes_ -= g->bytes();
+  redo_.clear();
+
+  open_.tags.shrink_to_fit();
+  open_.deltas.shrink_to_fit();
+  bytes_ += open_.bytes();
+  undo_.push_back( std::move( open_ ) );
+  open_ = Group();
+  trim();
+}
+
+/*
+  EditLog::rename : 変更前と変更後のタグの番号を差分にする
+*/
+void EditLog::rename( const string& oldTag, const string& newTag )
+{
+  bool single = ( depth_ == 0 );
+  if ( single ) begin( string() );
+  std::uint32_t to = tagIndex( newTag );
+  record( RENAME, oldTag, to );
+  if ( single ) end();
+}
+
+/*
+  EditLog::clear : 記録中の操作も含めて捨てる
+*/
+void EditLog::clear()
+{
+  undo_.clear();
+  redo_.clear();
+  open_ = Group();
+  openIndex_.clear();
+  bytes_ = 0;
+}
+
+/*
+  EditLog::remap : 全ての操作の ADD・REMOVE の差分のファイルを新しい識別番号に置き換える
+*/
+void EditLog::remap( const vector< FileId >& ids )
+{
+  auto remap = [&ids]( Group& group ) {
+    for ( auto d = group.deltas.begin() ; d != group.deltas.end() ; ++d )
+      if ( d->kind != RENAME ) d->arg = ids[d->arg];
+  };
+  for ( auto g = undo_.begin() ; g != undo_.end() ; ++g )
+    remap( *g );
+  for ( auto g = redo_.begin() ; g != redo_.end() ; ++g )
+    remap( *g );
+  remap( open_ );
+}
+
+/*
+  EditLog::undo : 最新の操作の差分を逆順に打ち消し、やり直しの履歴に移す
+*/
+bool EditLog::undo( FileData* fileData, TagData* tagData, TagTree* tagTree, string* label, vector< Change >* applied )
+{
+  applied->clear();
+  if ( undo_.empty() ) return( false );
+
+  Group group = std::move( undo_.back() );
+  undo_.pop_back();
+  apply( group, false, fileData, tagData, tagTree, applied );
+  *label = group.label;
+  redo_.push_back( std::move( group ) );
+
+  return( true );
+}
+
+/*
+  EditLog::redo : 最後に取り消した操作の差分を記録順に適用し、取り消しの履歴に戻す
+*/
+bool EditLog::redo( FileData* fileData, TagData* tagData, TagTree* tagTree, string* label, vector< Change >* applied )
+{
+  applied->clear();
+  if ( redo_.empty() ) return( false );
+
+  Group group = std::move( redo_.back() );
+  redo_.pop_back();
+  apply( group, true, fileData, tagData, tagTree, applied );
+  *label = group.label;
+  undo_.push_back( std::move( group ) );
+
+  return( true );
+}
+
+/*
+  EditLog::record : 記録中の操作に差分を加える(begin() の外なら差分 1 件の操作にする)
+*/
+void EditLog::record( Kind kind, const string& tag, std::uint32_t arg )
+{
+  bool single = ( depth_ == 0 );
+  if ( single ) begin( string() );
+  open_.deltas.push_back( Delta{ static_cast< std::uint8_t >( kind ), tagIndex( tag ), arg } );
+  if ( single ) end();
+}
+
+/*
+  EditLog::tagIndex : tag が記録中の操作に出てきていればその番号を、なければ加えて新しい番号を返す
+*/
+std::uint32_t EditLog::tagIndex( const string& tag )
+{
+  auto i = openIndex_.find( tag );
+  if ( i != openIndex_.end() ) return( i->second );
+
+  std::uint32_t index = static_cast< std::uint32_t >( open_.tags.size() );
+  open_.tags.push_back( tag );
+  openIndex_.emplace( tag, index );
+
+  return( index );
+}
+
+/*
+  EditLog::trim : 上限を下回るまで、古い操作から捨てる(取り消しの履歴を先に捨てる)
+*/
+void EditLog::trim()
+{
+  while ( bytes_ > limit_ && ! undo_.empty() ) {
+    bytes_ -= undo_.front().bytes();
+    undo_.pop_front();
+  }
+  while ( bytes_ > limit_ && ! redo_.empty() ) {
+    bytes_ -= redo_.front().bytes();
+    redo_.erase( redo_.begin() );
+  }
+}
+
+/*
+  EditLog::apply : 操作の差分を適用する
+
+  forward が true なら記録順に記録した編集を、false なら逆順に打ち消す編集を行い、
+  実際に索引が変わった差分を applied に加える
+*/
+void EditLog::apply( const Group& group, bool forward, FileData* fileData, TagData* tagData, TagTree* tagTree,
+                     vector< Change >* applied )
+{
+  for ( size_t n = 0 ; n < group.deltas.size() ; ++n ) {
+    const Delta& d = group.deltas[forward ? n : group.deltas.size() - 1 - n];
+    const string& tag = group.tags[d.tag];
+
+    if ( d.kind == RENAME ) {
+      const string& newTag = group.tags[d.arg];
+      const string& from = forward ? tag : newTag;
+      const string& to = forward ? newTag : tag;
+      ChangeTagName( from, to, fileData, tagData, tagTree );
+      // 後の差分で同じタグの名前がさらに変わる場合があるため、この時点のファイルを残す
+      const TagData& renamed = *tagData;
+      auto t = renamed.find( to );
+      applied->push_back( Change{ RENAME, from, to, NO_FILE,
+                                  ( t == renamed.end() ) ? vector< FileId >() : vector< FileId >( t->second.begin(), t->second.end() ) } );
+      continue;
+    }
+
+    bool add = ( ( d.kind == ADD ) == forward );
+    if ( add ? AddTag( tag, d.arg, fileData, tagData, tagTree ) : RemoveTag( tag, d.arg, fileData, tagData, tagTree ) )
+      applied->push_back( Change{ add ? ADD : REMOVE, tag, string(), d.arg, vector< FileId >() } );
+  }
+}
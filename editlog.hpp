@@ -0,0 +1,163 @@
+/**
+  @file editlog.hpp
+  @brief タグの編集の取り消し・やり直し
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef EDITLOG_HPP_20261018
+#define EDITLOG_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+
+#include "file.hpp"
+
+/**
+   @brief タグの編集の履歴
+
+   編集は索引の複製ではなく、タグの追加・削除・名前の変更の差分として記録する。
+   begin() から end() までの差分は 1 つの操作にまとめ、まとめて取り消し・やり直しする。
+   差分のタグ名は操作毎に 1 回だけ持ち、差分自体は 12 バイトで済む。
+   記録の合計が上限を超えたら、古い操作から捨てる。
+
+   取り消し・やり直しは、記録した順序の逆・順に差分を適用するため、
+   適用の時点の索引は記録した時点と同じ状態になっている。
+**/
+class EditLog
+{
+public:
+
+  /// @brief 差分の種類
+  enum Kind { ADD, REMOVE, RENAME };
+
+  /// @brief 適用した差分 1 件(画面への反映用)
+  struct Change
+  {
+    Kind kind;          // 種類
+    std::string tag;    // 対象のタグ(RENAME では変更前のタグ)
+    std::string newTag; // 変更後のタグ(RENAME のみ)
+    FileId file;        // 対象のファイル(RENAME では NO_FILE)
+    std::vector< FileId > files; // 名前を変更した時点で newTag の付いていたファイル(RENAME のみ)
+  };
+
+  /// @brief 記録の上限(バイト数)の既定値
+  static const std::size_t DEFAULT_LIMIT = 8 << 20;
+
+  /// @brief コンストラクタ
+  ///
+  /// @param limit 記録の上限(バイト数)
+  explicit EditLog( std::size_t limit = DEFAULT_LIMIT )
+    : undo_(), redo_(), open_(), openIndex_(), depth_( 0 ), bytes_( 0 ), limit_( limit ) {}
+
+  /// @brief 操作の記録を始める(入れ子にした場合は外側の操作にまとめる)
+  ///
+  /// @param label 操作の名前
+  void begin( const std::string& label );
+
+  /// @brief 操作の記録を終える
+  ///
+  /// 差分のない操作は記録しない。差分があればやり直しの履歴を捨てる。
+  void end();
+
+  /// @brief タグの追加を記録する
+  ///
+  /// @param tag 追加したタグ
+  /// @param file 対象のファイル
+  void add( const std::string& tag, FileId file )
+  { record( ADD, tag, file ); }
+
+  /// @brief タグの削除を記録する
+  ///
+  /// @param tag 削除したタグ
+  /// @param file 対象のファイル
+  void remove( const std::string& tag, FileId file )
+  { record( REMOVE, tag, file ); }
+
+  /// @brief タグ名の変更を記録する
+  ///
+  /// @param oldTag 変更前のタグ
+  /// @param newTag 変更後のタグ
+  void rename( const std::string& oldTag, const std::string& newTag );
+
+  /// @brief 履歴を全て捨てる(索引を読み直した時など)
+  void clear();
+
+  /// @brief 記録したファイルの識別番号を振り直す(遅延読み込みでファイルを加えた時など)
+  ///
+  /// @param ids 元の識別番号をインデックスとする新しい識別番号
+  void remap( const std::vector< FileId >& ids );
+
+  /// @brief 取り消せる操作があるか？
+  bool canUndo() const
+  { return( ! undo_.empty() ); }
+
+  /// @brief やり直せる操作があるか？
+  bool canRedo() const
+  { return( ! redo_.empty() ); }
+
+  /// @brief 最後の操作を取り消す
+  ///
+  /// @param fileData ファイルをキーとするタグリストへのポインタ
+  /// @param tagData タグをキーとするファイルリストへのポインタ
+  /// @param tagTree タグの階層へのポインタ
+  /// @param label 取り消した操作の名前を返す
+  /// @param applied 適用した差分を適用順に返す
+  /// @return 取り消せる操作がなければ false を返す
+  bool undo( FileData* fileData, TagData* tagData, TagTree* tagTree, std::string* label, std::vector< Change >* applied );
+
+  /// @brief 最後に取り消した操作をやり直す
+  ///
+  /// @param fileData ファイルをキーとするタグリストへのポインタ
+  /// @param tagData タグをキーとするファイルリストへのポインタ
+  /// @param tagTree タグの階層へのポインタ
+  /// @param label やり直した操作の名前を返す
+  /// @param applied 適用した差分を適用順に返す
+  /// @return やり直せる操作がなければ false を返す
+  bool redo( FileData* fileData, TagData* tagData, TagTree* tagTree, std::string* label, std::vector< Change >* applied );
+
+  /// @brief 記録のバイト数を返す
+  std::size_t bytes() const
+  { return( bytes_ ); }
+
+private:
+
+  /// 差分 1 件(タグは操作内のタグの番号)
+  struct Delta
+  {
+    std::uint8_t kind; // 種類
+    std::uint32_t tag; // 対象のタグの番号(RENAME では変更前のタグ)
+    std::uint32_t arg; // ADD・REMOVE ではファイルの識別番号、RENAME では変更後のタグの番号
+  };
+
+  /// 操作 1 件
+  struct Group
+  {
+    std::string label;               // 操作の名前
+    std::vector< std::string > tags; // 差分が参照するタグ
+    std::vector< Delta > deltas;     // 記録した順の差分
+
+    std::size_t bytes() const; // 記録のバイト数の見積もり
+  };
+
+  void record( Kind kind, const std::string& tag, std::uint32_t arg );  // 差分を記録する
+  std::uint32_t tagIndex( const std::string& tag );                     // 記録中の操作のタグの番号を返す
+  void trim();                                                          // 上限を超えた分の古い操作を捨てる
+  static void apply( const Group& group, bool forward, FileData* fileData, TagData* tagData, TagTree* tagTree,
+                     std::vector< Change >* applied );                  // 操作を適用する
+
+  std::deque< Group > undo_;                                  // 取り消せる操作(末尾が最新)
+  std::vector< Group > redo_;                                 // やり直せる操作(末尾が最後に取り消した操作)
+  Group open_;                                                // 記録中の操作
+  std::unordered_map< std::string, std::uint32_t > openIndex_; // 記録中の操作のタグの番号
+  unsigned depth_;                                            // begin() の入れ子の深さ
+  std::size_t bytes_;                                         // undo_ と redo_ の記録のバイト数
+  std::size_t limit_;                                         // 記録の上限
+};
+
+#endif
@@ -0,0 +1,157 @@
+/**
+   facet.cpp : 絞り込み結果に対するタグ毎のファイル数
+**/
+#include "facet.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using std::string;
+using std::vector;
+using std::set;
+using std::size_t;
+
+namespace
+{
+  const size_t CHUNK_SIZE = 64; // 一度にスレッドに割り当てるタグの数
+
+  /*
+    IntersectionSize : files と posting の共通部分の大きさを返す
+
+    小さい方の要素を大きい方から探す
+  */
+  size_t IntersectionSize( const FileList& files, const Posting& posting )
+  {
+    size_t n = 0;
+    if ( posting.size() <= files.size() ) {
+      for ( auto p = posting.begin() ; p != posting.end() ; ++p )
+        if ( std::binary_search( files.begin(), files.end(), *p ) ) ++n;
+    } else {
+      for ( auto f = files.begin() ; f != files.end() ; ++f )
+        if ( posting.find( *f ) != posting.end() ) ++n;
+    }
+
+    return( n );
+  }
+} // namespace
+
+/*
+  FacetCounter::compute : 全ファイルを対象にタグ毎のファイル数を数え直す
+*/
+void FacetCounter::compute( const TagData& tagData )
+{
+  counts_.clear();
+  for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+    if ( ! ( t->second ).empty() )
+      counts_.emplace_hint( counts_.end(), t->first, ( t->second ).size() );
+
+  changed_.clear();
+  rebuilt_ = true;
+}
+
+/*
+  FacetCounter::compute : 結果 files を対象にタグ毎のファイル数を数え直す
+
+  タグ毎のファイル数の偏りが大きいため、タグを CHUNK_SIZE 件ずつ空いたスレッドに割り当てる
+*/
+void FacetCounter::compute( const FileList& files, const TagData& tagData )
+{
+  vector< TagData::const_iterator > tags;
+  tags.reserve( tagData.size() );
+  for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+    tags.push_back( t );
+
+  vector< size_t > counts( tags.size() );
+  std::atomic< size_t > next( 0 );
+  auto work = [&]() {
+    for ( ;; ) {
+      size_t first = next.fetch_add( CHUNK_SIZE );
+      if ( first >= tags.size() ) break;
+      size_t last = std::min( first + CHUNK_SIZE, tags.size() );
+      for ( size_t i = first ; i < last ; ++i )
+        counts[i] = IntersectionSize( files, tags[i]->second );
+    }
+  };
+
+  unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+  threads = std::min< size_t >( threads, ( tags.size() + CHUNK_SIZE - 1 ) / CHUNK_SIZE );
+  vector< std::thread > workers;
+  for ( unsigned i = 1 ; i < threads ; ++i )
+    workers.emplace_back( work );
+  work();
+  for ( auto w = workers.begin() ; w != workers.end() ; ++w )
+    w->join();
+
+  counts_.clear();
+  for ( size_t i = 0 ; i < tags.size() ; ++i )
+    if ( counts[i] > 0 )
+      counts_.emplace_hint( counts_.end(), tags[i]->first, counts[i] );
+
+  changed_.clear();
+  rebuilt_ = true;
+}
+
+/*
+  FacetCounter::insertFile : 結果に加わったファイルのタグを数える
+*/
+void FacetCounter::insertFile( const TagSet& tags )
+{
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    insertTag( *t );
+}
+
+/*
+  FacetCounter::eraseFile : 結果から外れたファイルのタグを差し引く
+*/
+void FacetCounter::eraseFile( const TagSet& tags )
+{
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    eraseTag( *t );
+}
+
+/*
+  FacetCounter::insertTag : tag のファイル数を 1 増やす
+*/
+void FacetCounter::insertTag( const string& tag )
+{
+  ++counts_[tag];
+  if ( ! rebuilt_ ) changed_.insert( tag );
+}
+
+/*
+  FacetCounter::eraseTag : tag のファイル数を 1 減らす(0 になったら削除する)
+*/
+void FacetCounter::eraseTag( const string& tag )
+{
+  auto i = counts_.find( tag );
+  if ( i == counts_.end() ) return;
+
+  if ( --( i->second ) == 0 )
+    counts_.erase( i );
+  if ( ! rebuilt_ ) changed_.insert( tag );
+}
+
+/*
+  FacetCounter::count : tag のファイル数を返す
+*/
+size_t FacetCounter::count( const string& tag ) const
+{
+  auto i = counts_.find( tag );
+
+  return( ( i == counts_.end() ) ? 0 : i->second );
+}
+
+/*
+  FacetCounter::takeChanged : 変更のあったタグを取り出す
+*/
+vector< string > FacetCounter::takeChanged( bool* rebuilt )
+{
+  *rebuilt = rebuilt_;
+  vector< string > res( changed_.begin(), changed_.end() );
+
+  changed_.clear();
+  rebuilt_ = false;
+
+  return( res );
+}
@@ -0,0 +1,101 @@
+/**
+  @file facet.hpp
+  @brief 絞り込み結果に対するタグ毎のファイル数
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef FACET_HPP_20261018
+#define FACET_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+
+#include "file.hpp"
+#include "query.hpp"
+
+/**
+   @brief タグ毎のファイル数(ファセット)
+
+   結果全体が入れ替わった場合は、結果とタグ毎のファイルリストの共通部分をタグ毎に並列に数える。
+   ファイル単位の出入りやタグの追加・削除は差分だけを反映する。
+   変更のあったタグは takeChanged() で取り出せるため、表示側は該当行だけを更新すればよい。
+**/
+class FacetCounter
+{
+public:
+
+  using container = std::map< std::string, std::size_t, StrLess >;
+  using const_iterator = container::const_iterator;
+
+  /// @brief デフォルト・コンストラクタ
+  FacetCounter() : rebuilt_( false ) {}
+
+  /// @brief 全ファイルを対象に数え直す
+  ///
+  /// @param tagData タグをキーとするファイルリスト
+  void compute( const TagData& tagData );
+
+  /// @brief 結果 files を対象に数え直す
+  ///
+  /// タグを複数のスレッドに振り分けて数える。
+  ///
+  /// @param files 絞り込み結果
+  /// @param tagData タグをキーとするファイルリスト
+  void compute( const FileList& files, const TagData& tagData );
+
+  /// @brief ファイルが結果に加わった
+  ///
+  /// @param tags 加わったファイルのタグリスト
+  void insertFile( const TagSet& tags );
+
+  /// @brief ファイルが結果から外れた
+  ///
+  /// @param tags 外れたファイルのタグリスト
+  void eraseFile( const TagSet& tags );
+
+  /// @brief 結果内のファイルにタグが追加された
+  ///
+  /// @param tag 追加されたタグ
+  void insertTag( const std::string& tag );
+
+  /// @brief 結果内のファイルからタグが削除された
+  ///
+  /// @param tag 削除されたタグ
+  void eraseTag( const std::string& tag );
+
+  /// @brief タグのファイル数を返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return ファイル数
+  std::size_t count( const std::string& tag ) const;
+
+  /// @brief 前回の呼び出し以降に変更のあったタグを取り出す
+  ///
+  /// @param rebuilt 数え直した場合に true をセットする変数へのポインタ(この場合、戻り値は空)
+  /// @return 変更のあったタグ
+  std::vector< std::string > takeChanged( bool* rebuilt );
+
+  /// @brief 先頭位置を返す
+  ///
+  /// @return 先頭位置
+  const_iterator begin() const
+  { return( counts_.begin() ); }
+
+  /// @brief 末尾の次の位置を返す
+  ///
+  /// @return 末尾の次の位置
+  const_iterator end() const
+  { return( counts_.end() ); }
+
+private:
+
+  container counts_;                        // タグ毎のファイル数(0 のタグは含まない)
+  std::set< std::string, StrLess > changed_; // 変更のあったタグ
+  bool rebuilt_;                            // 数え直したか？
+};
+
+#endif
@@ -0,0 +1,322 @@
+/**
+   feature.cpp : 画像の特徴量とその保存
+**/
+#include "feature.hpp"
+
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "hash.hpp"
+
+using std::string;
+using std::vector;
+using std::size_t;
+using std::uint64_t;
+using std::int64_t;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const int LOAD_SIZE = 64; // 読み込み時に縮小する大きさ
+
+  const char FEATURE_MAGIC[8] = { 'g', 'T', 'a', 'g', 'F', 'e', 'a', 't' }; // 特徴量ファイルの識別子
+  const std::uint32_t FEATURE_VERSION = 1;                                  // 特徴量ファイルの版
+  const string FEATURE_EXT = ".features";                                   // 特徴量ファイルの拡張子
+
+  /*
+    PathKey : file のルートパスからの相対パスのハッシュ値を返す
+  */
+  uint64_t PathKey( const fs::path& file, const string& rootPath )
+  {
+    string relative = file.lexically_relative( rootPath ).native();
+
+    return( HashBytes( relative.data(), relative.size() ) );
+  }
+
+  /*
+    WriteValue : value をそのままのバイト列で書き込む
+  */
+  template< typename T >
+  void WriteValue( std::ofstream& ofs, const T& value )
+  { ofs.write( reinterpret_cast< const char* >( &value ), sizeof( T ) ); }
+
+  /*
+    ReadValue : value をそのままのバイト列で読み込む
+  */
+  template< typename T >
+  bool ReadValue( std::ifstream& ifs, T* value )
+  {
+    ifs.read( reinterpret_cast< char* >( value ), sizeof( T ) );
+    return( ! ifs.fail() );
+  }
+
+  /*
+    WriteColumn : 列 column を書き込む
+  */
+  template< typename T >
+  void WriteColumn( std::ofstream& ofs, const vector< T >& column )
+  { ofs.write( reinterpret_cast< const char* >( column.data() ), column.size() * sizeof( T ) ); }
+
+  /*
+    ReadColumn : rows 行の列を column に読み込む
+  */
+  template< typename T >
+  bool ReadColumn( std::ifstream& ifs, size_t rows, vector< T >* column )
+  {
+    column->resize( rows );
+    ifs.read( reinterpret_cast< char* >( column->data() ), rows * sizeof( T ) );
+    return( ! ifs.fail() );
+  }
+} // namespace
+
+/*
+  ComputeImageFeatures : file を LOAD_SIZE 四方に縮小して読み込み、知覚ハッシュと色のヒストグラムを求める
+*/
+bool ComputeImageFeatures( const fs::path& file, int64_t mtime, ImageFeatures* features )
+{
+  GError* error = 0;
+  GdkPixbuf* pixbuf = gdk_pixbuf_new_from_file_at_scale( file.c_str(), LOAD_SIZE, LOAD_SIZE, FALSE, &error );
+  if ( pixbuf == 0 ) {
+    g_error_free( error );
+    return( false );
+  }
+
+  int width = gdk_pixbuf_get_width( pixbuf );
+  int height = gdk_pixbuf_get_height( pixbuf );
+  int rowstride = gdk_pixbuf_get_rowstride( pixbuf );
+  int channels = gdk_pixbuf_get_n_channels( pixbuf );
+  bool valid = gdk_pixbuf_get_bits_per_sample( pixbuf ) == 8 && channels >= 3 && width >= 9 && height >= 8;
+  if ( valid ) {
+    const guint8* pixels = gdk_pixbuf_read_pixels( pixbuf );
+    features->mtime = mtime;
+    features->hash = DHash( pixels, width, height, rowstride, channels );
+    features->colors = ComputeHistogram( pixels, width, height, rowstride, channels );
+  }
+  g_object_unref( pixbuf );
+
+  return( valid );
+}
+
+/*
+  FeatureFileName : タグファイル名に拡張子を加える
+*/
+string FeatureFileName( const string& tagFile )
+{
+  return( tagFile + FEATURE_EXT );
+}
+
+/*
+  ReadImageFeatures : 特徴量ファイルを読み込み、パスのハッシュ値で rootPath 以下の現在のファイルに対応付ける
+*/
+bool ReadImageFeatures( const string& fileName, const string& rootPath, const FileData& fileData,
+                        vector< ImageFeatures >* features )
+{
+  features->resize( fileData.size(), ImageFeatures{ NO_FEATURES, 0, ColorHistogram() } );
+
+  std::ifstream ifs( fileName, std::ios::binary );
+  if ( ifs.fail() ) return( false );
+
+  char magic[sizeof( FEATURE_MAGIC )];
+  std::uint32_t version, bins;
+  uint64_t rows;
+  if ( ! ( ReadValue( ifs, &magic ) && ReadValue( ifs, &version ) && ReadValue( ifs, &bins ) && ReadValue( ifs, &rows ) ) )
+    return( false );
+  if ( std::memcmp( magic, FEATURE_MAGIC, sizeof( magic ) ) != 0 || version != FEATURE_VERSION || bins != COLOR_BINS )
+    return( false );
+
+  // 行数は列を確保する前に、ヘッダ以降のバイト数に収まるか確かめる(壊れたファイルで巨大な確保をしない)
+  const uint64_t ROW_SIZE = sizeof( uint64_t ) + sizeof( int64_t ) + sizeof( ImageHash ) + COLOR_BINS * sizeof( std::uint8_t );
+  std::streamoff header = ifs.tellg();
+  ifs.seekg( 0, std::ios::end );
+  std::streamoff size = ifs.tellg();
+  ifs.seekg( header );
+  if ( header < 0 || size < header || rows > static_cast< uint64_t >( size - header ) / ROW_SIZE )
+    return( false );
+
+  vector< uint64_t > keys;
+  vector< int64_t > mtimes;
+  vector< ImageHash > hashes;
+  vector< std::uint8_t > columns[COLOR_BINS];
+  bool read = ReadColumn( ifs, rows, &keys ) && ReadColumn( ifs, rows, &mtimes ) && ReadColumn( ifs, rows, &hashes );
+  for ( unsigned b = 0 ; read && b < COLOR_BINS ; ++b )
+    read = ReadColumn( ifs, rows, &columns[b] );
+  if ( ! read ) return( false );
+
+  FileId first, last; // rootPath 以下のファイルの範囲
+  RootRange( fileData, rootPath, &first, &last );
+  std::unordered_map< uint64_t, FileId > ids; // パスのハッシュ値をキーとする識別番号
+  ids.reserve( last - first );
+  for ( FileId id = first ; id < last ; ++id )
+    ids.emplace( PathKey( fileData.path( id ), rootPath ), id );
+
+  for ( size_t r = 0 ; r < rows ; ++r ) {
+    auto i = ids.find( keys[r] );
+    if ( i == ids.end() ) continue;
+    ImageFeatures& f = ( *features )[i->second];
+    f.mtime = mtimes[r];
+    f.hash = hashes[r];
+    for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+      f.colors[b] = columns[b][r];
+  }
+
+  return( true );
+}
+
+/*
+  SavedFeatures::open : ヘッダを確かめて写像し、パスのハッシュ値の列を行の番号とともに並べ替える
+
+  列の位置はヘッダの直後から行数で求まる(書式は ImageIndex::write を参照)
+*/
+bool SavedFeatures::open( const string& fileName, const string& rootPath )
+{
+  clear();
+  if ( ! fs::exists( fs::path( fileName ) ) ) return( false );
+
+  try {
+    file_.reset( new MappedFile( fileName ) );
+  } catch( std::runtime_error& ) {
+    return( false );
+  }
+
+  const size_t HEADER = sizeof( FEATURE_MAGIC ) + sizeof( std::uint32_t ) * 2 + sizeof( uint64_t );
+  const uint64_t ROW_SIZE = sizeof( uint64_t ) + sizeof( int64_t ) + sizeof( ImageHash ) + COLOR_BINS * sizeof( std::uint8_t );
+  const char* p = file_->begin();
+  std::uint32_t version, bins;
+  uint64_t rows;
+  if ( file_->size() < HEADER || std::memcmp( p, FEATURE_MAGIC, sizeof( FEATURE_MAGIC ) ) != 0 ) {
+    clear();
+    return( false );
+  }
+  std::memcpy( &version, p + sizeof( FEATURE_MAGIC ), sizeof( version ) );
+  std::memcpy( &bins, p + sizeof( FEATURE_MAGIC ) + sizeof( version ), sizeof( bins ) );
+  std::memcpy( &rows, p + sizeof( FEATURE_MAGIC ) + sizeof( version ) + sizeof( bins ), sizeof( rows ) );
+  if ( version != FEATURE_VERSION || bins != COLOR_BINS || rows > ( file_->size() - HEADER ) / ROW_SIZE ) {
+    clear();
+    return( false );
+  }
+
+  rootPath_ = rootPath;
+  rows_ = rows;
+  keys_.resize( rows );
+  for ( uint64_t r = 0 ; r < rows ; ++r ) {
+    std::memcpy( &( keys_[r].first ), p + HEADER + r * sizeof( uint64_t ), sizeof( uint64_t ) );
+    keys_[r].second = r;
+  }
+  std::sort( keys_.begin(), keys_.end() );
+
+  return( true );
+}
+
+/*
+  SavedFeatures::clear : 写像を解除し、並べ替えた列を手放す
+*/
+void SavedFeatures::clear()
+{
+  file_.reset();
+  rootPath_.clear();
+  rows_ = 0;
+  vector< std::pair< uint64_t, uint64_t > >().swap( keys_ );
+}
+
+/*
+  SavedFeatures::find : パスのハッシュ値を二分探索し、その行の各列の値を集める
+*/
+bool SavedFeatures::find( const fs::path& file, ImageFeatures* features ) const
+{
+  if ( ! file_ ) return( false );
+
+  uint64_t key = PathKey( file, rootPath_ );
+  auto k = std::lower_bound( keys_.begin(), keys_.end(), std::make_pair( key, uint64_t( 0 ) ) );
+  if ( k == keys_.end() || k->first != key ) return( false );
+
+  const size_t HEADER = sizeof( FEATURE_MAGIC ) + sizeof( std::uint32_t ) * 2 + sizeof( uint64_t );
+  const char* column = file_->begin() + HEADER + rows_ * sizeof( uint64_t ); // 更新時刻の列
+  uint64_t r = k->second;
+  std::memcpy( &( features->mtime ), column + r * sizeof( int64_t ), sizeof( int64_t ) );
+  column += rows_ * sizeof( int64_t );
+  std::memcpy( &( features->hash ), column + r * sizeof( ImageHash ), sizeof( ImageHash ) );
+  column += rows_ * sizeof( ImageHash );
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b, column += rows_ )
+    features->colors[b] = static_cast< std::uint8_t >( column[r] );
+
+  return( true );
+}
+
+/*
+  ImageIndex::assign : files 件のファイルを対象に索引を空にする
+*/
+void ImageIndex::assign( size_t files )
+{
+  similar_.assign( files );
+  colors_.assign( files );
+  mtimes_.assign( files, NO_FEATURES );
+}
+
+/*
+  ImageIndex::insert : file の特徴量を各索引に登録する
+*/
+void ImageIndex::insert( FileId file, const ImageFeatures& features )
+{
+  if ( file >= mtimes_.size() ) return;
+
+  similar_.insert( file, features.hash );
+  colors_.insert( file, features.colors );
+  mtimes_[file] = features.mtime;
+}
+
+/*
+  ImageIndex::erase : file の特徴量を各索引から除く
+*/
+void ImageIndex::erase( FileId file )
+{
+  if ( file >= mtimes_.size() ) return;
+
+  similar_.erase( file );
+  colors_.erase( file );
+  mtimes_[file] = NO_FEATURES;
+}
+
+/*
+  ImageIndex::write : rootPath 以下の登録済みのファイルの特徴量を列毎に書き込む
+
+  値はこの環境のバイト順で書く(他の環境で読めない場合は作り直される)
+*/
+void ImageIndex::write( const string& fileName, const string& rootPath, const FileData& fileData ) const
+{
+  vector< uint64_t > keys;
+  vector< int64_t > mtimes;
+  vector< ImageHash > hashes;
+  vector< std::uint8_t > columns[COLOR_BINS];
+  FileId first, last; // rootPath 以下のファイルの範囲
+  RootRange( fileData, rootPath, &first, &last );
+  for ( FileId id = first ; id < mtimes_.size() && id < last ; ++id ) {
+    if ( ! indexed( id ) ) continue;
+    keys.push_back( PathKey( fileData.path( id ), rootPath ) );
+    mtimes.push_back( mtimes_[id] );
+    hashes.push_back( similar_.hash( id ) );
+    ColorHistogram h = colors_.histogram( id );
+    for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+      columns[b].push_back( h[b] );
+  }
+
+  fs::path tempFile( fileName + ".tmp" );
+  std::ofstream ofs( tempFile.native(), std::ios::binary );
+  WriteValue( ofs, FEATURE_MAGIC );
+  WriteValue( ofs, FEATURE_VERSION );
+  WriteValue( ofs, static_cast< std::uint32_t >( COLOR_BINS ) );
+  WriteValue( ofs, static_cast< uint64_t >( keys.size() ) );
+  WriteColumn( ofs, keys );
+  WriteColumn( ofs, mtimes );
+  WriteColumn( ofs, hashes );
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b )
+    WriteColumn( ofs, columns[b] );
+  ofs.close();
+
+  fs::rename( tempFile, fs::path( fileName ) );
+}
@@ -0,0 +1,179 @@
+/**
+  @file feature.hpp
+  @brief 画像の特徴量(知覚ハッシュと色のヒストグラム)とその保存
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef FEATURE_HPP_20261018
+#define FEATURE_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <limits>
+#include <cstdint>
+
+#include <boost/filesystem.hpp>
+
+#include "file.hpp"
+#include "similar.hpp"
+#include "color.hpp"
+#include "tagparse.hpp"
+
+/// @brief 特徴量がないことを表す更新時刻
+const std::int64_t NO_FEATURES = std::numeric_limits< std::int64_t >::min();
+
+/// @brief 画像 1 件の特徴量
+struct ImageFeatures
+{
+  std::int64_t mtime;    // 求めたときのファイルの更新時刻(なければ NO_FEATURES)
+  ImageHash hash;        // 知覚ハッシュ
+  ColorHistogram colors; // 色のヒストグラム
+};
+
+/// @brief 画像ファイルの特徴量を求める
+///
+/// 画像は読み込み時に縮小した縮小画像から求め、全体は展開しない。
+///
+/// @param file 画像ファイル
+/// @param mtime ファイルの更新時刻
+/// @param features 特徴量を返す変数へのポインタ
+/// @return 画像として読み込めなければ false を返す
+bool ComputeImageFeatures( const boost::filesystem::path& file, std::int64_t mtime, ImageFeatures* features );
+
+/// @brief 特徴量ファイルの名前を返す
+///
+/// @param tagFile タグファイルの名前
+/// @return タグファイルと同じ場所の特徴量ファイルの名前
+std::string FeatureFileName( const std::string& tagFile );
+
+/// @brief 特徴量ファイルを読み込む
+///
+/// ファイルがない場合、形式が違う場合は何も読まずに false を返す。
+/// 現在のファイルにないパスの行は捨てる。
+/// features は rootPath 以下のファイルの分だけを書き換えるため、ライブラリ毎に続けて読み込める。
+///
+/// @param fileName 特徴量ファイルの名前
+/// @param rootPath ルートパス
+/// @param fileData ファイルをキーとするタグリスト
+/// @param features 識別番号をインデックスとする特徴量を返す変数へのポインタ
+/// @return 読み込めれば true を返す
+bool ReadImageFeatures( const std::string& fileName, const std::string& rootPath, const FileData& fileData,
+                        std::vector< ImageFeatures >* features );
+
+/**
+   @brief 特徴量ファイルからファイル毎に特徴量を引く表
+
+   遅延読み込みで使う。open() では特徴量ファイルを写像し、パスのハッシュ値の列だけを並べ替えておく。
+   読み込んだディレクトリのファイルの分だけ find() で引くため、全体を読み込むことはない。
+**/
+class SavedFeatures
+{
+public:
+
+  /// @brief デフォルト・コンストラクタ(特徴量なし)
+  SavedFeatures() : file_(), rootPath_(), rows_( 0 ), keys_() {}
+
+  /// @brief 特徴量ファイルを開く
+  ///
+  /// ファイルがない場合、形式が違う場合は特徴量なしにして false を返す。
+  ///
+  /// @param fileName 特徴量ファイルの名前
+  /// @param rootPath ルートパス
+  /// @return 開ければ true を返す
+  bool open( const std::string& fileName, const std::string& rootPath );
+
+  /// @brief 特徴量なしにする(写像を解除する)
+  void clear();
+
+  /// @brief ファイルの特徴量を引く
+  ///
+  /// @param file ファイル
+  /// @param features 特徴量を返す変数へのポインタ
+  /// @return 保存されていなければ false を返す
+  bool find( const boost::filesystem::path& file, ImageFeatures* features ) const;
+
+private:
+
+  std::unique_ptr< MappedFile > file_;                            // 写像した特徴量ファイル
+  std::string rootPath_;                                          // ルートパス
+  std::uint64_t rows_;                                            // 行数
+  std::vector< std::pair< std::uint64_t, std::uint64_t > > keys_; // パスのハッシュ値と行(ハッシュ値の順)
+};
+
+/**
+   @brief ファイル毎の特徴量の索引
+
+   知覚ハッシュは類似画像の索引に、色のヒストグラムは色の索引に登録する。
+   特徴量ファイルは列指向とし、パスのハッシュ値・更新時刻・知覚ハッシュ・色の区分毎の列を順に置く。
+**/
+class ImageIndex
+{
+public:
+
+  /// @brief files 件のファイルを対象に空にする
+  ///
+  /// @param files ファイル数
+  void assign( std::size_t files );
+
+  /// @brief 特徴量を登録する
+  ///
+  /// @param file ファイルの識別番号
+  /// @param features 特徴量
+  void insert( FileId file, const ImageFeatures& features );
+
+  /// @brief 特徴量の登録を取り消す
+  ///
+  /// @param file ファイルの識別番号
+  void erase( FileId file );
+
+  /// @brief 特徴量が登録済みか？
+  ///
+  /// @param file ファイルの識別番号
+  /// @return 登録済みなら true を返す
+  bool indexed( FileId file ) const
+  { return( similar_.indexed( file ) ); }
+
+  /// @brief 登録済みのファイル数を返す
+  ///
+  /// @return ファイル数
+  std::size_t size() const
+  { return( similar_.size() ); }
+
+  /// @brief 登録済みの特徴量を返す
+  ///
+  /// @param file ファイルの識別番号(登録済みであること)
+  /// @return 特徴量
+  ImageFeatures features( FileId file ) const
+  { return( ImageFeatures{ mtimes_[file], similar_.hash( file ), colors_.histogram( file ) } ); }
+
+  /// @brief 類似画像の索引を返す
+  ///
+  /// @return 類似画像の索引
+  const SimilarIndex& similar() const
+  { return( similar_ ); }
+
+  /// @brief 色の索引を返す
+  ///
+  /// @return 色の索引
+  const ColorIndex& colors() const
+  { return( colors_ ); }
+
+  /// @brief rootPath 以下の登録済みの特徴量を特徴量ファイルに書き込む
+  ///
+  /// @param fileName 特徴量ファイルの名前
+  /// @param rootPath ルートパス
+  /// @param fileData ファイルをキーとするタグリスト
+  void write( const std::string& fileName, const std::string& rootPath, const FileData& fileData ) const;
+
+private:
+
+  SimilarIndex similar_;               // 類似画像の索引
+  ColorIndex colors_;                  // 色の索引
+  std::vector< std::int64_t > mtimes_; // 特徴量を求めたときの更新時刻
+};
+
+#endif
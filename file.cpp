@@ -2,11 +2,20 @@
    file.cpp : ファイル操作用関数
 **/
 #include "file.hpp"
+#include "tagtree.hpp"
+#include "tagparse.hpp"
+
+#include <sstream>
+#include <algorithm>
+#include <iterator>
+#include <future>
+#include <cstring>
 
 using std::string;
 using std::map;
 using std::set;
 using std::vector;
+using std::size_t;
 
 using std::ifstream;
 using std::ofstream;
@@ -14,25 +23,414 @@ using std::endl;
 
 namespace fs = boost::filesystem;
 
+const FileData::size_type FileData::CHUNK;
+const TagSet FileData::EMPTY;
+
+/*
+  FileData::assign : パスの表を作り直し、空のタグリストのチャンクを作る
+*/
+void FileData::assign( vector< fs::path > files )
+{
+  auto paths = std::make_shared< PathTable >();
+  paths->assign( std::move( files ) );
+  assign( std::move( paths ) );
+}
+
+/*
+  FileData::assign : 作成済みのパスの表を共有し、チャンクを作り直す
+*/
+void FileData::assign( std::shared_ptr< const PathTable > paths )
+{
+  clear();
+
+  size_ = paths->size();
+  paths_ = std::move( paths );
+
+  chunks_.reserve( ( size_ + CHUNK - 1 ) / CHUNK );
+  for ( size_type first = 0 ; first < size_ ; first += CHUNK )
+    chunks_.push_back( std::make_shared< Chunk >( std::min( CHUNK, size_ - first ) ) );
+}
+
+/*
+  FileData::reset : パスの表を共有し、増えた識別番号の分だけ空のチャンク(nullptr)を加える
+
+  最後のチャンクが CHUNK 件に満たなければ、増えた分を加えた大きさで作り直す
+*/
+void FileData::reset( std::shared_ptr< const PathTable > paths )
+{
+  size_type size = paths->size();
+  paths_ = std::move( paths );
+  if ( size == size_ ) return;
+
+  if ( size_ % CHUNK != 0 && chunks_.back() ) {
+    auto chunk = std::make_shared< Chunk >( std::min( CHUNK, size - ( chunks_.size() - 1 ) * CHUNK ) );
+    std::copy( chunks_.back()->tags.begin(), chunks_.back()->tags.end(), chunk->tags.begin() );
+    chunks_.back() = std::move( chunk );
+  }
+  chunks_.resize( ( size + CHUNK - 1 ) / CHUNK );
+  size_ = size;
+}
+
+/*
+  FileData::clear : チャンクを手放す
+
+  コピーと共有中のチャンクは、コピーがなくなったときに解放される
+*/
+void FileData::clear()
+{
+  paths_ = std::make_shared< PathTable >();
+  vector< std::shared_ptr< Chunk > >().swap( chunks_ );
+  size_ = 0;
+}
+
+/*
+  FileData::edit : id のチャンクがなければ作り、共有中なら複製してから、タグリストを返す
+
+  他の参照がなくなったことを見てから書き込むため、参照を手放したスレッドの読み込みより後になるよう同期する
+*/
+TagSet& FileData::edit( FileId id )
+{
+  std::shared_ptr< Chunk >& chunk = chunks_[id / CHUNK];
+  if ( ! chunk )
+    chunk = std::make_shared< Chunk >( std::min( CHUNK, size_ - id / CHUNK * CHUNK ) );
+  else if ( chunk.use_count() > 1 )
+    chunk = std::make_shared< Chunk >( *chunk );
+  else
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+  return( chunk->tags[id % CHUNK] );
+}
+
+const TagData::size_type TagData::CHUNK;
+
+/*
+  TagData::find : tag を含みうるチャンクの中を探す
+*/
+TagData::const_iterator TagData::find( const string& tag ) const
+{
+  size_type c = locate( tag );
+  if ( c == chunks_.size() ) return( end() );
+
+  const Chunk& chunk = *( chunks_[c] );
+  auto t = chunk.find( tag );
+
+  return( ( t == chunk.end() ) ? end() : const_iterator( &chunks_, c, t ) );
+}
+
+/*
+  TagData::find : 見つかった場合だけ、チャンクを複製してから位置を返す
+
+  ないタグを探してもチャンクは複製しない
+*/
+TagData::iterator TagData::find( const string& tag )
+{
+  size_type c = locate( tag );
+  if ( c == chunks_.size() || chunks_[c]->count( tag ) == 0 )
+    return( iterator( &chunks_, chunks_.size(), Chunk::iterator() ) );
+
+  Chunk& chunk = edit( c );
+
+  return( iterator( &chunks_, c, chunk.find( tag ) ) );
+}
+
+/*
+  TagData::operator[] : tag のチャンク(全てのタグより後なら最後のチャンク)に追加し、大きくなりすぎたら 2 つに分ける
+
+  分割はノードを付け替えるだけなので、要素への参照は無効にならない
+*/
+Posting& TagData::operator[]( const string& tag )
+{
+  size_type c = locate( tag );
+  if ( c == chunks_.size() ) {
+    if ( chunks_.empty() )
+      chunks_.push_back( std::make_shared< Chunk >() );
+    c = chunks_.size() - 1;
+  }
+
+  Chunk& chunk = edit( c );
+  auto res = chunk.emplace( tag, Posting() );
+  if ( ! res.second ) return( res.first->second );
+  ++size_;
+
+  if ( chunk.size() > 2 * CHUNK ) {
+    auto next = std::make_shared< Chunk >();
+    auto half = std::next( chunk.begin(), chunk.size() / 2 );
+    while ( half != chunk.end() )
+      next->insert( next->end(), chunk.extract( half++ ) );
+    chunks_.insert( chunks_.begin() + c + 1, std::move( next ) );
+  }
+
+  return( res.first->second );
+}
+
+/*
+  TagData::erase : tag を削除し、空になったチャンクは表から外す
+*/
+TagData::size_type TagData::erase( const string& tag )
+{
+  size_type c = locate( tag );
+  if ( c == chunks_.size() || chunks_[c]->count( tag ) == 0 ) return( 0 );
+
+  Chunk& chunk = edit( c );
+  chunk.erase( tag );
+  --size_;
+  if ( chunk.empty() )
+    chunks_.erase( chunks_.begin() + c );
+
+  return( 1 );
+}
+
+/*
+  TagData::append : 最後のチャンクが CHUNK 件になるまで詰め、以降は新しいチャンクに追加する
+*/
+void TagData::append( const string& tag, Posting files )
+{
+  if ( chunks_.empty() || chunks_.back()->size() >= CHUNK )
+    chunks_.push_back( std::make_shared< Chunk >() );
+
+  Chunk& chunk = edit( chunks_.size() - 1 );
+  chunk.emplace_hint( chunk.end(), tag, std::move( files ) );
+  ++size_;
+}
+
+/*
+  TagData::locate : 最後のタグが tag 以上である最初のチャンクを二分探索する
+*/
+TagData::size_type TagData::locate( const string& tag ) const
+{
+  StrLess less;
+  size_type first = 0;
+  size_type last = chunks_.size();
+  while ( first < last ) {
+    size_type middle = first + ( last - first ) / 2;
+    if ( less( chunks_[middle]->rbegin()->first, tag ) )
+      first = middle + 1;
+    else
+      last = middle;
+  }
+
+  return( first );
+}
+
+/*
+  TagData::edit : chunk が共有中なら複製してから返す
+
+  FileData::edit と同様に、参照を手放したスレッドの読み込みより後になるよう同期する
+*/
+TagData::Chunk& TagData::edit( size_type chunk )
+{
+  std::shared_ptr< Chunk >& p = chunks_[chunk];
+  if ( p.use_count() > 1 )
+    p = std::make_shared< Chunk >( *p );
+  else
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+  return( *p );
+}
+
+namespace
+{
+  /*
+    ScanFiles : rootPath 内の全ファイルのパスを返す
+
+    progress : 見つけたファイル数を数える変数へのポインタ(nullptr なら数えない)
+  */
+  vector< fs::path > ScanFiles( const string& rootPath, ReadProgress* progress )
+  {
+    fs::path p( rootPath );
+
+    if ( ! fs::exists( p ) )
+      throw std::runtime_error( "指定したパスは存在しません。" );
+
+    vector< fs::path > files;
+    for ( auto rdi = fs::recursive_directory_iterator( p ) ;
+          rdi != fs::recursive_directory_iterator() ; ++rdi ) {
+      if ( fs::is_directory( *rdi ) ) continue;
+      files.push_back( *rdi );
+      if ( progress != nullptr ) ++( progress->scanned );
+    }
+
+    return( files );
+  }
+} // namespace
+
 /*
   InitTagData : rootPath 内の全ファイルに対してリスト fileData と tagData を作成する
 */
 void InitTagData( const string& rootPath, FileData* fileData, TagData* tagData )
 {
-  fs::path p( rootPath );
+  vector< fs::path > files = ScanFiles( rootPath, nullptr );
+  tagData->clear();
+  fileData->assign( std::move( files ) );
+}
 
-  if ( ! fs::exists( p ) )
-    throw std::runtime_error( "指定したパスは存在しません。" );
+/*
+  RootRange : rootPath 以上の最初のファイルから、パスの先頭が rootPath の要素と一致する間を範囲とする
+*/
+void RootRange( const FileData& fileData, const string& rootPath, FileId* first, FileId* last )
+{
+  fs::path root( rootPath );
 
-  fileData->clear();
-  tagData->clear();
-  for ( auto rdi = fs::recursive_directory_iterator( p ) ;
-        rdi != fs::recursive_directory_iterator() ; ++rdi ) {
-    if ( fs::is_directory( *rdi ) ) continue;
-    fileData->insert( std::make_pair( *rdi, set< string, StrLess >() ) );
+  *first = fileData.paths().lowerBound( root );
+  for ( *last = *first ; *last < fileData.size() ; ++*last ) {
+    fs::path p = fileData.path( *last );
+    if ( std::mismatch( root.begin(), root.end(), p.begin(), p.end() ).first != root.end() ) break;
   }
 }
 
+/*
+  AddTag : タグの登録を行う
+
+  tag : 登録するタグ
+  file : 登録対象のファイルの識別番号
+  fileData : ファイルをキーとしたタグリスト
+  tagData : タグをキーとしたファイルリスト
+  tagTree : タグの階層(nullptr なら更新しない)
+
+  戻り値 : タグがすでに登録されていた場合は false を返す
+*/
+bool AddTag( const string& tag, FileId file, FileData* fileData, TagData* tagData, TagTree* tagTree )
+{
+  // 付いているタグでチャンクを複製しないよう、先に確かめる
+  if ( ( *fileData )[file].count( tag ) != 0 )
+    return( false );
+  fileData->edit( file ).insert( tag );
+
+  auto& t = ( *tagData )[tag];
+  t.insert( file );
+  if ( tagTree != nullptr )
+    tagTree->update( file, tag, true, ( *fileData )[file] );
+
+  return( true );
+}
+
+/*
+  RemoveTag : タグの削除を行う
+
+  tag : 削除するタグ
+  file : 削除対象のファイルの識別番号
+  fileData : ファイルをキーとしたタグリスト
+  tagData : タグをキーとしたファイルリスト
+  tagTree : タグの階層(nullptr なら更新しない)
+
+  戻り値 : タグが登録されていなかった場合は false を返す
+*/
+bool RemoveTag( const string& tag, FileId file, FileData* fileData, TagData* tagData, TagTree* tagTree )
+{
+  // 付いていないタグでチャンクを複製しないよう、先に確かめる
+  if ( ( *fileData )[file].count( tag ) == 0 )
+    return( false );
+  fileData->edit( file ).erase( tag );
+
+  auto t = tagData->find( tag );
+  if ( t != tagData->end() )
+    t->second.erase( file );
+  if ( tagTree != nullptr )
+    tagTree->update( file, tag, false, ( *fileData )[file] );
+
+  return( true );
+}
+
+/*
+  ChangeTagName : タグ名の変更(変更後のタグがすでにあれば、そのタグにまとめる)
+
+  oldTag : 変更対象のタグ
+  newTag : 新しいタグ
+  fileData : ファイルをキーとするタグリストへのポインタ
+  tagData : タグをキーとするファイルリストへのポインタ
+  tagTree : タグの階層(nullptr なら更新しない)
+*/
+void ChangeTagName( const string& oldTag, const string& newTag, FileData* fileData, TagData* tagData, TagTree* tagTree )
+{
+  auto t = tagData->find( oldTag );
+  if ( t == tagData->end() ) return;
+
+  const auto& fileList = t->second;
+  for ( auto f = fileList.begin() ; f != fileList.end() ; ++f ) {
+    auto& tagList = fileData->edit( *f );
+    tagList.erase( oldTag );
+    tagList.insert( newTag );
+  }
+
+  // 先に変更前のタグを外す(大文字と小文字だけの変更でも消えないように)
+  Posting files = t->second;
+  tagData->erase( t );
+  auto dest = tagData->find( newTag );
+  if ( dest != tagData->end() && ! dest->second.empty() ) {
+    // 変更後のタグがすでに付いていれば、そのファイルリストにまとめる
+    for ( auto f = files.begin() ; f != files.end() ; ++f )
+      dest->second.insert( *f );
+  } else {
+    if ( dest != tagData->end() )
+      tagData->erase( dest );
+    ( *tagData )[newTag] = std::move( files );
+  }
+
+  if ( tagTree != nullptr )
+    tagTree->rename( oldTag, newTag, *tagData );
+}
+
+/*
+  MoveTag : ファイルリストの集合演算でタグを付け替え、対象のファイルのタグリストだけを書き換える
+
+  tag : 付け替えるタグ
+  newTag : 付け替え先のタグ
+  files : 対象のファイル(昇順)
+  fileData : ファイルをキーとするタグリストへのポインタ
+  tagData : タグをキーとするファイルリストへのポインタ
+  moved : tag を外したファイル
+  added : newTag を新たに付けたファイル
+  tagTree : タグの階層(nullptr なら更新しない)
+*/
+void MoveTag( const string& tag, const string& newTag, const vector< FileId >& files,
+              FileData* fileData, TagData* tagData, vector< FileId >* moved, vector< FileId >* added,
+              TagTree* tagTree )
+{
+  moved->clear();
+  added->clear();
+
+  StrLess less;
+  if ( ! less( tag, newTag ) && ! less( newTag, tag ) ) return;
+  auto t = tagData->find( tag );
+  if ( t == tagData->end() ) return;
+
+  Posting& from = t->second;
+  std::set_intersection( from.begin(), from.end(), files.begin(), files.end(), std::back_inserter( *moved ) );
+  if ( moved->empty() ) return;
+
+  Posting& into = ( *tagData )[newTag];
+  std::set_difference( moved->begin(), moved->end(), into.begin(), into.end(), std::back_inserter( *added ) );
+
+  // ファイルリストは作り直す
+  vector< FileId > rest;
+  rest.reserve( from.size() - moved->size() );
+  std::set_difference( from.begin(), from.end(), moved->begin(), moved->end(), std::back_inserter( rest ) );
+  vector< FileId > merged;
+  merged.reserve( into.size() + added->size() );
+  std::set_union( into.begin(), into.end(), added->begin(), added->end(), std::back_inserter( merged ) );
+  from.assign( rest.begin(), rest.end() );
+  into.assign( merged.begin(), merged.end() );
+
+  // タグリストは対象のファイルだけを書き換える
+  for ( auto f = moved->begin() ; f != moved->end() ; ++f ) {
+    auto& tagList = fileData->edit( *f );
+    tagList.erase( tag );
+    tagList.insert( newTag );
+  }
+
+  // 階層の集約したファイルリストは、変更後のタグリストで祖先の分だけ更新する
+  if ( tagTree != nullptr ) {
+    for ( auto f = moved->begin() ; f != moved->end() ; ++f )
+      tagTree->update( *f, tag, false, ( *fileData )[*f] );
+    for ( auto f = added->begin() ; f != added->end() ; ++f )
+      tagTree->update( *f, newTag, true, ( *fileData )[*f] );
+  }
+
+  // ( *tagData )[newTag] でチャンクが分かれた場合に t は使えないため、タグで削除する
+  if ( from.empty() )
+    tagData->erase( tag );
+}
+
 /*
   GetValueFromKey : data のキーが key であるかチェックし、そうなら value に値を登録する
 
@@ -53,6 +451,239 @@ bool GetValueFromKey( const string& data, const string& key, string* value )
 const string PATH_KEY = "path="; // パス名に対するキー
 const string FILE_KEY = "file="; // ファイル名に対するキー
 const string TAG_KEY = "tag=";   // タグに対するキー
+const string SEARCH_KEY = "search="; // 保存した検索条件の名前に対するキー
+const string QUERY_KEY = "query=";   // 保存した検索条件の検索文字列に対するキー
+const string HASH_KEY = "hash=";     // ファイルの内容のハッシュ値と属性に対するキー
+const string CHILD_KEY = "child=";   // 親タグを持つタグに対するキー
+const string PARENT_KEY = "parent="; // 親タグに対するキー
+const string ALIAS_KEY = "alias=";   // 別名に対するキー
+const string IMPLY_KEY = "implies="; // 他のタグを含意するタグに対するキー
+const string TARGET_KEY = "target="; // 別名・含意の対象のタグに対するキー
+const string GROUP_KEY = "group=";   // ファイルのグループの番号に対するキー
+const string DIR_KEY = "dir=";       // 索引のディレクトリに対するキー
+const string RANGE_KEY = "range=";   // 索引のディレクトリ以下のレコードの範囲に対するキー
+const string DICTIONARY_KEY = "dictionary="; // 索引のタグに対するキー
+const string DIRS_KEY = "dirs=";     // 索引のタグが付いたファイルを持つディレクトリに対するキー
+const string INDEX_KEY = "index=";   // 索引の開始位置に対するキー
+
+namespace
+{
+  /*
+    InsertTag : ファイル id にタグ tag を付ける
+
+    id が昇順に現れる場合は、ファイルリストの最後のチャンクへの追加になる
+  */
+  void InsertTag( FileId id, const string& tag, FileData* fileData, TagData* tagData )
+  {
+    fileData->edit( id ).insert( tag );
+    ( *tagData )[tag].insert( id );
+  }
+
+  /*
+    IndexBegin : 末尾の index= の行から索引(最初の dir= の行)の先頭を求める
+
+    index= がないか、指す位置が records より前か dir= の行でなければ last を返す
+  */
+  const char* IndexBegin( const char* first, const char* last, const char* records )
+  {
+    const char* end = last;
+    while ( end > first && *( end - 1 ) == '\n' )
+      --end;
+    const char* tail = end;
+    while ( tail > first && *( tail - 1 ) != '\n' )
+      --tail;
+
+    string value;
+    std::uint64_t offset = 0;
+    if ( ! GetValueFromKey( string( tail, end ), INDEX_KEY, &value ) || ! ( std::istringstream( value ) >> offset ) )
+      return( last );
+    if ( offset < static_cast< std::uint64_t >( records - first ) || offset >= static_cast< std::uint64_t >( last - first ) )
+      return( last );
+
+    const char* index = first + offset;
+    return( ( static_cast< size_t >( last - index ) >= DIR_KEY.size() &&
+              std::memcmp( index, DIR_KEY.data(), DIR_KEY.size() ) == 0 ) ? index : last );
+  }
+} // namespace
+
+/*
+  ParseHash : hash= の値を hash と stamp に読み取る
+
+  形式は [16 進数のハッシュ値] [デバイス] [i ノード] [サイズ] [更新時刻]
+*/
+bool ParseHash( const string& value, ContentHash* hash, FileStamp* stamp )
+{
+  std::istringstream iss( value );
+  iss >> std::hex >> *hash >> std::dec >> stamp->device >> stamp->inode >> stamp->size >> stamp->mtime;
+
+  return( ! iss.fail() && *hash != NO_HASH );
+}
+
+/*
+  MatchOrphans : パスが見つからなかったファイルを、タグもグループもないファイルから探してタグとグループを付け直す
+
+  まず属性が一致するファイル(同じファイルシステム内での移動・名前変更)を探し、
+  残りはサイズが同じファイルだけハッシュ値を求めて内容の一致で探す。
+
+  戻り値 : タグを付け直したファイル数
+*/
+size_t MatchOrphans( const vector< Orphan >& orphans, FileData* fileData, TagData* tagData, GroupData* groups, HashCache* hashCache )
+{
+  if ( orphans.empty() ) return( 0 );
+
+  map< FileStamp, size_t > byStamp; // 属性をキーとする orphans の位置
+  set< std::uint64_t > sizes;       // orphans のサイズ
+  for ( size_t i = 0 ; i < orphans.size() ; ++i ) {
+    byStamp.emplace( orphans[i].stamp, i );
+    sizes.insert( orphans[i].stamp.size );
+  }
+
+  vector< bool > matched( orphans.size(), false );
+  size_t relinked = 0;
+  auto relink = [&]( size_t i, FileId id ) {
+    for ( auto t = orphans[i].tags.begin() ; t != orphans[i].tags.end() ; ++t )
+      InsertTag( id, *t, fileData, tagData );
+    if ( orphans[i].group != 0 ) ( *groups )[id] = orphans[i].group;
+    matched[i] = true;
+    ++relinked;
+  };
+
+  // 属性が一致するファイル
+  vector< FileId > ids;        // 内容を調べるファイル
+  vector< fs::path > files;    // ids のパス
+  vector< FileStamp > stamps;  // ids の属性
+  for ( FileId id = 0 ; id < fileData->size() ; ++id ) {
+    FileStamp stamp;
+    if ( ! ( *fileData )[id].empty() || ( *groups )[id] != 0 ) continue;
+    fs::path file = fileData->path( id );
+    if ( ! GetFileStamp( file, &stamp ) ) continue;
+    auto o = byStamp.find( stamp );
+    if ( o != byStamp.end() && ! matched[o->second] ) {
+      relink( o->second, id );
+    } else if ( sizes.count( stamp.size ) > 0 ) {
+      ids.push_back( id );
+      files.push_back( file );
+      stamps.push_back( stamp );
+    }
+  }
+  if ( relinked == orphans.size() ) return( relinked );
+
+  // 内容が一致するファイル
+  std::multimap< ContentHash, size_t > byHash; // ハッシュ値をキーとする orphans の位置
+  for ( size_t i = 0 ; i < orphans.size() ; ++i )
+    if ( ! matched[i] ) byHash.emplace( orphans[i].hash, i );
+  vector< ContentHash > hashes = hashCache->hash( files, stamps );
+  for ( size_t j = 0 ; j < ids.size() ; ++j ) {
+    auto range = byHash.equal_range( hashes[j] );
+    for ( auto o = range.first ; o != range.second ; ++o ) {
+      if ( matched[o->second] || orphans[o->second].stamp.size != stamps[j].size ) continue;
+      relink( o->second, ids[j] );
+      break;
+    }
+  }
+
+  return( relinked );
+}
+
+namespace
+{
+  /*
+    DirectoryIndex : タグファイルの末尾に書き込むディレクトリの索引
+
+    ファイルはパスの順に書くため、ディレクトリ以下のファイルのレコードは連続した範囲になる。
+    書き込み中は根から現在のディレクトリまでを開いておき、別のディレクトリに移るときに閉じて範囲の末尾を決める。
+  */
+  class DirectoryIndex
+  {
+  public:
+
+    /*
+      add : ルートパスからの相対パスが dir のファイルのレコードを、offset から書く前に登録する
+    */
+    void add( const fs::path& dir, std::uint64_t offset, const TagSet& tags )
+    {
+      if ( open_.empty() ) {
+        open_.push_back( 0 );
+        dirs_.push_back( Entry{ string(), string(), offset, 0, 0, 0 } );
+      }
+
+      // 開いているディレクトリと一致する深さまで残して閉じ、残りを開く
+      vector< string > names;
+      for ( auto n = dir.begin() ; n != dir.end() ; ++n )
+        names.push_back( n->native() );
+      size_t depth = 0;
+      while ( depth < names.size() && depth + 1 < open_.size() && dirs_[open_[depth + 1]].name == names[depth] )
+        ++depth;
+      close( depth + 1, offset );
+      for ( ; depth < names.size() ; ++depth ) {
+        string path = ( fs::path( dirs_[open_.back()].path ) / names[depth] ).native();
+        open_.push_back( static_cast< unsigned >( dirs_.size() ) );
+        dirs_.push_back( Entry{ path, names[depth], offset, 0, 0, 0 } );
+      }
+
+      for ( auto o = open_.begin() ; o != open_.end() ; ++o ) {
+        ++dirs_[*o].files;
+        if ( ! tags.empty() ) ++dirs_[*o].tagged;
+      }
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+        vector< unsigned >& dirs = dictionary_[*t];
+        if ( dirs.empty() || dirs.back() != open_.back() ) dirs.push_back( open_.back() );
+      }
+    }
+
+    /*
+      write : 全てのディレクトリを offset で閉じ、索引を書き込む(offset は索引の開始位置)
+    */
+    void write( ofstream& ofs, std::uint64_t offset )
+    {
+      close( 0, offset );
+      for ( auto d = dirs_.begin() ; d != dirs_.end() ; ++d ) {
+        ofs << DIR_KEY << d->path << endl;
+        ofs << RANGE_KEY << d->begin << ' ' << d->end << ' ' << d->files << ' ' << d->tagged << endl;
+      }
+      for ( auto t = dictionary_.begin() ; t != dictionary_.end() ; ++t ) {
+        // 子のディレクトリを挟んで同じディレクトリに戻る場合があるため、重複を除く
+        vector< unsigned >& dirs = t->second;
+        std::sort( dirs.begin(), dirs.end() );
+        dirs.erase( std::unique( dirs.begin(), dirs.end() ), dirs.end() );
+        ofs << DICTIONARY_KEY << t->first << endl;
+        ofs << DIRS_KEY;
+        for ( auto d = dirs.begin() ; d != dirs.end() ; ++d )
+          ofs << ( ( d == dirs.begin() ) ? "" : " " ) << *d;
+        ofs << endl;
+      }
+      ofs << INDEX_KEY << offset << endl;
+    }
+
+  private:
+
+    // 索引のディレクトリ
+    struct Entry
+    {
+      string path;         // ルートパスからの相対パス
+      string name;         // ディレクトリ名
+      std::uint64_t begin; // 以下のレコードの開始位置
+      std::uint64_t end;   // 以下のレコードの終了位置
+      size_t files;        // 以下のファイル数
+      size_t tagged;       // 以下のタグの付いたファイル数
+    };
+
+    /*
+      close : 開いているディレクトリを depth 個まで閉じる
+    */
+    void close( size_t depth, std::uint64_t offset )
+    {
+      while ( open_.size() > depth ) {
+        dirs_[open_.back()].end = offset;
+        open_.pop_back();
+      }
+    }
+
+    vector< Entry > dirs_;     // 行きがけ順のディレクトリ
+    vector< unsigned > open_;  // 開いているディレクトリ(根から順の dirs_ の位置)
+    map< string, vector< unsigned >, StrLess > dictionary_; // タグをキーとする直接のファイルに付いたディレクトリ
+  };
+} // namespace
 
 /*
   ReadTagData : fileName からタグを読み取り、fileData と tagData に登録する
@@ -60,70 +691,241 @@ const string TAG_KEY = "tag=";   // タグに対するキー
   フォーマットは次のようにする
 
   path=[root path]
+  search=[name of search1]
+  query=[query of search1]
+  :
+  child=[name of tag1]
+  parent=[name of parent of tag1]
+  :
+  alias=[alias of tag1]
+  target=[name of tag1]
+  :
+  implies=[name of tag1]
+  target=[name of tag implied by tag1]
+  :
   file=[name of file1]
+  hash=[hash of file1] [device] [inode] [size] [mtime]
+  group=[number of group of file1]
   tag=[name of tag1]
   :
   file=[name of file2]
   :
+  dir=[name of directory1]
+  range=[begin] [end] [files] [tagged files]
+  :
+  dictionary=[name of tag1]
+  dirs=[index of directory] ...
+  :
+  index=[offset of first dir=]
+
+  hash= はタグの付いたファイルとグループに属するファイルだけに、group= はグループに属するファイルだけに書かれる。
+  グループの番号は保存の度に振り直す。
+  dir= 以降は索引で、ここでは読まない。ディレクトリは行きがけ順に並べ、range= はディレクトリ以下の
+  レコードのバイト範囲と、ファイル数・タグの付いたファイル数とする。dirs= はタグが直接のファイルに付いた
+  ディレクトリの番号(dir= の順)とする。
+  パスが見つからないファイルは、hash= を手掛かりに移動・名前変更先を探す。
+
+  ディレクトリの走査とタグファイルの読み込みはどちらも入出力待ちが主なため、path= を読んだら走査を
+  別のスレッドで始め、並行してファイルのレコードを保留の表に読む。識別番号は全てのパスが揃うまで
+  決まらないため、両方が終わってから保留の表をパスの順に突き合わせる。
+  設定は最初の file= までに書かれているものだけを読む。ファイルのレコードはメモリに写像し、file= の行で
+  区切った区間毎に並列に読み、突き合わせも区間毎の部分的な索引として並列に作ってからタグ毎にマージする
+  (tagparse.hpp を参照)。
+
+  戻り値 : 移動・名前変更先を見つけてタグを付け直したファイル数
 */
-void ReadTagData( const string& fileName, string* rootPath, FileData* fileData, TagData* tagData )
+size_t ReadTagData( const string& fileName, string* rootPath, FileData* fileData, TagData* tagData, SearchData* searchData, TagParents* tagParents, TagRuleData* tagRules, GroupData* groups, HashCache* hashCache, ReadProgress* progress )
 {
   if ( ! fs::exists( fs::path( fileName ) ) )
     throw std::runtime_error( "指定したタグファイルは存在しません。" );
 
-  ifstream ifs( fileName );
-  if ( ifs.fail() )
-    throw std::runtime_error( "タグファイルのオープンに失敗しました。" );
-
+  MappedFile mapped( fileName );
+  const char* line = mapped.begin(); // 次の行の先頭
   string data; // 1行読み込み
+  auto getLine = [&line, &mapped, &data]() {
+    if ( line >= mapped.end() ) return( false );
+    const char* eol = static_cast< const char* >( std::memchr( line, '\n', mapped.end() - line ) );
+    if ( eol == nullptr ) eol = mapped.end();
+    data.assign( line, eol );
+    line = ( eol == mapped.end() ) ? eol : eol + 1;
+    return( true );
+  };
+
   string buffer; // ルートパス用のバッファ
   //rootPath->clear();
-  while ( std::getline( ifs, data ) ) {
-    if ( GetValueFromKey( data, PATH_KEY, &buffer ) ) {
-      InitTagData( buffer, fileData, tagData );
+  while ( getLine() ) {
+    if ( GetValueFromKey( data, PATH_KEY, &buffer ) )
       break;
-    }
   }
   if ( buffer.empty() ) {
     throw std::runtime_error( "ルートパスの取得に失敗しました。" );
   }
   *rootPath = buffer;
 
-  string file; // 対象ファイル名
-  string tag;  // タグ名
-  auto fit = fileData->end();
-  while ( std::getline( ifs, data ) ) {
-    if ( GetValueFromKey( data, FILE_KEY, &file ) ) {
-      fit = fileData->find( fs::path( *rootPath + "/" + file ).lexically_normal() );
+  // ディレクトリの走査を別のスレッドで始める(例外は get() で送出し直し、途中で抜けても future の破棄で終わりを待つ)
+  std::future< vector< fs::path > > scanned = std::async( std::launch::async, ScanFiles, buffer, progress );
+
+  // 最初のレコードまでの設定を読む
+  string search; // 検索条件の名前
+  string query;  // 検索文字列
+  string child;  // 親タグを持つタグ
+  string parent; // 親タグ
+  string alias;  // 別名
+  string implier; // 他のタグを含意するタグ
+  string target;  // 別名・含意の対象のタグ
+  const char* records = line; // ファイルのレコードの先頭
+  searchData->clear();
+  tagParents->clear();
+  *tagRules = TagRuleData();
+  while ( getLine() ) {
+    if ( data.compare( 0, FILE_KEY.size(), FILE_KEY ) == 0 || data.compare( 0, DIR_KEY.size(), DIR_KEY ) == 0 )
+      break;
+    records = line;
+    if ( GetValueFromKey( data, SEARCH_KEY, &search ) )
+      continue;
+    if ( GetValueFromKey( data, QUERY_KEY, &query ) ) {
+      if ( ! search.empty() ) ( *searchData )[search] = query;
+      search.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, CHILD_KEY, &child ) )
+      continue;
+    if ( GetValueFromKey( data, PARENT_KEY, &parent ) ) {
+      if ( ! child.empty() ) ( *tagParents )[child] = parent;
+      child.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, ALIAS_KEY, &alias ) ) {
+      implier.clear();
       continue;
     }
-    if ( GetValueFromKey( data, TAG_KEY, &tag ) ) {
-      if ( fit == fileData->end() ) continue; // パスが見つからない場合は無視される
-      ( fit->second ).insert( tag );
-      auto tit = tagData->find( tag );
-      if ( tit == tagData->end() )
-        tit = ( tagData->insert( std::make_pair( tag, set< fs::path >() ) ) ).first;
-      ( tit->second ).insert( fit->first );
+    if ( GetValueFromKey( data, IMPLY_KEY, &implier ) ) {
+      alias.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, TARGET_KEY, &target ) ) {
+      if ( ! alias.empty() )
+        tagRules->aliases[alias] = target;
+      else if ( ! implier.empty() )
+        tagRules->implies.emplace( implier, target );
+      alias.clear();
+      implier.clear();
+    }
+  }
+
+  // 走査と並行して、ファイルのレコードを区間に分けて並列に読む(末尾の索引の手前まで)
+  unsigned threads = ParseThreads();
+  vector< RecordChunk > chunks = ParseRecords( records, IndexBegin( mapped.begin(), mapped.end(), records ), threads, progress );
+
+  // 走査の終わりを待ち、区間毎にパスを突き合わせてからタグ毎にマージする
+  vector< fs::path > files = scanned.get();
+  if ( progress != nullptr ) progress->joining = true;
+  tagData->clear();
+  fileData->assign( std::move( files ) );
+  groups->assign( fileData->size(), 0 );
+  hashCache->clear();
+
+  vector< PartialIndex > partials = IndexRecords( chunks, *rootPath, *fileData, threads );
+  FillTagSets( chunks, partials, fileData, threads );
+  MergePostings( partials, tagData, threads );
+
+  vector< Orphan > orphans; // パスが見つからなかったファイル
+  for ( size_t i = 0 ; i < chunks.size() ; ++i ) {
+    for ( size_t j = 0 ; j < chunks[i].size() ; ++j ) {
+      PendingRecord& r = chunks[i][j];
+      FileId id = partials[i].ids[j];
+
+      Orphan record;
+      bool hashed = ! r.hash.empty() && ParseHash( r.hash, &( record.hash ), &( record.stamp ) );
+      if ( id == NO_FILE ) {
+        // パスもハッシュ値も見つからない場合は無視される
+        if ( ! hashed ) continue;
+        record.tags = std::move( r.tags );
+        record.group = r.group;
+        orphans.push_back( std::move( record ) );
+        continue;
+      }
+
+      if ( hashed ) hashCache->insert( record.stamp, record.hash );
+      ( *groups )[id] = r.group;
     }
   }
+
+  return( MatchOrphans( orphans, fileData, tagData, groups, hashCache ) );
 }
 
 /*
-  WriteTagData : ルートパス rootPath とタグ fileData を fileName で指定したファイルに書き込む
+  WriteTagData : ルートパス rootPath とタグ fileData、検索条件 searchData、タグの親子関係 tagParents、規則 tagRules、
+                 ファイルのグループ groups を fileName で指定したファイルに書き込む
+
+  タグの付いたファイルとグループに属するファイルにはハッシュ値を添える(属性が変わらないファイルは hashCache から求める)
 */
-void WriteTagData( const string& fileName, const string& rootPath, const FileData& fileData )
+void WriteTagData( const string& fileName, const string& rootPath, const FileData& fileData, const SearchData& searchData, const TagParents& tagParents, const TagRuleData& tagRules, const GroupData& groups, HashCache* hashCache )
 {
   fs::path writeFile( fileName );
   fs::path tempFile( fileName + ".tmp" );
 
+  FileId first, last; // rootPath 以下のファイルの範囲
+  RootRange( fileData, rootPath, &first, &last );
+
+  vector< FileId > ids;       // タグの付いたファイルとグループに属するファイル
+  vector< fs::path > files;   // ids のパス
+  vector< FileStamp > stamps; // ids の属性
+  for ( FileId id = first ; id < last ; ++id ) {
+    FileStamp stamp;
+    if ( ( fileData[id].empty() && groups[id] == 0 ) || ! GetFileStamp( fileData.path( id ), &stamp ) ) continue;
+    ids.push_back( id );
+    files.push_back( fileData.path( id ) );
+    stamps.push_back( stamp );
+  }
+  vector< ContentHash > hashes = hashCache->hash( files, stamps );
+
   ofstream ofs( tempFile.native() );
   ofs << PATH_KEY << rootPath << endl;
-  for ( auto f = fileData.begin() ; f != fileData.end() ; ++f ) {
-    ofs << FILE_KEY << fs::path( f->first ).lexically_relative( rootPath ).native() << endl;
-    const auto& s = f->second;
+  for ( auto s = searchData.begin() ; s != searchData.end() ; ++s ) {
+    ofs << SEARCH_KEY << s->first << endl;
+    ofs << QUERY_KEY << s->second << endl;
+  }
+  for ( auto p = tagParents.begin() ; p != tagParents.end() ; ++p ) {
+    ofs << CHILD_KEY << p->first << endl;
+    ofs << PARENT_KEY << p->second << endl;
+  }
+  for ( auto a = tagRules.aliases.begin() ; a != tagRules.aliases.end() ; ++a ) {
+    ofs << ALIAS_KEY << a->first << endl;
+    ofs << TARGET_KEY << a->second << endl;
+  }
+  for ( auto i = tagRules.implies.begin() ; i != tagRules.implies.end() ; ++i ) {
+    ofs << IMPLY_KEY << i->first << endl;
+    ofs << TARGET_KEY << i->second << endl;
+  }
+  // レコードはいったん文字列にし、長さを数えて索引の位置にする
+  DirectoryIndex index;
+  std::uint64_t offset = static_cast< std::uint64_t >( ofs.tellp() );
+  std::ostringstream record;
+  size_t h = 0; // ids の位置
+  for ( FileId id = first ; id < last ; ++id ) {
+    fs::path file = fileData.path( id ).lexically_relative( rootPath );
+    const auto& s = fileData[id];
+    record.str( string() );
+    record << FILE_KEY << file.native() << '\n';
+    if ( h < ids.size() && ids[h] == id ) {
+      const FileStamp& st = stamps[h];
+      if ( hashes[h] != NO_HASH )
+        record << HASH_KEY << HashToString( hashes[h] ) << ' ' << st.device << ' ' << st.inode << ' '
+               << st.size << ' ' << st.mtime << '\n';
+      ++h;
+    }
+    if ( groups[id] != 0 )
+      record << GROUP_KEY << groups[id] << '\n';
     for ( auto t = s.begin() ; t != s.end() ; ++t )
-      ofs << TAG_KEY << *t << endl;
+      record << TAG_KEY << *t << '\n';
+
+    index.add( file.parent_path(), offset, s );
+    string text = record.str();
+    ofs << text;
+    offset += text.length();
   }
+  index.write( ofs, offset );
   ofs.close();
 
   fs::rename( tempFile, writeFile );
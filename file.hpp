@@ -13,12 +13,21 @@
 #include <map>
 #include <set>
 #include <vector>
+#include <memory>
+#include <memory_resource>
+#include <iterator>
+#include <type_traits>
 #include <stdexcept>
+#include <atomic>
 
-#include <gtk/gtk.h>
+#include <glib.h>
 
 #include <boost/filesystem.hpp>
 
+#include "pathtable.hpp"
+#include "hash.hpp"
+#include "posting.hpp"
+
 /**
    @brief 文字列の比較
 
@@ -45,8 +54,324 @@ struct StrLess
   }
 };
 
-using FileData = std::map< boost::filesystem::path, std::set< std::string, StrLess > >;
-using TagData = std::map< std::string, std::set< boost::filesystem::path >, StrLess >;
+/// @brief 文字列を大文字と小文字を区別しない形に変換する
+///
+/// 前方一致による比較を行うときに利用する。
+///
+/// @param s 対象の文字列
+/// @return 変換後の文字列
+inline std::string Casefold( const std::string& s )
+{
+  gchar* gc = g_utf8_casefold( s.c_str(), -1 );
+  std::string res( gc );
+  g_free( gc );
+
+  return( res );
+}
+
+// タグリストの set は std::pmr のアロケータを使い、FileData のチャンクの領域から確保する
+// (独立して作ったもの、コピーしたものは通常のヒープから確保する)
+using TagSet = std::pmr::set< std::string, StrLess >;
+using SearchData = std::map< std::string, std::string, StrLess >; // 検索名をキーとする検索文字列
+using TagParents = std::map< std::string, std::string, StrLess >; // タグをキーとする親タグ
+using GroupData = std::vector< unsigned >; // ファイルの識別番号をインデックスとするグループの番号(0 はグループなし)
+
+/// @brief タグの規則(保存用)
+struct TagRuleData
+{
+  std::map< std::string, std::string, StrLess > aliases;      // 別名をキーとする正式なタグ
+  std::multimap< std::string, std::string, StrLess > implies; // タグをキーとする含意されるタグ
+};
+
+/// @brief タグファイルの読み込みの進み具合(読み込み中に他のスレッドから読む)
+struct ReadProgress
+{
+  std::atomic< std::size_t > scanned{ 0 }; // ディレクトリの走査で見つけたファイル数
+  std::atomic< std::size_t > parsed{ 0 };  // タグファイルから読んだファイルのレコード数
+  std::atomic< bool > joining{ false };    // 走査と読み込みが終わり、突き合わせ中か？
+};
+
+class TagTree;  // タグの階層(tagtree.hpp)
+class TagRules; // タグの別名と含意(tagrules.hpp)
+
+/**
+   @brief タグをキーとするファイルリスト
+
+   タグの順に CHUNK 件前後ずつのチャンクに分け、チャンク毎の map に持つ。
+   コピーはチャンクを共有し、変更するときに共有中のチャンクだけを複製する(コピー・オン・ライト)。
+   そのため IndexSnapshot に含めて公開しても、複製するのはチャンクの表と、公開後に変更したタグのチャンクだけで済む。
+
+   変更できる要素を返す find()・operator[] は、その時点でチャンクを複製する。読むだけなら const で呼ぶこと。
+   タグの追加・削除はチャンクの分割・削除でイテレータを無効にすることがあるが、残った要素への参照は無効にしない。
+**/
+class TagData
+{
+private:
+
+  using Chunk = std::map< std::string, Posting, StrLess >; // CHUNK 件前後のタグ(前のチャンクのタグより後)
+  using Chunks = std::vector< std::shared_ptr< Chunk > >;
+
+  // チャンクを順に辿るイテレータ(Const なら要素を変更できない)
+  template< bool Const >
+  class Iterator
+  {
+  public:
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Chunk::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = typename std::conditional< Const, const value_type*, value_type* >::type;
+    using reference = typename std::conditional< Const, const value_type&, value_type& >::type;
+
+    Iterator() : chunks_( nullptr ), chunk_( 0 ), it_() {}
+
+    // iterator から const_iterator への変換
+    template< bool C = Const, typename = typename std::enable_if< C >::type >
+    Iterator( const Iterator< false >& other ) : chunks_( other.chunks_ ), chunk_( other.chunk_ ), it_( other.it_ ) {}
+
+    reference operator*() const
+    { return( *it_ ); }
+
+    pointer operator->() const
+    { return( &( *it_ ) ); }
+
+    Iterator& operator++()
+    {
+      if ( ++it_ == ( *chunks_ )[chunk_]->end() && ++chunk_ < chunks_->size() )
+        it_ = ( *chunks_ )[chunk_]->begin();
+      return( *this );
+    }
+
+    Iterator operator++( int )
+    {
+      Iterator res( *this );
+      ++( *this );
+      return( res );
+    }
+
+    template< bool C > bool operator==( const Iterator< C >& other ) const
+    { return( chunk_ == other.chunk_ && ( chunk_ >= chunks_->size() || it_ == other.it_ ) ); }
+
+    template< bool C > bool operator!=( const Iterator< C >& other ) const
+    { return( ! ( *this == other ) ); }
+
+  private:
+
+    friend class TagData;
+    friend class Iterator< ! Const >;
+
+    using Owner = typename std::conditional< Const, const Chunks, Chunks >::type;
+    using Base = typename std::conditional< Const, Chunk::const_iterator, Chunk::iterator >::type;
+
+    Iterator( Owner* chunks, std::size_t chunk, Base it ) : chunks_( chunks ), chunk_( chunk ), it_( it ) {}
+
+    Owner* chunks_;     // チャンクの表
+    std::size_t chunk_; // チャンクの位置(末尾なら表の大きさ)
+    Base it_;           // チャンク内の位置
+  };
+
+public:
+
+  using key_type = std::string;
+  using mapped_type = Posting;
+  using value_type = Chunk::value_type;
+  using size_type = std::size_t;
+  using iterator = Iterator< false >;
+  using const_iterator = Iterator< true >;
+
+  /// @brief 1 チャンクのタグ数の目安(2 倍を超えたら分割する)
+  static const size_type CHUNK = 64;
+
+  /// @brief デフォルト・コンストラクタ
+  TagData() : chunks_(), size_( 0 ) {}
+
+  /// @brief タグ数を返す
+  size_type size() const
+  { return( size_ ); }
+
+  /// @brief タグがないか？
+  bool empty() const
+  { return( size_ == 0 ); }
+
+  /// @brief 先頭のタグを返す
+  const_iterator begin() const
+  { return( chunks_.empty() ? end() : const_iterator( &chunks_, 0, chunks_.front()->cbegin() ) ); }
+
+  /// @brief 末尾の次を返す
+  const_iterator end() const
+  { return( const_iterator( &chunks_, chunks_.size(), Chunk::const_iterator() ) ); }
+
+  /// @brief タグを探す
+  ///
+  /// @param tag 対象のタグ
+  /// @return タグの位置(なければ end())
+  const_iterator find( const std::string& tag ) const;
+
+  /// @brief 変更するタグを探す
+  ///
+  /// 見つかったタグのチャンクが他のコピーと共有されていれば、先に複製する。
+  ///
+  /// @param tag 対象のタグ
+  /// @return タグの位置(なければ end())
+  iterator find( const std::string& tag );
+
+  /// @brief 変更するファイルリストを返す(なければ空のファイルリストを追加する)
+  ///
+  /// @param tag 対象のタグ
+  /// @return ファイルリスト
+  Posting& operator[]( const std::string& tag );
+
+  /// @brief タグを削除する
+  ///
+  /// @param tag 対象のタグ
+  /// @return 削除したタグ数
+  size_type erase( const std::string& tag );
+
+  /// @brief タグを削除する
+  ///
+  /// @param pos 対象のタグの位置
+  void erase( const_iterator pos )
+  { erase( std::string( pos->first ) ); }
+
+  /// @brief 末尾にタグを追加する(まとめて作るとき用)
+  ///
+  /// @param tag 対象のタグ(登録済みのどのタグよりも後であること)
+  /// @param files ファイルリスト
+  void append( const std::string& tag, Posting files );
+
+  /// @brief 空にする(共有中のチャンクは、コピーがなくなったときに解放される)
+  void clear()
+  {
+    Chunks().swap( chunks_ );
+    size_ = 0;
+  }
+
+private:
+
+  size_type locate( const std::string& tag ) const; // tag を含みうるチャンクの位置を返す(全てのタグより後なら表の大きさ)
+  Chunk& edit( size_type chunk );                   // 共有中なら複製してから、チャンクを返す
+
+  Chunks chunks_;  // チャンク(どれも空でない)
+  size_type size_; // タグ数
+};
+
+/**
+   @brief ファイルの識別番号をインデックスとするタグリスト
+
+   パスはパスの表に一度だけ保持し、タグリストとタグ毎のファイルリストは識別番号で参照する。
+
+   タグリストは CHUNK 件ずつのチャンクに分け、チャンク毎のメモリ領域(プール)から確保する。
+   コピーはパスの表とチャンクを共有し、edit() で変更するときに共有中のチャンクだけを複製する
+   (コピー・オン・ライト)。コピーした版は元を変更しても変わらないため、他のスレッドから読める。
+   reset() で加えたチャンクは最初に edit() するまで作らず、それまでは空のタグリストを返す。
+**/
+class FileData
+{
+public:
+
+  using size_type = std::size_t;
+
+  /// @brief 1 チャンクのファイル数
+  static const size_type CHUNK = 256;
+
+  /// @brief デフォルト・コンストラクタ
+  FileData() : paths_( std::make_shared< PathTable >() ), chunks_(), size_( 0 ) {}
+
+  /// @brief コピー・コンストラクタ
+  ///
+  /// パスの表とタグリストを共有する。
+  ///
+  /// @param other コピー元
+  FileData( const FileData& other ) : paths_( other.paths_ ), chunks_( other.chunks_ ), size_( other.size_ ) {}
+
+  FileData& operator=( const FileData& ) = delete;
+
+  /// @brief 対象のファイルを作り直す(タグは空になる)
+  ///
+  /// @param files 対象のファイル
+  void assign( std::vector< boost::filesystem::path > files );
+
+  /// @brief 作成済みのパスの表で対象のファイルを作り直す(タグは空になる)
+  ///
+  /// @param paths パスの表
+  void assign( std::shared_ptr< const PathTable > paths );
+
+  /// @brief パスの表を差し替える(タグリストは識別番号毎にそのまま残す)
+  ///
+  /// 遅延読み込みで、予約した範囲にファイルを入れた表に替える場合などに使う。
+  /// 識別番号が増えた分のチャンクは、最初に edit() するまで作らない。
+  ///
+  /// @param paths パスの表(識別番号の数が今以上であること)
+  void reset( std::shared_ptr< const PathTable > paths );
+
+  /// @brief 空にする
+  void clear();
+
+  /// @brief 識別番号の数を返す(パスの表の予約した範囲の空きを含む)
+  ///
+  /// @return 識別番号の数
+  size_type size() const
+  { return( size_ ); }
+
+  /// @brief ファイルがないか？
+  ///
+  /// @return ファイルがなければ true を返す
+  bool empty() const
+  { return( size_ == 0 ); }
+
+  /// @brief タグリストを返す
+  ///
+  /// @param id ファイルの識別番号
+  /// @return タグリスト
+  const TagSet& operator[]( FileId id ) const
+  { return( ( chunks_[id / CHUNK] ) ? chunks_[id / CHUNK]->tags[id % CHUNK] : EMPTY ); }
+
+  /// @brief 変更するタグリストを返す
+  ///
+  /// チャンクが他のコピーと共有されていれば、先に複製する。
+  ///
+  /// @param id ファイルの識別番号
+  /// @return タグリスト
+  TagSet& edit( FileId id );
+
+  /// @brief ファイルのパスを返す
+  ///
+  /// @param id ファイルの識別番号
+  /// @return パス
+  boost::filesystem::path path( FileId id ) const
+  { return( paths_->path( id ) ); }
+
+  /// @brief パスからファイルの識別番号を求める
+  ///
+  /// @param file 対象のパス
+  /// @return 識別番号(なければ NO_FILE)
+  FileId find( const boost::filesystem::path& file ) const
+  { return( paths_->find( file ) ); }
+
+  /// @brief パスの表を返す
+  ///
+  /// @return パスの表
+  const PathTable& paths() const
+  { return( *paths_ ); }
+
+private:
+
+  // CHUNK 件のファイルのタグリスト
+  struct Chunk
+  {
+    std::pmr::unsynchronized_pool_resource pool; // タグリストの領域
+    std::pmr::vector< TagSet > tags;             // タグリスト
+
+    explicit Chunk( size_type files ) : pool(), tags( files, &pool ) {}
+    Chunk( const Chunk& other ) : pool(), tags( other.tags, &pool ) {}
+  };
+
+  static const TagSet EMPTY; // 作っていないチャンクのタグリスト
+
+  std::shared_ptr< const PathTable > paths_;      // パスの表(作り直すまで変わらない)
+  std::vector< std::shared_ptr< Chunk > > chunks_; // チャンク
+  size_type size_;                                // ファイル数
+};
 
 /// @brief パス内の全ファイルを探索し、タグ登録する
 ///
@@ -59,23 +384,162 @@ using TagData = std::map< std::string, std::set< boost::filesystem::path >, StrL
 /// @return なし
 void InitTagData( const std::string& rootPath, FileData* fileData, TagData* tagData );
 
+/// @brief rootPath 以下のファイルの識別番号の範囲を求める
+///
+/// 識別番号はパスの順のため、ルートパス以下のファイルは連続した範囲になる。
+///
+/// @param fileData ファイルをキーとするタグリスト
+/// @param rootPath ルートパス
+/// @param first 先頭のファイルの識別番号を返す変数へのポインタ
+/// @param last 末尾のファイルの次の識別番号を返す変数へのポインタ
+/// @return なし
+void RootRange( const FileData& fileData, const std::string& rootPath, FileId* first, FileId* last );
+
+/// @brief ファイルにタグを付ける
+///
+/// @param tag 付けるタグ
+/// @param file 対象のファイルの識別番号
+/// @param fileData ファイルをキーとするタグリストへのポインタ
+/// @param tagData タグをキーとするファイルリストへのポインタ
+/// @param tagTree タグの階層へのポインタ(親タグの集約したファイルリストも更新する。階層がなければ nullptr)
+/// @return タグがすでに付いていた場合は false を返す
+bool AddTag( const std::string& tag, FileId file, FileData* fileData, TagData* tagData, TagTree* tagTree = nullptr );
+
+/// @brief ファイルからタグを外す
+///
+/// @param tag 外すタグ
+/// @param file 対象のファイルの識別番号
+/// @param fileData ファイルをキーとするタグリストへのポインタ
+/// @param tagData タグをキーとするファイルリストへのポインタ
+/// @param tagTree タグの階層へのポインタ(親タグの集約したファイルリストも更新する。階層がなければ nullptr)
+/// @return タグが付いていなかった場合は false を返す
+bool RemoveTag( const std::string& tag, FileId file, FileData* fileData, TagData* tagData, TagTree* tagTree = nullptr );
+
+/// @brief ファイルに付いたタグを別のタグに付け替える
+///
+/// tag のファイルリストと files の積集合を求め、tag のファイルリストから差し引いて newTag のファイルリストに加える。
+/// tag のファイルがなくなった場合は tag を削除する。tag と newTag が同じタグなら何もしない。
+///
+/// @param tag 付け替えるタグ
+/// @param newTag 付け替え先のタグ
+/// @param files 対象のファイル(昇順)
+/// @param fileData ファイルをキーとするタグリストへのポインタ
+/// @param tagData タグをキーとするファイルリストへのポインタ
+/// @param moved tag を外したファイルを昇順に返す
+/// @param added newTag を新たに付けたファイルを昇順に返す(moved のうち newTag が付いていなかったファイル)
+/// @param tagTree タグの階層へのポインタ(階層がなければ nullptr)
+void MoveTag( const std::string& tag, const std::string& newTag, const std::vector< FileId >& files,
+              FileData* fileData, TagData* tagData, std::vector< FileId >* moved, std::vector< FileId >* added,
+              TagTree* tagTree = nullptr );
+
+/// @brief タグ名を変更する
+///
+/// newTag がすでにファイルに付いている場合は、そのタグにまとめる(使われていない newTag は置き換える)。
+/// 階層の親子関係は newTag に引き継ぐ。
+///
+/// @param oldTag 変更対象のタグ
+/// @param newTag 新しいタグ
+/// @param fileData ファイルをキーとするタグリストへのポインタ
+/// @param tagData タグをキーとするファイルリストへのポインタ
+/// @param tagTree タグの階層へのポインタ(階層がなければ nullptr)
+void ChangeTagName( const std::string& oldTag, const std::string& newTag, FileData* fileData, TagData* tagData,
+                    TagTree* tagTree = nullptr );
+
+/// @brief タグファイルのキー(書式は file.cpp の ReadTagData を参照)
+extern const std::string PATH_KEY;
+extern const std::string FILE_KEY;
+extern const std::string TAG_KEY;
+extern const std::string SEARCH_KEY;
+extern const std::string QUERY_KEY;
+extern const std::string HASH_KEY;
+extern const std::string CHILD_KEY;
+extern const std::string PARENT_KEY;
+extern const std::string ALIAS_KEY;
+extern const std::string IMPLY_KEY;
+extern const std::string TARGET_KEY;
+extern const std::string GROUP_KEY;
+extern const std::string DIR_KEY;
+extern const std::string RANGE_KEY;
+extern const std::string DICTIONARY_KEY;
+extern const std::string DIRS_KEY;
+extern const std::string INDEX_KEY;
+
+/// @brief タグファイルの 1 行のキーが key であれば、値を取り出す
+///
+/// @param data 1 行分の文字列
+/// @param key キー
+/// @param value 値を返す変数へのポインタ
+/// @return data のキーが key であれば true を返す
+bool GetValueFromKey( const std::string& data, const std::string& key, std::string* value );
+
+/// @brief タグファイルの hash= の値を読み取る
+///
+/// @param value hash= の値([16 進数のハッシュ値] [デバイス] [i ノード] [サイズ] [更新時刻])
+/// @param hash ハッシュ値を返す変数へのポインタ
+/// @param stamp ファイルの属性を返す変数へのポインタ
+/// @return 読み取れれば true を返す
+bool ParseHash( const std::string& value, ContentHash* hash, FileStamp* stamp );
+
+/**
+   @brief タグファイルに記録されたが、パスが見つからなかったファイル
+**/
+struct Orphan
+{
+  FileStamp stamp;                 // 記録時の属性
+  ContentHash hash;                // 記録時のハッシュ値
+  std::vector< std::string > tags; // 記録されていたタグ
+  unsigned group = 0;              // 記録されていたグループの番号
+};
+
+/// @brief パスが見つからなかったファイルを、タグもグループもないファイルから探してタグとグループを付け直す
+///
+/// まず属性が一致するファイルを探し、残りはサイズが同じファイルだけハッシュ値を求めて内容の一致で探す。
+///
+/// @param orphans パスが見つからなかったファイル(group は groups と同じ番号の振り方であること)
+/// @param fileData ファイルをキーとするタグリストへのポインタ
+/// @param tagData タグをキーとするファイルリストへのポインタ
+/// @param groups ファイルのグループの番号へのポインタ
+/// @param hashCache ファイルの属性をキーとするハッシュ値のキャッシュへのポインタ
+/// @return タグを付け直したファイル数
+std::size_t MatchOrphans( const std::vector< Orphan >& orphans, FileData* fileData, TagData* tagData, GroupData* groups, HashCache* hashCache );
+
 /// @brief ファイルからタグを読み込む
 ///
 /// ファイルが存在しない場合、オープンに失敗した場合、ルートパスの取得に失敗した場合、
 /// ルートパスが存在しない場合は例外 runtime_error を投げる。
+/// ルートパスを読んだ時点でディレクトリの走査を別のスレッドで始め、走査と並行して残りのレコードを読んでおき、
+/// 両方が終わってからパスを突き合わせて識別番号を決める。レコードの読み込みと突き合わせは、
+/// file= の行で区切った区間毎にコア数のスレッドで並列に行う。
+/// 記録されたパスが見つからないファイルは、属性とハッシュ値が一致するタグのないファイルに付け直す(グループも移す)。
 ///
 /// @param fileName 読み込むファイルのファイル名
+/// @param rootPath ルートパスを保持する変数へのポインタ
 /// @param fileData ファイルをキーとするタグリストへのポインタ
 /// @param tagData タグをキーとするファイルリストへのポインタ
-/// @return なし
-void ReadTagData( const std::string& fileName, std::string* rootPath, FileData* fileData, TagData* tagData );
+/// @param searchData 保存された検索条件を保持する変数へのポインタ
+/// @param tagParents 保存されたタグの親子関係を保持する変数へのポインタ
+/// @param tagRules 保存されたタグの規則を保持する変数へのポインタ
+/// @param groups 保存されたファイルのグループを保持する変数へのポインタ
+/// @param hashCache 記録されたハッシュ値を登録するキャッシュへのポインタ
+/// @param progress 進み具合を数える変数へのポインタ(nullptr なら数えない、複数の読み込みで共有してよい)
+/// @return 移動・名前変更先を見つけてタグを付け直したファイル数
+std::size_t ReadTagData( const std::string& fileName, std::string* rootPath, FileData* fileData, TagData* tagData, SearchData* searchData, TagParents* tagParents, TagRuleData* tagRules, GroupData* groups, HashCache* hashCache, ReadProgress* progress = nullptr );
 
 /// @brief ファイルにタグを書き込む
 ///
+/// タグの付いたファイルとグループに属するファイルには、移動・名前変更を追跡するためのハッシュ値を書き込む。
+/// 複数のルートパスのファイルを読み込んでいる場合は、rootPath 以下のファイルだけを書き込む。
+/// 末尾には、ディレクトリ毎のレコードの範囲とタグの辞書を索引として書き込む(LazyTagFile が使う)。
+///
 /// @param fileNamw 書き込むファイルのファイル名
 /// @param rootPath データがある対象のパス名
 /// @param fileData 書き込むタグ
+/// @param searchData 書き込む検索条件
+/// @param tagParents 書き込むタグの親子関係
+/// @param tagRules 書き込むタグの規則
+/// @param groups 書き込むファイルのグループ
+/// @param hashCache ファイルの属性をキーとするハッシュ値のキャッシュへのポインタ
 /// @return なし
-void WriteTagData( const std::string& fileName, const std::string& rootPath, const FileData& fileData );
+void WriteTagData( const std::string& fileName, const std::string& rootPath, const FileData& fileData, const SearchData& searchData, const TagParents& tagParents, const TagRuleData& tagRules, const GroupData& groups, HashCache* hashCache );
 
 #endif
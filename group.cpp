@@ -0,0 +1,222 @@
+/**
+   group.cpp : ファイルのグループ
+**/
+#include "group.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+
+using std::vector;
+using std::size_t;
+
+/*
+  FileGroups::assign : 全てのファイルを自分自身につなぎ、グループなしにする
+*/
+void FileGroups::assign( FileId size )
+{
+  next_.resize( size );
+  prev_.resize( size );
+  std::iota( next_.begin(), next_.end(), 0 );
+  std::iota( prev_.begin(), prev_.end(), 0 );
+}
+
+/*
+  FileGroups::assign : 同じ番号のファイルを、番号毎の末尾のファイルの次につないでいく
+*/
+void FileGroups::assign( const GroupData& data )
+{
+  assign( static_cast< FileId >( data.size() ) );
+
+  std::unordered_map< unsigned, FileId > tails; // 番号をキーとするグループの末尾のファイル
+  for ( FileId id = 0 ; id < data.size() ; ++id ) {
+    if ( data[id] == 0 ) continue;
+    auto t = tails.emplace( data[id], id );
+    if ( t.second ) continue;
+    join( t.first->second, id );
+    t.first->second = id;
+  }
+}
+
+/*
+  FileGroups::split : first の前のファイルと last の次を入れ替え、first から last までを環から切り離す
+*/
+void FileGroups::split( FileId first, FileId last )
+{
+  splice( prev_[first], last );
+}
+
+/*
+  FileGroups::merge : files の先頭のグループに、まだ含まれないファイルのグループを順につなぐ
+
+  すでに同じグループのファイルをつなぐと分割になるため、つないだグループのファイルを記録しておく
+*/
+size_t FileGroups::merge( const vector< FileId >& files )
+{
+  if ( files.empty() ) return( 0 );
+
+  std::unordered_set< FileId > joined; // 先頭のグループにつないだファイル
+  auto mark = [this, &joined]( FileId file ) {
+    FileId f = file;
+    do {
+      joined.insert( f );
+      f = next_[f];
+    } while ( f != file );
+  };
+
+  mark( files.front() );
+  for ( auto f = files.begin() + 1 ; f != files.end() ; ++f ) {
+    if ( joined.count( *f ) > 0 ) continue;
+    mark( *f );
+    join( files.front(), *f );
+  }
+
+  return( joined.size() );
+}
+
+/*
+  FileGroups::isolate : files をそれぞれ取り外してから、先頭のファイルにつなぐ
+*/
+void FileGroups::isolate( const vector< FileId >& files )
+{
+  if ( files.empty() ) return;
+
+  for ( auto f = files.begin() ; f != files.end() ; ++f )
+    remove( *f );
+  for ( auto f = files.begin() + 1 ; f != files.end() ; ++f )
+    if ( *f != files.front() ) join( files.front(), *f );
+}
+
+/*
+  FileGroups::members : file から次をたどって一周する
+*/
+vector< FileId > FileGroups::members( FileId file ) const
+{
+  vector< FileId > res;
+  FileId f = file;
+  do {
+    res.push_back( f );
+    f = next_[f];
+  } while ( f != file );
+  std::sort( res.begin(), res.end() );
+
+  return( res );
+}
+
+/*
+  FileGroups::count : file から次をたどって一周した数を返す
+*/
+size_t FileGroups::count( FileId file ) const
+{
+  size_t n = 0;
+  FileId f = file;
+  do {
+    ++n;
+    f = next_[f];
+  } while ( f != file );
+
+  return( n );
+}
+
+/*
+  FileGroups::leader : file から次をたどって一周し、最小の識別番号を返す
+*/
+FileId FileGroups::leader( FileId file ) const
+{
+  FileId res = file;
+  for ( FileId f = next_[file] ; f != file ; f = next_[f] )
+    res = std::min( res, f );
+
+  return( res );
+}
+
+/*
+  FileGroups::collapse : グループに属するファイルは、グループ毎に 1 回だけ一周して代表を求める
+*/
+vector< FileId > FileGroups::collapse( const vector< FileId >& files ) const
+{
+  vector< FileId > res;
+  res.reserve( files.size() );
+  std::unordered_set< FileId > seen; // 代表を求めたグループのファイル
+  bool sorted = true; // 代表が昇順に並んだか？
+  for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+    FileId leader = *f;
+    if ( grouped( *f ) ) {
+      if ( seen.count( *f ) > 0 ) continue;
+      FileId g = *f;
+      do {
+        seen.insert( g );
+        leader = std::min( leader, g );
+        g = next_[g];
+      } while ( g != *f );
+    }
+    sorted = sorted && ( res.empty() || res.back() < leader );
+    res.push_back( leader );
+  }
+  if ( ! sorted ) std::sort( res.begin(), res.end() );
+
+  return( res );
+}
+
+/*
+  FileGroups::expand : グループに属するファイルは、グループ毎に 1 回だけ一周して全てのファイルを加える
+*/
+vector< FileId > FileGroups::expand( const vector< FileId >& files ) const
+{
+  vector< FileId > res;
+  res.reserve( files.size() );
+  std::unordered_set< FileId > seen; // 加えたグループのファイル
+  for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+    if ( ! grouped( *f ) ) {
+      res.push_back( *f );
+      continue;
+    }
+    if ( seen.count( *f ) > 0 ) continue;
+    FileId g = *f;
+    do {
+      seen.insert( g );
+      res.push_back( g );
+      g = next_[g];
+    } while ( g != *f );
+  }
+  std::sort( res.begin(), res.end() );
+  res.erase( std::unique( res.begin(), res.end() ), res.end() );
+
+  return( res );
+}
+
+/*
+  FileGroups::data : 番号の付いていないグループを見つける度に一周して番号を付ける
+*/
+GroupData FileGroups::data() const
+{
+  GroupData res( next_.size(), 0 );
+  unsigned number = 0;
+  for ( FileId id = 0 ; id < next_.size() ; ++id ) {
+    if ( ! grouped( id ) || res[id] != 0 ) continue;
+    ++number;
+    FileId f = id;
+    do {
+      res[f] = number;
+      f = next_[f];
+    } while ( f != id );
+  }
+
+  return( res );
+}
+
+/*
+  FileGroups::splice : a と b の次を入れ替える
+
+  a と b が別の環なら 1 つの環に、同じ環なら a の次から b までと b の次から a までの 2 つの環になる
+*/
+void FileGroups::splice( FileId a, FileId b )
+{
+  FileId na = next_[a];
+  FileId nb = next_[b];
+  next_[a] = nb;
+  prev_[nb] = a;
+  next_[b] = na;
+  prev_[na] = b;
+}
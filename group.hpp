@@ -0,0 +1,123 @@
+/**
+  @file group.hpp
+  @brief ファイルのグループ(連写・RAW+JPEG・編集版など)
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef GROUP_HPP_20261018
+#define GROUP_HPP_20261018
+
+#include <vector>
+#include <cstddef>
+
+#include "file.hpp"
+
+/**
+   @brief ファイルのグループ
+
+   Image::post_ と同じく、グループのファイルを環状のリストでつなぐ。
+   次のファイルが自分自身ならグループに属さない。
+   ファイルの識別番号をインデックスとして次・前のファイルを持つため、グループ同士の連結、
+   グループの分割、ファイル 1 件の取り外しは、いずれも 2 つのファイルの次を入れ替えるだけの O(1) で済む。
+**/
+class FileGroups
+{
+public:
+
+  /// @brief デフォルト・コンストラクタ(ファイルなし)
+  FileGroups() : next_(), prev_() {}
+
+  /// @brief 全てのファイルをグループなしにする
+  ///
+  /// @param size ファイル数
+  void assign( FileId size );
+
+  /// @brief 保存されたグループの番号からグループを作り直す
+  ///
+  /// 同じ番号のファイルを識別番号の順につなぐ。
+  ///
+  /// @param data ファイルの識別番号をインデックスとするグループの番号
+  void assign( const GroupData& data );
+
+  /// @brief ファイル数を返す
+  FileId size() const
+  { return( static_cast< FileId >( next_.size() ) ); }
+
+  /// @brief file がグループに属するか？
+  bool grouped( FileId file ) const
+  { return( next_[file] != file ); }
+
+  /// @brief グループ内で file の次のファイルを返す(グループなしなら file 自身)
+  FileId next( FileId file ) const
+  { return( next_[file] ); }
+
+  /// @brief a と b のグループを 1 つにつなぐ
+  ///
+  /// b のグループは a の直後に入る。a と b は別のグループであること(同じグループなら split() と同じく分割になる)。
+  void join( FileId a, FileId b )
+  { splice( a, b ); }
+
+  /// @brief グループ内で first から last までのファイルを、別のグループとして切り離す
+  ///
+  /// last は first から次をたどって到達できること(first と last が同じなら first だけを切り離す)。
+  ///
+  /// @param first 切り離す先頭のファイル
+  /// @param last 切り離す末尾のファイル
+  void split( FileId first, FileId last );
+
+  /// @brief file をグループから外す
+  void remove( FileId file )
+  { split( file, file ); }
+
+  /// @brief files を(それぞれが属するグループごと) 1 つのグループにまとめる
+  ///
+  /// グループはライブラリ毎に保存するため、files は同じライブラリのファイルであること(呼び出し側で確かめる)。
+  ///
+  /// @param files まとめるファイル
+  /// @return まとめたグループのファイル数
+  std::size_t merge( const std::vector< FileId >& files );
+
+  /// @brief files を元のグループから外し、files だけで新しいグループにする
+  ///
+  /// merge() と同じく、files は同じライブラリのファイルであること。
+  ///
+  /// @param files 切り離すファイル
+  void isolate( const std::vector< FileId >& files );
+
+  /// @brief file のグループのファイルを昇順に返す
+  std::vector< FileId > members( FileId file ) const;
+
+  /// @brief file のグループのファイル数を返す
+  std::size_t count( FileId file ) const;
+
+  /// @brief file のグループの代表(最小の識別番号のファイル)を返す
+  FileId leader( FileId file ) const;
+
+  /// @brief ファイルリストをグループの代表に置き換える
+  ///
+  /// @param files ファイルリスト(昇順)
+  /// @return files のファイルが属するグループの代表(昇順、重複なし)
+  std::vector< FileId > collapse( const std::vector< FileId >& files ) const;
+
+  /// @brief ファイルリストを、それぞれが属するグループの全てのファイルに広げる
+  ///
+  /// @param files ファイルリスト
+  /// @return files のファイルが属するグループのファイル(昇順、重複なし)
+  std::vector< FileId > expand( const std::vector< FileId >& files ) const;
+
+  /// @brief 保存用にグループの番号を返す
+  ///
+  /// @return ファイルの識別番号をインデックスとするグループの番号(1 から振り直す)
+  GroupData data() const;
+
+private:
+
+  void splice( FileId a, FileId b ); // a と b の次を入れ替える
+
+  std::vector< FileId > next_; // ファイルの識別番号をインデックスとするグループ内の次のファイル
+  std::vector< FileId > prev_; // ファイルの識別番号をインデックスとするグループ内の前のファイル
+};
+
+#endif
@@ -16,43 +16,67 @@ namespace fs = boost::filesystem;
 
 class TagFileStatus
 {
-  bool canSave_;        // 保存可能か？
-  bool edited_;         // 編集されているか？
-  string rootPath_;     // ルートパス名
-  string tagFile_;      // タグファイル名
-  GtkBuilder* builder_; // GtkBuilderへのポインタ
+  bool canSave_;          // 保存可能か？
+  bool edited_;           // 編集されているか？
+  Libraries libraries_;   // 開いているライブラリ(ルートパスとタグファイル)
+  LibrarySettings saved_; // 読み込み・保存した時点の設定(全てのライブラリの分をまとめたもの)
+  std::unique_ptr< LazyLibrary > lazy_; // 遅延読み込みで開いたライブラリ(全体を読み込んだ場合は nullptr)
+  SavedFeatures features_; // 遅延読み込み中のライブラリの保存済みの特徴量(読み込んだファイルの分だけ引く)
+  GtkBuilder* builder_;   // GtkBuilderへのポインタ
 
   // タイトル名を返す
   string title() const;
 
+  // 読み込んだファイル数が上限を超えていれば、使われていないディレクトリを追い出す
+  vector< FileId > evict( const vector< LazyTagFile::DirIndex >& loaded, FileData* fileData, TagData* tagData,
+                          TagTree* tagTree, TagRules* tagRules, FileGroups* groups );
+
 public:
 
   // コンストラクタ
   TagFileStatus( GtkBuilder* builder );
 
   // ルートパスの初期化
-  void init( const string& rootPath, FileData* fileData, TagData* tagData );
+  void init( const string& rootPath, FileData* fileData, TagData* tagData, TagTree* tagTree, TagRules* tagRules,
+             FileGroups* groups, SavedSearches* searches );
+
+  // タグファイルのオープン(複数なら並列に読み込んで 1 つにまとめる)
+  void open( const vector< string >& tagFiles, FileData* fileData, TagData* tagData, TagTree* tagTree, TagRules* tagRules,
+             FileGroups* groups, SavedSearches* searches );
 
-  // タグファイルのオープン
-  void open( const string& tagFile, FileData* fileData, TagData* tagData );
+  // 遅延読み込み中のライブラリのディレクトリを読み込んで加える
+  void load( const vector< LazyTagFile::DirIndex >& dirs, FileData* fileData, TagData* tagData, TagTree* tagTree,
+             TagRules* tagRules, FileGroups* groups, SavedSearches* searches );
 
   // タグファイルの上書き保存
-  void save( const FileData& fileData );
+  void save( const FileData& fileData, const TagTree& tagTree, const TagRules& tagRules, const FileGroups& groups,
+             const SavedSearches& searches );
 
   // タグファイルの新規保存
-  void save( const string& tagFile, const FileData& fileData );
+  void save( const string& tagFile, const FileData& fileData, const TagTree& tagTree, const TagRules& tagRules,
+             const FileGroups& groups, const SavedSearches& searches );
 
-  // タグファイルのファイル名だけを返す
-  string fileName() const
-  { return( fs::path( tagFile_ ).filename().native() ); }
+  // タグファイルのファイル名だけを返す(複数ならカンマで区切る)
+  string fileName() const;
 
-  // タグファイルをフルパスで返す
+  // 先頭のライブラリのタグファイルをフルパスで返す
   string pathName() const
-  { return( tagFile_ ); }
+  { return( ( libraries_.empty() ) ? string() : libraries_.front().tagFile ); }
+
+  // 開いているライブラリを返す
+  const Libraries& libraries() const
+  { return( libraries_ ); }
+
+  // 遅延読み込みで開いたライブラリを返す(全体を読み込んだ場合は nullptr)
+  const LazyLibrary* lazy() const
+  { return( lazy_.get() ); }
 
-  // ルートパスを返す
-  string rootPath() const
-  { return( rootPath_ ); }
+  // 遅延読み込み中なら、ディレクトリを使ったことにする(追い出す順を後にする)
+  void touch( LazyTagFile::DirIndex dir )
+  { if ( lazy_ ) lazy_->touch( dir ); }
+
+  // 遅延読み込み中なら、編集するファイルのディレクトリを追い出さないようにする
+  void edit( const FileData& fileData, const vector< FileId >& files );
 
   // 保存可能か？
   bool canSave() const
@@ -68,32 +92,124 @@ public:
   bool edited() const
   { return( edited_ ); }
 
-  // タグファイルがあるか？
+  // 全てのライブラリにタグファイルがあるか？
   bool hasFile() const
-  { return( ! tagFile_.empty() ); }
+  { return( ! libraries_.empty() &&
+            std::none_of( libraries_.begin(), libraries_.end(),
+                          []( const LibraryRoot& l ) { return( l.tagFile.empty() ); } ) ); }
 
   // GtkBuilderオブジェクトへのポインタを返す
   GtkBuilder* builder() const
   { return( builder_ ); }
 };
 
+// バックグラウンドで評価した絞り込みの結果
+struct FilterResult
+{
+  unsigned id;                             // 評価開始時の世代番号
+  Query query;                             // 絞り込み条件
+  std::shared_ptr< FileList > files;       // 絞り込み結果
+  TagFileStatus* status;                   // TagFileStatus オブジェクトへのポインタ
+};
+
+// 他のスレッドから GUI スレッドに依頼する処理
+struct GuiTask
+{
+  std::function< void() > work; // 処理
+  std::promise< void > done;    // 処理の終了
+};
+
+// バックグラウンドで求めた画像の特徴量
+struct FeatureBatch
+{
+  unsigned id;                                            // 索引作成開始時の世代番号
+  vector< std::pair< FileId, ImageFeatures > > features;  // ファイルと特徴量
+};
+
+// 展開したディレクトリの読み込みの依頼(遅延読み込み中)
+struct DirectoryLoad
+{
+  TagFileStatus* status;     // TagFileStatus オブジェクトへのポインタ
+  LazyTagFile::DirIndex dir; // 読み込むディレクトリ
+};
+
+// 画面に反映するタグの変更(同じタグの追加・削除をまとめる)
+struct TagChange
+{
+  string tag;             // 追加・削除されたタグ
+  vector< FileId > files; // 変更されたファイル(昇順)
+  bool added;             // 追加の場合は true
+};
+
 /** グローバル変数 **/
 
 const string PROGRAM_NAME = "gTag";
 const string EDITED_IDENT = " (*)";
 
-FileData g_FileData; // ファイルをキーとするタグリスト
-TagData g_TagData;   // タグをキーとするファイルリスト
+FileData g_FileData;                         // ファイルをキーとするタグリスト
+TagData g_TagData;                           // タグをキーとするファイルリスト
+TagTree g_TagTree;                           // タグの階層(親タグの集約したファイルリストを含む)
+TagRules g_TagRules;                         // タグの別名と含意
+FileGroups g_Groups;                         // ファイルのグループ(GUI スレッドのみで使う)
+
+SavedSearches g_Searches; // 保存した検索条件
+
+CompletionIndex g_Completion; // タグ補完用の索引
+const std::size_t COMPLETION_LIMIT = 50; // 補完候補として表示するタグの上限
+
+TagSuggester g_Suggester; // タグの共起行列
+const std::size_t SUGGEST_LIMIT = 10; // 候補として表示するタグの上限
+
+FacetCounter g_Facets; // 表示中のファイルリストに対するタグ毎のファイル数
+std::map< string, GtkTreeIter, StrLess > g_FacetRows; // タグをキーとするファセットリストの行
 
-set< string, StrLess > g_Clipboard;
+DirectoryTree g_Directories; // 開いているライブラリのディレクトリの木
+std::map< DirectoryTree::NodeId, GtkTreeIter > g_DirRows;   // ディレクトリをキーとする、作成済みのディレクトリリストの行
+DirectoryTree::NodeId g_DirScope = DirectoryTree::NO_NODE; // ファイルリストとファセットを絞り込むディレクトリ(NO_NODE は全体)
+
+TagSet g_Clipboard;
+
+HashCache g_HashCache; // ファイルの属性をキーとする内容のハッシュ値
+
+ImageIndex g_Images; // 画像の特徴量の索引
+const unsigned SIMILAR_DISTANCE = 10;    // 類似とみなす知覚ハッシュの距離の上限
+const std::size_t FEATURE_BATCH = 256;   // GUI スレッドにまとめて渡す特徴量の数
+const std::size_t PALETTE_LIMIT = 100;   // 配色が似た画像として表示する上限
+const std::uint8_t DOMINANT_SHARE = 64;  // 主な色とみなす割合の下限(255 が 100%)
+std::atomic< unsigned > g_IndexGeneration( 0 ); // 画像の索引作成の世代番号(更新すると実行中の処理は中断する)
+std::atomic< int > g_IndexWorkers( 0 );         // 実行中の索引作成スレッドの数
 
 string g_CurrentTagFolder; // 現在のタグファイル取得先カレントフォルダ
 
 bool g_AutoScale = true;   // 画像を自動的にスケーリングするか？
+bool g_CollapseGroups = false; // グループを 1 行にまとめて表示するか？
 GdkPixbufAnimation* g_Animation = 0;             // GdkPixbufAnimationオブジェクト
 GdkPixbufAnimationIter* g_AnimationIterator = 0; // GdkPixbufAnimationIterオブジェクト
 
 gulong g_FileListID; // ファイルリスト選択変更時のイベントID
+gulong g_FilterID;   // 絞り込み条件変更時のイベントID
+gulong g_SearchID;   // 保存した検索条件の選択変更時のイベントID
+gulong g_DirListID;  // ディレクトリリスト選択変更時のイベントID
+
+IndexVersions g_Versions; // g_FileData と g_TagData の公開済みの版(書き込みは GUI スレッドのみ、他のスレッドは版を読む)
+EditLog g_EditLog;        // g_FileData と g_TagData の編集の履歴(取り消し・やり直し用)
+
+std::shared_ptr< FileList > g_FileListShown = std::make_shared< FileList >(); // ファイルリストに表示中のファイル
+std::shared_ptr< FileList > g_FileListResult; // グループをまとめて表示中の、まとめる前の絞り込み結果
+std::size_t g_FileListFilled = 0;      // g_FileListShown のうちファイルリストの行を作ったファイル数
+guint g_FileListFillID = 0;            // 残りの行を作るアイドル処理のID(0 なら全ての行を作成済み)
+const Libraries* g_FileListLibraries = nullptr; // 残りの行の文字列に使うライブラリ
+const std::size_t FILL_BATCH = 2048;  // アイドル時に一度に作るファイルリストの行数
+Query g_FilterQuery;                            // 表示中のファイルリストの絞り込み条件
+std::atomic< unsigned > g_FilterGeneration( 0 ); // 絞り込み処理の世代番号(更新すると実行中の処理は中断する)
+std::atomic< int > g_FilterWorkers( 0 );         // 実行中の絞り込み処理の数
+
+std::atomic< bool > g_Quitting( false ); // メインループを抜けたか？(GUI スレッドへの依頼は実行されない)
+
+bool g_Loading = false; // タグファイルを読み込み中か？(読み込み中は GUI スレッドへの依頼を後回しにする)
+const std::size_t LAZY_CAPACITY = 1000000; // 遅延読み込みで読み込んだままにしておくファイル数の上限
+const std::size_t LAZY_THRESHOLD = 100000; // 遅延読み込みで開くタグファイルのファイル数(保存時)の下限
+const std::chrono::milliseconds PROGRESS_INTERVAL( 100 ); // 読み込み中に進み具合を表示する間隔
 
 /*
   MessageBox : メッセージダイアログの表示
@@ -156,10 +272,10 @@ void ShowStatus( GtkBuilder* builder, const string& message )
   InitTagList : タグリストの初期化
 
   builder : GtkBuilder オブジェクトへのポインタ
-  fileName : 対象ファイルの名前
+  file : 対象ファイルの識別番号
   fileData : ファイルをキーとするタグリスト
 */
-void InitTagList( GtkBuilder* builder, const string& fileName, const FileData& fileData )
+void InitTagList( GtkBuilder* builder, FileId file, const FileData& fileData )
 {
   // ファイルリストのパーツ
   GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
@@ -167,16 +283,44 @@ void InitTagList( GtkBuilder* builder, const string& fileName, const FileData& f
 
   // リストの更新
   gtk_list_store_clear( store );
-  const auto& s = ( fileData.find( fileName ) )->second;
+  const auto& s = fileData[file];
   for ( auto i = s.begin() ; i != s.end() ; ++i ) {
     gtk_list_store_append( store, &iter );
     gtk_list_store_set( store, &iter, 0, i->c_str(), -1 );
   }
 }
 
+/*
+  InitTagList : 複数のファイルのタグリストの初期化(いずれかのファイルに付いたタグを表示する)
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  files : 対象ファイルの識別番号
+  fileData : ファイルをキーとするタグリスト
+*/
+void InitTagList( GtkBuilder* builder, const vector< FileId >& files, const FileData& fileData )
+{
+  if ( files.size() == 1 ) {
+    InitTagList( builder, files.front(), fileData );
+    return;
+  }
+
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
+  GtkTreeIter iter;
+
+  std::set< string, StrLess > tags;
+  for ( auto f = files.begin() ; f != files.end() ; ++f )
+    tags.insert( fileData[*f].begin(), fileData[*f].end() );
+
+  gtk_list_store_clear( store );
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    gtk_list_store_insert_with_values( store, &iter, -1, 0, t->c_str(), -1 );
+}
+
 /*
   InitCompletionList : 補完用リストの初期化
 
+  補完用の索引を作り直す。補完用リストには入力中の文字列に一致する候補だけを登録する。
+
   builder : GtkBuilder オブジェクトへのポインタ
   tagData : タグをキーとするファイルリスト
 */
@@ -184,72 +328,102 @@ void InitCompletionList( GtkBuilder* builder, const TagData& tagData )
 {
   // 補完リストのパーツ
   GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "completionstore" ) );
-  GtkTreeIter iter;
 
-  // リストの更新
+  // 索引の更新
+  g_Completion.assign( tagData );
   gtk_list_store_clear( store );
-  for ( auto t = tagData.begin() ; t != tagData.end() ; ++t ) {
-    gtk_list_store_append( store, &iter );
-    gtk_list_store_set( store, &iter, 0, ( t->first ).c_str(), -1 );
-  }
 }
 
 /*
-  ChangeCompletionList : 補完用リストのタグ名を変更する
+  GetSelectedFiles : リストで選択されている全てのファイルの識別番号を取得する
+
+  グループをまとめて表示中は、選択した行のグループの全てのファイルを取得する。
 
   builder : GtkBuilder オブジェクトへのポインタ
-  oldTag : 変更対象のタグ名
-  newTag : 変更後のタグ名
+  files : 識別番号を昇順に取得する変数へのポインタ
+
+  戻り値 : リスト選択されていなければ false を返す
 */
-void ChangeCompletionList( GtkBuilder* builder, const string& oldTag, const string& newTag )
+bool GetSelectedFiles( GtkBuilder* builder, vector< FileId >* files )
 {
-  // 補完リストのパーツ
-  GtkTreeModel* model = GTK_TREE_MODEL( gtk_builder_get_object( builder, "completionstore" ) );
-  GtkTreeIter iter;
+  GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
 
-  if ( ! gtk_tree_model_get_iter_first( model, &iter ) )
-    return;
+  files->clear();
+  GtkTreeModel* model = 0;
+  GList* rows = gtk_tree_selection_get_selected_rows( selection, &model );
+  for ( GList* r = rows ; r != 0 ; r = r->next ) {
+    GtkTreeIter iter;
+    if ( ! gtk_tree_model_get_iter( model, &iter, static_cast< GtkTreePath* >( r->data ) ) ) continue;
+    guint id;
+    gtk_tree_model_get( model, &iter, 1, &id, -1 );
+    files->push_back( id );
+  }
+  g_list_free_full( rows, reinterpret_cast< GDestroyNotify >( gtk_tree_path_free ) );
 
-  do {
-    GValue value = G_VALUE_INIT;
-    gtk_tree_model_get_value( model, &iter, 0, &value );
-    string tag = g_value_get_string( &value );
-    g_value_unset( &value );
-    if ( tag == oldTag ) {
-      gtk_list_store_set( GTK_LIST_STORE( model ), &iter, 0, newTag.c_str(), -1 );
-      return;
-    }
-  } while ( gtk_tree_model_iter_next( model, &iter ) );
+  // ファイルリストは識別番号の順に並んでいる
+  std::sort( files->begin(), files->end() );
+  if ( g_CollapseGroups )
+    *files = g_Groups.expand( *files );
+
+  return( ! files->empty() );
 }
 
 /*
-  GetFileName : リストで選択されているファイル名を取得する
+  GetFileId : リストで 1 つだけ選択されているファイルの識別番号を取得する
 
   builder : GtkBuilder オブジェクトへのポインタ
-  rootPath : ルートパス
-  fileName : ファイル名を取得する変数へのポインタ
+  file : 識別番号を取得する変数へのポインタ
 
-  戻り値 : リスト選択されていなければ false を返す
+  戻り値 : リスト選択されていないか、複数選択されていれば false を返す
 */
-bool GetFileName( GtkBuilder* builder, const string& rootPath, string* fileName )
+bool GetFileId( GtkBuilder* builder, FileId* file )
 {
   GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
-
-  // 選択された GtkTreeIter を取得する
-  GtkTreeModel* model = 0;
-  GtkTreeIter iter;
-  if ( ! gtk_tree_selection_get_selected( selection, &model, &iter ) )
+  if ( gtk_tree_selection_count_selected_rows( selection ) != 1 )
     return( false );
 
-  // ファイル名の取得
-  gchar* gc;
-  gtk_tree_model_get( model, &iter, 0, &gc, -1 );
-  *fileName = fs::path( rootPath + "/" + gc ).lexically_normal().native();
-  g_free( gc );
+  vector< FileId > files;
+  GetSelectedFiles( builder, &files );
+  *file = files.front();
 
   return( true );
 }
 
+/*
+  RefreshTagList : 選択中のファイルに合わせてタグリストを表示し直す
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void RefreshTagList( GtkBuilder* builder )
+{
+  vector< FileId > files;
+  if ( GetSelectedFiles( builder, &files ) )
+    InitTagList( builder, files, g_FileData );
+  else
+    gtk_list_store_clear( GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) ) );
+}
+
+/*
+  UpdateSuggestList : 選択中のファイルに付けるタグの候補を表示する
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void UpdateSuggestList( GtkBuilder* builder )
+{
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "suggeststore" ) );
+  GtkTreeIter iter;
+
+  gtk_list_store_clear( store );
+
+  FileId file;
+  if ( ! GetFileId( builder, &file ) )
+    return;
+
+  vector< string > tags = g_Suggester.suggest( file, g_FileData, SUGGEST_LIMIT );
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    gtk_list_store_insert_with_values( store, &iter, -1, 0, t->c_str(), -1 );
+}
+
 /*
   Timer : アニメーション用のタイマー
 
@@ -334,10 +508,20 @@ void CB_ShowImage( GtkTreeSelection* selection, gpointer data )
   GtkBuilder* builder = status->builder();
   GtkImage* image = GTK_IMAGE( gtk_builder_get_object( builder, "imageview" ) );
 
-  // リスト選択されているファイル名の取得
-  string fileName;
-  if ( ! GetFileName( builder, status->rootPath(), &fileName ) )
+  // 複数選択されている場合は、タグリストだけを表示する
+  FileId file;
+  if ( ! GetFileId( builder, &file ) ) {
+    vector< FileId > files;
+    if ( ! GetSelectedFiles( builder, &files ) )
+      return;
+    InitTagList( builder, files, g_FileData );
+    UpdateSuggestList( builder );
+    ShowStatus( builder, std::to_string( files.size() ) + " files selected" );
     return;
+  }
+
+  // リスト選択されているファイル名の取得
+  string fileName = g_FileData.path( file ).native();
 
   // 画像の出力
   if ( g_Animation != 0 ) {
@@ -358,920 +542,3585 @@ void CB_ShowImage( GtkTreeSelection* selection, gpointer data )
     CB_DrawImage( GTK_WIDGET( image ), 0, data );
   }
 
-  InitTagList( builder, fileName, g_FileData );
+  // グループをまとめて表示中は、グループのいずれかのファイルに付いたタグを表示する
+  vector< FileId > files;
+  GetSelectedFiles( builder, &files );
+  InitTagList( builder, files, g_FileData );
+  UpdateSuggestList( builder );
 }
 
 /*
-  InitFileList : ファイルリストの初期化
+  FileRowLabel : ファイルリストの行に表示する文字列を返す
+
+  グループをまとめて表示中は、グループの他のファイル数を添える。
+
+  libraries : 開いているライブラリ
+  file : 行のファイル
+*/
+string FileRowLabel( const Libraries& libraries, FileId file )
+{
+  string label = LibraryPath( libraries, g_FileData, file );
+  if ( g_CollapseGroups && g_Groups.grouped( file ) )
+    label += " (+" + std::to_string( g_Groups.count( file ) - 1 ) + ")";
+
+  return( label );
+}
+
+/*
+  MatchedFiles : 表示中の絞り込み結果を返す(グループをまとめて表示中は、まとめる前の結果を返す)
+*/
+std::shared_ptr< FileList > MatchedFiles()
+{
+  return( ( g_CollapseGroups ) ? g_FileListResult : g_FileListShown );
+}
+
+/*
+  FillFileList : g_FileListShown のうち行を作っていないファイルを、最大 count 件ファイルリストの末尾に加える
 
   builder : GtkBuilder オブジェクトへのポインタ
-  fileData : ファイルをキーとするタグリスト
-  rootPath : ルートパス
+  count : 加える行数の上限
+
+  戻り値 : 全ての行を作った場合は true
 */
-void InitFileList( GtkBuilder* builder, const FileData& fileData, const string& rootPath )
+bool FillFileList( GtkBuilder* builder, std::size_t count )
 {
-  // ファイルリストのパーツ
   GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "fileliststore" ) );
   GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
   GtkTreeIter iter;
 
+  const FileList& files = *g_FileListShown;
+  std::size_t last = std::min( files.size(), g_FileListFilled + count );
   g_signal_handler_block( selection, g_FileListID );
-
-  // ファイルリストの更新
-  gtk_list_store_clear( store );
-  for ( auto i = fileData.begin() ; i != fileData.end() ; ++i ) {
-    gtk_list_store_append( store, &iter );
-    gtk_list_store_set( store, &iter, 0, ( i->first ).lexically_relative( rootPath ).native().c_str(), -1 );
-  }
-
+  for ( ; g_FileListFilled < last ; ++g_FileListFilled )
+    gtk_list_store_insert_with_values( store, &iter, -1, 0, FileRowLabel( *g_FileListLibraries, files[g_FileListFilled] ).c_str(),
+                                       1, static_cast< guint >( files[g_FileListFilled] ), -1 );
   g_signal_handler_unblock( selection, g_FileListID );
 
-  // タグリストの消去
-  store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
-  gtk_list_store_clear( store );
+  return( g_FileListFilled >= files.size() );
 }
 
 /*
-  GetFileNameFromDialog : ファイル・フォルダ名の取得
+  CB_FillFileList : ファイルリストの残りの行を FILL_BATCH 件ずつ作る(コールバック関数)
 
-  builder : GtkBuilderオブジェクトへのポインタ
-  title : ダイアログのタイトル
-  action : ダイアログのタイプ(GTK_FILE_CHOOSER_ACTION_OPEN/SAVE/SELECT_FOLDER)
-  cancelAction : キャンセルボタン用の名称
-  acceptAction : 適用ボタン用の名称
-  fileName : ファイル名を取得する変数へのポインタ
-  currentFolder : 現在のパスを保持する変数へのポインタ
+  data : GtkBuilder オブジェクトへのポインタ
 
-  戻り値 : レスポンスID(GTK_RESPONSE_ACCEPT/CANCEL)
+  戻り値 : 全ての行を作ったら G_SOURCE_REMOVE
 */
-gint GetFileNameFromDialog( GtkBuilder* builder, const string& title,
-                            GtkFileChooserAction action,
-                            const string& cancelAction, const string& acceptAction,
-                            string* fileName, string* currentFolder )
+gboolean CB_FillFileList( gpointer data )
 {
-  // ディレクトリ選択用ダイアログ生成
-  GtkWidget* dialog = gtk_file_chooser_dialog_new
-    (
-     title.c_str(),
-     GTK_WINDOW( gtk_builder_get_object( builder, "root" ) ),
-     action,
-     cancelAction.c_str(), GTK_RESPONSE_CANCEL,
-     acceptAction.c_str(), GTK_RESPONSE_ACCEPT,
-     NULL
-     );
+  if ( ! FillFileList( static_cast< GtkBuilder* >( data ), FILL_BATCH ) )
+    return( G_SOURCE_CONTINUE );
 
-  // カレント・ディレクトリとファイル名のセット
-  if ( action == GTK_FILE_CHOOSER_ACTION_SAVE ) {
-    GtkFileChooser* chooser = GTK_FILE_CHOOSER( dialog );
-    if ( fileName->empty() ) {
-      if ( ! currentFolder->empty() )
-        gtk_file_chooser_set_current_folder( chooser, currentFolder->c_str() );
-      gtk_file_chooser_set_current_name( chooser, "untitled.tag" );
-    } else {
-      GFile* file = g_file_new_for_path( fileName->c_str() );
-      gtk_file_chooser_set_file( chooser, file, 0 );
-      g_object_unref( file );
-    }
-  } else {
-    if ( ! currentFolder->empty() )
-      gtk_file_chooser_set_current_folder( GTK_FILE_CHOOSER( dialog ), currentFolder->c_str() );
-  }
+  g_FileListFillID = 0;
+  return( G_SOURCE_REMOVE );
+}
 
-  gint res = gtk_dialog_run( GTK_DIALOG( dialog ) );
+/*
+  FinishFileList : ファイルリストの残りの行をすぐに作る
 
-  // ディレクトリ選択時の処理
-  if ( res == GTK_RESPONSE_ACCEPT ) {
-    // ルートパスの決定
-    GtkFileChooser* chooser = GTK_FILE_CHOOSER( dialog );
-    gchar* gc = gtk_file_chooser_get_filename( chooser );
-    *fileName = gc;
-    g_free( gc );
-    // カレント・ディレクトリの更新
-    gc = gtk_file_chooser_get_current_folder( chooser );
-    if ( gc != 0 ) {
-      *currentFolder = gc;
-      g_free( gc );
-    }
-  }
+  表示中のファイルと行が一致している前提で行を変更する前に呼ぶ。
 
-  gtk_widget_destroy( dialog );
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void FinishFileList( GtkBuilder* builder )
+{
+  if ( g_FileListFillID == 0 ) return;
 
-  return( res );
+  g_source_remove( g_FileListFillID );
+  g_FileListFillID = 0;
+  FillFileList( builder, g_FileListShown->size() );
 }
 
 /*
-  TagFileStatus::title() : タイトル名を返す
+  InitFileList : ファイルリストの初期化
 
-  戻り値 : タイトル
+  絞り込み条件も消去する。
+  先頭の FILL_BATCH 件の行だけをすぐに作り、残りはアイドル時に少しずつ作る。
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  fileData : ファイルをキーとするタグリスト
+  libraries : 開いているライブラリ
 */
-string TagFileStatus::title() const
+void InitFileList( GtkBuilder* builder, const FileData& fileData, const Libraries& libraries )
 {
-  string title = ( ! hasFile() ) ?
-    ( PROGRAM_NAME + " - [No file]" ) :
-    ( PROGRAM_NAME + " - [" + fileName() + "]" );
+  // ファイルリストのパーツ
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "fileliststore" ) );
+  GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
+  GtkEntry* filter = GTK_ENTRY( gtk_builder_get_object( builder, "filterentry" ) );
+  GtkComboBox* search = GTK_COMBO_BOX( gtk_builder_get_object( builder, "searchcombo" ) );
 
-  if ( edited() )
-    title += EDITED_IDENT;
+  // 作成中の行の中断
+  if ( g_FileListFillID != 0 ) {
+    g_source_remove( g_FileListFillID );
+    g_FileListFillID = 0;
+  }
 
-  return( title );
+  // ファイルリストの更新(グループをまとめて表示中は代表だけを表示する)
+  // 遅延読み込み中は、予約した範囲の空きを除く
+  const PathTable& paths = fileData.paths();
+  auto files = std::make_shared< FileList >();
+  files->reserve( paths.count() );
+  for ( FileId id = 0 ; id < fileData.size() ; ++id )
+    if ( paths.used( id ) ) files->push_back( id );
+  g_FileListResult.reset();
+  if ( g_CollapseGroups ) {
+    g_FileListResult = files;
+    files = std::make_shared< FileList >( g_Groups.collapse( *g_FileListResult ) );
+  }
+  g_signal_handler_block( selection, g_FileListID );
+  gtk_list_store_clear( store );
+  g_signal_handler_unblock( selection, g_FileListID );
+  g_FileListShown = files;
+  g_FileListFilled = 0;
+  g_FileListLibraries = &libraries;
+  if ( ! FillFileList( builder, FILL_BATCH ) )
+    g_FileListFillID = g_idle_add( CB_FillFileList, builder );
+
+  // 絞り込み条件の消去
+  ++g_FilterGeneration;
+  g_FilterQuery = Query();
+  g_signal_handler_block( filter, g_FilterID );
+  gtk_entry_set_text( filter, "" );
+  g_signal_handler_unblock( filter, g_FilterID );
+  g_signal_handler_block( search, g_SearchID );
+  gtk_combo_box_set_active( search, -1 );
+  g_signal_handler_unblock( search, g_SearchID );
+
+  // タグリストと候補の消去
+  store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
+  gtk_list_store_clear( store );
+  store = GTK_LIST_STORE( gtk_builder_get_object( builder, "suggeststore" ) );
+  gtk_list_store_clear( store );
 }
 
 /*
-  TagFileStatus コンストラクタ
+  UpdateFacetList : ファセットリストに g_Facets の変更を反映する
 
   builder : GtkBuilder オブジェクトへのポインタ
 */
-TagFileStatus::TagFileStatus( GtkBuilder* builder )
-  : canSave_( false ), edited_( false ), rootPath_(), tagFile_(), builder_( builder )
+void UpdateFacetList( GtkBuilder* builder )
 {
-  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
-  gtk_window_set_title( rootWin, title().c_str() );
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "facetstore" ) );
+  GtkTreeIter iter;
+
+  bool rebuilt;
+  vector< string > changed = g_Facets.takeChanged( &rebuilt );
+
+  // 数え直した場合は作り直す
+  if ( rebuilt ) {
+    gtk_list_store_clear( store );
+    g_FacetRows.clear();
+    for ( auto i = g_Facets.begin() ; i != g_Facets.end() ; ++i ) {
+      gtk_list_store_insert_with_values( store, &iter, -1, 0, ( i->first ).c_str(), 1, static_cast< guint >( i->second ), -1 );
+      g_FacetRows.emplace_hint( g_FacetRows.end(), i->first, iter );
+    }
+    return;
+  }
+
+  // 変更のあった行だけを更新する
+  for ( auto t = changed.begin() ; t != changed.end() ; ++t ) {
+    std::size_t count = g_Facets.count( *t );
+    auto r = g_FacetRows.find( *t );
+    if ( count == 0 ) {
+      if ( r != g_FacetRows.end() ) {
+        gtk_list_store_remove( store, &( r->second ) );
+        g_FacetRows.erase( r );
+      }
+    } else if ( r == g_FacetRows.end() ) {
+      gtk_list_store_insert_with_values( store, &iter, -1, 0, t->c_str(), 1, static_cast< guint >( count ), -1 );
+      g_FacetRows[*t] = iter;
+    } else {
+      gtk_list_store_set( store, &( r->second ), 1, static_cast< guint >( count ), -1 );
+    }
+  }
 }
 
 /*
-  TagFileStatus::init : ルートパスの新規作成
+  InsertDirectoryRow : ディレクトリリストにディレクトリの行を加える
 
-  rootPath : 新しいルートパス
-  fileData : ファイル名をキーとするタグリストへのポインタ
-  tagData : タグ名をキーとするファイルリストへのポインタ
+  子のディレクトリがあれば、展開時に置き換える空の行を子として加えておく。
+
+  store : ディレクトリリストの GtkTreeStore
+  parent : 親の行(ライブラリのルートなら 0)
+  node : 加えるディレクトリ
+  iter : 加えた行を返す変数へのポインタ
 */
-void TagFileStatus::init( const string& rootPath, FileData* fileData, TagData* tagData )
+void InsertDirectoryRow( GtkTreeStore* store, GtkTreeIter* parent, DirectoryTree::NodeId node, GtkTreeIter* iter )
 {
-  // タグの初期化
-  try {
-    InitTagData( rootPath, fileData, tagData );
-  } catch( std::runtime_error& e ) {
-    MessageBox( e.what(), GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
-    return;
+  const DirectoryTree::Node& dir = g_Directories[node];
+  gtk_tree_store_insert_with_values( store, iter, parent, -1, 0, dir.name.c_str(),
+                                     1, static_cast< guint >( g_Directories.files( node ) ),
+                                     2, static_cast< guint >( dir.tagged ), 3, static_cast< guint >( node ), -1 );
+  g_DirRows[node] = *iter;
+
+  if ( ! dir.children.empty() ) {
+    GtkTreeIter placeholder;
+    gtk_tree_store_insert_with_values( store, &placeholder, iter, -1, 0, "", 3, static_cast< guint >( DirectoryTree::NO_NODE ), -1 );
   }
-
-  // 変数の初期化
-  canSave_ = true;
-  rootPath_ = rootPath;
-  tagFile_.clear();
-  reset();
-
-  // ファイルリストの初期化
-  InitFileList( builder_, *fileData, rootPath_ );
-  // 補完用リストの初期化
-  InitCompletionList( builder_, *tagData );
-  // メッセージ出力
-  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
-  gtk_window_set_title( rootWin, title().c_str() );
-  ShowStatus( builder_, "Path : " + rootPath_ );
 }
 
 /*
-  TagFileStatus::open : タグファイルのオープン
+  InitDirectoryList : ディレクトリリストの初期化
 
-  tagFile : オープンするタグファイル
-  fileData : ファイル名をキーとするタグリストへのポインタ
-  tagData : タグ名をキーとするファイルリストへのポインタ
+  ライブラリのルートの行だけを作り、子の行は展開時に作る。ディレクトリによる絞り込みも解除する。
+  遅延読み込み中は、木を索引から作る。
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  fileData : ファイルをキーとするタグリスト
+  libraries : 開いているライブラリ
+  lazy : 遅延読み込みで開いたライブラリ(全体を読み込んだ場合は nullptr)
 */
-void TagFileStatus::open( const string& tagFile, FileData* fileData, TagData* tagData )
+void InitDirectoryList( GtkBuilder* builder, const FileData& fileData, const Libraries& libraries, const LazyLibrary* lazy )
 {
-  string rootPath;
+  GtkTreeStore* store = GTK_TREE_STORE( gtk_builder_get_object( builder, "dirstore" ) );
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "dirlist" ) );
+  GtkTreeSelection* selection = gtk_tree_view_get_selection( view );
+  GtkTreeIter iter;
 
-  // タグファイルの読み込み
-  try {
-    ReadTagData( tagFile, &rootPath, fileData, tagData );
-  } catch( std::runtime_error& e ) {
-    MessageBox( e.what(), GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
-    return;
+  g_signal_handler_block( selection, g_DirListID );
+  gtk_tree_store_clear( store );
+  g_DirRows.clear();
+  g_DirScope = DirectoryTree::NO_NODE;
+  if ( lazy != nullptr )
+    g_Directories.assign( fileData, libraries.front(), *lazy );
+  else
+    g_Directories.assign( fileData, libraries );
+  for ( auto r = g_Directories.roots().begin() ; r != g_Directories.roots().end() ; ++r )
+    InsertDirectoryRow( store, 0, *r, &iter );
+  g_signal_handler_unblock( selection, g_DirListID );
+
+  // ライブラリが 1 つなら、ルートの直下まで展開しておく
+  if ( g_Directories.roots().size() == 1 && gtk_tree_model_get_iter_first( GTK_TREE_MODEL( store ), &iter ) ) {
+    GtkTreePath* path = gtk_tree_model_get_path( GTK_TREE_MODEL( store ), &iter );
+    gtk_tree_view_expand_row( view, path, FALSE );
+    gtk_tree_path_free( path );
   }
+}
 
-  // 変数の初期化
-  canSave_ = true;
-  rootPath_ = rootPath;
-  tagFile_ = tagFile;
-  reset();
+/*
+  UpdateDirectoryList : ディレクトリリストに g_Directories のファイル数・タグの付いたファイル数の変更を反映する
 
-  // ファイルリストの初期化
-  InitFileList( builder_, *fileData, rootPath_ );
+  作成済みの行だけを更新する(未作成の行は、展開時に現在の数で作られる)。
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void UpdateDirectoryList( GtkBuilder* builder )
+{
+  GtkTreeStore* store = GTK_TREE_STORE( gtk_builder_get_object( builder, "dirstore" ) );
+
+  vector< DirectoryTree::NodeId > changed = g_Directories.takeChanged();
+  for ( auto n = changed.begin() ; n != changed.end() ; ++n ) {
+    auto r = g_DirRows.find( *n );
+    if ( r != g_DirRows.end() )
+      gtk_tree_store_set( store, &( r->second ), 1, static_cast< guint >( g_Directories.files( *n ) ),
+                          2, static_cast< guint >( g_Directories[*n].tagged ), -1 );
+  }
+}
+
+/*
+  RefreshDirectoryList : ディレクトリリストの作成済みの行のファイル数を、作り直した g_Directories に合わせる
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void RefreshDirectoryList( GtkBuilder* builder )
+{
+  GtkTreeStore* store = GTK_TREE_STORE( gtk_builder_get_object( builder, "dirstore" ) );
+
+  for ( auto r = g_DirRows.begin() ; r != g_DirRows.end() ; ++r )
+    gtk_tree_store_set( store, &( r->second ), 1, static_cast< guint >( g_Directories.files( r->first ) ),
+                        2, static_cast< guint >( g_Directories[r->first].tagged ), -1 );
+}
+
+/*
+  InScope : ファイルが選択中のディレクトリ以下にあるか判定する(選択していなければ常に true)
+
+  file : 対象のファイル
+*/
+bool InScope( FileId file )
+{
+  if ( g_DirScope == DirectoryTree::NO_NODE ) return( true );
+  const DirectoryTree::Node& dir = g_Directories[g_DirScope];
+
+  return( dir.first <= file && file < dir.last );
+}
+
+/*
+  ScopeFiles : files のうち選択中のディレクトリ以下のファイルを返す
+
+  ディレクトリ以下のファイルは連続した範囲のため、両端を二分探索して切り出す。
+  全てのファイルが範囲内なら files をそのまま返す。
+
+  files : ファイルリスト(昇順)
+*/
+std::shared_ptr< FileList > ScopeFiles( std::shared_ptr< FileList > files )
+{
+  if ( g_DirScope == DirectoryTree::NO_NODE ) return( files );
+  const DirectoryTree::Node& dir = g_Directories[g_DirScope];
+
+  auto first = std::lower_bound( files->begin(), files->end(), dir.first );
+  auto last = std::lower_bound( first, files->end(), dir.last );
+  if ( first == files->begin() && last == files->end() ) return( files );
+
+  return( std::make_shared< FileList >( first, last ) );
+}
+
+/*
+  ShowFileList : ファイルリストの表示を files に合わせる
+
+  現在の表示と files を先頭から突き合わせ、追加・削除のあった行だけを変更する。
+  ディレクトリを選択中は、files をそのディレクトリ以下に絞ってから突き合わせる。
+  グループをまとめて表示中は、files をグループの代表に置き換えてから突き合わせる。
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  libraries : 開いているライブラリ
+  files : 新たに表示するファイルリスト
+*/
+void ShowFileList( GtkBuilder* builder, const Libraries& libraries, std::shared_ptr< FileList > files )
+{
+  FinishFileList( builder );
+  files = ScopeFiles( files );
+  g_FileListResult.reset();
+  if ( g_CollapseGroups ) {
+    g_FileListResult = files;
+    files = std::make_shared< FileList >( g_Groups.collapse( *files ) );
+  }
+
+  // ファイルリストのパーツ
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "fileliststore" ) );
+  GtkTreeModel* model = GTK_TREE_MODEL( store );
+  GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
+  GtkTreeIter iter;
+
+  g_signal_handler_block( selection, g_FileListID );
+
+  std::shared_ptr< FileList > shown = g_FileListShown;
+  const FileList& current = *shown;
+  vector< FileId > entered; // 表示対象となったファイル
+  vector< FileId > left;    // 表示対象から外れたファイル
+  bool valid = gtk_tree_model_get_iter_first( model, &iter );
+  auto c = current.begin();
+  auto f = files->begin();
+  while ( c != current.end() || f != files->end() ) {
+    if ( f == files->end() || ( c != current.end() && *c < *f ) ) {
+      // 表示対象から外れた行の削除
+      valid = gtk_list_store_remove( store, &iter );
+      left.push_back( *c );
+      ++c;
+    } else if ( c == current.end() || *f < *c ) {
+      // 新たに表示対象となった行の挿入
+      GtkTreeIter newIter;
+      gtk_list_store_insert_before( store, &newIter, ( valid ) ? &iter : 0 );
+      gtk_list_store_set( store, &newIter, 0, FileRowLabel( libraries, *f ).c_str(), 1, static_cast< guint >( *f ), -1 );
+      entered.push_back( *f );
+      ++f;
+    } else {
+      valid = gtk_tree_model_iter_next( model, &iter );
+      ++c;
+      ++f;
+    }
+  }
+
+  g_signal_handler_unblock( selection, g_FileListID );
+
+  g_FileListShown = files;
+
+  // ファセットの更新(差分が結果より大きければ数え直す)
+  if ( entered.size() + left.size() > files->size() ) {
+    g_Facets.compute( *files, g_TagData );
+  } else {
+    for ( auto i = left.begin() ; i != left.end() ; ++i )
+      g_Facets.eraseFile( g_FileData[*i] );
+    for ( auto i = entered.begin() ; i != entered.end() ; ++i )
+      g_Facets.insertFile( g_FileData[*i] );
+  }
+  UpdateFacetList( builder );
+
+  // 選択中のファイルが表示対象から外れた場合はタグリストと候補を消去する
+  gint selected = gtk_tree_selection_count_selected_rows( selection );
+  if ( selected == 0 ) {
+    store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
+    gtk_list_store_clear( store );
+    store = GTK_LIST_STORE( gtk_builder_get_object( builder, "suggeststore" ) );
+    gtk_list_store_clear( store );
+  } else if ( selected > 1 && ! left.empty() ) {
+    RefreshTagList( builder );
+  }
+}
+
+/*
+  ReshowFileList : ファイルリストの全ての行を入れ直して、絞り込み結果 matched を表示する
+
+  グループの表示を切り替えた場合や、まとめて表示中にグループが変わった場合は、
+  代表の行と行の文字列(グループのファイル数)が変わるため、差分ではなく作り直す。
+
+  status : TagFileStatus オブジェクトへのポインタ
+  matched : 表示する絞り込み結果(グループをまとめる前)
+*/
+void ReshowFileList( TagFileStatus* status, std::shared_ptr< FileList > matched )
+{
+  GtkBuilder* builder = status->builder();
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "fileliststore" ) );
+  GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
+
+  FinishFileList( builder );
+  g_signal_handler_block( selection, g_FileListID );
+  gtk_list_store_clear( store );
+  g_signal_handler_unblock( selection, g_FileListID );
+
+  g_FileListShown = std::make_shared< FileList >();
+  g_Facets.compute( *g_FileListShown, g_TagData );
+  ShowFileList( builder, status->libraries(), matched );
+}
+
+/*
+  CB_FilterDone : バックグラウンドで評価した絞り込み結果の反映(コールバック関数)
+
+  data : FilterResult オブジェクトへのポインタ
+
+  戻り値 : 常に G_SOURCE_REMOVE
+*/
+gboolean CB_FilterDone( gpointer data )
+{
+  std::unique_ptr< FilterResult > result( static_cast< FilterResult* >( data ) );
+
+  // 評価中に条件やデータが変更された場合は破棄する
+  if ( result->id != g_FilterGeneration )
+    return( G_SOURCE_REMOVE );
+
+  TagFileStatus* status = result->status;
+  ShowFileList( status->builder(), status->libraries(), result->files );
+  g_FilterQuery = result->query;
+
+  return( G_SOURCE_REMOVE );
+}
+
+/*
+  StartFilter : 絞り込み条件の評価をバックグラウンドで開始する
+
+  条件が前回より詳しくなった場合は、前回の結果を対象に評価する。
+  実行中の評価は中断される。
+  遅延読み込み中は、条件を満たしうる読み込んでいないディレクトリを先に読み込む(読み込み後に評価し直される)。
+
+  status : TagFileStatus オブジェクトへのポインタ
+  incremental : false なら前回の結果を使わずに全ファイルを評価する(タグの階層を変えた場合など)
+*/
+void StartFilter( TagFileStatus* status, bool incremental = true )
+{
+  GtkEntry* entry = GTK_ENTRY( gtk_builder_get_object( status->builder(), "filterentry" ) );
+  Query query( gtk_entry_get_text( entry ) );
+
+  if ( status->lazy() != nullptr && ! g_Loading && ! query.empty() ) {
+    vector< LazyTagFile::DirIndex > dirs = status->lazy()->pending( query, g_TagTree, g_TagRules );
+    if ( ! dirs.empty() ) {
+      status->load( dirs, &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+      return;
+    }
+  }
+
+  unsigned id = ++g_FilterGeneration;
+  std::shared_ptr< const FileList > current;
+  if ( incremental && query.refines( g_FilterQuery ) )
+    current = MatchedFiles();
+  std::shared_ptr< const IndexSnapshot > snapshot = g_Versions.current();
+
+  ++g_FilterWorkers;
+  std::thread( [query, id, current, snapshot, status]() {
+      CancelToken cancel{ &g_FilterGeneration, id };
+      auto files = std::make_shared< FileList >();
+      bool done = ( current ) ?
+        query.refine( *current, snapshot->tagData, snapshot->tagTree, snapshot->tagRules, files.get(), cancel ) :
+        query.evaluate( snapshot->fileData, snapshot->tagData, snapshot->tagTree, snapshot->tagRules,
+                        files.get(), cancel );
+      if ( done )
+        g_idle_add( CB_FilterDone, new FilterResult{ id, query, files, status } );
+      --g_FilterWorkers;
+    } ).detach();
+}
+
+/*
+  CB_FilterChanged : 絞り込み条件の変更(コールバック関数)
+
+  GtkSearchEntry の "search-changed" はキー入力が止まってから発生するため、
+  入力中に毎回評価が始まることはない。
+
+  entry : GtkSearchEntry オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_FilterChanged( GtkEntry* entry, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  // 保存した検索条件の選択を解除する
+  GtkComboBox* search = GTK_COMBO_BOX( gtk_builder_get_object( status->builder(), "searchcombo" ) );
+  g_signal_handler_block( search, g_SearchID );
+  gtk_combo_box_set_active( search, -1 );
+  g_signal_handler_unblock( search, g_SearchID );
+
+  StartFilter( status );
+}
+
+/*
+  RefreshFilter : データの変更で中断された絞り込みを再開する
+
+  status : TagFileStatus オブジェクトへのポインタ
+*/
+void RefreshFilter( TagFileStatus* status )
+{
+  GtkEntry* entry = GTK_ENTRY( gtk_builder_get_object( status->builder(), "filterentry" ) );
+  if ( ! ( Query( gtk_entry_get_text( entry ) ) == g_FilterQuery ) )
+    StartFilter( status );
+}
+
+/*
+  ShowFileRow : ファイルリストのファイル1件の表示・非表示を切り替える
+
+  選択中のディレクトリ以下にないファイルは表示しない。
+  グループをまとめて表示中は、まとめる前の結果を更新し、グループのファイルが 1 つでも結果にあれば代表の行を表示する。
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  libraries : 開いているライブラリ
+  file : 対象のファイル
+  show : 表示する場合は true
+*/
+void ShowFileRow( GtkBuilder* builder, const Libraries& libraries, FileId file, bool show )
+{
+  FinishFileList( builder );
+  show = show && InScope( file );
+  if ( g_CollapseGroups ) {
+    if ( UpdateResult( &g_FileListResult, file, show ) < 0 ) return;
+    if ( g_Groups.grouped( file ) ) {
+      vector< FileId > members = g_Groups.members( file );
+      show = std::any_of( members.begin(), members.end(), []( FileId m ) {
+          return( std::binary_search( g_FileListResult->begin(), g_FileListResult->end(), m ) ); } );
+      file = members.front();
+    }
+  }
+
+  long index = UpdateResult( &g_FileListShown, file, show );
+  if ( index < 0 ) return;
+
+  if ( show )
+    g_Facets.insertFile( g_FileData[file] );
+  else
+    g_Facets.eraseFile( g_FileData[file] );
+
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "fileliststore" ) );
+  GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
+  GtkTreeIter iter;
+
+  g_signal_handler_block( selection, g_FileListID );
+  if ( show ) {
+    gtk_list_store_insert_with_values( store, &iter, index, 0, FileRowLabel( libraries, file ).c_str(),
+                                       1, static_cast< guint >( file ), -1 );
+  } else if ( gtk_tree_model_iter_nth_child( GTK_TREE_MODEL( store ), &iter, 0, index ) ) {
+    gtk_list_store_remove( store, &iter );
+  }
+  g_signal_handler_unblock( selection, g_FileListID );
+}
+
+/*
+  ReflectTagChange : 複数のファイルへの同じタグの追加・削除を、保存した検索条件と表示中のファイルリスト、
+                     補完用の索引、共起行列、ディレクトリ毎のファイル数に反映する
+
+  補完用の索引とファセットリスト、ディレクトリリストは、ファイル数によらず 1 回だけ更新する。
+
+  status : TagFileStatus オブジェクトへのポインタ
+  files : タグが変更されたファイル
+  tag : 追加・削除されたタグ
+  added : 追加の場合は true、削除の場合は false
+*/
+void ReflectTagChange( TagFileStatus* status, const vector< FileId >& files, const string& tag, bool added )
+{
+  bool concerns = g_FilterQuery.concerns( tag, g_TagTree, g_TagRules );
+  status->edit( g_FileData, files );
+
+  for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+    const TagSet& tags = g_FileData[*f];
+
+    g_Searches.update( *f, tag, tags, g_TagTree, g_TagRules );
+
+    if ( added )
+      g_Suggester.insert( tag, tags );
+    else
+      g_Suggester.erase( tag, tags );
+
+    g_Directories.update( g_FileData, *f );
+
+    // 表示中のファイルならファセットに反映する
+    if ( std::binary_search( g_FileListShown->begin(), g_FileListShown->end(), *f ) ) {
+      if ( added )
+        g_Facets.insertTag( tag );
+      else
+        g_Facets.eraseTag( tag );
+    }
+
+    if ( concerns )
+      ShowFileRow( status->builder(), status->libraries(), *f, g_FilterQuery.match( tags, g_TagTree, g_TagRules ) );
+  }
+
+  const TagData& tagData = g_TagData; // 読むだけなのでチャンクを複製しない
+  auto t = tagData.find( tag );
+  g_Completion.update( tag, ( t == tagData.end() ) ? 0 : ( t->second ).size() );
+
+  UpdateFacetList( status->builder() );
+  UpdateDirectoryList( status->builder() );
+}
+
+/*
+  ReflectTagChange : ファイル 1 件へのタグの追加・削除を反映する
+
+  status : TagFileStatus オブジェクトへのポインタ
+  file : タグが変更されたファイル
+  tag : 追加・削除されたタグ
+  added : 追加の場合は true、削除の場合は false
+*/
+void ReflectTagChange( TagFileStatus* status, FileId file, const string& tag, bool added )
+{
+  ReflectTagChange( status, vector< FileId >( 1, file ), tag, added );
+}
+
+/*
+  InitSearchList : 保存した検索条件のリストの初期化
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  searches : 保存した検索条件
+  active : 選択状態にする検索名
+*/
+void InitSearchList( GtkBuilder* builder, const SavedSearches& searches, const string& active = string() )
+{
+  GtkComboBoxText* combo = GTK_COMBO_BOX_TEXT( gtk_builder_get_object( builder, "searchcombo" ) );
+
+  g_signal_handler_block( combo, g_SearchID );
+
+  gtk_combo_box_text_remove_all( combo );
+  gint index = -1;
+  gint n = 0;
+  for ( auto s = searches.begin() ; s != searches.end() ; ++s, ++n ) {
+    gtk_combo_box_text_append_text( combo, ( s->first ).c_str() );
+    if ( s->first == active ) index = n;
+  }
+  gtk_combo_box_set_active( GTK_COMBO_BOX( combo ), index );
+
+  g_signal_handler_unblock( combo, g_SearchID );
+}
+
+/*
+  CB_SearchSelected : 保存した検索条件の表示(コールバック関数)
+
+  保存してある結果を表示するため、評価は行わない。
+  遅延読み込み中は、条件を満たしうる読み込んでいないディレクトリを続けて読み込み、該当するファイルを結果と表示に加える。
+
+  combo : GtkComboBoxText オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_SearchSelected( GtkComboBox* combo, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  gchar* gc = gtk_combo_box_text_get_active_text( GTK_COMBO_BOX_TEXT( combo ) );
+  if ( gc == 0 ) return;
+  const SavedSearches::Entry* entry = g_Searches.find( gc );
+  g_free( gc );
+  if ( entry == nullptr ) return;
+
+  // 実行中の絞り込みを中断し、検索文字列を入れ替える
+  ++g_FilterGeneration;
+  GtkEntry* filter = GTK_ENTRY( gtk_builder_get_object( builder, "filterentry" ) );
+  g_signal_handler_block( filter, g_FilterID );
+  gtk_entry_set_text( filter, ( entry->text ).c_str() );
+  g_signal_handler_unblock( filter, g_FilterID );
+
+  ShowFileList( builder, status->libraries(), entry->files );
+  g_FilterQuery = entry->query;
+
+  // 読み込み後は表示中の条件として、該当するファイルが保存した結果と表示に加わる
+  if ( status->lazy() != nullptr && ! g_Loading ) {
+    vector< LazyTagFile::DirIndex > dirs = status->lazy()->pending( g_FilterQuery, g_TagTree, g_TagRules );
+    if ( ! dirs.empty() )
+      status->load( dirs, &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+  }
+}
+
+/*
+  CB_FeaturesIndexed : バックグラウンドで求めた特徴量を画像の索引に登録する(コールバック関数)
+
+  data : FeatureBatch オブジェクトへのポインタ
+
+  戻り値 : 常に G_SOURCE_REMOVE
+*/
+gboolean CB_FeaturesIndexed( gpointer data )
+{
+  std::unique_ptr< FeatureBatch > batch( static_cast< FeatureBatch* >( data ) );
+
+  // 作成中に対象のファイルが変わった場合は破棄する
+  if ( batch->id != g_IndexGeneration )
+    return( G_SOURCE_REMOVE );
+
+  // 作成中に遅延読み込みで追い出したファイルは登録しない
+  const PathTable& paths = g_FileData.paths();
+  for ( auto f = batch->features.begin() ; f != batch->features.end() ; ++f )
+    if ( paths.used( f->first ) ) g_Images.insert( f->first, f->second );
+
+  return( G_SOURCE_REMOVE );
+}
+
+/*
+  IndexImages : targets の特徴量をバックグラウンドで求め、画像の索引に登録する
+
+  id : 索引作成の世代番号(g_IndexGeneration と変わったら中断する)
+  targets : 対象のファイル(nullptr なら全てのファイル)
+  saved : 特徴量ファイルから読み込んだ特徴量(targets の位置、targets が nullptr なら識別番号をインデックスとする)
+
+  更新時刻が保存時と変わらないファイルは saved の値を使い、画像を読み込まない。
+  パスは開始時の版から読むため、作成中に編集を待たせることはない。予約した範囲の空きは飛ばす。
+*/
+void IndexImages( unsigned id, std::shared_ptr< const vector< FileId > > targets,
+                  std::shared_ptr< const vector< ImageFeatures > > saved )
+{
+  std::shared_ptr< const IndexSnapshot > snapshot = g_Versions.current();
+  const FileData* files = &( snapshot->fileData );
+  std::size_t size = ( targets ) ? targets->size() : files->size();
+
+  unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+  auto next = std::make_shared< std::atomic< std::size_t > >( 0 );
+  for ( unsigned i = 0 ; i < threads ; ++i ) {
+    ++g_IndexWorkers;
+    std::thread( [id, snapshot, files, targets, size, saved, next]() {
+        vector< std::pair< FileId, ImageFeatures > > batch;
+        for ( std::size_t n = ( *next )++ ; n < size && id == g_IndexGeneration ; n = ( *next )++ ) {
+          FileId f = ( targets ) ? ( *targets )[n] : static_cast< FileId >( n );
+          if ( ! files->paths().used( f ) ) continue;
+          FileStamp stamp;
+          if ( ! GetFileStamp( files->path( f ), &stamp ) ) continue;
+          ImageFeatures features;
+          if ( n < saved->size() && ( *saved )[n].mtime == stamp.mtime )
+            batch.emplace_back( f, ( *saved )[n] );
+          else if ( ComputeImageFeatures( files->path( f ), stamp.mtime, &features ) )
+            batch.emplace_back( f, features );
+          if ( batch.size() == FEATURE_BATCH ) {
+            g_idle_add( CB_FeaturesIndexed, new FeatureBatch{ id, std::move( batch ) } );
+            batch.clear();
+          }
+        }
+        if ( ! batch.empty() )
+          g_idle_add( CB_FeaturesIndexed, new FeatureBatch{ id, std::move( batch ) } );
+        --g_IndexWorkers;
+      } ).detach();
+  }
+}
+
+/*
+  StartImageIndex : 全ファイルの特徴量をバックグラウンドで求め、画像の索引を作り直す
+
+  saved : 特徴量ファイルから読み込んだ特徴量(識別番号をインデックスとする)
+
+  実行中の作成は中断される。
+*/
+void StartImageIndex( std::shared_ptr< const vector< ImageFeatures > > saved )
+{
+  unsigned id = ++g_IndexGeneration;
+  g_Images.assign( g_FileData.size() );
+
+  IndexImages( id, nullptr, saved );
+}
+
+/*
+  EditScope : g_FileData と g_TagData(と g_TagTree・g_TagRules)の編集の区切り
+
+  開始時に実行中の絞り込みを中断し、終了時に編集後のデータを新しい版として公開する。
+  操作の名前を指定した場合は、その間に g_EditLog に記録した差分を 1 つの操作にまとめる。
+*/
+class EditScope
+{
+public:
+
+  EditScope() : grouped_( false )
+  { ++g_FilterGeneration; }
+
+  explicit EditScope( const string& label ) : grouped_( true )
+  {
+    ++g_FilterGeneration;
+    g_EditLog.begin( label );
+  }
+
+  EditScope( const EditScope& ) = delete;
+  EditScope& operator=( const EditScope& ) = delete;
+
+  ~EditScope()
+  {
+    if ( grouped_ ) g_EditLog.end();
+    g_Versions.publish( g_FileData, g_TagData, g_TagTree, g_TagRules );
+  }
+
+private:
+
+  bool grouped_; // 操作として記録するか？
+};
+
+/*
+  GetFileNameFromDialog : ファイル・フォルダ名の取得
+
+  builder : GtkBuilderオブジェクトへのポインタ
+  title : ダイアログのタイトル
+  action : ダイアログのタイプ(GTK_FILE_CHOOSER_ACTION_OPEN/SAVE/SELECT_FOLDER)
+  cancelAction : キャンセルボタン用の名称
+  acceptAction : 適用ボタン用の名称
+  fileName : ファイル名を取得する変数へのポインタ
+  currentFolder : 現在のパスを保持する変数へのポインタ
+
+  戻り値 : レスポンスID(GTK_RESPONSE_ACCEPT/CANCEL)
+*/
+gint GetFileNameFromDialog( GtkBuilder* builder, const string& title,
+                            GtkFileChooserAction action,
+                            const string& cancelAction, const string& acceptAction,
+                            string* fileName, string* currentFolder )
+{
+  // ディレクトリ選択用ダイアログ生成
+  GtkWidget* dialog = gtk_file_chooser_dialog_new
+    (
+     title.c_str(),
+     GTK_WINDOW( gtk_builder_get_object( builder, "root" ) ),
+     action,
+     cancelAction.c_str(), GTK_RESPONSE_CANCEL,
+     acceptAction.c_str(), GTK_RESPONSE_ACCEPT,
+     NULL
+     );
+
+  // カレント・ディレクトリとファイル名のセット
+  if ( action == GTK_FILE_CHOOSER_ACTION_SAVE ) {
+    GtkFileChooser* chooser = GTK_FILE_CHOOSER( dialog );
+    if ( fileName->empty() ) {
+      if ( ! currentFolder->empty() )
+        gtk_file_chooser_set_current_folder( chooser, currentFolder->c_str() );
+      gtk_file_chooser_set_current_name( chooser, "untitled.tag" );
+    } else {
+      GFile* file = g_file_new_for_path( fileName->c_str() );
+      gtk_file_chooser_set_file( chooser, file, 0 );
+      g_object_unref( file );
+    }
+  } else {
+    if ( ! currentFolder->empty() )
+      gtk_file_chooser_set_current_folder( GTK_FILE_CHOOSER( dialog ), currentFolder->c_str() );
+  }
+
+  gint res = gtk_dialog_run( GTK_DIALOG( dialog ) );
+
+  // ディレクトリ選択時の処理
+  if ( res == GTK_RESPONSE_ACCEPT ) {
+    // ルートパスの決定
+    GtkFileChooser* chooser = GTK_FILE_CHOOSER( dialog );
+    gchar* gc = gtk_file_chooser_get_filename( chooser );
+    *fileName = gc;
+    g_free( gc );
+    // カレント・ディレクトリの更新
+    gc = gtk_file_chooser_get_current_folder( chooser );
+    if ( gc != 0 ) {
+      *currentFolder = gc;
+      g_free( gc );
+    }
+  }
+
+  gtk_widget_destroy( dialog );
+
+  return( res );
+}
+
+/*
+  GetFileNamesFromDialog : 複数のファイル名の取得
+
+  builder : GtkBuilderオブジェクトへのポインタ
+  title : ダイアログのタイトル
+  fileNames : 選択したファイル名を取得する変数へのポインタ
+  currentFolder : 現在のパスを保持する変数へのポインタ
+
+  戻り値 : レスポンスID(GTK_RESPONSE_ACCEPT/CANCEL)
+*/
+gint GetFileNamesFromDialog( GtkBuilder* builder, const string& title, vector< string >* fileNames, string* currentFolder )
+{
+  // ファイル選択用ダイアログ生成
+  GtkWidget* dialog = gtk_file_chooser_dialog_new
+    (
+     title.c_str(),
+     GTK_WINDOW( gtk_builder_get_object( builder, "root" ) ),
+     GTK_FILE_CHOOSER_ACTION_OPEN,
+     "Cancel", GTK_RESPONSE_CANCEL,
+     "Open", GTK_RESPONSE_ACCEPT,
+     NULL
+     );
+  GtkFileChooser* chooser = GTK_FILE_CHOOSER( dialog );
+  gtk_file_chooser_set_select_multiple( chooser, TRUE );
+  if ( ! currentFolder->empty() )
+    gtk_file_chooser_set_current_folder( chooser, currentFolder->c_str() );
+
+  gint res = gtk_dialog_run( GTK_DIALOG( dialog ) );
+
+  // ファイル選択時の処理
+  if ( res == GTK_RESPONSE_ACCEPT ) {
+    GSList* list = gtk_file_chooser_get_filenames( chooser );
+    for ( GSList* l = list ; l != 0 ; l = l->next ) {
+      fileNames->push_back( static_cast< gchar* >( l->data ) );
+      g_free( l->data );
+    }
+    g_slist_free( list );
+    // カレント・ディレクトリの更新
+    gchar* gc = gtk_file_chooser_get_current_folder( chooser );
+    if ( gc != 0 ) {
+      *currentFolder = gc;
+      g_free( gc );
+    }
+  }
+
+  gtk_widget_destroy( dialog );
+
+  return( res );
+}
+
+/*
+  TagFileStatus::title() : タイトル名を返す
+
+  戻り値 : タイトル
+*/
+string TagFileStatus::title() const
+{
+  string title = ( ! hasFile() ) ?
+    ( PROGRAM_NAME + " - [No file]" ) :
+    ( PROGRAM_NAME + " - [" + fileName() + "]" );
+
+  if ( edited() )
+    title += EDITED_IDENT;
+
+  return( title );
+}
+
+/*
+  TagFileStatus::fileName : ライブラリ毎のタグファイルのファイル名をカンマで区切って返す
+
+  戻り値 : ファイル名
+*/
+string TagFileStatus::fileName() const
+{
+  string res;
+  for ( auto l = libraries_.begin() ; l != libraries_.end() ; ++l ) {
+    if ( l != libraries_.begin() ) res += ", ";
+    res += fs::path( l->tagFile ).filename().native();
+  }
+
+  return( res );
+}
+
+/*
+  TagFileStatus コンストラクタ
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+TagFileStatus::TagFileStatus( GtkBuilder* builder )
+  : canSave_( false ), edited_( false ), libraries_(), saved_(), lazy_(), features_(), builder_( builder )
+{
+  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
+  gtk_window_set_title( rootWin, title().c_str() );
+}
+
+/*
+  TagFileStatus::init : ルートパスの新規作成
+
+  rootPath : 新しいルートパス
+  fileData : ファイル名をキーとするタグリストへのポインタ
+  tagData : タグ名をキーとするファイルリストへのポインタ
+  tagTree : タグの階層へのポインタ
+  tagRules : タグの規則へのポインタ
+  groups : ファイルのグループへのポインタ
+  searches : 保存した検索条件へのポインタ
+*/
+void TagFileStatus::init( const string& rootPath, FileData* fileData, TagData* tagData, TagTree* tagTree, TagRules* tagRules,
+                          FileGroups* groups, SavedSearches* searches )
+{
+  // タグの初期化
+  try {
+    EditScope edit;
+    InitTagData( rootPath, fileData, tagData );
+    tagTree->clear();
+    tagRules->clear();
+    groups->assign( fileData->size() );
+    g_HashCache.clear();
+    g_EditLog.clear();
+  } catch( std::runtime_error& e ) {
+    MessageBox( e.what(), GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
+    return;
+  }
+
+  // 変数の初期化
+  canSave_ = true;
+  libraries_.assign( 1, LibraryRoot{ rootPath, string(), 0, static_cast< FileId >( fileData->size() ) } );
+  saved_ = LibrarySettings();
+  lazy_.reset();
+  features_.clear();
+  reset();
+  searches->assign( SearchData(), *fileData, *tagData, *tagTree, *tagRules );
+
+  // ファイルリストとディレクトリリストの初期化
+  InitFileList( builder_, *fileData, libraries_ );
+  InitDirectoryList( builder_, *fileData, libraries_, lazy_.get() );
+  // 検索条件リストの初期化
+  InitSearchList( builder_, *searches );
+  // ファセットリストの初期化(グループをまとめて表示中は代表のファイルで数える)
+  if ( g_CollapseGroups )
+    g_Facets.compute( *g_FileListShown, *tagData );
+  else
+    g_Facets.compute( *tagData );
+  UpdateFacetList( builder_ );
+  // 補完用リストの初期化
+  InitCompletionList( builder_, *tagData );
+  // 共起行列の初期化
+  g_Suggester.assign( *fileData );
+  // 画像の索引の作成開始
+  StartImageIndex( std::make_shared< const vector< ImageFeatures > >() );
+  // メッセージ出力
+  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
+  gtk_window_set_title( rootWin, title().c_str() );
+  ShowStatus( builder_, "Path : " + rootPath );
+}
+
+/*
+  ReadWithProgress : read を別のスレッドで実行し、終わるまでステータスバーに進み具合を表示する
+
+  待つ間もウィンドウを再描画できるよう、イベントを処理しながら待つ。
+  ウィンドウへの入力は受け付けず、他のスレッドからの依頼は読み込みが終わってから実行する。
+  作成中のファイルリストの行は、読み込み中に g_FileData を参照しないよう先に作り終える。
+
+  builder : GtkBuilder オブジェクトへのポインタ
+  read : 読み込み処理(進み具合を数える変数へのポインタを受け取る)
+
+  戻り値 : read の戻り値(read が送出した例外はそのまま送出する)
+*/
+std::size_t ReadWithProgress( GtkBuilder* builder, std::function< std::size_t( ReadProgress* ) > read )
+{
+  FinishFileList( builder );
+
+  GtkWidget* rootWin = GTK_WIDGET( gtk_builder_get_object( builder, "root" ) );
+  ReadProgress progress;
+  g_Loading = true;
+  gtk_widget_set_sensitive( rootWin, FALSE );
+  std::future< std::size_t > reading = std::async( std::launch::async, read, &progress );
+  while ( reading.wait_for( PROGRESS_INTERVAL ) != std::future_status::ready ) {
+    ShowStatus( builder, "Scanning : " + std::to_string( progress.scanned ) + " files / Reading : " +
+                std::to_string( progress.parsed ) + " records" + ( ( progress.joining ) ? " (matching)" : "" ) );
+    while ( gtk_events_pending() )
+      gtk_main_iteration();
+  }
+  gtk_widget_set_sensitive( rootWin, TRUE );
+  g_Loading = false;
+
+  return( reading.get() );
+}
+
+/*
+  TagFileStatus::open : タグファイルのオープン
+
+  tagFiles : オープンするタグファイル(ライブラリ毎に 1 つ)
+  fileData : ファイル名をキーとするタグリストへのポインタ
+  tagData : タグ名をキーとするファイルリストへのポインタ
+  tagTree : タグの階層へのポインタ
+  tagRules : タグの規則へのポインタ
+  groups : ファイルのグループへのポインタ
+  searches : 保存した検索条件へのポインタ
+*/
+void TagFileStatus::open( const vector< string >& tagFiles, FileData* fileData, TagData* tagData, TagTree* tagTree,
+                          TagRules* tagRules, FileGroups* groups, SavedSearches* searches )
+{
+  Libraries libraries;
+  SearchData searchData;
+  TagParents tagParents;
+  TagRuleData tagRuleData;
+  GroupData groupData;
+  std::size_t relinked = 0; // 移動・名前変更先を見つけたファイル数
+  std::unique_ptr< LazyLibrary > lazy; // 遅延読み込みで開いたライブラリ
+
+  // タグファイルの読み込み(ディレクトリの走査と並行して読み、進み具合を表示する)
+  // 索引のある大きなタグファイルを 1 つだけ開く場合は、索引だけを読み込んでディレクトリ毎に識別番号の範囲を予約し、
+  // ディレクトリは展開時や絞り込み時に読み込む
+  try {
+    EditScope edit;
+    if ( tagFiles.size() == 1 ) {
+      lazy.reset( new LazyLibrary( LAZY_CAPACITY ) );
+      if ( ! lazy->open( tagFiles.front(), LAZY_THRESHOLD, fileData ) ) lazy.reset();
+    }
+    if ( lazy ) {
+      const LazyTagFile& file = lazy->file();
+      searchData = file.searches();
+      tagParents = file.parents();
+      tagRuleData = file.rules();
+      libraries.assign( 1, LibraryRoot{ file.rootPath(), tagFiles.front(), 0, static_cast< FileId >( fileData->size() ),
+                                        LibrarySettings{ searchData, tagParents, tagRuleData } } );
+      tagData->clear();
+      groupData.assign( fileData->size(), 0 );
+      g_HashCache.clear();
+    } else {
+      relinked = ReadWithProgress( builder_, [&]( ReadProgress* progress ) {
+          return( ReadLibraries( tagFiles, &libraries, fileData, tagData, &searchData, &tagParents, &tagRuleData,
+                                 &groupData, &g_HashCache, progress ) ); } );
+    }
+    tagTree->assign( tagParents, *tagData );
+    tagRules->assign( tagRuleData );
+    groups->assign( groupData );
+    g_EditLog.clear();
+  } catch( std::runtime_error& e ) {
+    MessageBox( e.what(), GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
+    return;
+  }
+
+  // 変数の初期化
+  canSave_ = true;
+  libraries_ = libraries;
+  saved_ = LibrarySettings{ searchData, tagParents, tagRuleData };
+  lazy_ = std::move( lazy );
+  features_.clear();
+  reset();
+  searches->assign( searchData, *fileData, *tagData, *tagTree, *tagRules );
+
+  // ファイルリストとディレクトリリストの初期化
+  InitFileList( builder_, *fileData, libraries_ );
+  InitDirectoryList( builder_, *fileData, libraries_, lazy_.get() );
+  // 検索条件リストの初期化
+  InitSearchList( builder_, *searches );
+  // ファセットリストの初期化(グループをまとめて表示中は代表のファイルで数える)
+  if ( g_CollapseGroups )
+    g_Facets.compute( *g_FileListShown, *tagData );
+  else
+    g_Facets.compute( *tagData );
+  UpdateFacetList( builder_ );
   // 補完用リストの初期化
   InitCompletionList( builder_, *tagData );
+  // 共起行列の初期化
+  g_Suggester.assign( *fileData );
+  // 画像の索引の作成開始(保存済みの特徴量をライブラリ毎に読み込んで使う)
+  // 遅延読み込み中は、特徴量ファイルを開いておき、読み込んだファイルの分だけ引く
+  auto saved = std::make_shared< vector< ImageFeatures > >();
+  string paths; // ルートパス(カンマ区切り)
+  for ( auto l = libraries_.begin() ; l != libraries_.end() ; ++l ) {
+    if ( lazy_ )
+      features_.open( FeatureFileName( l->tagFile ), l->rootPath );
+    else
+      ReadImageFeatures( FeatureFileName( l->tagFile ), l->rootPath, *fileData, saved.get() );
+    paths += ( ( l == libraries_.begin() ) ? "" : ", " ) + l->rootPath;
+  }
+  StartImageIndex( saved );
+  // メッセージ出力
+  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
+  gtk_window_set_title( rootWin, title().c_str() );
+  ShowStatus( builder_, "Path : " + paths +
+              ( ( relinked > 0 ) ? " (" + std::to_string( relinked ) + " moved files relinked)" : "" ) +
+              ( ( lazy_ ) ? " (directories are loaded when expanded or searched)" : "" ) );
+}
+
+/*
+  TagFileStatus::load : 遅延読み込み中のライブラリのディレクトリを読み込み、読み込み済みのファイルに加える
+
+  読み込んだファイルは予約した範囲に入るため、通常は加えたファイルの分だけ、保存した検索条件・表示中の絞り込み結果・
+  補完用リスト・共起行列・画像の索引・ディレクトリの木を更新する。
+  このとき読み込んだファイル数が上限を超えていれば、使われていないディレクトリを追い出して同じものから除く。
+  範囲に収まらずに識別番号が振り直された場合と、全てのディレクトリを読み込んでパスの順に並べ直した場合は、
+  識別番号を持つもの(タグの階層・グループ・編集の履歴・保存した検索条件・ファイルリストの行・画像の索引)を
+  新しい番号で作り直す。全てのディレクトリを読み込んだら、遅延読み込みを終える。
+
+  dirs : 読み込むディレクトリ
+  fileData : ファイル名をキーとするタグリストへのポインタ
+  tagData : タグ名をキーとするファイルリストへのポインタ
+  tagTree : タグの階層へのポインタ
+  tagRules : タグの規則へのポインタ
+  groups : ファイルのグループへのポインタ
+  searches : 保存した検索条件へのポインタ
+*/
+void TagFileStatus::load( const vector< LazyTagFile::DirIndex >& dirs, FileData* fileData, TagData* tagData, TagTree* tagTree,
+                          TagRules* tagRules, FileGroups* groups, SavedSearches* searches )
+{
+  if ( ! lazy_ || g_Loading || dirs.empty() ) return;
+
+  bool renumbered = false;  // 識別番号を振り直したか？
+  auto added = std::make_shared< vector< FileId > >(); // 加えたファイル(新しい識別番号)
+  vector< FileId > ids;     // 元の識別番号をインデックスとする新しい識別番号
+  std::size_t relinked = 0; // 移動・名前変更先を見つけたファイル数
+  try {
+    EditScope edit;
+    ReadWithProgress( builder_, [&]( ReadProgress* progress ) {
+        renumbered = lazy_->load( dirs, fileData, tagData, tagTree, groups, &g_HashCache, added.get(), &ids, &relinked,
+                                  progress );
+        return( added->size() ); } );
+    if ( renumbered ) {
+      tagTree->assign( tagTree->data(), *tagData );
+      g_EditLog.remap( ids );
+    }
+  } catch( std::runtime_error& e ) {
+    MessageBox( e.what(), GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
+    return;
+  }
+  if ( ! renumbered && added->empty() ) return;
+
+  // 加えたファイルの保存済みの特徴量(added の位置をインデックスとする)
+  const PathTable& paths = fileData->paths();
+  auto addedFeatures = std::make_shared< vector< ImageFeatures > >( added->size(), ImageFeatures{ NO_FEATURES, 0, ColorHistogram() } );
+  for ( std::size_t i = 0 ; i < added->size() ; ++i )
+    features_.find( paths.path( ( *added )[i] ), &( *addedFeatures )[i] );
+
+  LibraryRoot& library = libraries_.front();
+  library.last = static_cast< FileId >( fileData->size() );
+  if ( ! renumbered ) {
+    // 読み込んだファイル数が上限を超えていれば、使われていないディレクトリを追い出す
+    vector< FileId > removed = evict( dirs, fileData, tagData, tagTree, tagRules, groups );
+    // 保存した検索条件と、表示中の絞り込み結果に加える(表示中の条件が入力中の条件と違えば評価し直す)
+    // 追い出したファイルは除く
+    searches->remove( removed );
+    searches->add( *added, *fileData, *tagTree, *tagRules );
+    GtkEntry* entry = GTK_ENTRY( gtk_builder_get_object( builder_, "filterentry" ) );
+    bool same = ( Query( gtk_entry_get_text( entry ) ) == g_FilterQuery );
+    FileList matched;
+    if ( same )
+      for ( auto a = added->begin() ; a != added->end() ; ++a )
+        if ( g_FilterQuery.match( ( *fileData )[*a], *tagTree, *tagRules ) ) matched.push_back( *a );
+    if ( same || ! removed.empty() ) {
+      std::shared_ptr< FileList > current = MatchedFiles();
+      FileList rest;
+      rest.reserve( current->size() );
+      std::set_difference( current->begin(), current->end(), removed.begin(), removed.end(), std::back_inserter( rest ) );
+      auto files = std::make_shared< FileList >();
+      files->reserve( rest.size() + matched.size() );
+      std::set_union( rest.begin(), rest.end(), matched.begin(), matched.end(), std::back_inserter( *files ) );
+      // グループをまとめて表示中は、読み込み済みのグループにつないだファイルで代表の行が変わりうる
+      if ( g_CollapseGroups ) {
+        ReshowFileList( this, files );
+      } else {
+        ShowFileList( builder_, libraries_, files );
+        // 追い出したファイルのタグは差し引けないため、ファセットは数え直す
+        if ( ! removed.empty() ) {
+          g_Facets.compute( *g_FileListShown, *tagData );
+          UpdateFacetList( builder_ );
+        }
+      }
+    }
+    if ( ! same )
+      StartFilter( this, false );
+    // 補完用リストと共起行列に加える
+    std::set< string > tags; // 加えたファイルのタグ
+    for ( auto a = added->begin() ; a != added->end() ; ++a ) {
+      const TagSet& t = ( *fileData )[*a];
+      g_Suggester.add( t );
+      tags.insert( t.begin(), t.end() );
+    }
+    for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+      auto i = tagData->find( *t );
+      g_Completion.update( *t, ( i == tagData->end() ) ? 0 : ( i->second ).size() );
+    }
+    // 加えたファイルの特徴量を画像の索引に登録する
+    IndexImages( g_IndexGeneration, added, addedFeatures );
+    // ディレクトリリストの数の更新
+    for ( auto d = dirs.begin() ; d != dirs.end() ; ++d )
+      g_Directories.recount( *fileData, *lazy_, *d );
+    UpdateDirectoryList( builder_ );
+  } else {
+    // ディレクトリの木を作り直す(全て読み込んだら遅延読み込みを終え、パスから作る)
+    if ( lazy_->complete() ) {
+      lazy_.reset();
+      InitDirectoryList( builder_, *fileData, libraries_, nullptr );
+    } else {
+      g_Directories.assign( *fileData, library, *lazy_ );
+      RefreshDirectoryList( builder_ );
+    }
+    searches->assign( searches->data(), *fileData, *tagData, *tagTree, *tagRules );
+    // ファイルリストの行を入れ直し、絞り込み条件を評価し直す
+    ReshowFileList( this, std::make_shared< FileList >() );
+    g_FilterQuery = Query();
+    StartFilter( this, false );
+    // 補完用リストと共起行列の作り直し
+    InitCompletionList( builder_, *tagData );
+    g_Suggester.assign( *fileData );
+    // 画像の索引の作成し直し(登録済みの特徴量は新しい識別番号に移し、加えたファイルは保存済みの特徴量を使う)
+    auto saved = std::make_shared< vector< ImageFeatures > >( fileData->size(), ImageFeatures{ NO_FEATURES, 0, ColorHistogram() } );
+    for ( FileId id = 0 ; id < ids.size() ; ++id )
+      if ( ids[id] != NO_FILE && g_Images.indexed( id ) ) ( *saved )[ids[id]] = g_Images.features( id );
+    for ( std::size_t i = 0 ; i < added->size() ; ++i )
+      ( *saved )[( *added )[i]] = ( *addedFeatures )[i];
+    if ( ! lazy_ ) features_.clear();
+    StartImageIndex( saved );
+  }
+
+  // メッセージ出力
+  ShowStatus( builder_, "Loaded : " + std::to_string( fileData->paths().count() ) + " files" +
+              ( ( relinked > 0 ) ? " (" + std::to_string( relinked ) + " moved files relinked)" : "" ) +
+              ( ( lazy_ ) ? " (some directories are not loaded yet)" : "" ) );
+}
+
+/*
+  TagFileStatus::evict : 読み込んだファイル数が上限を超えていれば、使われていないディレクトリを追い出す
+
+  読み込んだディレクトリ、選択中のディレクトリ以下、表示中・入力中の絞り込み条件を満たしうるディレクトリ、
+  選択中のファイルのディレクトリは残す。追い出したファイルは、補完用リスト・共起行列・画像の索引・
+  ディレクトリの木から除く(保存した検索条件と表示中の絞り込み結果からは呼び出し側で除く)。
+
+  loaded : 読み込んだディレクトリ
+  fileData : ファイル名をキーとするタグリストへのポインタ
+  tagData : タグ名をキーとするファイルリストへのポインタ
+  tagTree : タグの階層へのポインタ
+  tagRules : タグの規則へのポインタ
+  groups : ファイルのグループへのポインタ
+
+  戻り値 : 追い出したファイル(昇順)
+*/
+vector< FileId > TagFileStatus::evict( const vector< LazyTagFile::DirIndex >& loaded, FileData* fileData, TagData* tagData,
+                                       TagTree* tagTree, TagRules* tagRules, FileGroups* groups )
+{
+  vector< FileId > removed;
+  if ( ! lazy_->full( fileData->paths() ) ) return( removed );
+
+  // 残すディレクトリ
+  const PathTable& paths = fileData->paths();
+  vector< bool > keep( lazy_->file().directories().size(), false );
+  for ( auto d = loaded.begin() ; d != loaded.end() ; ++d )
+    keep[*d] = true;
+  if ( g_DirScope != DirectoryTree::NO_NODE ) {
+    // 以下のディレクトリは行きがけ順に続く
+    FileId last = g_Directories[g_DirScope].last;
+    for ( DirectoryTree::NodeId n = g_DirScope ; n < keep.size() && g_Directories[n].first < last ; ++n )
+      keep[n] = true;
+  }
+  GtkEntry* entry = GTK_ENTRY( gtk_builder_get_object( builder_, "filterentry" ) );
+  Query queries[] = { g_FilterQuery, Query( gtk_entry_get_text( entry ) ) };
+  for ( auto q = std::begin( queries ) ; q != std::end( queries ) ; ++q ) {
+    if ( q->empty() ) continue;
+    vector< LazyTagFile::DirIndex > dirs = lazy_->file().candidates( *q, *tagTree, *tagRules );
+    for ( auto d = dirs.begin() ; d != dirs.end() ; ++d )
+      keep[*d] = true;
+  }
+  vector< FileId > selected;
+  GetSelectedFiles( builder_, &selected );
+  for ( auto f = selected.begin() ; f != selected.end() ; ++f )
+    keep[paths.range( *f )] = true;
+
+  vector< LazyTagFile::DirIndex > cold = lazy_->cold( paths, keep );
+  if ( cold.empty() ) return( removed );
+
+  // 共起行列から除き、補完用リストを更新するタグを集める
+  std::set< string > tags; // 追い出すファイルのタグ
+  for ( auto d = cold.begin() ; d != cold.end() ; ++d ) {
+    FileId first = paths.rangeFirst( *d );
+    for ( FileId id = first ; id < first + paths.rangeFiles( *d ) ; ++id ) {
+      const TagSet& t = ( *fileData )[id];
+      g_Suggester.remove( t );
+      tags.insert( t.begin(), t.end() );
+    }
+  }
+  {
+    EditScope edit;
+    lazy_->evict( cold, fileData, tagData, tagTree, groups, &removed );
+  }
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+    auto i = tagData->find( *t );
+    g_Completion.update( *t, ( i == tagData->end() ) ? 0 : ( i->second ).size() );
+  }
+  for ( auto f = removed.begin() ; f != removed.end() ; ++f )
+    g_Images.erase( *f );
+  for ( auto d = cold.begin() ; d != cold.end() ; ++d )
+    g_Directories.recount( *fileData, *lazy_, *d );
+
+  return( removed );
+}
+
+/*
+  TagFileStatus::edit : 遅延読み込み中なら、編集するファイルのディレクトリに編集ありの印を付ける
+
+  編集したファイルは保存まで残す必要があるため、そのディレクトリは追い出さない。
+
+  fileData : ファイル名をキーとするタグリスト
+  files : 編集するファイル
+*/
+void TagFileStatus::edit( const FileData& fileData, const vector< FileId >& files )
+{
+  if ( ! lazy_ ) return;
+
+  for ( auto f = files.begin() ; f != files.end() ; ++f )
+    lazy_->edit( fileData.paths(), *f );
+}
+
+/*
+  TagFileStatus::save : タグファイルの上書き保存
+
+  fileData : ファイル名をキーとするタグリストへのポインタ
+  tagTree : タグの階層
+  tagRules : タグの規則
+  groups : ファイルのグループ
+  searches : 保存した検索条件
+*/
+void TagFileStatus::save( const FileData& fileData, const TagTree& tagTree, const TagRules& tagRules, const FileGroups& groups,
+                          const SavedSearches& searches )
+{
+  assert( hasFile() );
+
+  if ( ! ( canSave() && edited() ) ) return;
+
+  // 読み込んでいないディレクトリがあると、そのファイルのレコードが失われる
+  if ( lazy_ && ! lazy_->complete() ) {
+    MessageBox( "読み込めなかったディレクトリがあるため、保存できません。", GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
+    return;
+  }
+
+  // タグファイルの上書き(ライブラリ毎に、ルートパス以下のファイルと自分のタグファイルの設定だけを書き込む)
+  LibrarySettings current{ searches.data(), tagTree.data(), tagRules.data() };
+  GroupData groupData = groups.data();
+  for ( auto l = libraries_.begin() ; l != libraries_.end() ; ++l ) {
+    LibrarySettings own = LibraryOwnSettings( l->settings, saved_, current );
+    WriteTagData( l->tagFile, l->rootPath, fileData, own.searches, own.parents, own.rules, groupData, &g_HashCache );
+    g_Images.write( FeatureFileName( l->tagFile ), l->rootPath, fileData );
+    l->settings = std::move( own );
+  }
+  saved_ = std::move( current );
+
+  // 変数の初期化
+  reset();
+
   // メッセージ出力
   GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
   gtk_window_set_title( rootWin, title().c_str() );
-  ShowStatus( builder_, "Path : " + rootPath_ );
 }
 
 /*
-  TagFileStatus::save : タグファイルの上書き保存
+  TagFileStatus::save : タグファイルの新規保存
+
+  tagFile : 保存するタグファイル
+  fileData : ファイル名をキーとするタグリストへのポインタ
+  tagTree : タグの階層
+  tagRules : タグの規則
+  groups : ファイルのグループ
+  searches : 保存した検索条件
+*/
+void TagFileStatus::save( const string& tagFile, const FileData& fileData, const TagTree& tagTree, const TagRules& tagRules,
+                          const FileGroups& groups, const SavedSearches& searches )
+{
+  if ( ! canSave() ) return;
+
+  // 複数のライブラリは 1 つのタグファイルに保存できない
+  if ( libraries_.size() != 1 ) {
+    MessageBox( "複数のライブラリを開いているときは、新規保存できません。", GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
+    return;
+  }
+  if ( lazy_ && ! lazy_->complete() ) {
+    MessageBox( "読み込めなかったディレクトリがあるため、保存できません。", GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, builder_ );
+    return;
+  }
+
+  // タグファイルの書き込み
+  LibraryRoot& library = libraries_.front();
+  LibrarySettings current{ searches.data(), tagTree.data(), tagRules.data() };
+  WriteTagData( tagFile, library.rootPath, fileData, current.searches, current.parents, current.rules, groups.data(),
+                &g_HashCache );
+  g_Images.write( FeatureFileName( tagFile ), library.rootPath, fileData );
+
+  // 変数の初期化
+  library.tagFile = tagFile;
+  library.settings = current;
+  saved_ = std::move( current );
+  reset();
+
+  // メッセージ出力
+  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
+  gtk_window_set_title( rootWin, title().c_str() );
+}
+
+/*
+  TagFileStatus::set : 編集ありにする
+*/
+void TagFileStatus::set()
+{
+  edited_ = true;
+
+  // メッセージ出力
+  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
+  gtk_window_set_title( rootWin, title().c_str() );
+}
+
+/*
+  TagFileStatus::reset : 編集なしにする
+*/
+void TagFileStatus::reset()
+{
+  edited_ = false;
+
+  // メッセージ出力
+  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
+  gtk_window_set_title( rootWin, title().c_str() );
+}
+
+/*
+  LoadAllDirectories : 遅延読み込み中なら、読み込んでいないディレクトリを全て読み込む
+
+  タグファイルは全てのファイルのレコードを書き直すため、保存の前に呼ぶ。
+
+  status : TagFileStatus オブジェクトへのポインタ
+*/
+void LoadAllDirectories( TagFileStatus* status )
+{
+  if ( status->lazy() == nullptr || status->lazy()->complete() ) return;
+
+  status->load( status->lazy()->pending(), &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+}
+
+/*
+  CB_FileSaveAs : タグリストの新規保存(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_FileSaveAs( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  if ( ! status->canSave() ) return;
+
+  string tagFile = status->pathName();
+  if ( GetFileNameFromDialog( status->builder(), "タグリストの新規保存", GTK_FILE_CHOOSER_ACTION_SAVE,
+                              "Cancel", "Save", &tagFile, &g_CurrentTagFolder ) == GTK_RESPONSE_ACCEPT ) {
+    LoadAllDirectories( status );
+    status->save( tagFile, g_FileData, g_TagTree, g_TagRules, g_Groups, g_Searches );
+  }
+}
+
+/*
+  CB_FileSave : タグリストの上書き保存(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_FileSave( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  if ( ! status->hasFile() ) {
+    CB_FileSaveAs( menuItem, data );
+    return;
+  }
+
+  if ( status->edited() ) LoadAllDirectories( status );
+  status->save( g_FileData, g_TagTree, g_TagRules, g_Groups, g_Searches );
+}
+
+/*
+  ConfirmSave : 保存するか確認するダイアログの出力
+
+  status : TagFileStatus オブジェクトへのポインタ
+
+  戻り値 : 処理を中断する場合は false を返す
+*/
+bool ConfirmSave( TagFileStatus* status )
+{
+  gint res = ThreeButtons_MessageBox( "編集中のファイルを保存しますか？", status->builder() );
+
+  switch ( res ) {
+  case GTK_RESPONSE_YES:
+    CB_FileSave( 0, status );
+    break;
+  case GTK_RESPONSE_NO:
+    break;
+  default:
+    return( false );
+  }
+
+  return( true );
+}
+
+/*
+  CB_FileNew : タグリストの新規作成(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_FileNew( GtkMenuItem* menuItem, gpointer data )
+{
+  static string currentImageFolder;
+
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  // 編集されたタグファイルが残っていたら、保存するか確認する
+  if ( status->edited() )
+    if ( ! ConfirmSave( status ) ) return;
+
+  string rootPath;
+  if ( GetFileNameFromDialog( status->builder(), "ルートパスの選択", GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+                              "Cancel", "Select", &rootPath, &currentImageFolder ) == GTK_RESPONSE_ACCEPT ) {
+    status->init( rootPath, &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+  }
+}
+
+/*
+  CB_FileOpen : タグリストを開く(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_FileOpen( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  // 編集されたタグファイルが残っていたら、保存するか確認する
+  if ( status->edited() )
+    ConfirmSave( status );
+
+  // 複数選択した場合は、それぞれをライブラリとして並列に読み込む
+  vector< string > tagFiles;
+  if ( GetFileNamesFromDialog( status->builder(), "タグリストを開く", &tagFiles, &g_CurrentTagFolder ) == GTK_RESPONSE_ACCEPT ) {
+    status->open( tagFiles, &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+  }
+}
+
+/*
+  CB_FileAddLibrary : 開いているタグリストにライブラリを加える(コールバック関数)
+
+  開いているライブラリのタグファイルと合わせて開き直すため、編集中の内容は先に保存しておく。
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_FileAddLibrary( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  // 何も開いていなければ、タグリストを開くのと同じ
+  if ( ! status->canSave() ) {
+    CB_FileOpen( menuItem, data );
+    return;
+  }
+
+  // 編集されたタグファイルが残っていたら、保存するか確認する
+  if ( status->edited() )
+    if ( ! ConfirmSave( status ) ) return;
+  if ( ! status->hasFile() ) {
+    MessageBox( "先にタグリストを保存してください。", GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, status->builder() );
+    return;
+  }
+
+  vector< string > tagFiles;
+  for ( auto l = status->libraries().begin() ; l != status->libraries().end() ; ++l )
+    tagFiles.push_back( l->tagFile );
+  std::size_t opened = tagFiles.size();
+  if ( GetFileNamesFromDialog( status->builder(), "ライブラリの追加", &tagFiles, &g_CurrentTagFolder ) == GTK_RESPONSE_ACCEPT &&
+       tagFiles.size() > opened ) {
+    status->open( tagFiles, &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+  }
+}
+
+/*
+  CB_ToggleAutoScale : 画像をウィンドウに合わせる/そのままの大きさにする の切り替え(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : NULL ポインタ(未使用)
+*/
+void CB_ToggleAutoScale( GtkMenuItem* menuItem, gpointer data )
+{
+  g_AutoScale = ! g_AutoScale;
+}
+
+/*
+  CB_ToggleCollapseGroups : グループを 1 行にまとめて表示する/しない の切り替え(コールバック関数)
+
+  menuItem : GtkCheckMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_ToggleCollapseGroups( GtkCheckMenuItem* menuItem, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  std::shared_ptr< FileList > matched = MatchedFiles();
+  g_CollapseGroups = gtk_check_menu_item_get_active( menuItem );
+  ReshowFileList( status, matched );
+}
+
+/*
+  ReflectEditLog : 取り消し・やり直しで適用した差分を、変わったファイルとタグの分だけ画面に反映する
+
+  status : TagFileStatus オブジェクトへのポインタ
+  applied : 適用した差分
+  message : ステータスバーに表示するメッセージ
+*/
+void ReflectEditLog( TagFileStatus* status, const vector< EditLog::Change >& applied, const string& message )
+{
+  GtkBuilder* builder = status->builder();
+
+  status->set();
+  for ( auto c = applied.begin() ; c != applied.end() ; ++c ) {
+    if ( c->kind != EditLog::RENAME ) {
+      ReflectTagChange( status, c->file, c->tag, c->kind == EditLog::ADD );
+      continue;
+    }
+    // 名前の変更が続く場合は最後のファイルリストと一致しないため、変更した時点のファイルを使う
+    for ( auto f = ( c->files ).begin() ; f != ( c->files ).end() ; ++f ) {
+      ReflectTagChange( status, *f, c->tag, false );
+      ReflectTagChange( status, *f, c->newTag, true );
+    }
+  }
+  RefreshFilter( status );
+
+  RefreshTagList( builder );
+  UpdateSuggestList( builder );
+  ShowStatus( builder, message );
+}
+
+/*
+  CB_EditUndo : 最後の操作を取り消す(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_EditUndo( GtkMenuItem* menuItem, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  string label;
+  vector< EditLog::Change > applied;
+  bool done;
+  {
+    EditScope edit;
+    done = g_EditLog.undo( &g_FileData, &g_TagData, &g_TagTree, &label, &applied );
+  }
+  if ( ! done ) {
+    ShowStatus( status->builder(), "nothing to undo" );
+    return;
+  }
+
+  ReflectEditLog( status, applied, "undo : " + label );
+}
+
+/*
+  CB_EditRedo : 最後に取り消した操作をやり直す(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_EditRedo( GtkMenuItem* menuItem, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+
+  string label;
+  vector< EditLog::Change > applied;
+  bool done;
+  {
+    EditScope edit;
+    done = g_EditLog.redo( &g_FileData, &g_TagData, &g_TagTree, &label, &applied );
+  }
+  if ( ! done ) {
+    ShowStatus( status->builder(), "nothing to redo" );
+    return;
+  }
+
+  ReflectEditLog( status, applied, "redo : " + label );
+}
+
+/*
+  CheckTag : タグの両端の空白文字を除去し、チェックする
+
+  tag : タグへのポインタ
+  message : 不正があった場合のメッセージを保持する変数へのポインタ
+  tagData : タグをキーとするファイルリスト
+
+  戻り値 : 不正があった場合は false を返す
+*/
+bool CheckTag( string* tag, string* message )
+{
+  boost::algorithm::trim( *tag );
+
+  // 空文字のチェック
+  if ( tag->empty() ) {
+    *message = "空文字はタグにできません。";
+    return( false );
+  }
+
+  // 空白文字を含んでいるか？
+  if ( tag->find( ' ' ) != string::npos ) {
+    *message = "空白文字はタグに使えません。";
+    return( false );
+  }
+
+  return( true );
+}
+
+/*
+  CheckDuplicateTag : 同じタグが存在しないかチェックする
+
+  tag : タグ
+  message : 不正があった場合のメッセージを保持する変数へのポインタ
+  tagData : タグをキーとするファイルリスト
+
+  戻り値 : 重複があった場合は false を返す
+*/
+bool CheckDuplicateTag( const string& tag, string* message, const TagData& tagData )
+{
+  // 同じタグが存在していないか？
+  if ( tagData.find( tag ) != tagData.end() ) {
+    *message = "すでに同名のタグがあります。";
+    return( false );
+  }
+
+  return( true );
+}
+
+/*
+  AddSelectedTag : 選択中の全てのファイルにタグを登録し、タグリストに表示する
+
+  タグは g_TagRules で正式なタグと含意されるタグに展開し、全て登録する。
+  全てのファイルへの登録を 1 つの操作として索引に反映し、画面の更新も 1 回にまとめる。
+
+  status : TagFileStatus オブジェクトへのポインタ
+  tag : 登録するタグ(チェック済み)
+
+  戻り値 : ファイルが選択されていないか、全てのファイルにタグがすでに登録されていた場合は false を返す
+*/
+bool AddSelectedTag( TagFileStatus* status, const string& tag )
+{
+  GtkBuilder* builder = status->builder();
+
+  // タグを登録する対象ファイルの取得
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( builder, &files ) )
+    return( false );
+
+  // タグの登録(タグ毎に登録したファイルを集める)
+  const vector< string > tags = g_TagRules.expand( tag );
+  vector< std::pair< string, vector< FileId > > > added; // 登録したタグとファイル
+  {
+    EditScope edit( "add tag" );
+    for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+      vector< FileId > tagged;
+      for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+        if ( AddTag( *t, *f, &g_FileData, &g_TagData, &g_TagTree ) ) {
+          g_EditLog.add( *t, *f );
+          tagged.push_back( *f );
+        }
+      }
+      if ( ! tagged.empty() )
+        added.emplace_back( *t, std::move( tagged ) );
+    }
+  }
+  if ( added.empty() )
+    return( false );
+
+  // タグリストへの登録
+  if ( files.size() == 1 && tags.size() == 1 ) {
+    GtkTreeIter iter;
+    GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
+    gtk_list_store_append( store, &iter );
+    gtk_list_store_set( store, &iter, 0, tags.front().c_str(), -1 );
+  } else {
+    InitTagList( builder, files, g_FileData );
+  }
+  if ( files.size() > 1 || tags.size() > 1 || tags.front() != tag ) {
+    string implied;        // 含意されて登録したタグ
+    std::size_t count = 0; // 登録したファイル数(タグ毎の最大)
+    for ( auto a = added.begin() ; a != added.end() ; ++a ) {
+      if ( a->first != tags.front() ) implied += " +" + a->first;
+      count = std::max( count, a->second.size() );
+    }
+    ShowStatus( builder, "\"" + tags.front() + "\"" + implied + " added to " + std::to_string( count ) + " files" );
+  }
+
+  status->set();
+  for ( auto a = added.begin() ; a != added.end() ; ++a )
+    ReflectTagChange( status, a->second, a->first, true );
+  RefreshFilter( status );
+  UpdateSuggestList( builder );
+
+  return( true );
+}
+
+/*
+  CB_AddTag : タグを登録し、タグリストに表示する(コールバック関数)
+
+  entry : GtkEntry オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_AddTag( GtkEntry* entry, gpointer data )
+{
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  // タグの取得
+  string tag = gtk_entry_get_text( entry );
+
+  // タグのチェック
+  string message;
+  if ( ! CheckTag( &tag, &message ) ) {
+    MessageBox( message, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+    return;
+  }
+
+  if ( AddSelectedTag( status, tag ) )
+    gtk_entry_set_text( entry, "" );
+}
+
+/*
+  CB_SuggestActivated : 候補のタグを選択中のファイルに登録する(コールバック関数)
+
+  view : GtkTreeView オブジェクトへのポインタ
+  path : 選択された行
+  column : 選択された列
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_SuggestActivated( GtkTreeView* view, GtkTreePath* path, GtkTreeViewColumn* column, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkTreeModel* model = gtk_tree_view_get_model( view );
+  GtkTreeIter iter;
+  if ( ! gtk_tree_model_get_iter( model, &iter, path ) )
+    return;
+
+  gchar* gc;
+  gtk_tree_model_get( model, &iter, 0, &gc, -1 );
+  string tag = gc;
+  g_free( gc );
+
+  AddSelectedTag( status, tag );
+}
+
+/*
+  SortTag : リストの a, b の順位を比較する
+
+  model : GtkTreeModel オブジェクトへのポインタ
+  a, b : 比較対象
+  data : NULL値(未使用)
+*/
+gint SortTag( GtkTreeModel* model, GtkTreeIter* a, GtkTreeIter* b, gpointer data )
+{
+  gchar* gc;
+  gtk_tree_model_get( model, a, 0, &gc, -1 );
+  string sa = ( gc == 0 ) ? "" : gc;
+  g_free( gc );
+  gtk_tree_model_get( model, b, 0, &gc, -1 );
+  string sb = ( gc == 0 ) ? "" : gc;
+  g_free( gc );
+
+  StrLess less;
+  return( ( less( sa, sb ) ) ? -1 :
+          ( less( sb, sa ) ? 1 : 0 ) );
+}
+
+/*
+  MatchCompletion : 補完候補の判定
+
+  補完用リストには一致する候補だけを登録しているため、常に TRUE を返す
+
+  completion : GtkEntryCompletion オブジェクトへのポインタ
+  key : 入力中の文字列
+  iter : 判定対象の行
+  data : NULL値(未使用)
+*/
+gboolean MatchCompletion( GtkEntryCompletion* completion, const gchar* key, GtkTreeIter* iter, gpointer data )
+{
+  return( TRUE );
+}
+
+/*
+  CB_CompletionChanged : 入力中の文字列に一致する補完候補の登録(コールバック関数)
+
+  entry : GtkEntry オブジェクトへのポインタ
+  data : GtkBuilder オブジェクトへのポインタ
+*/
+void CB_CompletionChanged( GtkEntry* entry, gpointer data )
+{
+  GtkBuilder* builder = static_cast< GtkBuilder* >( data );
+  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "completionstore" ) );
+  GtkEntryCompletion* completion = GTK_ENTRY_COMPLETION( gtk_builder_get_object( builder, "entrycompletion" ) );
+  GtkTreeIter iter;
+
+  string key = gtk_entry_get_text( entry );
+  boost::algorithm::trim( key );
+
+  gtk_list_store_clear( store );
+  if ( ! key.empty() ) {
+    vector< string > tags = g_Completion.lookup( key, COMPLETION_LIMIT );
+    for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+      gtk_list_store_insert_with_values( store, &iter, -1, 0, t->c_str(), -1 );
+  }
+
+  // GtkEntryCompletion は先に "changed" を処理しているため、候補を入れ替えた後に再評価させる
+  gtk_entry_completion_complete( completion );
+}
+
+/*
+  CreateCompletion : 補完リストの生成
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void CreateCompletion( GtkBuilder* builder )
+{
+  GtkEntryCompletion* completion = GTK_ENTRY_COMPLETION( gtk_builder_get_object( builder, "entrycompletion" ) );
+  gtk_entry_completion_set_text_column( completion, 0 );
+  gtk_entry_completion_set_match_func( completion, MatchCompletion, 0, 0 );
+
+  GObject* tagEntry = gtk_builder_get_object( builder, "tagentry" );
+  g_signal_connect( tagEntry, "changed", G_CALLBACK( CB_CompletionChanged ), builder );
+}
+
+/*
+  CB_FilePopup : ファイルリスト上のメニュー表示(コールバック関数)
+
+  widget : GtkWidget オブジェクトへのポインタ
+  event : GdkEventButton オブジェクトへのポインタ
+  data : GtkBuilder オブジェクトへのポインタ
+*/
+gboolean CB_FilePopup( GtkWidget* widget, GdkEventButton* event, gpointer data )
+{
+  GtkBuilder* builder = static_cast< GtkBuilder* >( data );
+
+  if ( event->button != 3 )
+    return( FALSE );
+
+  GtkMenu* menu = GTK_MENU( gtk_builder_get_object( builder, "filepopup" ) );
+  gtk_menu_popup_at_pointer( menu, reinterpret_cast< GdkEvent* >( event ) );
+
+  // 選択中の行の上なら、複数選択を解除しないよう既定の処理を行わない
+  GtkTreePath* path = 0;
+  if ( ! gtk_tree_view_get_path_at_pos( GTK_TREE_VIEW( widget ), static_cast< gint >( event->x ), static_cast< gint >( event->y ),
+                                        &path, 0, 0, 0 ) )
+    return( FALSE );
+  GtkTreeSelection* selection = GTK_TREE_SELECTION( gtk_builder_get_object( builder, "filelistselection" ) );
+  gboolean selected = gtk_tree_selection_path_is_selected( selection, path );
+  gtk_tree_path_free( path );
+
+  return( selected );
+}
+
+/*
+  CreateFileList : ファイルリストの生成
+
+  status : TagFileStatus オブジェクトへのポインタ
+*/
+void CreateFileList( TagFileStatus* status )
+{
+  GtkBuilder* builder = status->builder();
+
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "filelist" ) );
+
+  GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+  GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes
+    ( "path name", renderer, "text", 0, NULL );
+  gtk_tree_view_append_column( view, column );
+
+  GtkTreeSelection* selection = gtk_tree_view_get_selection( view );
+  gtk_tree_selection_set_mode( selection, GTK_SELECTION_MULTIPLE );
+  gtk_tree_view_set_rubber_banding( view, TRUE );
+  g_FileListID = g_signal_connect( G_OBJECT( selection ), "changed", G_CALLBACK( CB_ShowImage ), status );
+
+  GObject* filter = gtk_builder_get_object( builder, "filterentry" );
+  g_FilterID = g_signal_connect( filter, "search-changed", G_CALLBACK( CB_FilterChanged ), status );
+
+  g_signal_connect( G_OBJECT( view ), "button-press-event", G_CALLBACK( CB_FilePopup ), builder );
+}
+
+/*
+  CB_TagPopup : タグリスト上のメニュー表示(コールバック関数)
+
+  widget : GtkWidget オブジェクトへのポインタ
+  event : GdkEventButton オブジェクトへのポインタ
+  data : GtkBuilder オブジェクトへのポインタ
+*/
+gboolean CB_TagPopup( GtkWidget* widget, GdkEventButton* event, gpointer data )
+{
+  GtkBuilder* builder = static_cast< GtkBuilder* >( data );
+
+  if ( event->button == 3 ) {
+    GtkMenu* menu = GTK_MENU( gtk_builder_get_object( builder, "tagmenu" ) );
+    gtk_menu_popup_at_pointer( menu, reinterpret_cast< GdkEvent* >( event ) );
+  }
+
+  return( FALSE );
+}
+
+/*
+  CreateTagList : タグリストの生成
+
+  builder : GtkBuilder オブジェクトへのポインタ
+*/
+void CreateTagList( GtkBuilder* builder )
+{
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "taglist" ) );
+
+  GtkTreeModel* sorted = GTK_TREE_MODEL( gtk_builder_get_object( builder, "taglistsort" ) );
+  gtk_tree_sortable_set_sort_column_id( GTK_TREE_SORTABLE( sorted ), 0, GTK_SORT_ASCENDING );
+  gtk_tree_sortable_set_sort_func( GTK_TREE_SORTABLE( sorted ), 0, SortTag, 0, 0 );
+  GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+  GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes
+    ( "tag name", renderer, "text", 0, NULL );
+  gtk_tree_view_append_column( view, column );
+
+  g_signal_connect( G_OBJECT( view ), "button-press-event", G_CALLBACK( CB_TagPopup ), builder );
+}
+
+/*
+  CreateMenu : メニューの生成
+
+  status : TagFileStatus オブジェクトへのポインタ
+*/
+void CreateMenu( TagFileStatus* status )
+{
+  GtkBuilder* builder = status->builder();
+
+  GObject* obj = gtk_builder_get_object( builder, "filenew" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileNew ), status );
+  obj = gtk_builder_get_object( builder, "fileopen" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileOpen ), status );
+  obj = gtk_builder_get_object( builder, "fileaddlibrary" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileAddLibrary ), status );
+  obj = gtk_builder_get_object( builder, "filesave" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileSave ), status );
+  obj = gtk_builder_get_object( builder, "filesaveas" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileSaveAs ), status );
+
+  obj = gtk_builder_get_object( builder, "editundo" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_EditUndo ), status );
+  obj = gtk_builder_get_object( builder, "editredo" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_EditRedo ), status );
+
+  obj = gtk_builder_get_object( builder, "autoscale" );
+  g_signal_connect( obj, "activate", G_CALLBACK( CB_ToggleAutoScale ), 0 );
+  obj = gtk_builder_get_object( builder, "collapsegroups" );
+  g_signal_connect( obj, "toggled", G_CALLBACK( CB_ToggleCollapseGroups ), status );
+}
+
+/*
+  GetSelectedRow : リスト内の選択行を取得する
+
+  builder : GtkBuilderオブジェクトへのポインタ
+  listName : リスト名(filelist/taglist)
+  rowName : 選択行をセットする変数へのポインタ
+  model : GtkTreeModelオブジェクトへのハンドル
+  iter : GtkTreeIterオブジェクトへのポインタ
+
+  戻り値 : 選択されていた場合は true を返す
+*/
+bool GetSelectedRow( GtkBuilder* builder, const string& listName, string* rowName, GtkTreeModel** model, GtkTreeIter* iter )
+{
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, listName.c_str() ) );
+  *model = gtk_tree_view_get_model( view );
+  GtkTreeSelection* selection = gtk_tree_view_get_selection( view );
+  if ( ! gtk_tree_selection_get_selected( selection, model, iter ) )
+    return( false );
+  gchar* gc;
+  gtk_tree_model_get( *model, iter, 0, &gc, -1 );
+  *rowName = gc;
+  g_free( gc );
+
+  return( true );
+}
+
+/*
+  CB_TagCopy : タグのコピー(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_TagCopy( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagClipboard オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  // 複数選択されている場合は、いずれかのファイルに付いたタグをコピーする
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( builder, &files ) )
+    return;
+
+  g_Clipboard.clear();
+  for ( auto f = files.begin() ; f != files.end() ; ++f )
+    g_Clipboard.insert( g_FileData[*f].begin(), g_FileData[*f].end() );
+  //std::cout << g_Clipboard.size() << std::endl;
+}
+
+/*
+  CB_TagPaste : タグの貼り付け(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_TagPaste( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagClipboard オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( builder, &files ) )
+    return;
+
+  // 選択中の全てのファイルに貼り付ける(規則で展開し、タグ毎に貼り付けたファイルを集める)
+  vector< std::pair< string, vector< FileId > > > added; // 貼り付けたタグとファイル
+  {
+    EditScope edit( "paste tags" );
+    for ( auto i = g_Clipboard.begin() ; i != g_Clipboard.end() ; ++i ) {
+      const vector< string > tags = g_TagRules.expand( *i );
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+        vector< FileId > pasted;
+        for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+          if ( AddTag( *t, *f, &g_FileData, &g_TagData, &g_TagTree ) ) {
+            g_EditLog.add( *t, *f );
+            pasted.push_back( *f );
+          }
+        }
+        if ( ! pasted.empty() )
+          added.emplace_back( *t, std::move( pasted ) );
+      }
+    }
+  }
+  if ( added.empty() ) return;
+
+  InitTagList( builder, files, g_FileData );
+
+  status->set();
+  for ( auto i = added.begin() ; i != added.end() ; ++i )
+    ReflectTagChange( status, i->second, i->first, true );
+  RefreshFilter( status );
+  UpdateSuggestList( builder );
+}
+
+/*
+  CB_DlgOk : レスポンスID(GTK_RESPONSE_ACCEPT)を投げる
 
-  fileData : ファイル名をキーとするタグリストへのポインタ
+  entry : GtkEntryオブジェクトへのポインタ
+  data : GtkDialogオブジェクトへのポインタ
 */
-void TagFileStatus::save( const FileData& fileData )
+void CB_DlgOk( GtkEntry* entry, gpointer data )
 {
-  assert( hasFile() );
+  GtkDialog* dialog = static_cast< GtkDialog* >( data );
 
-  if ( ! ( canSave() && edited() ) ) return;
+  gtk_dialog_response( dialog, GTK_RESPONSE_ACCEPT );
+}
 
-  // タグファイルの上書き
-  WriteTagData( tagFile_, rootPath_, fileData );
+/*
+  InputText : 文字列の入力
 
-  // 変数の初期化
-  reset();
+  builder : GtkBuilderオブジェクトへのポインタ
+  title : ダイアログのタイトル
+  currentText : 現在の文字列
+  newText : 新たな文字列をセットする変数へのポインタ
 
-  // メッセージ出力
-  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
-  gtk_window_set_title( rootWin, title().c_str() );
+  戻り値 : レスポンスID(GTK_RESPONSE_ACCEPT/REJECT)
+*/
+gint InputText( GtkBuilder* builder, const string& title, const string& currentText, string* newText )
+{
+  GtkWidget* dialog = gtk_dialog_new_with_buttons( title.c_str(), GTK_WINDOW( gtk_builder_get_object( builder, "root" ) ),
+                                                   static_cast< GtkDialogFlags >( GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT ),
+                                                   "OK", GTK_RESPONSE_ACCEPT,
+                                                   "Cancel", GTK_RESPONSE_REJECT,
+                                                   NULL );
+
+  // GtkEntryの追加
+  GtkWidget* contentArea = gtk_dialog_get_content_area( GTK_DIALOG( dialog ) );
+  GtkWidget* entry = gtk_entry_new();
+  gtk_entry_set_text( GTK_ENTRY( entry ), currentText.c_str() );
+  g_signal_connect( entry, "activate", G_CALLBACK( CB_DlgOk ), dialog );
+  gtk_container_add( GTK_CONTAINER( contentArea ), entry );
+  gtk_widget_show_all( dialog );
+
+  gint res = gtk_dialog_run( GTK_DIALOG( dialog ) );
+
+  if ( res == GTK_RESPONSE_ACCEPT )
+    *newText = gtk_entry_get_text( GTK_ENTRY( entry ) );
+
+  gtk_widget_destroy( dialog );
+
+  return( res );
 }
 
 /*
-  TagFileStatus::save : タグファイルの新規保存
+  TagEdit : タグの編集
 
-  tagFile : 保存するタグファイル
-  fileData : ファイル名をキーとするタグリストへのポインタ
+  builder : GtkBuilderオブジェクトへのポインタ
+  currentTag : 現在のタグ
+  newTag : 新たなタグをセットする変数へのポインタ
+
+  戻り値 : レスポンスID(GTK_RESPONSE_ACCEPT/REJECT)
 */
-void TagFileStatus::save( const string& tagFile, const FileData& fileData )
+gint TagEdit( GtkBuilder* builder, const string& currentTag, string* newTag )
 {
-  if ( ! canSave() ) return;
+  return( InputText( builder, "タグの編集", currentTag, newTag ) );
+}
 
-  // タグファイルの書き込み
-  WriteTagData( tagFile, rootPath_, fileData );
+/*
+  CB_SearchSave : 現在の絞り込み条件に名前を付けて保存する(コールバック関数)
 
-  // 変数の初期化
-  tagFile_ = tagFile;
-  reset();
+  button : GtkButton オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_SearchSave( GtkButton* button, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  // メッセージ出力
-  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
-  gtk_window_set_title( rootWin, title().c_str() );
+  if ( ! status->canSave() ) return;
+
+  GtkEntry* filter = GTK_ENTRY( gtk_builder_get_object( builder, "filterentry" ) );
+  string text = gtk_entry_get_text( filter );
+  Query query( text );
+  if ( query.empty() ) {
+    MessageBox( "絞り込み条件が入力されていません。", GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+    return;
+  }
+
+  string name;
+  if ( InputText( builder, "検索条件の保存", text, &name ) != GTK_RESPONSE_ACCEPT )
+    return;
+  boost::algorithm::trim( name );
+  if ( name.empty() ) return;
+
+  // 表示中の結果が同じ条件なら、そのまま結果として使う
+  std::shared_ptr< FileList > files = MatchedFiles();
+  if ( ! ( query == g_FilterQuery ) ) {
+    files = std::make_shared< FileList >();
+    query.evaluate( g_FileData, g_TagData, g_TagTree, g_TagRules, files.get(), CancelToken{ nullptr, 0 } );
+  }
+  g_Searches.insert( name, text, files );
+
+  InitSearchList( builder, g_Searches, name );
+  status->set();
 }
 
 /*
-  TagFileStatus::set : 編集ありにする
+  CB_SearchDelete : 選択中の保存した検索条件を削除する(コールバック関数)
+
+  button : GtkButton オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 */
-void TagFileStatus::set()
+void CB_SearchDelete( GtkButton* button, gpointer data )
 {
-  edited_ = true;
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  // メッセージ出力
-  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
-  gtk_window_set_title( rootWin, title().c_str() );
+  GtkComboBoxText* combo = GTK_COMBO_BOX_TEXT( gtk_builder_get_object( builder, "searchcombo" ) );
+  gchar* gc = gtk_combo_box_text_get_active_text( combo );
+  if ( gc == 0 ) return;
+  g_Searches.erase( gc );
+  g_free( gc );
+
+  InitSearchList( builder, g_Searches );
+  status->set();
 }
 
 /*
-  TagFileStatus::reset : 編集なしにする
+  RetagFiles : ファイルに付いた tag を newTag に付け替え、編集の履歴に記録する(EditScope の中で呼ぶこと)
+
+  全てのファイルが対象で newTag が使われていなければ名前の変更として、
+  それ以外はファイルリストの集合演算で付け替える(newTag があればまとめる)。
+
+  tag : 付け替えるタグ
+  newTag : 付け替え先のタグ
+  files : 対象のファイル(昇順、null なら tag の付いた全てのファイル)
+  changes : 画面に反映する変更を加える
+
+  戻り値 : 付け替えたファイル数
+*/
+std::size_t RetagFiles( const string& tag, const string& newTag, const vector< FileId >* files, vector< TagChange >* changes )
+{
+  const TagData& tagData = g_TagData; // 付け替えるまでは読むだけ
+  auto t = tagData.find( tag );
+  if ( t == tagData.end() || t->second.empty() ) return( 0 );
+
+  auto dest = tagData.find( newTag );
+  if ( files == nullptr && ( dest == tagData.end() || dest == t || dest->second.empty() ) ) {
+    ChangeTagName( tag, newTag, &g_FileData, &g_TagData, &g_TagTree );
+    g_EditLog.rename( tag, newTag );
+    const Posting& renamed = g_TagData.find( newTag )->second;
+    vector< FileId > all( renamed.begin(), renamed.end() );
+    changes->push_back( TagChange{ tag, all, false } );
+    changes->push_back( TagChange{ newTag, std::move( all ), true } );
+    return( renamed.size() );
+  }
+
+  vector< FileId > moved, added;
+  vector< FileId > all;
+  if ( files == nullptr ) {
+    all.assign( t->second.begin(), t->second.end() );
+    files = &all;
+  }
+  MoveTag( tag, newTag, *files, &g_FileData, &g_TagData, &moved, &added, &g_TagTree );
+  for ( auto f = moved.begin() ; f != moved.end() ; ++f )
+    g_EditLog.remove( tag, *f );
+  for ( auto f = added.begin() ; f != added.end() ; ++f )
+    g_EditLog.add( newTag, *f );
+
+  std::size_t count = moved.size();
+  if ( ! moved.empty() )
+    changes->push_back( TagChange{ tag, std::move( moved ), false } );
+  if ( ! added.empty() )
+    changes->push_back( TagChange{ newTag, std::move( added ), true } );
+
+  return( count );
+}
+
+/*
+  ReflectTagChanges : タグの付け替えをタグ毎にまとめて画面に反映する
+
+  status : TagFileStatus オブジェクトへのポインタ
+  changes : 画面に反映する変更
+*/
+void ReflectTagChanges( TagFileStatus* status, const vector< TagChange >& changes )
+{
+  if ( changes.empty() ) return;
+
+  status->set();
+  for ( auto c = changes.begin() ; c != changes.end() ; ++c )
+    ReflectTagChange( status, c->files, c->tag, c->added );
+  RefreshFilter( status );
+  RefreshTagList( status->builder() );
+  UpdateSuggestList( status->builder() );
+}
+
+/*
+  CB_TagSplit : 選択中のファイル(選択がなければ表示中のファイル)に付いたタグだけを別のタグに付け替える(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_TagSplit( GtkMenuItem* menuItem, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  GtkTreeModel* model;
+  GtkTreeIter iter;
+  string currentTag;
+  if ( ! GetSelectedRow( builder, "taglist", &currentTag, &model, &iter ) )
+    return;
+
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( builder, &files ) )
+    files = *MatchedFiles();
+
+  string newTag;
+  while ( InputText( builder, "タグの分割", currentTag, &newTag ) == GTK_RESPONSE_ACCEPT ) {
+    string message;
+    if ( ! CheckTag( &newTag, &message ) ) {
+      MessageBox( message, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+      continue;
+    }
+
+    vector< TagChange > changes;
+    std::size_t moved;
+    {
+      EditScope edit( "split tag" );
+      moved = RetagFiles( currentTag, newTag, &files, &changes );
+    }
+    ReflectTagChanges( status, changes );
+    ShowStatus( builder, std::to_string( moved ) + " files moved from \"" + currentTag + "\" to \"" + newTag + "\"" );
+    break;
+  }
+}
+
+/*
+  CB_TagReplace : 正規表現に一致するタグ名をまとめて置換する(コールバック関数)
+
+  置換後のタグがすでにあれば、そのタグにまとめる。全ての変更を 1 つの操作として記録する。
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_TagReplace( GtkMenuItem* menuItem, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  string pattern, format;
+  if ( InputText( builder, "置換するタグ名(正規表現)", string(), &pattern ) != GTK_RESPONSE_ACCEPT || pattern.empty() )
+    return;
+  std::regex regex;
+  try {
+    regex.assign( pattern );
+  } catch( std::regex_error& e ) {
+    MessageBox( "正規表現が正しくありません。", GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+    return;
+  }
+  if ( InputText( builder, "置換後のタグ名($1 などで一致した部分を参照)", string(), &format ) != GTK_RESPONSE_ACCEPT )
+    return;
+
+  // 変更するタグ名を先に全て求める
+  vector< std::pair< string, string > > renames; // 変更前と変更後のタグ
+  for ( auto t = g_TagData.begin() ; t != g_TagData.end() ; ++t ) {
+    if ( t->second.empty() || ! std::regex_search( t->first, regex ) ) continue;
+    string newTag = std::regex_replace( t->first, regex, format );
+    string message;
+    if ( CheckTag( &newTag, &message ) && newTag != t->first )
+      renames.emplace_back( t->first, newTag );
+  }
+  if ( renames.empty() ) {
+    ShowStatus( builder, "no tags matched" );
+    return;
+  }
+  if ( MessageBox( std::to_string( renames.size() ) + " 個のタグ名を変更します。", GTK_MESSAGE_QUESTION, GTK_BUTTONS_OK_CANCEL, builder )
+       != GTK_RESPONSE_OK )
+    return;
+
+  // 変更後のタグが別の変更前のタグと重なる場合に付け替えが連鎖しないよう、付け替える前のファイルを求めておく
+  const TagData& tagData = g_TagData; // 読むだけなのでチャンクを複製しない
+  vector< vector< FileId > > sources; // renames 毎の変更前のタグの付いたファイル
+  for ( auto r = renames.begin() ; r != renames.end() ; ++r ) {
+    const Posting& posting = tagData.find( r->first )->second;
+    sources.emplace_back( posting.begin(), posting.end() );
+  }
+
+  vector< TagChange > changes;
+  {
+    EditScope edit( "replace tag names" );
+    for ( std::size_t i = 0 ; i < renames.size() ; ++i ) {
+      // 先の付け替えでファイルが増えていなければ、タグ全体の付け替え(空いていれば名前の変更)にする
+      auto t = tagData.find( renames[i].first );
+      bool unchanged = ( t != tagData.end() ) &&
+        std::equal( t->second.begin(), t->second.end(), sources[i].begin(), sources[i].end() );
+      RetagFiles( renames[i].first, renames[i].second, unchanged ? nullptr : &( sources[i] ), &changes );
+    }
+  }
+  ReflectTagChanges( status, changes );
+  ShowStatus( builder, std::to_string( renames.size() ) + " tags renamed" );
+}
+
+/*
+  CB_TagEdit : タグの編集(コールバック関数)
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_TagEdit( GtkMenuItem* menuItem, gpointer data )
+{
+  // TagFileStatus オブジェクトへのポインタに変換
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  GtkTreeModel* model;
+  GtkTreeIter iter;
+  string currentTag;
+  string newTag;
+
+  if ( ! GetSelectedRow( builder, "taglist", &currentTag, &model, &iter ) )
+    return;
+
+  while ( TagEdit( builder, currentTag, &newTag ) == GTK_RESPONSE_ACCEPT ) {
+    string message;
+    if ( ! CheckTag( &newTag, &message ) ) {
+      MessageBox( message, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+      continue;
+    }
+
+    // 別のタグと重複する場合は、そのタグにまとめるか確認する(大文字と小文字だけの変更はそのまま変更する)
+    StrLess less;
+    bool same = ! less( currentTag, newTag ) && ! less( newTag, currentTag );
+    if ( ! same && ! CheckDuplicateTag( newTag, &message, g_TagData ) &&
+         MessageBox( message + "\n「" + newTag + "」にまとめますか？", GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, builder )
+         != GTK_RESPONSE_YES )
+      continue;
+
+    vector< TagChange > changes;
+    {
+      EditScope edit( "rename tag" );
+      RetagFiles( currentTag, newTag, nullptr, &changes );
+    }
+    ReflectTagChanges( status, changes );
+    break;
+  }
+}
+
+/*
+  CB_TagParent : 選択中のタグの親タグの設定(コールバック関数)
+
+  親タグで絞り込むと、子孫のタグの付いたファイルも表示される。空にすると親子関係を解く。
+  階層は編集の履歴に記録しないため、取り消しの対象にはならない。
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
+*/
+void CB_TagParent( GtkMenuItem* menuItem, gpointer data )
+{
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+
+  GtkTreeModel* model;
+  GtkTreeIter iter;
+  string tag;
+  if ( ! GetSelectedRow( builder, "taglist", &tag, &model, &iter ) )
+    return;
+
+  string parent;
+  while ( InputText( builder, "親タグ(空なら親子関係を解く)", g_TagTree.parent( tag ), &parent ) == GTK_RESPONSE_ACCEPT ) {
+    string message;
+    boost::algorithm::trim( parent );
+    if ( ! parent.empty() && ! CheckTag( &parent, &message ) ) {
+      MessageBox( message, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+      continue;
+    }
+
+    bool done;
+    {
+      EditScope edit;
+      done = g_TagTree.setParent( tag, parent, g_TagData );
+    }
+    if ( ! done ) {
+      MessageBox( "「" + parent + "」は「" + tag + "」自身か子孫のタグです。", GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+      continue;
+    }
+
+    // 親タグに一致する条件の結果が変わるため、評価し直す
+    status->set();
+    g_Searches.assign( g_Searches.data(), g_FileData, g_TagData, g_TagTree, g_TagRules );
+    StartFilter( status, false );
+    const Posting* files = parent.empty() ? nullptr : g_TagTree.files( parent );
+    ShowStatus( builder, parent.empty() ? "\"" + tag + "\" detached" :
+                "\"" + tag + "\" -> \"" + parent + "\" : " + std::to_string( files->size() ) + " files under \"" + parent + "\"" );
+    break;
+  }
+}
+
+/*
+  SplitTags : 空白で区切ったタグを、重複を除いて返す
+*/
+TagRules::Names SplitTags( const string& text )
+{
+  TagRules::Names res;
+  std::istringstream iss( text );
+  string tag;
+  while ( iss >> tag )
+    res.insert( tag );
+
+  return( res );
+}
+
+/*
+  JoinTags : タグを空白で区切って 1 つの文字列にする
+*/
+string JoinTags( const TagRules::Names& tags )
+{
+  string res;
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    res += ( ( t == tags.begin() ) ? "" : " " ) + *t;
+
+  return( res );
+}
+
+/*
+  ReflectTagRules : 規則の変更を、保存した検索条件と絞り込みの結果に反映する
+
+  別名・含意に一致する条件の結果が変わるため、評価し直す
+*/
+void ReflectTagRules( TagFileStatus* status )
+{
+  status->set();
+  g_Searches.assign( g_Searches.data(), g_FileData, g_TagData, g_TagTree, g_TagRules );
+  StartFilter( status, false );
+}
+
+/*
+  CB_TagAlias : 選択中のタグの別名の設定(コールバック関数)
+
+  別名で付けたタグは正式なタグに読み替え、別名で絞り込むと正式なタグの付いたファイルが表示される。
+  規則は編集の履歴に記録しないため、取り消しの対象にはならない。
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 */
-void TagFileStatus::reset()
+void CB_TagAlias( GtkMenuItem* menuItem, gpointer data )
 {
-  edited_ = false;
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  // メッセージ出力
-  GtkWindow* rootWin = GTK_WINDOW( gtk_builder_get_object( builder_, "root" ) );
-  gtk_window_set_title( rootWin, title().c_str() );
+  GtkTreeModel* model;
+  GtkTreeIter iter;
+  string tag;
+  if ( ! GetSelectedRow( builder, "taglist", &tag, &model, &iter ) )
+    return;
+  tag = g_TagRules.canonical( tag );
+
+  const TagRules::Names current = g_TagRules.aliases( tag );
+  string text;
+  while ( InputText( builder, "「" + tag + "」の別名(空白区切り)", JoinTags( current ), &text ) == GTK_RESPONSE_ACCEPT ) {
+    TagRules::Names aliases = SplitTags( text );
+    if ( aliases.count( tag ) > 0 ) {
+      MessageBox( "タグ自身は別名にできません。", GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+      continue;
+    }
+
+    {
+      EditScope edit;
+      for ( auto a = current.begin() ; a != current.end() ; ++a )
+        if ( aliases.count( *a ) == 0 ) g_TagRules.setAlias( *a, string() );
+      for ( auto a = aliases.begin() ; a != aliases.end() ; ++a )
+        if ( current.count( *a ) == 0 ) g_TagRules.setAlias( *a, tag );
+    }
+
+    ReflectTagRules( status );
+    ShowStatus( builder, aliases.empty() ? "\"" + tag + "\" has no alias" :
+                "\"" + tag + "\" aliases : " + JoinTags( g_TagRules.aliases( tag ) ) );
+    break;
+  }
 }
 
 /*
-  CB_FileSaveAs : タグリストの新規保存(コールバック関数)
+  CB_TagImply : 選択中のタグが含意するタグの設定(コールバック関数)
+
+  タグを付けると、含意するタグ(とそれが含意するタグ)も付く。
+  含意するタグで絞り込むと、このタグの付いたファイルも表示される。
+  規則は編集の履歴に記録しないため、取り消しの対象にはならない。
 
   menuItem : GtkMenuItem オブジェクトへのポインタ
   data : TagFileStatus オブジェクトへのポインタ
 */
-void CB_FileSaveAs( GtkMenuItem* menuItem, gpointer data )
+void CB_TagImply( GtkMenuItem* menuItem, gpointer data )
 {
-  // TagFileStatus オブジェクトへのポインタに変換
   TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  if ( ! status->canSave() ) return;
+  GtkTreeModel* model;
+  GtkTreeIter iter;
+  string tag;
+  if ( ! GetSelectedRow( builder, "taglist", &tag, &model, &iter ) )
+    return;
+  tag = g_TagRules.canonical( tag );
+
+  const TagRules::Names current = g_TagRules.implies( tag );
+  string text;
+  while ( InputText( builder, "「" + tag + "」が含意するタグ(空白区切り)", JoinTags( current ), &text ) == GTK_RESPONSE_ACCEPT ) {
+    TagRules::Names implies = SplitTags( text );
+
+    vector< string > rejected; // 循環するため加えなかったタグ
+    {
+      EditScope edit;
+      for ( auto i = current.begin() ; i != current.end() ; ++i )
+        if ( implies.count( *i ) == 0 ) g_TagRules.unimply( tag, *i );
+      for ( auto i = implies.begin() ; i != implies.end() ; ++i )
+        if ( current.count( *i ) == 0 && ! g_TagRules.imply( tag, *i ) ) rejected.push_back( *i );
+    }
 
-  string tagFile = status->pathName();
-  if ( GetFileNameFromDialog( status->builder(), "タグリストの新規保存", GTK_FILE_CHOOSER_ACTION_SAVE,
-                              "Cancel", "Save", &tagFile, &g_CurrentTagFolder ) == GTK_RESPONSE_ACCEPT ) {
-    status->save( tagFile, g_FileData );
+    ReflectTagRules( status );
+    if ( ! rejected.empty() ) {
+      string message;
+      for ( auto r = rejected.begin() ; r != rejected.end() ; ++r )
+        message += "「" + *r + "」";
+      MessageBox( message + "は「" + tag + "」自身か「" + tag + "」を含意するタグのため、加えませんでした。",
+                  GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
+    }
+    ShowStatus( builder, "\"" + tag + "\" implies : " + JoinTags( g_TagRules.implied( tag ) ) );
+    break;
   }
 }
 
 /*
-  CB_FileSave : タグリストの上書き保存(コールバック関数)
+  CB_TagDelete : タグの削除(コールバック関数)
 
   menuItem : GtkMenuItem オブジェクトへのポインタ
   data : TagFileStatus オブジェクトへのポインタ
 */
-void CB_FileSave( GtkMenuItem* menuItem, gpointer data )
+void CB_TagDelete( GtkMenuItem* menuItem, gpointer data )
 {
   // TagFileStatus オブジェクトへのポインタに変換
   TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  if ( ! status->hasFile() ) {
-    CB_FileSaveAs( menuItem, data );
+  GtkTreeModel* model;
+  GtkTreeIter iter;
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( builder, &files ) )
+    return;
+  string tagName;
+  if ( ! GetSelectedRow( builder, "taglist", &tagName, &model, &iter ) )
     return;
+
+  // 選択中の全てのファイルから削除する
+  vector< FileId > removed; // タグを削除したファイル
+  {
+    EditScope edit( "delete tag" );
+    for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+      if ( RemoveTag( tagName, *f, &g_FileData, &g_TagData, &g_TagTree ) ) {
+        g_EditLog.remove( tagName, *f );
+        removed.push_back( *f );
+      }
+    }
   }
 
-  status->save( g_FileData );
+  GtkTreeIter child_iter;
+  gtk_tree_model_sort_convert_iter_to_child_iter( GTK_TREE_MODEL_SORT( model ), &child_iter, &iter );
+  GtkTreeModel* child = gtk_tree_model_sort_get_model( GTK_TREE_MODEL_SORT( model ) );
+  gtk_list_store_remove( GTK_LIST_STORE( child ), &child_iter );
+
+  status->set();
+  ReflectTagChange( status, removed, tagName, false );
+  RefreshFilter( status );
+  UpdateSuggestList( builder );
 }
 
 /*
-  ConfirmSave : 保存するか確認するダイアログの出力
+  ShowFileSet : 絞り込み条件を解除し、files だけをファイルリストに表示する
 
   status : TagFileStatus オブジェクトへのポインタ
-
-  戻り値 : 処理を中断する場合は false を返す
+  files : 表示するファイル
+  message : ステータスバーに表示するメッセージ
 */
-bool ConfirmSave( TagFileStatus* status )
+void ShowFileSet( TagFileStatus* status, vector< FileId > files, const string& message )
 {
-  gint res = ThreeButtons_MessageBox( "編集中のファイルを保存しますか？", status->builder() );
+  GtkBuilder* builder = status->builder();
 
-  switch ( res ) {
-  case GTK_RESPONSE_YES:
-    CB_FileSave( 0, status );
-    break;
-  case GTK_RESPONSE_NO:
-    break;
-  default:
-    return( false );
-  }
+  // 実行中の絞り込みを中断し、条件を空にする
+  ++g_FilterGeneration;
+  GtkEntry* filter = GTK_ENTRY( gtk_builder_get_object( builder, "filterentry" ) );
+  GtkComboBox* search = GTK_COMBO_BOX( gtk_builder_get_object( builder, "searchcombo" ) );
+  g_signal_handler_block( filter, g_FilterID );
+  gtk_entry_set_text( filter, "" );
+  g_signal_handler_unblock( filter, g_FilterID );
+  g_signal_handler_block( search, g_SearchID );
+  gtk_combo_box_set_active( search, -1 );
+  g_signal_handler_unblock( search, g_SearchID );
+  g_FilterQuery = Query();
+
+  std::sort( files.begin(), files.end() );
+  ShowFileList( builder, status->libraries(), std::make_shared< FileList >( files.begin(), files.end() ) );
+  ShowStatus( builder, message );
+}
 
-  return( true );
+/*
+  ShowNotIndexed : 索引の作成中であることを表示する
+
+  builder : GtkBuilderオブジェクトへのポインタ
+*/
+void ShowNotIndexed( GtkBuilder* builder )
+{
+  ShowStatus( builder, "Not indexed yet (" + std::to_string( g_Images.size() ) + " / " +
+              std::to_string( g_FileData.paths().count() ) + " images)" );
 }
 
 /*
-  CB_FileNew : タグリストの新規作成(コールバック関数)
+  CB_FindSimilar : 選択中のファイルに似た画像をファイルリストに表示する(コールバック関数)
+
+  絞り込み条件は解除し、選択中のファイルと似た画像だけを表示する。
 
   menuItem : GtkMenuItem オブジェクトへのポインタ
   data : TagFileStatus オブジェクトへのポインタ
 */
-void CB_FileNew( GtkMenuItem* menuItem, gpointer data )
+void CB_FindSimilar( GtkMenuItem* menuItem, gpointer data )
 {
-  static string currentImageFolder;
-
-  // TagFileStatus オブジェクトへのポインタに変換
   TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  // 編集されたタグファイルが残っていたら、保存するか確認する
-  if ( status->edited() )
-    if ( ! ConfirmSave( status ) ) return;
+  FileId file;
+  if ( ! GetFileId( builder, &file ) )
+    return;
 
-  string rootPath;
-  if ( GetFileNameFromDialog( status->builder(), "ルートパスの選択", GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
-                              "Cancel", "Select", &rootPath, &currentImageFolder ) == GTK_RESPONSE_ACCEPT ) {
-    status->init( rootPath, &g_FileData, &g_TagData );
+  if ( ! g_Images.indexed( file ) ) {
+    ShowNotIndexed( builder );
+    return;
   }
+
+  vector< FileId > files = g_Images.similar().find( file, SIMILAR_DISTANCE );
+  string message = std::to_string( files.size() ) + " similar images";
+  files.push_back( file );
+  ShowFileSet( status, std::move( files ), message );
 }
 
 /*
-  CB_FileOpen : タグリストを開く(コールバック関数)
+  CB_FindSimilarColors : 選択中のファイルと配色が似た画像をファイルリストに表示する(コールバック関数)
 
   menuItem : GtkMenuItem オブジェクトへのポインタ
   data : TagFileStatus オブジェクトへのポインタ
 */
-void CB_FileOpen( GtkMenuItem* menuItem, gpointer data )
+void CB_FindSimilarColors( GtkMenuItem* menuItem, gpointer data )
 {
-  // TagFileStatus オブジェクトへのポインタに変換
   TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  // 編集されたタグファイルが残っていたら、保存するか確認する
-  if ( status->edited() )
-    ConfirmSave( status );
+  FileId file;
+  if ( ! GetFileId( builder, &file ) )
+    return;
 
-  string tagFile;
-  if ( GetFileNameFromDialog( status->builder(), "タグリストを開く", GTK_FILE_CHOOSER_ACTION_OPEN,
-                              "Cancel", "Open", &tagFile, &g_CurrentTagFolder ) == GTK_RESPONSE_ACCEPT ) {
-    status->open( tagFile, &g_FileData, &g_TagData );
+  if ( ! g_Images.indexed( file ) ) {
+    ShowNotIndexed( builder );
+    return;
   }
+
+  vector< FileId > files = g_Images.colors().nearest( file, PALETTE_LIMIT );
+  string message = std::to_string( files.size() ) + " images with similar colors";
+  files.push_back( file );
+  ShowFileSet( status, std::move( files ), message );
 }
 
 /*
-  CB_ToggleAutoScale : 画像をウィンドウに合わせる/そのままの大きさにする の切り替え(コールバック関数)
+  CB_FilterByColor : 選択した色が主な色の画像をファイルリストに表示する(コールバック関数)
+
+  色の区分はメニュー項目の "bin" に持たせる。
 
   menuItem : GtkMenuItem オブジェクトへのポインタ
-  data : NULL ポインタ(未使用)
+  data : TagFileStatus オブジェクトへのポインタ
 */
-void CB_ToggleAutoScale( GtkMenuItem* menuItem, gpointer data )
+void CB_FilterByColor( GtkMenuItem* menuItem, gpointer data )
 {
-  g_AutoScale = ! g_AutoScale;
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  unsigned bin = GPOINTER_TO_UINT( g_object_get_data( G_OBJECT( menuItem ), "bin" ) );
+
+  vector< FileId > files = g_Images.colors().dominant( bin, DOMINANT_SHARE );
+  string message = std::to_string( files.size() ) + " images mostly " + ColorName( bin ) +
+    " (" + std::to_string( g_Images.size() ) + " / " + std::to_string( g_FileData.paths().count() ) + " indexed)";
+  ShowFileSet( status, std::move( files ), message );
 }
 
 /*
-  AddTag : タグの登録を行う
+  CB_CopyTagsToSimilar : 選択中のファイルのタグを、似た画像すべてに付ける(コールバック関数)
 
-  tag : 登録するタグ
-  fileName : 登録対象のファイル
-  fileData : ファイルをキーとしたタグリスト
-  tagData : タグをキーとしたファイルリスト
-
-  戻り値 : タグがすでに登録されていた場合は false を返す
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 */
-bool AddTag( const string& tag, const string& fileName, FileData* fileData, TagData* tagData )
+void CB_CopyTagsToSimilar( GtkMenuItem* menuItem, gpointer data )
 {
-  auto& f = ( *fileData )[fileName];
-  if ( ! f.insert( tag ).second )
-    return( false );
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
 
-  auto& t = ( *tagData )[tag];
-  t.insert( fileName );
+  FileId file;
+  if ( ! GetFileId( builder, &file ) || ! g_Images.indexed( file ) )
+    return;
 
-  return( true );
+  vector< FileId > similar = g_Images.similar().find( file, SIMILAR_DISTANCE );
+  vector< std::pair< FileId, string > > added; // 付けたファイルとタグ
+  {
+    EditScope edit( "copy tags to similar images" );
+    vector< string > tags; // 規則で展開したタグ
+    for ( auto t = g_FileData[file].begin() ; t != g_FileData[file].end() ; ++t ) {
+      vector< string > expanded = g_TagRules.expand( *t );
+      tags.insert( tags.end(), expanded.begin(), expanded.end() );
+    }
+    for ( auto f = similar.begin() ; f != similar.end() ; ++f )
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+        if ( AddTag( *t, *f, &g_FileData, &g_TagData, &g_TagTree ) ) {
+          g_EditLog.add( *t, *f );
+          added.emplace_back( *f, *t );
+        }
+  }
+  if ( added.empty() ) return;
+
+  status->set();
+  for ( auto a = added.begin() ; a != added.end() ; ++a )
+    ReflectTagChange( status, a->first, a->second, true );
+  RefreshFilter( status );
+  ShowStatus( builder, std::to_string( added.size() ) + " tags copied to " +
+              std::to_string( similar.size() ) + " similar images" );
 }
 
 /*
-  CheckTag : タグの両端の空白文字を除去し、チェックする
-
-  tag : タグへのポインタ
-  message : 不正があった場合のメッセージを保持する変数へのポインタ
-  tagData : タグをキーとするファイルリスト
+  ReflectGroupChange : グループの変更を画面に反映する
 
-  戻り値 : 不正があった場合は false を返す
+  status : TagFileStatus オブジェクトへのポインタ
+  message : ステータスバーに表示するメッセージ
 */
-bool CheckTag( string* tag, string* message )
+void ReflectGroupChange( TagFileStatus* status, const string& message )
 {
-  boost::algorithm::trim( *tag );
-
-  // 空文字のチェック
-  if ( tag->empty() ) {
-    *message = "空文字はタグにできません。";
-    return( false );
-  }
-
-  // 空白文字を含んでいるか？
-  if ( tag->find( ' ' ) != string::npos ) {
-    *message = "空白文字はタグに使えません。";
-    return( false );
-  }
-
-  return( true );
+  status->set();
+  if ( g_CollapseGroups )
+    ReshowFileList( status, MatchedFiles() );
+  ShowStatus( status->builder(), message );
 }
 
 /*
-  CheckDuplicateTag : 同じタグが存在しないかチェックする
+  CheckSameLibrary : files が全て同じライブラリのファイルか確かめ、違えばメッセージを表示する
 
-  tag : タグ
-  message : 不正があった場合のメッセージを保持する変数へのポインタ
-  tagData : タグをキーとするファイルリスト
+  グループはライブラリ毎のタグファイルに保存するため、ライブラリをまたぐグループは作らない
 
-  戻り値 : 重複があった場合は false を返す
+  status : TagFileStatus オブジェクトへのポインタ
+  files : 同じグループにするファイル
+
+  戻り値 : 全て同じライブラリのファイルなら true を返す
 */
-bool CheckDuplicateTag( const string& tag, string* message, const TagData& tagData )
+bool CheckSameLibrary( TagFileStatus* status, const vector< FileId >& files )
 {
-  // 同じタグが存在していないか？
-  if ( tagData.find( tag ) != tagData.end() ) {
-    *message = "すでに同名のタグがあります。";
-    return( false );
-  }
+  if ( files.empty() ) return( true );
 
-  return( true );
+  const Libraries& libraries = status->libraries();
+  const LibraryRoot* library = FindLibrary( libraries, files.front() );
+  if ( std::all_of( files.begin(), files.end(),
+                    [&libraries, library]( FileId f ) { return( FindLibrary( libraries, f ) == library ); } ) )
+    return( true );
+
+  MessageBox( "別のライブラリのファイルは同じグループにできません。", GTK_MESSAGE_ERROR, GTK_BUTTONS_OK, status->builder() );
+  return( false );
 }
 
 /*
-  CB_AddTag : タグを登録し、タグリストに表示する(コールバック関数)
+  CB_GroupJoin : 選択中のファイルを(それぞれが属するグループごと) 1 つのグループにまとめる(コールバック関数)
 
-  entry : GtkEntry オブジェクトへのポインタ
+  menuItem : GtkMenuItem オブジェクトへのポインタ
   data : TagFileStatus オブジェクトへのポインタ
 */
-void CB_AddTag( GtkEntry* entry, gpointer data )
+void CB_GroupJoin( GtkMenuItem* menuItem, gpointer data )
 {
-  // TagFileStatus オブジェクトへのポインタに変換
   TagFileStatus* status = static_cast< TagFileStatus* >( data );
-  GtkBuilder* builder = status->builder();
-
-  // タグの取得
-  string tag = gtk_entry_get_text( entry );
-
-  // タグのチェック
-  string message;
-  if ( ! CheckTag( &tag, &message ) ) {
-    MessageBox( message, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
-    return;
-  }
 
-  // タグを登録する対象ファイルの取得
-  string fileName;
-  if ( ! GetFileName( builder, status->rootPath(), &fileName ) )
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( status->builder(), &files ) || files.size() < 2 )
     return;
-
-  // タグの登録
-  if ( ! AddTag( tag, fileName, &g_FileData, &g_TagData ) )
+  if ( ! CheckSameLibrary( status, files ) )
     return;
 
-  // 補完用リストへの登録
-  GtkTreeIter iter;
-  if ( g_TagData[tag].size() == 1 ) {
-    GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "completionstore" ) );
-    gtk_list_store_append( store, &iter );
-    gtk_list_store_set( store, &iter, 0, tag.c_str(), -1 );
-  }
-
-  // タグリストへの登録
-  GtkListStore* store = GTK_LIST_STORE( gtk_builder_get_object( builder, "tagliststore" ) );
-  gtk_list_store_append( store, &iter );
-  gtk_list_store_set( store, &iter, 0, tag.c_str(), -1 );
-
-  gtk_entry_set_text( entry, "" );
-
-  status->set();
+  status->edit( g_FileData, g_Groups.expand( files ) );
+  std::size_t count = g_Groups.merge( files );
+  ReflectGroupChange( status, std::to_string( count ) + " files grouped" );
 }
 
 /*
-  SortTag : リストの a, b の順位を比較する
+  CB_GroupSplit : 選択中のファイルを元のグループから外し、別のグループにする(コールバック関数)
 
-  model : GtkTreeModel オブジェクトへのポインタ
-  a, b : 比較対象
-  data : NULL値(未使用)
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 */
-gint SortTag( GtkTreeModel* model, GtkTreeIter* a, GtkTreeIter* b, gpointer data )
+void CB_GroupSplit( GtkMenuItem* menuItem, gpointer data )
 {
-  gchar* gc;
-  gtk_tree_model_get( model, a, 0, &gc, -1 );
-  string sa = ( gc == 0 ) ? "" : gc;
-  g_free( gc );
-  gtk_tree_model_get( model, b, 0, &gc, -1 );
-  string sb = ( gc == 0 ) ? "" : gc;
-  g_free( gc );
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
 
-  StrLess less;
-  return( ( less( sa, sb ) ) ? -1 :
-          ( less( sb, sa ) ? 1 : 0 ) );
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( status->builder(), &files ) )
+    return;
+  if ( ! CheckSameLibrary( status, files ) )
+    return;
+
+  status->edit( g_FileData, g_Groups.expand( files ) );
+  g_Groups.isolate( files );
+  ReflectGroupChange( status, std::to_string( files.size() ) + " files split into a new group" );
 }
 
 /*
-  CreateCompletion : 補完リストの生成
+  CB_GroupRemove : 選択中のファイルをグループから外す(コールバック関数)
 
-  builder : GtkBuilder オブジェクトへのポインタ
+  グループをまとめて表示中は、選択した行のグループを解散する。
+
+  menuItem : GtkMenuItem オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 */
-void CreateCompletion( GtkBuilder* builder )
+void CB_GroupRemove( GtkMenuItem* menuItem, gpointer data )
 {
-  GtkTreeModel* sorted = GTK_TREE_MODEL( gtk_builder_get_object( builder, "completionsort" ) );
-  gtk_tree_sortable_set_sort_column_id( GTK_TREE_SORTABLE( sorted ), 0, GTK_SORT_ASCENDING );
-  gtk_tree_sortable_set_sort_func( GTK_TREE_SORTABLE( sorted ), 0, SortTag, 0, 0 );
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
 
-  GtkEntryCompletion* completion = GTK_ENTRY_COMPLETION( gtk_builder_get_object( builder, "entrycompletion" ) );
-  gtk_entry_completion_set_text_column( completion, 0 );
+  vector< FileId > files;
+  if ( ! GetSelectedFiles( status->builder(), &files ) )
+    return;
+
+  status->edit( g_FileData, g_Groups.expand( files ) );
+  for ( auto f = files.begin() ; f != files.end() ; ++f )
+    g_Groups.remove( *f );
+  ReflectGroupChange( status, std::to_string( files.size() ) + " files ungrouped" );
 }
 
 /*
-  CB_FilePopup : ファイルリスト上のメニュー表示(コールバック関数)
+  CreateFilePopupMenu : ファイルリスト上のポップアップメニューの作成
 
-  widget : GtkWidget オブジェクトへのポインタ
-  event : GdkEventButton オブジェクトへのポインタ
-  data : GtkBuilder オブジェクトへのポインタ
+  status : TagFileStatus オブジェクトへのポインタ
 */
-gboolean CB_FilePopup( GtkWidget* widget, GdkEventButton* event, gpointer data )
+void CreateFilePopupMenu( TagFileStatus* status )
 {
-  GtkBuilder* builder = static_cast< GtkBuilder* >( data );
-
-  if ( event->button == 3 ) {
-    GtkMenu* menu = GTK_MENU( gtk_builder_get_object( builder, "filepopup" ) );
-    gtk_menu_popup_at_pointer( menu, reinterpret_cast< GdkEvent* >( event ) );
-  }
+  GtkBuilder* builder = status->builder();
 
-  return( FALSE );
+  GObject* tagCopy = gtk_builder_get_object( builder, "tagcopy" );
+  g_signal_connect( tagCopy, "activate", G_CALLBACK( CB_TagCopy ), status );
+  GObject* tagPaste = gtk_builder_get_object( builder, "tagpaste" );
+  g_signal_connect( tagPaste, "activate", G_CALLBACK( CB_TagPaste ), status );
+  GObject* findSimilar = gtk_builder_get_object( builder, "findsimilar" );
+  g_signal_connect( findSimilar, "activate", G_CALLBACK( CB_FindSimilar ), status );
+  GObject* copySimilar = gtk_builder_get_object( builder, "copysimilar" );
+  g_signal_connect( copySimilar, "activate", G_CALLBACK( CB_CopyTagsToSimilar ), status );
+  GObject* similarColors = gtk_builder_get_object( builder, "similarcolors" );
+  g_signal_connect( similarColors, "activate", G_CALLBACK( CB_FindSimilarColors ), status );
+  GObject* groupJoin = gtk_builder_get_object( builder, "groupjoin" );
+  g_signal_connect( groupJoin, "activate", G_CALLBACK( CB_GroupJoin ), status );
+  GObject* groupSplit = gtk_builder_get_object( builder, "groupsplit" );
+  g_signal_connect( groupSplit, "activate", G_CALLBACK( CB_GroupSplit ), status );
+  GObject* groupRemove = gtk_builder_get_object( builder, "groupremove" );
+  g_signal_connect( groupRemove, "activate", G_CALLBACK( CB_GroupRemove ), status );
 }
 
 /*
-  CreateFileList : ファイルリストの生成
+  CreateColorMenu : 主な色で絞り込むメニューの生成
+
+  色の区分毎に項目を作り、区分を項目の "bin" に持たせる。
 
   status : TagFileStatus オブジェクトへのポインタ
 */
-void CreateFileList( TagFileStatus* status )
+void CreateColorMenu( TagFileStatus* status )
 {
   GtkBuilder* builder = status->builder();
 
-  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "filelist" ) );
-
-  GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
-  GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes
-    ( "path name", renderer, "text", 0, NULL );
-  gtk_tree_view_append_column( view, column );
+  GtkMenuShell* colorMenu = GTK_MENU_SHELL( gtk_builder_get_object( builder, "colormenu" ) );
+  for ( unsigned b = 0 ; b < COLOR_BINS ; ++b ) {
+    GtkWidget* item = gtk_menu_item_new_with_label( ColorName( b ) );
+    g_object_set_data( G_OBJECT( item ), "bin", GUINT_TO_POINTER( b ) );
+    g_signal_connect( item, "activate", G_CALLBACK( CB_FilterByColor ), status );
+    gtk_menu_shell_append( colorMenu, item );
+    gtk_widget_show( item );
+  }
+}
 
-  GtkTreeSelection* selection = gtk_tree_view_get_selection( view );
-  gtk_tree_selection_set_mode( selection, GTK_SELECTION_SINGLE );
-  g_FileListID = g_signal_connect( G_OBJECT( selection ), "changed", G_CALLBACK( CB_ShowImage ), status );
+/*
+  CreateTagPopupMenu : タグリスト上のポップアップメニューの作成
 
-  g_signal_connect( G_OBJECT( view ), "button-press-event", G_CALLBACK( CB_FilePopup ), builder );
+  status : TagFileStatus オブジェクトへのポインタ
+*/
+void CreateTagPopupMenu( TagFileStatus* status )
+{
+  GtkBuilder* builder = status->builder();
+
+  GObject* tagEdit = gtk_builder_get_object( builder, "tagedit" );
+  g_signal_connect( tagEdit, "activate", G_CALLBACK( CB_TagEdit ), status );
+  GObject* tagDelete = gtk_builder_get_object( builder, "tagdelete" );
+  g_signal_connect( tagDelete, "activate", G_CALLBACK( CB_TagDelete ), status );
+  GObject* tagSplit = gtk_builder_get_object( builder, "tagsplit" );
+  g_signal_connect( tagSplit, "activate", G_CALLBACK( CB_TagSplit ), status );
+  GObject* tagParent = gtk_builder_get_object( builder, "tagparent" );
+  g_signal_connect( tagParent, "activate", G_CALLBACK( CB_TagParent ), status );
+  GObject* tagAlias = gtk_builder_get_object( builder, "tagalias" );
+  g_signal_connect( tagAlias, "activate", G_CALLBACK( CB_TagAlias ), status );
+  GObject* tagImply = gtk_builder_get_object( builder, "tagimply" );
+  g_signal_connect( tagImply, "activate", G_CALLBACK( CB_TagImply ), status );
+
+  // 編集メニューのタグ名の一括置換
+  GObject* tagReplace = gtk_builder_get_object( builder, "tagreplace" );
+  g_signal_connect( tagReplace, "activate", G_CALLBACK( CB_TagReplace ), status );
 }
 
 /*
-  CB_TagPopup : タグリスト上のメニュー表示(コールバック関数)
+  CB_FacetActivated : ファセットのタグを絞り込み条件に加える(コールバック関数)
 
-  widget : GtkWidget オブジェクトへのポインタ
-  event : GdkEventButton オブジェクトへのポインタ
+  view : GtkTreeView オブジェクトへのポインタ
+  path : 選択された行
+  column : 選択された列
   data : GtkBuilder オブジェクトへのポインタ
 */
-gboolean CB_TagPopup( GtkWidget* widget, GdkEventButton* event, gpointer data )
+void CB_FacetActivated( GtkTreeView* view, GtkTreePath* path, GtkTreeViewColumn* column, gpointer data )
 {
   GtkBuilder* builder = static_cast< GtkBuilder* >( data );
+  GtkTreeModel* model = gtk_tree_view_get_model( view );
+  GtkTreeIter iter;
+  if ( ! gtk_tree_model_get_iter( model, &iter, path ) )
+    return;
 
-  if ( event->button == 3 ) {
-    GtkMenu* menu = GTK_MENU( gtk_builder_get_object( builder, "tagmenu" ) );
-    gtk_menu_popup_at_pointer( menu, reinterpret_cast< GdkEvent* >( event ) );
-  }
+  gchar* gc;
+  gtk_tree_model_get( model, &iter, 0, &gc, -1 );
+  string tag = gc;
+  g_free( gc );
 
-  return( FALSE );
+  // 語を加えると絞り込みとして評価される
+  GtkEntry* filter = GTK_ENTRY( gtk_builder_get_object( builder, "filterentry" ) );
+  string text = gtk_entry_get_text( filter );
+  boost::algorithm::trim( text );
+  text += ( text.empty() ) ? tag : ( " " + tag );
+  gtk_entry_set_text( filter, text.c_str() );
 }
 
 /*
-  CreateTagList : タグリストの生成
+  CreateFacetList : ファセットリストの生成
 
   builder : GtkBuilder オブジェクトへのポインタ
 */
-void CreateTagList( GtkBuilder* builder )
+void CreateFacetList( GtkBuilder* builder )
 {
-  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "taglist" ) );
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "facetlist" ) );
 
-  GtkTreeModel* sorted = GTK_TREE_MODEL( gtk_builder_get_object( builder, "taglistsort" ) );
-  gtk_tree_sortable_set_sort_column_id( GTK_TREE_SORTABLE( sorted ), 0, GTK_SORT_ASCENDING );
-  gtk_tree_sortable_set_sort_func( GTK_TREE_SORTABLE( sorted ), 0, SortTag, 0, 0 );
+  GtkTreeModel* sorted = GTK_TREE_MODEL( gtk_builder_get_object( builder, "facetsort" ) );
+  gtk_tree_sortable_set_sort_column_id( GTK_TREE_SORTABLE( sorted ), 1, GTK_SORT_DESCENDING );
   GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
   GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes
     ( "tag name", renderer, "text", 0, NULL );
   gtk_tree_view_append_column( view, column );
+  renderer = gtk_cell_renderer_text_new();
+  column = gtk_tree_view_column_new_with_attributes
+    ( "count", renderer, "text", 1, NULL );
+  gtk_tree_view_append_column( view, column );
 
-  g_signal_connect( G_OBJECT( view ), "button-press-event", G_CALLBACK( CB_TagPopup ), builder );
+  g_signal_connect( G_OBJECT( view ), "row-activated", G_CALLBACK( CB_FacetActivated ), builder );
 }
 
 /*
-  CreateMenu : メニューの生成
+  CB_LoadDirectory : 展開したディレクトリを読み込む(コールバック関数)
 
-  status : TagFileStatus オブジェクトへのポインタ
+  タグファイルの読み込み中は、読み込みが終わってから読み込む。
+
+  data : DirectoryLoad オブジェクトへのポインタ
+
+  戻り値 : 常に G_SOURCE_REMOVE
 */
-void CreateMenu( TagFileStatus* status )
+gboolean CB_LoadDirectory( gpointer data )
 {
-  GtkBuilder* builder = status->builder();
+  std::unique_ptr< DirectoryLoad > request( static_cast< DirectoryLoad* >( data ) );
 
-  GObject* obj = gtk_builder_get_object( builder, "filenew" );
-  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileNew ), status );
-  obj = gtk_builder_get_object( builder, "fileopen" );
-  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileOpen ), status );
-  obj = gtk_builder_get_object( builder, "filesave" );
-  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileSave ), status );
-  obj = gtk_builder_get_object( builder, "filesaveas" );
-  g_signal_connect( obj, "activate", G_CALLBACK( CB_FileSaveAs ), status );
+  if ( g_Loading ) {
+    g_timeout_add( PROGRESS_INTERVAL.count(), CB_LoadDirectory, request.release() );
+    return( G_SOURCE_REMOVE );
+  }
 
-  obj = gtk_builder_get_object( builder, "autoscale" );
-  g_signal_connect( obj, "activate", G_CALLBACK( CB_ToggleAutoScale ), 0 );
+  // 依頼後に別のタグファイルを開いた場合などは、読み込み済みか範囲外になる
+  TagFileStatus* status = request->status;
+  const LazyLibrary* lazy = status->lazy();
+  if ( lazy != nullptr && request->dir < lazy->file().directories().size() && ! lazy->loaded( request->dir ) )
+    status->load( vector< LazyTagFile::DirIndex >( 1, request->dir ),
+                  &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+
+  return( G_SOURCE_REMOVE );
 }
 
 /*
-  ChangeTagName : タグ名の変更
+  CB_DirectoryExpand : 展開するディレクトリの子の行を作る(コールバック関数)
+
+  子の行が空の行だけなら、子のディレクトリの行を加えてから空の行を削除する。
+  遅延読み込み中は、展開したディレクトリの直接のファイルをアイドル時に読み込む。
 
-  oldTag : 変更対象のタグ
-  newTag : 新しいタグ
-  fileData : ファイルをキーとするタグリストへのポインタ
-  tagData : タグをキーとするファイルリストへのポインタ
+  view : GtkTreeView オブジェクトへのポインタ
+  iter : 展開する行
+  path : 展開する行のパス
+  data : TagFileStatus オブジェクトへのポインタ
+
+  戻り値 : 常に FALSE(展開を許可する)
 */
-void ChangeTagName( const string& oldTag, const string& newTag, FileData* fileData, TagData* tagData )
+gboolean CB_DirectoryExpand( GtkTreeView* view, GtkTreeIter* iter, GtkTreePath* path, gpointer data )
 {
-  auto t = tagData->find( oldTag );
-  if ( t == tagData->end() ) return;
-
-  const auto& fileList = t->second;
-  for ( auto f = fileList.begin() ; f != fileList.end() ; ++f ) {
-    auto& tagList = ( *fileData )[*f];
-    tagList.erase( oldTag );
-    tagList.insert( newTag );
-  }
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkBuilder* builder = status->builder();
+  GtkTreeStore* store = GTK_TREE_STORE( gtk_builder_get_object( builder, "dirstore" ) );
+  GtkTreeModel* model = GTK_TREE_MODEL( store );
+
+  GtkTreeIter placeholder;
+  guint node;
+  if ( ! gtk_tree_model_iter_children( model, &placeholder, iter ) )
+    return( FALSE );
+  gtk_tree_model_get( model, &placeholder, 3, &node, -1 );
+  if ( node != DirectoryTree::NO_NODE )
+    return( FALSE );
+
+  gtk_tree_model_get( model, iter, 3, &node, -1 );
+  const DirectoryTree::Node& dir = g_Directories[node];
+  GtkTreeIter child;
+  for ( auto c = dir.children.begin() ; c != dir.children.end() ; ++c )
+    InsertDirectoryRow( store, iter, *c, &child );
+  gtk_tree_store_remove( store, &placeholder );
+
+  const LazyLibrary* lazy = status->lazy();
+  if ( lazy != nullptr && ! lazy->loaded( node ) )
+    g_idle_add( CB_LoadDirectory, new DirectoryLoad{ status, node } );
+  else
+    status->touch( node );
 
-  tagData->insert( std::make_pair( newTag, fileList ) );
-  tagData->erase( oldTag );
+  return( FALSE );
 }
 
 /*
-  GetSelectedRow : リスト内の選択行を取得する
+  CB_DirectorySelected : ファイルリストとファセットを選択したディレクトリ以下に絞る(コールバック関数)
 
-  builder : GtkBuilderオブジェクトへのポインタ
-  listName : リスト名(filelist/taglist)
-  rowName : 選択行をセットする変数へのポインタ
-  model : GtkTreeModelオブジェクトへのハンドル
-  iter : GtkTreeIterオブジェクトへのポインタ
+  範囲が狭まる場合は表示中の結果を絞るだけでよい。広がる場合は絞り込み条件を評価し直す。
+  遅延読み込み中は、読み込んでいないディレクトリの直接のファイルを先に読み込む。
 
-  戻り値 : 選択されていた場合は true を返す
+  selection : GtkTreeSelection オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 */
-bool GetSelectedRow( GtkBuilder* builder, const string& listName, string* rowName, GtkTreeModel** model, GtkTreeIter* iter )
+void CB_DirectorySelected( GtkTreeSelection* selection, gpointer data )
 {
-  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, listName.c_str() ) );
-  *model = gtk_tree_view_get_model( view );
-  GtkTreeSelection* selection = gtk_tree_view_get_selection( view );
-  if ( ! gtk_tree_selection_get_selected( selection, model, iter ) )
-    return( false );
-  gchar* gc;
-  gtk_tree_model_get( *model, iter, 0, &gc, -1 );
-  *rowName = gc;
-  g_free( gc );
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
+  GtkTreeModel* model;
+  GtkTreeIter iter;
 
-  return( true );
+  DirectoryTree::NodeId node = DirectoryTree::NO_NODE;
+  if ( gtk_tree_selection_get_selected( selection, &model, &iter ) ) {
+    guint n;
+    gtk_tree_model_get( model, &iter, 3, &n, -1 );
+    node = n;
+  }
+  if ( node == g_DirScope ) return;
+
+  bool narrowed = ( g_DirScope == DirectoryTree::NO_NODE ) ||
+    ( node != DirectoryTree::NO_NODE && g_Directories[g_DirScope].first <= g_Directories[node].first &&
+      g_Directories[node].last <= g_Directories[g_DirScope].last );
+  g_DirScope = node;
+  const LazyLibrary* lazy = status->lazy();
+  if ( lazy != nullptr && node != DirectoryTree::NO_NODE && ! lazy->loaded( node ) )
+    status->load( vector< LazyTagFile::DirIndex >( 1, node ),
+                  &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+  else if ( node != DirectoryTree::NO_NODE )
+    status->touch( node );
+  if ( narrowed )
+    ShowFileList( status->builder(), status->libraries(), MatchedFiles() );
+  else
+    StartFilter( status, false );
 }
 
 /*
-  CB_TagCopy : タグのコピー(コールバック関数)
+  CreateDirectoryList : ディレクトリリストの生成
 
-  menuItem : GtkMenuItem オブジェクトへのポインタ
-  data : TagFileStatus オブジェクトへのポインタ
+  status : TagFileStatus オブジェクトへのポインタ
 */
-void CB_TagCopy( GtkMenuItem* menuItem, gpointer data )
+void CreateDirectoryList( TagFileStatus* status )
 {
-  // TagClipboard オブジェクトへのポインタに変換
-  TagFileStatus* status = static_cast< TagFileStatus* >( data );
   GtkBuilder* builder = status->builder();
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( builder, "dirlist" ) );
 
-  string fileName;
-  if ( ! GetFileName( builder, status->rootPath(), &fileName ) )
-    return;
+  GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+  GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes
+    ( "directory", renderer, "text", 0, NULL );
+  gtk_tree_view_append_column( view, column );
+  renderer = gtk_cell_renderer_text_new();
+  column = gtk_tree_view_column_new_with_attributes
+    ( "files", renderer, "text", 1, NULL );
+  gtk_tree_view_append_column( view, column );
+  renderer = gtk_cell_renderer_text_new();
+  column = gtk_tree_view_column_new_with_attributes
+    ( "tagged", renderer, "text", 2, NULL );
+  gtk_tree_view_append_column( view, column );
 
-  g_Clipboard = g_FileData[fileName];
-  //std::cout << g_Clipboard.size() << std::endl;
+  g_signal_connect( G_OBJECT( view ), "test-expand-row", G_CALLBACK( CB_DirectoryExpand ), status );
+  GtkTreeSelection* selection = gtk_tree_view_get_selection( view );
+  g_DirListID = g_signal_connect( G_OBJECT( selection ), "changed", G_CALLBACK( CB_DirectorySelected ), status );
 }
 
 /*
-  CB_TagPaste : タグの貼り付け(コールバック関数)
+  CreateSuggestList : タグの候補リストの生成
 
-  menuItem : GtkMenuItem オブジェクトへのポインタ
-  data : TagFileStatus オブジェクトへのポインタ
+  status : TagFileStatus オブジェクトへのポインタ
 */
-void CB_TagPaste( GtkMenuItem* menuItem, gpointer data )
+void CreateSuggestList( TagFileStatus* status )
 {
-  // TagClipboard オブジェクトへのポインタに変換
-  TagFileStatus* status = static_cast< TagFileStatus* >( data );
-  GtkBuilder* builder = status->builder();
-
-  string fileName;
-  if ( ! GetFileName( builder, status->rootPath(), &fileName ) )
-    return;
+  GtkTreeView* view = GTK_TREE_VIEW( gtk_builder_get_object( status->builder(), "suggestlist" ) );
 
-  auto& tagList = g_FileData[fileName];
-  for ( auto i = g_Clipboard.begin() ; i != g_Clipboard.end() ; ++i ) {
-    if ( tagList.find( *i ) == tagList.end() ) {
-      tagList.insert( *i );
-      g_TagData[*i].insert( fileName );
-    }
-  }
-
-  InitTagList( builder, fileName, g_FileData );
+  GtkCellRenderer* renderer = gtk_cell_renderer_text_new();
+  GtkTreeViewColumn* column = gtk_tree_view_column_new_with_attributes
+    ( "tag name", renderer, "text", 0, NULL );
+  gtk_tree_view_append_column( view, column );
 
-  status->set();
+  g_signal_connect( G_OBJECT( view ), "row-activated", G_CALLBACK( CB_SuggestActivated ), status );
 }
 
 /*
-  CB_DlgOk : レスポンスID(GTK_RESPONSE_ACCEPT)を投げる
+  CreateSearchList : 保存した検索条件のリストの生成
 
-  entry : GtkEntryオブジェクトへのポインタ
-  data : GtkDialogオブジェクトへのポインタ
+  status : TagFileStatus オブジェクトへのポインタ
 */
-void CB_DlgOk( GtkEntry* entry, gpointer data )
+void CreateSearchList( TagFileStatus* status )
 {
-  GtkDialog* dialog = static_cast< GtkDialog* >( data );
+  GtkBuilder* builder = status->builder();
 
-  gtk_dialog_response( dialog, GTK_RESPONSE_ACCEPT );
+  GObject* combo = gtk_builder_get_object( builder, "searchcombo" );
+  g_SearchID = g_signal_connect( combo, "changed", G_CALLBACK( CB_SearchSelected ), status );
+  GObject* save = gtk_builder_get_object( builder, "searchsave" );
+  g_signal_connect( save, "clicked", G_CALLBACK( CB_SearchSave ), status );
+  GObject* erase = gtk_builder_get_object( builder, "searchdelete" );
+  g_signal_connect( erase, "clicked", G_CALLBACK( CB_SearchDelete ), status );
 }
 
 /*
-  TagEdit : タグの編集
+  CB_DeleteEvent : ウィンドウを閉じるときのコールバック関数
 
-  builder : GtkBuilderオブジェクトへのポインタ
-  currentTag : 現在のタグ
-  newTag : 新たなタグをセットする変数へのポインタ
+  widget : GtkWidget オブジェクトへのポインタ
+  event : GdkEvent オブジェクトへのポインタ
+  data : TagFileStatus オブジェクトへのポインタ
 
-  戻り値 : レスポンスID(GTK_RESPONSE_ACCEPT/REJECT)
+  戻り値 : 閉じない場合は TRUE
 */
-gint TagEdit( GtkBuilder* builder, const string& currentTag, string* newTag )
+gint CB_DeleteEvent( GtkWidget* widget, GdkEvent* event, gpointer data )
 {
-  GtkWidget* dialog = gtk_dialog_new_with_buttons( "タグの編集", GTK_WINDOW( gtk_builder_get_object( builder, "root" ) ),
-                                                   static_cast< GtkDialogFlags >( GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT ),
-                                                   "OK", GTK_RESPONSE_ACCEPT,
-                                                   "Cancel", GTK_RESPONSE_REJECT,
-                                                   NULL );
-
-  // GtkEntryの追加
-  GtkWidget* contentArea = gtk_dialog_get_content_area( GTK_DIALOG( dialog ) );
-  GtkWidget* entry = gtk_entry_new();
-  gtk_entry_set_text( GTK_ENTRY( entry ), currentTag.c_str() );
-  g_signal_connect( entry, "activate", G_CALLBACK( CB_DlgOk ), dialog );
-  gtk_container_add( GTK_CONTAINER( contentArea ), entry );
-  gtk_widget_show_all( dialog );
-
-  gint res = gtk_dialog_run( GTK_DIALOG( dialog ) );
+  TagFileStatus* status = static_cast< TagFileStatus* >( data );
 
-  if ( res == GTK_RESPONSE_ACCEPT )
-    *newTag = gtk_entry_get_text( GTK_ENTRY( entry ) );
+  // タグファイルの読み込み中は閉じない
+  if ( g_Loading )
+    return( TRUE );
 
-  gtk_widget_destroy( dialog );
+  if ( status->edited() )
+    if ( ! ConfirmSave( status ) )
+      return( TRUE );
+    //if ( MessageBox( "タグファイルを保存しますか？", GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, status->builder() ) == GTK_RESPONSE_YES )
+    //  CB_FileSave( 0, data );
 
-  return( res );
+  return( FALSE );
 }
 
 /*
-  CB_TagEdit : タグの編集(コールバック関数)
+  CB_RunGuiTask : 他のスレッドから依頼された処理を実行する(コールバック関数)
 
-  menuItem : GtkMenuItem オブジェクトへのポインタ
-  data : TagFileStatus オブジェクトへのポインタ
+  data : GuiTask の shared_ptr へのポインタ
+
+  戻り値 : 常に G_SOURCE_REMOVE
 */
-void CB_TagEdit( GtkMenuItem* menuItem, gpointer data )
+gboolean CB_RunGuiTask( gpointer data )
 {
-  // TagFileStatus オブジェクトへのポインタに変換
-  TagFileStatus* status = static_cast< TagFileStatus* >( data );
-  GtkBuilder* builder = status->builder();
-
-  GtkTreeModel* model;
-  GtkTreeIter iter;
-  string currentTag;
-  string newTag;
-
-  if ( ! GetSelectedRow( builder, "taglist", &currentTag, &model, &iter ) )
-    return;
+  // タグファイルの読み込み中は、読み込みが終わってから実行する
+  if ( g_Loading ) {
+    g_timeout_add( PROGRESS_INTERVAL.count(), CB_RunGuiTask, data );
+    return( G_SOURCE_REMOVE );
+  }
 
-  while ( TagEdit( builder, currentTag, &newTag ) == GTK_RESPONSE_ACCEPT ) {
-    string message;
-    if ( ! ( CheckTag( &newTag, &message ) && CheckDuplicateTag( newTag, &message, g_TagData ) ) ) {
-      MessageBox( message, GTK_MESSAGE_WARNING, GTK_BUTTONS_OK, builder );
-      continue;
-    } else {
-      ChangeTagName( currentTag, newTag, &g_FileData, &g_TagData );
+  std::unique_ptr< std::shared_ptr< GuiTask > > task( static_cast< std::shared_ptr< GuiTask >* >( data ) );
 
-      GtkTreeIter child_iter;
-      gtk_tree_model_sort_convert_iter_to_child_iter( GTK_TREE_MODEL_SORT( model ), &child_iter, &iter );
-      GtkTreeModel* child = gtk_tree_model_sort_get_model( GTK_TREE_MODEL_SORT( model ) );
-      gtk_list_store_set( GTK_LIST_STORE( child ), &child_iter, 0, newTag.c_str(), -1 );
+  ( *task )->work();
+  ( *task )->done.set_value();
 
-      ChangeCompletionList( builder, currentTag, newTag );
-      status->set();
-      break;
-    }
-  }
+  return( G_SOURCE_REMOVE );
 }
 
 /*
-  CB_TagDelete : タグの削除(コールバック関数)
+  RunOnGuiThread : work を GUI スレッドで実行し、終わるまで待つ
 
-  menuItem : GtkMenuItem オブジェクトへのポインタ
-  data : TagFileStatus オブジェクトへのポインタ
+  work : 実行する処理
+
+  戻り値 : メインループを抜けて実行できない場合は false を返す
 */
-void CB_TagDelete( GtkMenuItem* menuItem, gpointer data )
+bool RunOnGuiThread( std::function< void() > work )
 {
-  // TagFileStatus オブジェクトへのポインタに変換
-  TagFileStatus* status = static_cast< TagFileStatus* >( data );
-  GtkBuilder* builder = status->builder();
-
-  GtkTreeModel* model;
-  GtkTreeIter iter;
-  string fileName;
-  if ( ! GetFileName( builder, status->rootPath(), &fileName ) )
-    return;
-  string tagName;
-  if ( ! GetSelectedRow( builder, "taglist", &tagName, &model, &iter ) )
-    return;
-
-  g_FileData[fileName].erase( tagName );
-  g_TagData[tagName].erase( fileName );
+  auto task = std::make_shared< GuiTask >();
+  task->work = std::move( work );
+  std::future< void > done = task->done.get_future();
+  g_idle_add( CB_RunGuiTask, new std::shared_ptr< GuiTask >( task ) );
 
-  GtkTreeIter child_iter;
-  gtk_tree_model_sort_convert_iter_to_child_iter( GTK_TREE_MODEL_SORT( model ), &child_iter, &iter );
-  GtkTreeModel* child = gtk_tree_model_sort_get_model( GTK_TREE_MODEL_SORT( model ) );
-  gtk_list_store_remove( GTK_LIST_STORE( child ), &child_iter );
+  while ( done.wait_for( std::chrono::milliseconds( 100 ) ) != std::future_status::ready )
+    if ( g_Quitting ) return( false );
 
-  status->set();
+  return( true );
 }
 
 /*
-  CreateFilePopupMenu : ファイルリスト上のポップアップメニューの作成
+  ServeEdit : ソケットから依頼されたタグの追加・削除を行う(GUI スレッドで呼ぶ)
 
   status : TagFileStatus オブジェクトへのポインタ
+  add : 追加なら true、削除なら false
+  tag : 対象のタグ
+  path : 対象のファイル
+  changed : 変更があれば true を返す変数へのポインタ
+  error : 失敗した場合のメッセージを返す変数へのポインタ
+
+  戻り値 : 失敗した場合は false を返す
 */
-void CreateFilePopupMenu( TagFileStatus* status )
+bool ServeEdit( TagFileStatus* status, bool add, string tag, const fs::path& path, bool* changed, string* error )
 {
   GtkBuilder* builder = status->builder();
 
-  GObject* tagCopy = gtk_builder_get_object( builder, "tagcopy" );
-  g_signal_connect( tagCopy, "activate", G_CALLBACK( CB_TagCopy ), status );
-  GObject* tagPaste = gtk_builder_get_object( builder, "tagpaste" );
-  g_signal_connect( tagPaste, "activate", G_CALLBACK( CB_TagPaste ), status );
+  if ( add && ! CheckTag( &tag, error ) )
+    return( false );
+  // 遅延読み込み中は、ファイルのディレクトリ(索引になければ、ファイルを入れる祖先のディレクトリ)を先に読み込む
+  const LazyLibrary* lazy = status->lazy();
+  if ( lazy != nullptr ) {
+    LazyTagFile::DirIndex dir = lazy->locate( path.parent_path() );
+    if ( dir != LazyTagFile::NO_DIR && ! lazy->loaded( dir ) )
+      status->load( vector< LazyTagFile::DirIndex >( 1, dir ), &g_FileData, &g_TagData, &g_TagTree, &g_TagRules,
+                    &g_Groups, &g_Searches );
+  }
+  FileId file = g_FileData.find( path );
+  if ( file == NO_FILE ) {
+    *error = "not found : " + path.native();
+    return( false );
+  }
+
+  // 付ける場合は規則で展開したタグを全て付ける
+  const vector< string > tags = add ? g_TagRules.expand( tag ) : vector< string >( 1, tag );
+  vector< string > done; // 変更したタグ
+  {
+    EditScope edit( add ? "add tag" : "delete tag" );
+    for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+      if ( ! ( add ? AddTag( *t, file, &g_FileData, &g_TagData, &g_TagTree )
+                   : RemoveTag( *t, file, &g_FileData, &g_TagData, &g_TagTree ) ) )
+        continue;
+      if ( add )
+        g_EditLog.add( *t, file );
+      else
+        g_EditLog.remove( *t, file );
+      done.push_back( *t );
+    }
+  }
+  *changed = ! done.empty();
+  if ( ! *changed ) return( true );
+
+  status->set();
+  for ( auto t = done.begin() ; t != done.end() ; ++t )
+    ReflectTagChange( status, file, *t, add );
+  RefreshFilter( status );
+  vector< FileId > selected;
+  if ( GetSelectedFiles( builder, &selected ) && std::binary_search( selected.begin(), selected.end(), file ) )
+    InitTagList( builder, selected, g_FileData );
+
+  return( true );
 }
 
 /*
-  CreateTagPopupMenu : タグリスト上のポップアップメニューの作成
+  ServeRead : ソケットから依頼された読み込みに関係するディレクトリを読み込む(GUI スレッドで呼ぶ)
+
+  遅延読み込み中なら、query は条件を満たしうるディレクトリ、tags はファイルのディレクトリを読み込む。
+  stats は全体を読み込むことになるため、読み込まずに読み込んだファイルの分だけで答えさせる。
 
   status : TagFileStatus オブジェクトへのポインタ
+  command : 要求
+  argument : 引数
+
+  戻り値 : 読み込んでいないファイルが答えに関係しうる場合は false を返す
 */
-void CreateTagPopupMenu( TagFileStatus* status )
+bool ServeRead( TagFileStatus* status, const string& command, const string& argument )
 {
-  GtkBuilder* builder = status->builder();
+  // 答えに関係する読み込んでいないディレクトリ
+  auto missing = [&]() {
+    vector< LazyTagFile::DirIndex > dirs;
+    const LazyLibrary* lazy = status->lazy();
+    if ( lazy == nullptr ) return( dirs );
+    if ( command == "query" ) {
+      dirs = lazy->pending( Query( argument ), g_TagTree, g_TagRules );
+    } else if ( command == "tags" ) {
+      LazyTagFile::DirIndex dir = lazy->locate( fs::path( argument ).parent_path() );
+      if ( dir != LazyTagFile::NO_DIR && ! lazy->loaded( dir ) )
+        dirs.push_back( dir );
+    }
+    return( dirs );
+  };
 
-  GObject* tagEdit = gtk_builder_get_object( builder, "tagedit" );
-  g_signal_connect( tagEdit, "activate", G_CALLBACK( CB_TagEdit ), status );
-  GObject* tagDelete = gtk_builder_get_object( builder, "tagdelete" );
-  g_signal_connect( tagDelete, "activate", G_CALLBACK( CB_TagDelete ), status );
+  if ( status->lazy() == nullptr ) return( true );
+  if ( command == "stats" ) return( false );
+
+  vector< LazyTagFile::DirIndex > dirs = missing();
+  if ( ! dirs.empty() )
+    status->load( dirs, &g_FileData, &g_TagData, &g_TagTree, &g_TagRules, &g_Groups, &g_Searches );
+
+  return( missing().empty() ); // 読み込みに失敗した場合は false
 }
 
 /*
-  CB_DeleteEvent : ウィンドウを閉じるときのコールバック関数
+  StartServer : 索引をソケットで提供する
 
-  widget : GtkWidget オブジェクトへのポインタ
-  event : GdkEvent オブジェクトへのポインタ
-  data : TagFileStatus オブジェクトへのポインタ
+  編集と保存は GUI スレッドに依頼し、検索は接続毎のスレッドで行う。
 
-  戻り値 : 常に FALSE
+  server : 開始する TagServer オブジェクトへのポインタ
+  socketPath : ソケットのパス
+  status : TagFileStatus オブジェクトへのポインタ
 */
-gint CB_DeleteEvent( GtkWidget* widget, GdkEvent* event, gpointer data )
+void StartServer( std::unique_ptr< TagServer >* server, const string& socketPath, TagFileStatus* status )
 {
-  TagFileStatus* status = static_cast< TagFileStatus* >( data );
-
-  if ( status->edited() )
-    if ( ! ConfirmSave( status ) )
-      return( TRUE );
-    //if ( MessageBox( "タグファイルを保存しますか？", GTK_MESSAGE_QUESTION, GTK_BUTTONS_YES_NO, status->builder() ) == GTK_RESPONSE_YES )
-    //  CB_FileSave( 0, data );
-
-  return( FALSE );
+  auto edit = [status]( bool add, const string& tag, const fs::path& file, bool* changed, string* error ) {
+    bool done = false;
+    if ( ! RunOnGuiThread( [&]() { done = ServeEdit( status, add, tag, file, changed, error ); } ) )
+      *error = "gTag is shutting down";
+    return( done );
+  };
+  auto save = [status]( string* error ) {
+    bool done = false;
+    RunOnGuiThread( [&]() {
+        if ( status->hasFile() ) {
+          if ( status->edited() ) LoadAllDirectories( status );
+          status->save( g_FileData, g_TagTree, g_TagRules, g_Groups, g_Searches );
+          done = true;
+        } else {
+          *error = "no tag file to save";
+        }
+      } );
+    return( done );
+  };
+
+  auto prepare = [status]( const string& command, const string& argument ) {
+    bool complete = false;
+    RunOnGuiThread( [&]() { complete = ServeRead( status, command, argument ); } );
+    return( complete );
+  };
+
+  server->reset( new TagServer( g_Versions, edit, save, prepare ) );
+  try {
+    ( *server )->start( socketPath );
+  } catch( std::runtime_error& e ) {
+    cerr << socketPath << " : " << e.what() << endl;
+    server->reset();
+  }
 }
 
 int main( int argc, char* argv[] )
@@ -1296,9 +4145,14 @@ int main( int argc, char* argv[] )
   CreateMenu( &status );
   CreateFileList( &status );
   CreateTagList( builder );
+  CreateFacetList( builder );
+  CreateDirectoryList( &status );
+  CreateSuggestList( &status );
   CreateCompletion( builder );
   CreateFilePopupMenu( &status );
+  CreateColorMenu( &status );
   CreateTagPopupMenu( &status );
+  CreateSearchList( &status );
 
   GObject* tagEntry = gtk_builder_get_object( builder, "tagentry" );
   g_signal_connect( tagEntry, "activate", G_CALLBACK( CB_AddTag ), &status );
@@ -1311,7 +4165,23 @@ int main( int argc, char* argv[] )
 
   gtk_widget_show_all( GTK_WIDGET( rootWin ) );
 
+  // --serve ソケット : 索引をソケットで提供する
+  std::unique_ptr< TagServer > server;
+  for ( int i = 1 ; i + 1 < argc ; ++i )
+    if ( string( argv[i] ) == "--serve" )
+      StartServer( &server, argv[i + 1], &status );
+
   gtk_main();
 
+  // 接続中の要求を打ち切ってサーバを止める
+  g_Quitting = true;
+  server.reset();
+
+  // バックグラウンドの絞り込みと索引作成の終了を待つ
+  ++g_FilterGeneration;
+  ++g_IndexGeneration;
+  while ( g_FilterWorkers > 0 || g_IndexWorkers > 0 )
+    std::this_thread::yield();
+
   return( 0 );
 }
@@ -9,8 +9,29 @@
 #define GUI_20200128_H
 
 #include "file.hpp"
+#include "query.hpp"
+#include "facet.hpp"
+#include "completion.hpp"
+#include "suggest.hpp"
+#include "feature.hpp"
+#include "snapshot.hpp"
+#include "editlog.hpp"
+#include "tagtree.hpp"
+#include "tagrules.hpp"
+#include "group.hpp"
+#include "library.hpp"
+#include "dirtree.hpp"
+#include "lazy.hpp"
+#include "server.hpp"
 #include <gtk/gtk.h>
 #include <iostream>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <future>
+#include <regex>
+#include <sstream>
 #include <boost/algorithm/string/trim.hpp>
 
 #endif
@@ -0,0 +1,244 @@
+/**
+   hash.cpp : ファイル内容のハッシュ値
+**/
+#include "hash.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/stat.h>
+
+using std::string;
+using std::vector;
+using std::size_t;
+using std::uint64_t;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const size_t BLOCK_SIZE = 1 << 16; // 一度に読み込むバイト数(32 の倍数)
+
+  const uint64_t PRIME1 = 11400714785074694791ULL;
+  const uint64_t PRIME2 = 14029467366897019727ULL;
+  const uint64_t PRIME3 = 1609587929392839161ULL;
+  const uint64_t PRIME4 = 9650029242287828579ULL;
+  const uint64_t PRIME5 = 2870177450012600261ULL;
+
+  inline uint64_t RotateLeft( uint64_t x, int r )
+  { return( ( x << r ) | ( x >> ( 64 - r ) ) ); }
+
+  inline uint64_t Read64( const unsigned char* p )
+  {
+    uint64_t v;
+    std::memcpy( &v, p, sizeof( v ) );
+    return( v ); // リトル・エンディアンを前提とする
+  }
+
+  inline uint64_t Read32( const unsigned char* p )
+  {
+    std::uint32_t v;
+    std::memcpy( &v, p, sizeof( v ) );
+    return( v );
+  }
+
+  inline uint64_t Round( uint64_t acc, uint64_t input )
+  { return( RotateLeft( acc + input * PRIME2, 31 ) * PRIME1 ); }
+
+  inline uint64_t MergeRound( uint64_t acc, uint64_t value )
+  { return( ( acc ^ Round( 0, value ) ) * PRIME1 + PRIME4 ); }
+
+  /**
+     @brief XXH64 の逐次計算(シードは 0)
+
+     update() には、最後を除き 32 の倍数のバイト数を渡すこと。
+  **/
+  class Xxh64
+  {
+  public:
+
+    Xxh64()
+    : v1_( PRIME1 + PRIME2 ), v2_( PRIME2 ), v3_( 0 ), v4_( -PRIME1 ), total_( 0 ), rest_( nullptr ), restLen_( 0 ) {}
+
+    // data から len バイトを加える
+    void update( const unsigned char* data, size_t len )
+    {
+      total_ += len;
+      const unsigned char* end = data + len - len % 32;
+      for ( ; data < end ; data += 32 ) {
+        v1_ = Round( v1_, Read64( data ) );
+        v2_ = Round( v2_, Read64( data + 8 ) );
+        v3_ = Round( v3_, Read64( data + 16 ) );
+        v4_ = Round( v4_, Read64( data + 24 ) );
+      }
+      rest_ = data;
+      restLen_ = len % 32;
+    }
+
+    // ハッシュ値を返す(最後の update() で渡した領域が残っていること)
+    uint64_t digest() const
+    {
+      uint64_t h;
+      if ( total_ >= 32 ) {
+        h = RotateLeft( v1_, 1 ) + RotateLeft( v2_, 7 ) + RotateLeft( v3_, 12 ) + RotateLeft( v4_, 18 );
+        h = MergeRound( h, v1_ );
+        h = MergeRound( h, v2_ );
+        h = MergeRound( h, v3_ );
+        h = MergeRound( h, v4_ );
+      } else {
+        h = PRIME5;
+      }
+      h += total_;
+
+      const unsigned char* p = rest_;
+      size_t len = restLen_;
+      for ( ; len >= 8 ; p += 8, len -= 8 )
+        h = RotateLeft( h ^ Round( 0, Read64( p ) ), 27 ) * PRIME1 + PRIME4;
+      if ( len >= 4 ) {
+        h = RotateLeft( h ^ ( Read32( p ) * PRIME1 ), 23 ) * PRIME2 + PRIME3;
+        p += 4;
+        len -= 4;
+      }
+      for ( ; len > 0 ; ++p, --len )
+        h = RotateLeft( h ^ ( *p * PRIME5 ), 11 ) * PRIME1;
+
+      h ^= h >> 33;
+      h *= PRIME2;
+      h ^= h >> 29;
+      h *= PRIME3;
+      h ^= h >> 32;
+
+      return( h );
+    }
+
+  private:
+
+    uint64_t v1_, v2_, v3_, v4_; // 32 バイト毎の累積値
+    uint64_t total_;             // 加えたバイト数
+    const unsigned char* rest_;  // 32 バイトに満たない残り
+    size_t restLen_;             // 残りのバイト数
+  };
+} // namespace
+
+/*
+  GetFileStamp : file のデバイス・i ノード・サイズ・更新時刻を stamp に返す
+*/
+bool GetFileStamp( const fs::path& file, FileStamp* stamp )
+{
+  struct stat st;
+  if ( ::stat( file.c_str(), &st ) != 0 ) return( false );
+
+  stamp->device = st.st_dev;
+  stamp->inode = st.st_ino;
+  stamp->size = st.st_size;
+  stamp->mtime = st.st_mtime;
+
+  return( true );
+}
+
+/*
+  HashFile : file の内容の XXH64 を求める
+
+  読み込みに失敗した場合、まれに計算結果が NO_HASH と一致した場合は NO_HASH を返す
+*/
+ContentHash HashFile( const fs::path& file )
+{
+  FILE* fp = std::fopen( file.c_str(), "rb" );
+  if ( fp == nullptr ) return( NO_HASH );
+
+  vector< unsigned char > buffer( BLOCK_SIZE );
+  Xxh64 xxh;
+  size_t len;
+  do {
+    len = std::fread( buffer.data(), 1, buffer.size(), fp );
+    xxh.update( buffer.data(), len );
+  } while ( len == buffer.size() );
+  bool failed = std::ferror( fp );
+  std::fclose( fp );
+
+  return( failed ? NO_HASH : xxh.digest() );
+}
+
+/*
+  HashBytes : data から size バイトの XXH64 を求める
+*/
+ContentHash HashBytes( const void* data, size_t size )
+{
+  Xxh64 xxh;
+  xxh.update( static_cast< const unsigned char* >( data ), size );
+
+  return( xxh.digest() );
+}
+
+/*
+  HashFiles : files のハッシュ値を空いたスレッドで一件ずつ求める
+*/
+vector< ContentHash > HashFiles( const vector< fs::path >& files )
+{
+  vector< ContentHash > hashes( files.size(), NO_HASH );
+  std::atomic< size_t > next( 0 );
+  auto work = [&]() {
+    for ( size_t i = next++ ; i < files.size() ; i = next++ )
+      hashes[i] = HashFile( files[i] );
+  };
+
+  unsigned threads = std::max( 1u, std::thread::hardware_concurrency() );
+  threads = std::min< size_t >( threads, files.size() );
+  vector< std::thread > workers;
+  for ( unsigned i = 1 ; i < threads ; ++i )
+    workers.emplace_back( work );
+  work();
+  for ( auto w = workers.begin() ; w != workers.end() ; ++w )
+    w->join();
+
+  return( hashes );
+}
+
+/*
+  HashToString : hash を 16 桁の 16 進数にする
+*/
+string HashToString( ContentHash hash )
+{
+  char buffer[17];
+  std::snprintf( buffer, sizeof( buffer ), "%016llx", static_cast< unsigned long long >( hash ) );
+
+  return( buffer );
+}
+
+/*
+  HashCache::find : stamp のハッシュ値を返す
+*/
+ContentHash HashCache::find( const FileStamp& stamp ) const
+{
+  auto i = hashes_.find( stamp );
+
+  return( ( i != hashes_.end() ) ? i->second : NO_HASH );
+}
+
+/*
+  HashCache::hash : files のハッシュ値をキャッシュから返し、ないものだけを並列に求める
+*/
+vector< ContentHash > HashCache::hash( const vector< fs::path >& files, const vector< FileStamp >& stamps )
+{
+  vector< ContentHash > hashes( files.size() );
+  vector< fs::path > missing;  // キャッシュにないファイル
+  vector< size_t > missingPos; // missing の files での位置
+  for ( size_t i = 0 ; i < files.size() ; ++i ) {
+    hashes[i] = find( stamps[i] );
+    if ( hashes[i] == NO_HASH ) {
+      missing.push_back( files[i] );
+      missingPos.push_back( i );
+    }
+  }
+
+  vector< ContentHash > computed = HashFiles( missing );
+  for ( size_t i = 0 ; i < missing.size() ; ++i ) {
+    hashes[missingPos[i]] = computed[i];
+    if ( computed[i] != NO_HASH ) insert( stamps[missingPos[i]], computed[i] );
+  }
+
+  return( hashes );
+}
@@ -0,0 +1,125 @@
+/**
+  @file hash.hpp
+  @brief ファイル内容のハッシュ値
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef HASH_HPP_20261018
+#define HASH_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <cstdint>
+
+#include <boost/filesystem.hpp>
+
+/// @brief ファイル内容のハッシュ値(XXH64)
+using ContentHash = std::uint64_t;
+
+/// @brief ハッシュ値が求められないことを表す値
+const ContentHash NO_HASH = 0;
+
+/**
+   @brief ファイルの同一性を判定する属性
+
+   デバイス・i ノード・サイズ・更新時刻がすべて一致すれば、内容は変わっていないとみなす。
+**/
+struct FileStamp
+{
+  std::uint64_t device; // デバイス番号
+  std::uint64_t inode;  // i ノード番号
+  std::uint64_t size;   // サイズ
+  std::int64_t mtime;   // 更新時刻(秒)
+
+  bool operator<( const FileStamp& other ) const
+  { return( std::tie( device, inode, size, mtime ) < std::tie( other.device, other.inode, other.size, other.mtime ) ); }
+
+  bool operator==( const FileStamp& other ) const
+  { return( device == other.device && inode == other.inode && size == other.size && mtime == other.mtime ); }
+};
+
+/// @brief ファイルの属性を取得する
+///
+/// @param file 対象のファイル
+/// @param stamp 属性を返す変数へのポインタ
+/// @return 取得できれば true を返す
+bool GetFileStamp( const boost::filesystem::path& file, FileStamp* stamp );
+
+/// @brief ファイル内容のハッシュ値を求める
+///
+/// @param file 対象のファイル
+/// @return ハッシュ値(読み込めなければ NO_HASH)
+ContentHash HashFile( const boost::filesystem::path& file );
+
+/// @brief メモリ上のデータのハッシュ値を求める
+///
+/// @param data 対象のデータ
+/// @param size バイト数
+/// @return ハッシュ値
+ContentHash HashBytes( const void* data, std::size_t size );
+
+/// @brief 複数のファイルのハッシュ値を並列に求める
+///
+/// @param files 対象のファイル
+/// @return files と同じ順のハッシュ値
+std::vector< ContentHash > HashFiles( const std::vector< boost::filesystem::path >& files );
+
+/// @brief ハッシュ値を 16 進数の文字列にする
+///
+/// @param hash ハッシュ値
+/// @return 16 桁の文字列
+std::string HashToString( ContentHash hash );
+
+/**
+   @brief ファイルの属性をキーとするハッシュ値のキャッシュ
+
+   属性が変わらないファイルは、内容を読み直さずにハッシュ値を返す。
+   タグファイルに保存し、次に開いたときに読み戻す。
+**/
+class HashCache
+{
+public:
+
+  /// @brief 空にする
+  void clear()
+  { hashes_.clear(); }
+
+  /// @brief ハッシュ値を登録する
+  ///
+  /// @param stamp ファイルの属性
+  /// @param hash ハッシュ値
+  void insert( const FileStamp& stamp, ContentHash hash )
+  { hashes_[stamp] = hash; }
+
+  /// @brief other に登録されたハッシュ値をまとめて登録する
+  ///
+  /// @param other 登録元のキャッシュ(同じ属性はすでに登録されたハッシュ値を残す)
+  void merge( const HashCache& other )
+  { hashes_.insert( other.hashes_.begin(), other.hashes_.end() ); }
+
+  /// @brief 登録されたハッシュ値を返す
+  ///
+  /// @param stamp ファイルの属性
+  /// @return ハッシュ値(なければ NO_HASH)
+  ContentHash find( const FileStamp& stamp ) const;
+
+  /// @brief files のハッシュ値を求める
+  ///
+  /// 属性が登録済みのファイルはキャッシュから返し、それ以外は並列に読んで登録する。
+  ///
+  /// @param files 対象のファイル
+  /// @param stamps files の属性
+  /// @return files と同じ順のハッシュ値
+  std::vector< ContentHash > hash( const std::vector< boost::filesystem::path >& files,
+                                   const std::vector< FileStamp >& stamps );
+
+private:
+
+  std::map< FileStamp, ContentHash > hashes_; // 属性をキーとするハッシュ値
+};
+
+#endif
@@ -0,0 +1,718 @@
+/**
+   lazy.cpp : タグファイルのディレクトリ単位の遅延読み込み
+**/
+#include "lazy.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <set>
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+namespace fs = boost::filesystem;
+
+const LazyTagFile::DirIndex LazyTagFile::NO_DIR;
+
+namespace
+{
+  const std::streamoff INDEX_TAIL = 64; // 索引の開始位置を探す末尾のバイト数(index= の行が収まる長さ)
+} // namespace
+
+/*
+  LazyTagFile::open : 最初のレコードまでを読んで先頭の設定を取り出し、末尾の index= から索引を読む
+*/
+bool LazyTagFile::open( const string& fileName )
+{
+  if ( ! fs::exists( fs::path( fileName ) ) )
+    throw std::runtime_error( "指定したタグファイルは存在しません。" );
+
+  std::ifstream ifs( fileName, std::ios::binary );
+  if ( ifs.fail() )
+    throw std::runtime_error( "タグファイルのオープンに失敗しました。" );
+
+  fileName_ = fileName;
+  rootPath_.clear();
+  searches_.clear();
+  parents_.clear();
+  rules_ = TagRuleData();
+  dirs_.clear();
+
+  // 先頭の設定(書式は ReadTagData を参照)
+  string data;    // 1行読み込み
+  string value;   // 値
+  string search;  // 検索条件の名前
+  string child;   // 親タグを持つタグ
+  string alias;   // 別名
+  string implier; // 他のタグを含意するタグ
+  while ( std::getline( ifs, data ) ) {
+    if ( GetValueFromKey( data, FILE_KEY, &value ) || GetValueFromKey( data, DIR_KEY, &value ) )
+      break;
+    if ( GetValueFromKey( data, PATH_KEY, &value ) ) {
+      rootPath_ = value;
+      continue;
+    }
+    if ( GetValueFromKey( data, SEARCH_KEY, &search ) )
+      continue;
+    if ( GetValueFromKey( data, QUERY_KEY, &value ) ) {
+      if ( ! search.empty() ) searches_[search] = value;
+      search.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, CHILD_KEY, &child ) )
+      continue;
+    if ( GetValueFromKey( data, PARENT_KEY, &value ) ) {
+      if ( ! child.empty() ) parents_[child] = value;
+      child.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, ALIAS_KEY, &alias ) ) {
+      implier.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, IMPLY_KEY, &implier ) ) {
+      alias.clear();
+      continue;
+    }
+    if ( GetValueFromKey( data, TARGET_KEY, &value ) ) {
+      if ( ! alias.empty() )
+        rules_.aliases[alias] = value;
+      else if ( ! implier.empty() )
+        rules_.implies.emplace( implier, value );
+      alias.clear();
+      implier.clear();
+    }
+  }
+  if ( rootPath_.empty() )
+    throw std::runtime_error( "ルートパスの取得に失敗しました。" );
+
+  // 末尾の行から索引の開始位置を求める
+  ifs.clear();
+  ifs.seekg( 0, std::ios::end );
+  std::streamoff size = ifs.tellg();
+  std::streamoff tail = std::min( size, INDEX_TAIL );
+  string last( static_cast< size_t >( tail ), '\0' );
+  ifs.seekg( size - tail );
+  ifs.read( &last[0], tail );
+  while ( ! last.empty() && last.back() == '\n' )
+    last.pop_back();
+  last.erase( 0, last.rfind( '\n' ) + 1 );
+
+  std::uint64_t offset = 0;
+  if ( ! GetValueFromKey( last, INDEX_KEY, &value ) || ! ( std::istringstream( value ) >> offset ) )
+    return( false );
+
+  ifs.seekg( static_cast< std::streamoff >( offset ) );
+  readIndex( ifs );
+
+  return( true );
+}
+
+/*
+  LazyTagFile::ownFiles : 以下のファイル数から子のディレクトリ以下のファイル数を引く
+*/
+size_t LazyTagFile::ownFiles( DirIndex dir ) const
+{
+  size_t files = dirs_[dir].files;
+  for ( auto c = dirs_[dir].children.begin() ; c != dirs_[dir].children.end() ; ++c )
+    files -= dirs_[*c].files;
+
+  return( files );
+}
+
+/*
+  LazyTagFile::find : 索引の行きがけ順はパスの順と一致するため、二分探索で求める
+*/
+LazyTagFile::DirIndex LazyTagFile::find( const string& path ) const
+{
+  fs::path p( path );
+  auto d = std::lower_bound( dirs_.begin(), dirs_.end(), p,
+                             []( const Directory& a, const fs::path& b ) { return( fs::path( a.path ) < b ); } );
+
+  return( ( d != dirs_.end() && fs::path( d->path ) == p ) ? static_cast< DirIndex >( d - dirs_.begin() ) : NO_DIR );
+}
+
+/*
+  LazyTagFile::load : ディレクトリ以下の範囲から子のディレクトリ以下の範囲を除いた部分を読み、レコードにする
+*/
+LazyTagFile::Records LazyTagFile::load( DirIndex dir ) const
+{
+  std::ifstream ifs( fileName_, std::ios::binary );
+  if ( ifs.fail() )
+    throw std::runtime_error( "タグファイルのオープンに失敗しました。" );
+
+  Records records;
+  auto read = [&ifs, &records]( std::uint64_t first, std::uint64_t last ) {
+    if ( first >= last ) return;
+    string buffer( static_cast< size_t >( last - first ), '\0' );
+    ifs.seekg( static_cast< std::streamoff >( first ) );
+    if ( ! ifs.read( &buffer[0], buffer.size() ) )
+      throw std::runtime_error( "タグファイルの読み込みに失敗しました。" );
+
+    std::istringstream iss( buffer );
+    string data, value;
+    while ( std::getline( iss, data ) ) {
+      if ( GetValueFromKey( data, FILE_KEY, &value ) ) {
+        records.push_back( Record{ value, TagSet(), 0, string() } );
+      } else if ( records.empty() ) {
+        continue;
+      } else if ( GetValueFromKey( data, HASH_KEY, &value ) ) {
+        records.back().hash = value;
+      } else if ( GetValueFromKey( data, GROUP_KEY, &value ) ) {
+        std::istringstream( value ) >> records.back().group;
+      } else if ( GetValueFromKey( data, TAG_KEY, &value ) ) {
+        records.back().tags.insert( value );
+      }
+    }
+  };
+
+  const Directory& d = dirs_[dir];
+  std::uint64_t pos = d.begin;
+  for ( auto c = d.children.begin() ; c != d.children.end() ; ++c ) {
+    read( pos, dirs_[*c].begin );
+    pos = dirs_[*c].end;
+  }
+  read( pos, d.end );
+
+  return( records );
+}
+
+/*
+  LazyTagFile::candidates : 直接のファイルを持つディレクトリのうち、タグの和集合が条件を満たしうるものを返す
+*/
+vector< LazyTagFile::DirIndex > LazyTagFile::candidates( const Query& query, const TagTree& tagTree, const TagRules& tagRules ) const
+{
+  vector< DirIndex > res;
+  for ( DirIndex d = 0 ; d < dirs_.size() ; ++d )
+    if ( ownFiles( d ) > 0 && query.mayMatch( dirs_[d].tags, tagTree, tagRules ) )
+      res.push_back( d );
+
+  return( res );
+}
+
+/*
+  LazyTagFile::readIndex : dir= と range= からディレクトリの木を、dictionary= と dirs= からディレクトリ毎のタグを作る
+*/
+void LazyTagFile::readIndex( std::istream& is )
+{
+  string data;  // 1行読み込み
+  string value; // 値
+  string tag;   // 辞書のタグ
+  while ( std::getline( is, data ) ) {
+    if ( GetValueFromKey( data, DIR_KEY, &value ) ) {
+      DirIndex parent = ( dirs_.empty() ) ? NO_DIR : find( fs::path( value ).parent_path().native() );
+      if ( parent != NO_DIR )
+        dirs_[parent].children.push_back( static_cast< DirIndex >( dirs_.size() ) );
+      dirs_.push_back( Directory{ value, parent, vector< DirIndex >(), 0, 0, 0, 0, TagSet() } );
+    } else if ( GetValueFromKey( data, RANGE_KEY, &value ) ) {
+      if ( dirs_.empty() ) continue;
+      Directory& d = dirs_.back();
+      std::istringstream( value ) >> d.begin >> d.end >> d.files >> d.tagged;
+    } else if ( GetValueFromKey( data, DICTIONARY_KEY, &tag ) ) {
+      continue;
+    } else if ( GetValueFromKey( data, DIRS_KEY, &value ) ) {
+      std::istringstream iss( value );
+      DirIndex d;
+      while ( iss >> d )
+        if ( d < dirs_.size() ) dirs_[d].tags.insert( tag );
+    } else if ( GetValueFromKey( data, INDEX_KEY, &value ) ) {
+      break;
+    }
+  }
+}
+
+/*
+  LazyLibrary::open : 索引を読み、保存時のファイル数が threshold 以上なら、ディレクトリ毎に識別番号の範囲を予約する
+
+  保存時にファイルのなかったディレクトリは索引にないため、直接のファイルがなくても親のディレクトリとして読み込む。
+*/
+bool LazyLibrary::open( const string& fileName, size_t threshold, FileData* fileData )
+{
+  if ( ! file_.open( fileName ) || file_.directories().empty() ) return( false );
+  const vector< LazyTagFile::Directory >& dirs = file_.directories();
+  if ( dirs.front().files < threshold ) return( false );
+  if ( ! fs::exists( fs::path( file_.rootPath() ) ) )
+    throw std::runtime_error( "指定したパスは存在しません。" );
+
+  loaded_.assign( dirs.size(), false );
+  dirty_.assign( dirs.size(), false );
+  recent_.clear();
+  positions_.assign( dirs.size(), recent_.end() );
+  remaining_ = dirs.size();
+  members_.clear();
+  orphans_.clear();
+  orphanDirs_.clear();
+
+  vector< size_t > files( dirs.size() ); // ディレクトリ毎の直接のファイル数
+  for ( DirIndex d = 0 ; d < dirs.size() ; ++d )
+    files[d] = file_.ownFiles( d );
+  fileData->clear();
+  fileData->reset( reserve( files ) );
+
+  return( true );
+}
+
+/*
+  LazyLibrary::find : ルートパスからの相対パスにして索引を探す
+*/
+LazyLibrary::DirIndex LazyLibrary::find( const fs::path& dir ) const
+{
+  fs::path root( file_.rootPath() );
+  if ( std::mismatch( root.begin(), root.end(), dir.begin(), dir.end() ).first != root.end() )
+    return( LazyTagFile::NO_DIR );
+  fs::path relative = dir.lexically_relative( root );
+
+  return( file_.find( ( relative == "." ) ? string() : relative.native() ) );
+}
+
+/*
+  LazyLibrary::locate : dir から親をたどり、最初に索引にあったディレクトリを返す
+*/
+LazyLibrary::DirIndex LazyLibrary::locate( const fs::path& dir ) const
+{
+  for ( fs::path p = dir ; ! p.empty() ; p = p.parent_path() ) {
+    DirIndex d = find( p );
+    if ( d != LazyTagFile::NO_DIR ) return( d );
+  }
+
+  return( LazyTagFile::NO_DIR );
+}
+
+/*
+  LazyLibrary::pending : 読み込んでいないディレクトリを返す
+*/
+vector< LazyLibrary::DirIndex > LazyLibrary::pending() const
+{
+  vector< DirIndex > res;
+  for ( DirIndex d = 0 ; d < loaded_.size() ; ++d )
+    if ( ! loaded_[d] ) res.push_back( d );
+
+  return( res );
+}
+
+/*
+  LazyLibrary::pending : 条件を満たしうるディレクトリのうち、読み込んでいないものを返す
+*/
+vector< LazyLibrary::DirIndex > LazyLibrary::pending( const Query& query, const TagTree& tagTree, const TagRules& tagRules ) const
+{
+  vector< DirIndex > res = file_.candidates( query, tagTree, tagRules );
+  res.erase( std::remove_if( res.begin(), res.end(), [this]( DirIndex d ) { return( loaded_[d] ); } ), res.end() );
+
+  return( res );
+}
+
+namespace
+{
+  const size_t RESERVE_RATIO = 8; // 予約するファイル数に足す、直接のファイル数に対する割合の逆数
+  const size_t RESERVE_MIN = 16;  // 予約するファイル数に足す最小のファイル数
+
+  /*
+    Renumber : 識別番号を振り直した表でタグリスト・ファイルリスト・グループを作り直す
+
+    ファイルリストは新しい識別番号の昇順に作る。
+
+    ids : 元の識別番号をインデックスとする新しい識別番号(予約した範囲の空きなら NO_FILE)
+    paths : 新しいパスの表
+  */
+  void Renumber( const vector< FileId >& ids, std::shared_ptr< const PathTable > paths, FileData* fileData, TagData* tagData,
+                 FileGroups* groups )
+  {
+    vector< FileId > from( paths->size(), NO_FILE ); // 新しい識別番号をインデックスとする元の識別番号
+    for ( FileId id = 0 ; id < ids.size() ; ++id )
+      if ( ids[id] != NO_FILE ) from[ids[id]] = id;
+
+    FileData before( *fileData ); // 作り直す前の版(チャンクを共有する)
+    GroupData data = groups->data();
+    GroupData next( paths->size(), 0 );
+    fileData->clear();
+    fileData->reset( std::move( paths ) );
+    tagData->clear();
+    for ( FileId to = 0 ; to < from.size() ; ++to ) {
+      if ( from[to] == NO_FILE ) continue;
+      const TagSet& tags = before[from[to]];
+      if ( ! tags.empty() ) fileData->edit( to ).insert( tags.begin(), tags.end() );
+      for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+        ( *tagData )[*t].insert( to );
+      next[to] = data[from[to]];
+    }
+    groups->assign( next );
+  }
+} // namespace
+
+/*
+  LazyLibrary::reserve : ディレクトリ毎に、直接のファイル数に余裕を足した範囲を索引の順に予約する
+*/
+std::shared_ptr< PathTable > LazyLibrary::reserve( const vector< size_t >& files ) const
+{
+  const vector< LazyTagFile::Directory >& dirs = file_.directories();
+  fs::path root( file_.rootPath() );
+  root.remove_trailing_separator();
+  vector< fs::path > paths;
+  vector< FileId > capacities;
+  paths.reserve( dirs.size() );
+  capacities.reserve( dirs.size() );
+  for ( DirIndex d = 0 ; d < dirs.size() ; ++d ) {
+    paths.push_back( root / dirs[d].path );
+    capacities.push_back( static_cast< FileId >( files[d] + files[d] / RESERVE_RATIO + RESERVE_MIN ) );
+  }
+
+  auto table = std::make_shared< PathTable >();
+  table->reserve( paths, capacities );
+
+  return( table );
+}
+
+/*
+  LazyLibrary::relayout : 読み込み済みのディレクトリは今のファイル数、読み込むディレクトリは走査したファイル数、
+                          他は保存時の直接のファイル数で範囲を予約し直し、読み込み済みのファイルを同じ順に入れ直す
+*/
+void LazyLibrary::relayout( const vector< std::pair< DirIndex, Entries > >& loading, FileData* fileData, TagData* tagData,
+                            FileGroups* groups, vector< FileId >* ids )
+{
+  const PathTable& paths = fileData->paths();
+  vector< size_t > files( paths.ranges() );
+  for ( DirIndex d = 0 ; d < files.size() ; ++d )
+    files[d] = ( loaded_[d] ) ? paths.rangeFiles( d ) : file_.ownFiles( d );
+  for ( auto l = loading.begin() ; l != loading.end() ; ++l )
+    files[l->first] = ( l->second ).size();
+
+  std::shared_ptr< PathTable > table = reserve( files );
+  ids->assign( paths.size(), NO_FILE );
+  for ( DirIndex d = 0 ; d < files.size() ; ++d ) {
+    FileId first = paths.rangeFirst( d );
+    vector< fs::path > range;
+    range.reserve( paths.rangeFiles( d ) );
+    for ( FileId i = 0 ; i < paths.rangeFiles( d ) ; ++i ) {
+      range.push_back( paths.path( first + i ) );
+      ( *ids )[first + i] = table->rangeFirst( d ) + i;
+    }
+    table->fill( d, std::move( range ) );
+  }
+  for ( auto m = members_.begin() ; m != members_.end() ; ++m )
+    ( m->second ).file = ( *ids )[( m->second ).file];
+
+  Renumber( *ids, std::move( table ), fileData, tagData, groups );
+}
+
+/*
+  LazyLibrary::flatten : ファイルをパスの順に並べた表に替えて振り直し、パスが見つからなかったファイルを付け直す
+
+  付け直すファイルのグループは、同じグループのファイルを読み込み済みならそのファイルと同じ番号にする
+*/
+void LazyLibrary::flatten( FileData* fileData, TagData* tagData, FileGroups* groups, HashCache* hashCache,
+                           vector< FileId >* ids, size_t* relinked )
+{
+  const PathTable& paths = fileData->paths();
+  vector< std::pair< fs::path, FileId > > files; // パスと元の識別番号
+  files.reserve( paths.count() );
+  for ( FileId id = 0 ; id < paths.size() ; ++id )
+    if ( paths.used( id ) ) files.emplace_back( paths.path( id ), id );
+  std::sort( files.begin(), files.end() );
+
+  ids->assign( paths.size(), NO_FILE );
+  vector< fs::path > sorted;
+  sorted.reserve( files.size() );
+  for ( FileId i = 0 ; i < files.size() ; ++i ) {
+    ( *ids )[files[i].second] = i;
+    sorted.push_back( std::move( files[i].first ) );
+  }
+  auto table = std::make_shared< PathTable >();
+  table->assign( std::move( sorted ) );
+  for ( auto m = members_.begin() ; m != members_.end() ; ++m )
+    ( m->second ).file = ( *ids )[( m->second ).file];
+  Renumber( *ids, std::move( table ), fileData, tagData, groups );
+
+  if ( orphans_.empty() ) return;
+  GroupData data = groups->data();
+  unsigned number = ( data.empty() ) ? 0 : *std::max_element( data.begin(), data.end() ); // 使用中のグループの番号の最大値
+  std::map< unsigned, unsigned > numbers; // タグファイルのグループの番号をキーとする data の番号
+  for ( auto o = orphans_.begin() ; o != orphans_.end() ; ++o ) {
+    if ( o->group == 0 ) continue;
+    auto n = numbers.find( o->group );
+    if ( n == numbers.end() ) {
+      // 読み込み済みのファイルが 1 件だけならそのファイルも新しい番号にする(後からグループを外されたファイルは除く)
+      auto m = members_.find( o->group );
+      unsigned group = ( m == members_.end() ) ? 0 : data[( m->second ).file];
+      if ( group == 0 ) {
+        group = ++number;
+        if ( m != members_.end() && ! ( m->second ).joined ) data[( m->second ).file] = group;
+      }
+      n = numbers.emplace( o->group, group ).first;
+    }
+    o->group = n->second;
+  }
+  *relinked = MatchOrphans( orphans_, fileData, tagData, &data, hashCache );
+  orphans_.clear();
+  orphanDirs_.clear();
+  groups->assign( data );
+}
+
+/*
+  LazyLibrary::load : 読み込むディレクトリのファイルを予約した範囲に入れ、加えたファイルの分だけタグとグループを更新する
+
+  ディレクトリのファイルは走査して突き合わせ、ディスクにあるレコードと、レコードのないファイルを加える。
+  ディスクにないレコードは、ハッシュ値があれば付け直し用に残す。
+  範囲に収まらなければ先に範囲を予約し直し、全てのディレクトリを読み込んだらパスの順の表に並べ直す。
+*/
+bool LazyLibrary::load( const vector< DirIndex >& dirs, FileData* fileData, TagData* tagData, TagTree* tagTree,
+                        FileGroups* groups, HashCache* hashCache, vector< FileId >* added, vector< FileId >* ids,
+                        size_t* relinked, ReadProgress* progress )
+{
+  added->clear();
+  ids->clear();
+  *relinked = 0;
+
+  // 読み込むディレクトリのレコードを、ディスクのファイルと突き合わせる
+  vector< LazyTagFile::Records > held;               // loading が参照するレコード
+  vector< std::pair< DirIndex, Entries > > loading; // 読み込むディレクトリと直接のファイル
+  fs::path root( file_.rootPath() );
+  held.reserve( dirs.size() ); // 要素を移さないよう、先に確保する
+  for ( auto d = dirs.begin() ; d != dirs.end() ; ++d ) {
+    if ( loaded_[*d] ) continue;
+    held.push_back( file_.load( *d ) );
+    const LazyTagFile::Records& records = held.back();
+
+    // 索引にない子のディレクトリ(保存後に作った、または保存時に空だった)は、以下のファイルを全て加える
+    std::set< fs::path > found; // ディスクにある直接のファイル
+    boost::system::error_code ec;
+    for ( fs::directory_iterator i( root / file_.directories()[*d].path, ec ), end ; ! ec && i != end ; i.increment( ec ) ) {
+      if ( ! fs::is_directory( i->path() ) ) {
+        found.insert( i->path() );
+        if ( progress != nullptr ) ++( progress->scanned );
+        continue;
+      }
+      if ( find( i->path() ) != LazyTagFile::NO_DIR ) continue;
+      boost::system::error_code sub;
+      for ( fs::recursive_directory_iterator j( i->path(), sub ), end ; ! sub && j != end ; j.increment( sub ) ) {
+        if ( fs::is_directory( j->path() ) ) continue;
+        found.insert( j->path() );
+        if ( progress != nullptr ) ++( progress->scanned );
+      }
+    }
+
+    Entries entries;
+    for ( auto r = records.begin() ; r != records.end() ; ++r ) {
+      if ( progress != nullptr ) ++( progress->parsed );
+      fs::path file = root / r->path;
+      if ( found.erase( file ) != 0 ) {
+        entries.emplace_back( file, &( *r ) );
+        continue;
+      }
+      // パスが見つからない場合は、ハッシュ値があれば付け直し用に残す
+      Orphan orphan;
+      if ( r->hash.empty() || ! ParseHash( r->hash, &( orphan.hash ), &( orphan.stamp ) ) ) continue;
+      orphan.tags.assign( r->tags.begin(), r->tags.end() );
+      orphan.group = r->group;
+      orphans_.push_back( std::move( orphan ) );
+      orphanDirs_.push_back( *d );
+    }
+    for ( auto f = found.begin() ; f != found.end() ; ++f )
+      entries.emplace_back( *f, nullptr );
+    std::sort( entries.begin(), entries.end(),
+               []( const Entries::value_type& a, const Entries::value_type& b ) { return( a.first < b.first ); } );
+    loading.emplace_back( *d, std::move( entries ) );
+
+    loaded_[*d] = true;
+    --remaining_;
+    recent_.push_front( *d );
+    positions_[*d] = recent_.begin();
+  }
+  if ( loading.empty() ) return( false );
+  if ( progress != nullptr ) progress->joining = true;
+
+  // 範囲に収まらないディレクトリがあれば、範囲を予約し直して振り直す
+  bool renumbered = false;
+  for ( auto l = loading.begin() ; l != loading.end() && ! renumbered ; ++l )
+    if ( ( l->second ).size() > fileData->paths().rangeCapacity( l->first ) ) {
+      relayout( loading, fileData, tagData, groups, ids );
+      renumbered = true;
+    }
+  if ( renumbered || complete() ) tagTree = nullptr; // 階層は呼び出し側で作り直す
+
+  // 読み込んだファイルを範囲に入れた表に替える
+  auto next = std::make_shared< PathTable >( fileData->paths() ); // 範囲の表は共有する
+  for ( auto l = loading.begin() ; l != loading.end() ; ++l ) {
+    vector< fs::path > files;
+    files.reserve( ( l->second ).size() );
+    for ( auto e = ( l->second ).begin() ; e != ( l->second ).end() ; ++e )
+      files.push_back( e->first );
+    next->fill( l->first, std::move( files ) );
+  }
+  fileData->reset( next );
+
+  // 加えたファイルのタグとハッシュ値、グループ(同じグループのファイルを読み込み済みなら、そのグループにつなぐ)
+  for ( auto l = loading.begin() ; l != loading.end() ; ++l ) {
+    FileId first = next->rangeFirst( l->first );
+    for ( FileId i = 0 ; i < ( l->second ).size() ; ++i ) {
+      FileId id = first + i;
+      added->push_back( id );
+      const LazyTagFile::Record* r = ( l->second )[i].second;
+      if ( r == nullptr ) continue;
+      for ( auto t = r->tags.begin() ; t != r->tags.end() ; ++t )
+        AddTag( *t, id, fileData, tagData, tagTree );
+      ContentHash hash;
+      FileStamp stamp;
+      if ( ! r->hash.empty() && ParseHash( r->hash, &hash, &stamp ) ) hashCache->insert( stamp, hash );
+      if ( r->group == 0 ) continue;
+      auto m = members_.emplace( r->group, Member{ id, false } );
+      if ( m.second ) continue;
+      // 読み込み済みのファイルが後からグループを外された場合はつながない
+      Member& member = m.first->second;
+      if ( groups->grouped( member.file ) || ! member.joined ) {
+        groups->join( member.file, id );
+        member.joined = true;
+      }
+      member.file = id;
+    }
+  }
+
+  // 全てのディレクトリを読み込んだら、パスの順に並べ直す(振り直した識別番号をつなげる)
+  if ( complete() ) {
+    vector< FileId > order;
+    flatten( fileData, tagData, groups, hashCache, &order, relinked );
+    for ( auto a = added->begin() ; a != added->end() ; ++a )
+      *a = order[*a];
+    if ( renumbered ) {
+      for ( auto i = ids->begin() ; i != ids->end() ; ++i )
+        if ( *i != NO_FILE ) *i = order[*i];
+    } else {
+      *ids = std::move( order );
+    }
+    renumbered = true;
+  }
+  std::sort( added->begin(), added->end() );
+
+  return( renumbered );
+}
+
+/*
+  LazyLibrary::touch : 読み込み済みなら recent_ の先頭に移す
+*/
+void LazyLibrary::touch( DirIndex dir )
+{
+  if ( dir >= loaded_.size() || ! loaded_[dir] ) return;
+
+  recent_.splice( recent_.begin(), recent_, positions_[dir] );
+}
+
+/*
+  LazyLibrary::edit : file を入れた範囲のディレクトリに編集ありの印を付ける
+*/
+void LazyLibrary::edit( const PathTable& paths, FileId file )
+{
+  if ( paths.ranges() != dirty_.size() || file >= paths.size() ) return;
+
+  dirty_[paths.range( file )] = true;
+}
+
+/*
+  LazyLibrary::cold : recent_ の末尾から、編集がなく keep にないディレクトリを、ファイル数が上限以下になるまで選ぶ
+*/
+vector< LazyLibrary::DirIndex > LazyLibrary::cold( const PathTable& paths, const vector< bool >& keep ) const
+{
+  vector< DirIndex > res;
+  if ( paths.ranges() != dirty_.size() ) return( res ); // 並べ直した後は追い出さない
+
+  size_t files = paths.count();
+  for ( auto d = recent_.rbegin() ; d != recent_.rend() && files > capacity_ ; ++d ) {
+    if ( dirty_[*d] || ( *d < keep.size() && keep[*d] ) ) continue;
+    res.push_back( *d );
+    files -= paths.rangeFiles( *d );
+  }
+
+  return( res );
+}
+
+/*
+  LazyLibrary::evict : 追い出すディレクトリのファイルのタグとグループを除き、範囲を空にして読み込む前に戻す
+
+  ファイルの抜けたグループは、最後に読み込んだファイルを残ったファイルに替え、残ったファイルが 1 件だけなら
+  次に読み込んだファイルをつなげるようにする(追い出したファイルを読み直したときに元のグループに戻す)。
+  付け直し用に残したファイルも、ディレクトリを読み直したときに改めて残すため除く。
+*/
+void LazyLibrary::evict( const vector< DirIndex >& dirs, FileData* fileData, TagData* tagData, TagTree* tagTree,
+                         FileGroups* groups, vector< FileId >* removed )
+{
+  removed->clear();
+  const PathTable& paths = fileData->paths();
+  if ( paths.ranges() != dirty_.size() ) return;
+
+  vector< DirIndex > evicting;
+  vector< bool > evicted( loaded_.size(), false );
+  for ( auto d = dirs.begin() ; d != dirs.end() ; ++d ) {
+    if ( ! loaded_[*d] || dirty_[*d] || evicted[*d] ) continue;
+    evicting.push_back( *d );
+    evicted[*d] = true;
+    FileId first = paths.rangeFirst( *d );
+    for ( FileId i = 0 ; i < paths.rangeFiles( *d ) ; ++i )
+      removed->push_back( first + i );
+  }
+  if ( evicting.empty() ) return;
+  std::sort( removed->begin(), removed->end() );
+  auto gone = [removed]( FileId id ) { return( std::binary_search( removed->begin(), removed->end(), id ) ); };
+
+  // ファイルの抜けるグループの、最後に読み込んだファイルを残るファイルに替える(残らなければ忘れる)
+  std::set< FileId > leaders; // ファイルの抜けるグループの代表
+  for ( auto id = removed->begin() ; id != removed->end() ; ++id )
+    if ( groups->grouped( *id ) ) leaders.insert( groups->leader( *id ) );
+  vector< unsigned > affected; // ファイルの抜けるグループ(タグファイルの番号)
+  for ( auto m = members_.begin() ; m != members_.end() ; ) {
+    Member& member = m->second;
+    bool lost = gone( member.file ) || ( groups->grouped( member.file ) && leaders.count( groups->leader( member.file ) ) != 0 );
+    if ( ! lost ) {
+      ++m;
+      continue;
+    }
+    if ( gone( member.file ) ) {
+      vector< FileId > rest = groups->members( member.file );
+      rest.erase( std::remove_if( rest.begin(), rest.end(), gone ), rest.end() );
+      if ( rest.empty() ) {
+        m = members_.erase( m );
+        continue;
+      }
+      member.file = rest.back();
+    }
+    affected.push_back( m->first );
+    ++m;
+  }
+  for ( auto id = removed->begin() ; id != removed->end() ; ++id )
+    if ( groups->grouped( *id ) ) groups->remove( *id );
+  for ( auto a = affected.begin() ; a != affected.end() ; ++a ) {
+    Member& member = members_[*a];
+    member.joined = groups->grouped( member.file );
+  }
+
+  // タグ
+  for ( auto id = removed->begin() ; id != removed->end() ; ++id ) {
+    TagSet tags = ( *fileData )[*id];
+    for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+      RemoveTag( *t, *id, fileData, tagData, tagTree );
+  }
+
+  // 付け直し用に残したファイル
+  size_t kept = 0;
+  for ( size_t o = 0 ; o < orphans_.size() ; ++o ) {
+    if ( evicted[orphanDirs_[o]] ) continue;
+    if ( kept != o ) {
+      orphans_[kept] = std::move( orphans_[o] );
+      orphanDirs_[kept] = orphanDirs_[o];
+    }
+    ++kept;
+  }
+  orphans_.resize( kept );
+  orphanDirs_.resize( kept );
+
+  // 範囲を空にした表に替える
+  auto next = std::make_shared< PathTable >( paths ); // 範囲の表は共有する
+  for ( auto d = evicting.begin() ; d != evicting.end() ; ++d ) {
+    next->fill( *d, vector< fs::path >() );
+    loaded_[*d] = false;
+    ++remaining_;
+    recent_.erase( positions_[*d] );
+    positions_[*d] = recent_.end();
+  }
+  fileData->reset( next );
+}
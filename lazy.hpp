@@ -0,0 +1,313 @@
+/**
+  @file lazy.hpp
+  @brief タグファイルのディレクトリ単位の遅延読み込み
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef LAZY_HPP_20261018
+#define LAZY_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "file.hpp"
+#include "query.hpp"
+#include "group.hpp"
+
+/**
+   @brief 索引を使って必要なディレクトリだけを読むタグファイル
+
+   open() ではタグファイルの先頭(ルートパス・検索条件・親子関係・規則)と末尾の索引
+   (ディレクトリの木とタグの辞書)だけを読み、ディレクトリの走査もファイルのレコードの読み込みも行わない。
+   ディレクトリの直接のファイルのレコードは、load() で必要になったときに読む(読んだレコードは保持しない)。
+   内容は保存時のもので、保存後に加わったファイルや移動したファイルは反映されない。
+   1 つのスレッドから使うこと。
+**/
+class LazyTagFile
+{
+public:
+
+  /// @brief ディレクトリの番号(索引の行きがけ順、根が 0)
+  using DirIndex = std::uint32_t;
+
+  /// @brief 該当するディレクトリがないことを表す番号
+  static const DirIndex NO_DIR = static_cast< DirIndex >( -1 );
+
+  /// @brief ファイルのレコード
+  struct Record
+  {
+    std::string path; // ルートパスからの相対パス
+    TagSet tags;      // タグリスト
+    unsigned group;   // グループの番号(0 はグループなし)
+    std::string hash; // hash= の値(なければ空)
+  };
+
+  /// @brief ディレクトリの直接のファイルのレコード
+  using Records = std::vector< Record >;
+
+  /// @brief 索引のディレクトリ
+  struct Directory
+  {
+    std::string path;                 // ルートパスからの相対パス(根は空)
+    DirIndex parent;                  // 親のディレクトリ(根は NO_DIR)
+    std::vector< DirIndex > children; // 子のディレクトリ(パスの順)
+    std::uint64_t begin;              // 以下のレコードの開始位置
+    std::uint64_t end;                // 以下のレコードの終了位置
+    std::size_t files;                // 以下のファイル数
+    std::size_t tagged;               // 以下のタグの付いたファイル数
+    TagSet tags;                      // 直接のファイルに付いたタグ
+  };
+
+  /// @brief デフォルト・コンストラクタ(索引なし)
+  LazyTagFile() : fileName_(), rootPath_(), searches_(), parents_(), rules_(), dirs_() {}
+
+  /// @brief タグファイルの先頭と索引を読み込む
+  ///
+  /// @param fileName タグファイルの名前
+  /// @return 索引がない(古い形式の)タグファイルなら false を返す
+  /// @exception std::runtime_error タグファイルがない場合、読めない場合
+  bool open( const std::string& fileName );
+
+  /// @brief ルートパスを返す
+  const std::string& rootPath() const
+  { return( rootPath_ ); }
+
+  /// @brief 保存された検索条件を返す
+  const SearchData& searches() const
+  { return( searches_ ); }
+
+  /// @brief 保存されたタグの親子関係を返す
+  const TagParents& parents() const
+  { return( parents_ ); }
+
+  /// @brief 保存されたタグの規則を返す
+  const TagRuleData& rules() const
+  { return( rules_ ); }
+
+  /// @brief 索引のディレクトリを返す
+  const std::vector< Directory >& directories() const
+  { return( dirs_ ); }
+
+  /// @brief ディレクトリの直接のファイル数を返す
+  std::size_t ownFiles( DirIndex dir ) const;
+
+  /// @brief パスからディレクトリを探す
+  ///
+  /// @param path ルートパスからの相対パス(根は空)
+  /// @return ディレクトリの番号(なければ NO_DIR)
+  DirIndex find( const std::string& path ) const;
+
+  /// @brief ディレクトリの直接のファイルのレコードを読み込む
+  ///
+  /// @param dir ディレクトリの番号
+  /// @return レコード
+  /// @exception std::runtime_error タグファイルが読めない場合
+  Records load( DirIndex dir ) const;
+
+  /// @brief 条件を満たすファイルを持ちうるディレクトリを返す
+  ///
+  /// 直接のファイルに付いたタグの和集合が含むべき語を満たすディレクトリを、索引の順に返す。
+  ///
+  /// @param query 絞り込み条件
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  /// @return ディレクトリの番号
+  std::vector< DirIndex > candidates( const Query& query, const TagTree& tagTree, const TagRules& tagRules ) const;
+
+private:
+
+  void readIndex( std::istream& is ); // 末尾の索引を読み込む
+
+  std::string fileName_;            // タグファイルの名前
+  std::string rootPath_;            // ルートパス
+  SearchData searches_;             // 保存された検索条件
+  TagParents parents_;              // 保存されたタグの親子関係
+  TagRuleData rules_;               // 保存されたタグの規則
+  std::vector< Directory > dirs_;   // 索引のディレクトリ
+};
+
+/**
+   @brief 遅延読み込みで開いたライブラリ
+
+   LazyTagFile の索引でディレクトリの木とタグの辞書だけを読み込んでおき、ディレクトリの直接のファイルは
+   展開されたときや絞り込み条件を満たしうるときに、読み込み済みのファイルの索引(FileData・TagData・グループ)に加える。
+
+   open() で索引のディレクトリ毎に、保存時の直接のファイル数に余裕を足した識別番号の範囲を予約する(PathTable::reserve)。
+   読み込んだファイルは範囲の先頭から入れるため、読み込みは加えたファイルの分だけ索引を更新すればよく、
+   他のファイルの識別番号は変わらない。保存後にファイルが増えて範囲に収まらない場合だけ、全ての範囲を取り直して振り直す。
+   全てのディレクトリを読み込んだら、パスの順の表に並べ直して振り直す(以降は通常のライブラリと同じに扱える)。
+
+   読み込むディレクトリは走査して突き合わせ、保存後に加わったファイルはタグなしで加える。
+   索引にない子のディレクトリ(保存後に作られた、または保存時に空だったディレクトリ)のファイルは、
+   索引にある最も近い祖先のディレクトリの範囲に入れる。
+   記録されたパスが見つからないファイルは、全てのディレクトリを読み込んだときに MatchOrphans で付け直す。
+
+   読み込んだファイル数が上限を超えたら、編集のないディレクトリを最も長く使われていない順に選び(cold())、
+   evict() でそのファイルを索引から除いて読み込む前に戻す。識別番号の範囲は予約したまま残すため、
+   読み直したファイルには同じ範囲の番号が振られる。編集したファイルのディレクトリは edit() で記録し、追い出さない。
+**/
+class LazyLibrary
+{
+public:
+
+  /// @brief ディレクトリの番号
+  using DirIndex = LazyTagFile::DirIndex;
+
+  /// @brief コンストラクタ
+  ///
+  /// @param capacity 読み込んだままにしておくファイル数の上限
+  explicit LazyLibrary( std::size_t capacity )
+    : file_(), capacity_( capacity ), loaded_(), dirty_(), recent_(), positions_(), remaining_( 0 ), members_(),
+      orphans_(), orphanDirs_() {}
+
+  /// @brief タグファイルの先頭と索引を読み込み、ディレクトリ毎に識別番号の範囲を予約する
+  ///
+  /// @param fileName タグファイルの名前
+  /// @param threshold 遅延読み込みにする、保存時のファイル数の下限
+  /// @param fileData 範囲を予約した空のパスの表で作り直すファイルをキーとするタグリストへのポインタ
+  /// @return 索引がない(古い形式の)タグファイル、ファイル数が threshold より少ないタグファイルなら
+  ///         false を返す(fileData は変えない)
+  /// @exception std::runtime_error タグファイルがない場合、読めない場合、ルートパスが存在しない場合
+  bool open( const std::string& fileName, std::size_t threshold, FileData* fileData );
+
+  /// @brief タグファイルを返す
+  const LazyTagFile& file() const
+  { return( file_ ); }
+
+  /// @brief ディレクトリを読み込み済みか？
+  bool loaded( DirIndex dir ) const
+  { return( loaded_[dir] ); }
+
+  /// @brief 全てのディレクトリを読み込み済みか？
+  bool complete() const
+  { return( remaining_ == 0 ); }
+
+  /// @brief パスからディレクトリを探す
+  ///
+  /// @param dir ディレクトリのパス
+  /// @return ディレクトリの番号(ルートパス以下でない、または索引になければ LazyTagFile::NO_DIR)
+  DirIndex find( const boost::filesystem::path& dir ) const;
+
+  /// @brief ディレクトリのファイルを読み込むディレクトリを探す
+  ///
+  /// @param dir ディレクトリのパス
+  /// @return dir か、索引にある最も近い祖先のディレクトリの番号(ルートパス以下でなければ LazyTagFile::NO_DIR)
+  DirIndex locate( const boost::filesystem::path& dir ) const;
+
+  /// @brief 読み込んでいないディレクトリを返す
+  ///
+  /// @return 読み込んでいないディレクトリ(索引の順)
+  std::vector< DirIndex > pending() const;
+
+  /// @brief 条件を満たすファイルを持ちうる、読み込んでいないディレクトリを返す
+  ///
+  /// @param query 絞り込み条件
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  /// @return ディレクトリの番号(索引の順)
+  std::vector< DirIndex > pending( const Query& query, const TagTree& tagTree, const TagRules& tagRules ) const;
+
+  /// @brief ディレクトリの直接のファイルを読み込み、予約した範囲に入れて読み込み済みのファイルに加える
+  ///
+  /// 加えたファイルのタグは AddTag で tagData と tagTree に加え、同じグループのファイルを読み込み済みならそのグループにつなぐ。
+  /// 範囲に収まらないディレクトリがある場合と、全てのディレクトリを読み込んだ場合は識別番号を振り直す。
+  /// このとき fileData・tagData・groups は新しい番号で作り直すが、tagTree は作り直さない(呼び出し側で作り直すこと)。
+  /// 全てのディレクトリを読み込んだら、パスが見つからなかったファイルを付け直す。
+  ///
+  /// @param dirs 読み込むディレクトリ(読み込み済みのディレクトリは無視する)
+  /// @param fileData ファイルをキーとするタグリストへのポインタ
+  /// @param tagData タグをキーとするファイルリストへのポインタ
+  /// @param tagTree タグの階層へのポインタ
+  /// @param groups ファイルのグループへのポインタ
+  /// @param hashCache 記録されたハッシュ値を登録するキャッシュへのポインタ
+  /// @param added 加えたファイルの識別番号(振り直した場合は新しい番号、昇順)を返す変数へのポインタ
+  /// @param ids 振り直した場合に、元の識別番号をインデックスとする新しい識別番号を返す変数へのポインタ
+  ///            (元の番号が予約した範囲の空きなら NO_FILE。振り直さなければ空)
+  /// @param relinked 移動・名前変更先を見つけてタグを付け直したファイル数を返す変数へのポインタ
+  /// @param progress 進み具合を数える変数へのポインタ(nullptr なら数えない)
+  /// @return 識別番号を振り直した場合は true を返す
+  /// @exception std::runtime_error タグファイルが読めない場合
+  bool load( const std::vector< DirIndex >& dirs, FileData* fileData, TagData* tagData, TagTree* tagTree, FileGroups* groups,
+             HashCache* hashCache, std::vector< FileId >* added, std::vector< FileId >* ids, std::size_t* relinked,
+             ReadProgress* progress = nullptr );
+
+  /// @brief 読み込み済みのディレクトリを使ったことにする(追い出す順を後にする)
+  ///
+  /// @param dir ディレクトリの番号
+  void touch( DirIndex dir );
+
+  /// @brief ファイルを編集したことにする(ファイルのディレクトリは追い出さない)
+  ///
+  /// タグの付け外しとグループの変更の前に、対象の全てのファイルについて呼ぶこと。
+  ///
+  /// @param paths パスの表
+  /// @param file ファイルの識別番号
+  void edit( const PathTable& paths, FileId file );
+
+  /// @brief 読み込んだファイル数が上限を超えているか？
+  ///
+  /// @param paths パスの表
+  bool full( const PathTable& paths ) const
+  { return( paths.count() > capacity_ ); }
+
+  /// @brief 追い出すディレクトリを返す
+  ///
+  /// 読み込んだファイル数が上限以下になるまで、編集のない読み込み済みのディレクトリを最も長く使われていない順に選ぶ。
+  ///
+  /// @param paths パスの表
+  /// @param keep ディレクトリの番号をインデックスとする、追い出さないディレクトリか？
+  /// @return ディレクトリの番号(追い出す順)
+  std::vector< DirIndex > cold( const PathTable& paths, const std::vector< bool >& keep ) const;
+
+  /// @brief ディレクトリを追い出し、読み込む前に戻す
+  ///
+  /// ファイルのタグは RemoveTag で tagData と tagTree から除き、ファイルをグループから外してから、範囲を空にする。
+  ///
+  /// @param dirs ディレクトリ(読み込んでいない、または編集のあったディレクトリは無視する)
+  /// @param fileData ファイルをキーとするタグリストへのポインタ
+  /// @param tagData タグをキーとするファイルリストへのポインタ
+  /// @param tagTree タグの階層へのポインタ
+  /// @param groups ファイルのグループへのポインタ
+  /// @param removed 除いたファイルの識別番号(昇順)を返す変数へのポインタ
+  void evict( const std::vector< DirIndex >& dirs, FileData* fileData, TagData* tagData, TagTree* tagTree, FileGroups* groups,
+              std::vector< FileId >* removed );
+
+private:
+
+  // 読み込み済みのグループのファイル
+  struct Member
+  {
+    FileId file; // 最後に読み込んだファイル
+    bool joined; // 2 件目以降のファイルをつないだか？
+  };
+
+  // 読み込むディレクトリの直接のファイル(パスの順)とレコード(レコードがなければ nullptr)
+  using Entries = std::vector< std::pair< boost::filesystem::path, const LazyTagFile::Record* > >;
+
+  std::shared_ptr< PathTable > reserve( const std::vector< std::size_t >& files ) const; // 範囲を予約した表を作る
+  void relayout( const std::vector< std::pair< DirIndex, Entries > >& loading, FileData* fileData, TagData* tagData,
+                 FileGroups* groups, std::vector< FileId >* ids ); // 範囲を取り直して振り直す
+  void flatten( FileData* fileData, TagData* tagData, FileGroups* groups, HashCache* hashCache,
+                std::vector< FileId >* ids, std::size_t* relinked ); // パスの順の表に並べ直して振り直す
+
+  LazyTagFile file_;                                         // タグファイル
+  std::size_t capacity_;                                     // 読み込んだままにしておくファイル数の上限
+  std::vector< bool > loaded_;                               // ディレクトリの番号をインデックスとする、読み込み済みか？
+  std::vector< bool > dirty_;                                // ディレクトリの番号をインデックスとする、編集があったか？
+  std::list< DirIndex > recent_;                             // 読み込み済みのディレクトリ(最近使った順)
+  std::vector< std::list< DirIndex >::iterator > positions_; // ディレクトリの番号をインデックスとする recent_ 内の位置
+  std::size_t remaining_;                                    // 読み込んでいないディレクトリの数
+  std::map< unsigned, Member > members_;                     // タグファイルのグループの番号をキーとする、読み込み済みのファイル
+  std::vector< Orphan > orphans_;                            // パスが見つからなかったファイル(group はタグファイルの番号)
+  std::vector< DirIndex > orphanDirs_;                       // orphans_ のレコードがあったディレクトリ
+};
+
+#endif
@@ -0,0 +1,235 @@
+/**
+   library.cpp : 複数のライブラリ(ルートパスとタグファイルの組)
+**/
+#include "library.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  // タグファイル 1 つ分の読み込み結果
+  struct Part
+  {
+    string tagFile;           // タグファイル名
+    string rootPath;          // ルートパス
+    FileData fileData;        // ファイルをキーとするタグリスト
+    TagData tagData;          // タグをキーとするファイルリスト
+    SearchData searchData;    // 検索条件
+    TagParents tagParents;    // タグの親子関係
+    TagRuleData tagRules;     // タグの規則
+    GroupData groups;         // ファイルのグループ
+    HashCache hashCache;      // 記録されたハッシュ値
+    size_t relinked;          // 移動・名前変更先を見つけたファイル数
+    std::exception_ptr error; // 読み込み中に送出された例外
+
+    explicit Part( const string& file )
+      : tagFile( file ), rootPath(), fileData(), tagData(), searchData(), tagParents(),
+        tagRules(), groups(), hashCache(), relinked( 0 ), error()
+    {}
+  };
+
+  /*
+    ReadPart : part のタグファイルを読み込む(例外は part に記録し、呼び出し側のスレッドで送出し直す)
+
+    progress : 進み具合を数える変数へのポインタ(全てのタグファイルで共有する)
+  */
+  void ReadPart( Part* part, ReadProgress* progress )
+  {
+    try {
+      part->relinked = ReadTagData( part->tagFile, &( part->rootPath ), &( part->fileData ), &( part->tagData ),
+                                    &( part->searchData ), &( part->tagParents ), &( part->tagRules ),
+                                    &( part->groups ), &( part->hashCache ), progress );
+    } catch ( ... ) {
+      part->error = std::current_exception();
+    }
+  }
+
+  /*
+    Contains : root が file 自身か file の祖先のディレクトリか判定する
+  */
+  bool Contains( const fs::path& root, const fs::path& file )
+  {
+    return( std::mismatch( root.begin(), root.end(), file.begin(), file.end() ).first == root.end() );
+  }
+
+  /*
+    OwnEntries : own のキーのうち current に残るもの(値を変えていなければ own の値)と、merged にないキーを返す
+  */
+  template< typename Map >
+  Map OwnEntries( const Map& own, const Map& merged, const Map& current )
+  {
+    Map res;
+    for ( auto o = own.begin() ; o != own.end() ; ++o ) {
+      auto c = current.find( o->first );
+      if ( c == current.end() ) continue;
+      auto m = merged.find( o->first );
+      res.emplace( o->first, ( m != merged.end() && m->second == c->second ) ? o->second : c->second );
+    }
+    for ( auto c = current.begin() ; c != current.end() ; ++c )
+      if ( merged.count( c->first ) == 0 ) res.emplace( c->first, c->second );
+
+    return( res );
+  }
+
+  /*
+    Includes : multimap の data にキーと値の組 entry があるか？
+  */
+  bool Includes( const std::multimap< string, string, StrLess >& data, const std::pair< const string, string >& entry )
+  {
+    auto range = data.equal_range( entry.first );
+    return( std::any_of( range.first, range.second,
+                         [&entry]( const std::pair< const string, string >& e ) { return( e.second == entry.second ); } ) );
+  }
+} // namespace
+
+/*
+  ReadLibraries : タグファイル毎に並列に読み込み、ルートパスの順に識別番号をずらしてつなぐ
+
+  先頭のタグファイルは呼び出し側のスレッドで読むため、1 つだけならスレッドは立てない
+*/
+size_t ReadLibraries( const vector< string >& tagFiles, Libraries* libraries, FileData* fileData, TagData* tagData, SearchData* searchData, TagParents* tagParents, TagRuleData* tagRules, GroupData* groups, HashCache* hashCache, ReadProgress* progress )
+{
+  vector< std::unique_ptr< Part > > parts;
+  for ( auto f = tagFiles.begin() ; f != tagFiles.end() ; ++f )
+    parts.push_back( std::make_unique< Part >( *f ) );
+
+  vector< std::thread > threads;
+  for ( size_t i = 1 ; i < parts.size() ; ++i )
+    threads.emplace_back( ReadPart, parts[i].get(), progress );
+  if ( ! parts.empty() )
+    ReadPart( parts.front().get(), progress );
+  for ( auto t = threads.begin() ; t != threads.end() ; ++t )
+    t->join();
+
+  for ( auto p = parts.begin() ; p != parts.end() ; ++p ) {
+    if ( ! ( *p )->error ) continue;
+    try {
+      std::rethrow_exception( ( *p )->error );
+    } catch ( std::exception& e ) {
+      throw std::runtime_error( ( *p )->tagFile + " : " + e.what() );
+    }
+  }
+
+  // ルートパスの順に並べ、重なり(同じパスか、一方が他方の中にある)がないか確かめる
+  std::sort( parts.begin(), parts.end(), []( const std::unique_ptr< Part >& a, const std::unique_ptr< Part >& b ) {
+      return( fs::path( a->rootPath ) < fs::path( b->rootPath ) ); } );
+  for ( size_t i = 1 ; i < parts.size() ; ++i ) {
+    if ( Contains( parts[i - 1]->rootPath, parts[i]->rootPath ) )
+      throw std::runtime_error( "ライブラリのルートパスが重なっています : " + parts[i - 1]->rootPath + " , " +
+                                parts[i]->rootPath );
+  }
+
+  // パスの表をつなぐ(ルートパスの順に並べたため、つないだ表もパスの順になる)
+  auto paths = std::make_shared< PathTable >();
+  for ( auto p = parts.begin() ; p != parts.end() ; ++p )
+    paths->append( ( *p )->fileData.paths() );
+
+  tagData->clear();
+  fileData->assign( std::move( paths ) );
+  libraries->clear();
+  searchData->clear();
+  tagParents->clear();
+  *tagRules = TagRuleData();
+  groups->clear();
+  hashCache->clear();
+
+  FileId offset = 0;       // ライブラリの先頭のファイルの識別番号
+  unsigned numbers = 0;    // つないだライブラリのグループの番号の最大値
+  size_t relinked = 0;
+  for ( auto p = parts.begin() ; p != parts.end() ; ++p ) {
+    Part& part = **p;
+    FileId size = static_cast< FileId >( part.fileData.size() );
+    libraries->push_back( LibraryRoot{ part.rootPath, part.tagFile, offset, offset + size,
+                                       LibrarySettings{ part.searchData, part.tagParents, part.tagRules } } );
+
+    // タグリストとファイルリスト(識別番号が後ろのライブラリほど大きいため、ファイルリストの末尾に加わる)
+    for ( FileId id = 0 ; id < size ; ++id ) {
+      const TagSet& tags = part.fileData[id];
+      if ( ! tags.empty() )
+        fileData->edit( offset + id ).insert( tags.begin(), tags.end() );
+    }
+    for ( auto t = part.tagData.begin() ; t != part.tagData.end() ; ++t ) {
+      if ( t->second.empty() ) continue;
+      Posting& files = ( *tagData )[t->first];
+      for ( auto f = t->second.begin() ; f != t->second.end() ; ++f )
+        files.insert( offset + *f );
+    }
+
+    // 検索条件・親子関係・規則(すでにあるキーは残す)
+    searchData->insert( part.searchData.begin(), part.searchData.end() );
+    tagParents->insert( part.tagParents.begin(), part.tagParents.end() );
+    tagRules->aliases.insert( part.tagRules.aliases.begin(), part.tagRules.aliases.end() );
+    tagRules->implies.insert( part.tagRules.implies.begin(), part.tagRules.implies.end() );
+
+    // グループの番号はライブラリ毎に振られているため、前のライブラリの番号の後ろにずらす
+    unsigned most = 0;
+    for ( auto g = part.groups.begin() ; g != part.groups.end() ; ++g ) {
+      groups->push_back( ( *g == 0 ) ? 0 : numbers + *g );
+      most = std::max( most, *g );
+    }
+    numbers += most;
+
+    hashCache->merge( part.hashCache );
+    relinked += part.relinked;
+    offset += size;
+  }
+
+  return( relinked );
+}
+
+/*
+  LibraryOwnSettings : 検索条件・親子関係・別名はキー毎に、含意は組毎に、ライブラリの分を選ぶ
+*/
+LibrarySettings LibraryOwnSettings( const LibrarySettings& own, const LibrarySettings& merged, const LibrarySettings& current )
+{
+  LibrarySettings res;
+  res.searches = OwnEntries( own.searches, merged.searches, current.searches );
+  res.parents = OwnEntries( own.parents, merged.parents, current.parents );
+  res.rules.aliases = OwnEntries( own.rules.aliases, merged.rules.aliases, current.rules.aliases );
+
+  // 含意は同じタグに複数あるため、タグと含意されるタグの組で比べる
+  for ( auto o = own.rules.implies.begin() ; o != own.rules.implies.end() ; ++o )
+    if ( Includes( current.rules.implies, *o ) ) res.rules.implies.insert( *o );
+  for ( auto c = current.rules.implies.begin() ; c != current.rules.implies.end() ; ++c )
+    if ( ! Includes( merged.rules.implies, *c ) && ! Includes( res.rules.implies, *c ) ) res.rules.implies.insert( *c );
+
+  return( res );
+}
+
+/*
+  FindLibrary : 先頭のファイルが file 以下の最後のライブラリを二分探索で求める
+*/
+const LibraryRoot* FindLibrary( const Libraries& libraries, FileId file )
+{
+  auto l = std::upper_bound( libraries.begin(), libraries.end(), file,
+                             []( FileId f, const LibraryRoot& r ) { return( f < r.first ); } );
+  if ( l == libraries.begin() ) return( nullptr );
+  --l;
+
+  return( ( file < l->last ) ? &( *l ) : nullptr );
+}
+
+/*
+  LibraryPath : file のライブラリのルートパスからの相対パスを返す
+*/
+string LibraryPath( const Libraries& libraries, const FileData& fileData, FileId file )
+{
+  const LibraryRoot* library = FindLibrary( libraries, file );
+  if ( library == nullptr ) return( fileData.path( file ).native() );
+
+  fs::path res = fileData.path( file ).lexically_relative( library->rootPath );
+  if ( libraries.size() > 1 )
+    res = fs::path( library->rootPath ).filename() / res;
+
+  return( res.native() );
+}
@@ -0,0 +1,97 @@
+/**
+  @file library.hpp
+  @brief 複数のライブラリ(ルートパスとタグファイルの組)
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef LIBRARY_HPP_20261018
+#define LIBRARY_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "file.hpp"
+
+/**
+   @brief タグファイルに保存する検索条件・タグの親子関係・タグの規則
+**/
+struct LibrarySettings
+{
+  SearchData searches; // 検索条件
+  TagParents parents;  // タグの親子関係
+  TagRuleData rules;   // タグの規則
+};
+
+/**
+   @brief 1 つのセッションで開いているライブラリ
+
+   ファイルの識別番号はパスの順に振るため、ルートパスが重ならなければ
+   ライブラリ毎のファイルは連続した範囲 [first, last) になる。
+   グループもライブラリ毎に保存するため、ライブラリをまたぐグループは作らないこと。
+**/
+struct LibraryRoot
+{
+  std::string rootPath;     // ルートパス
+  std::string tagFile;      // タグファイル名(未保存なら空)
+  FileId first;             // 先頭のファイルの識別番号
+  FileId last;              // 末尾のファイルの次の識別番号
+  LibrarySettings settings; // タグファイルから読んだ設定(保存したら書き込んだ設定になる)
+};
+
+/// @brief ルートパスの順に並べたライブラリ
+using Libraries = std::vector< LibraryRoot >;
+
+/// @brief 複数のタグファイルを並列に読み込み、1 つの索引にまとめる
+///
+/// タグファイル毎にスレッドを立てて ReadTagData でファイルの走査と読み込みを行い、
+/// ルートパスの順にファイルの識別番号をずらしてつなぐ。タグは全てのライブラリで共通の辞書にまとめる。
+/// 検索条件・タグの親子関係・タグの規則が重なる場合は、ルートパスの小さいライブラリの方を残す。
+/// ライブラリ毎のタグファイルの設定は、libraries の settings に残す(保存時に LibraryOwnSettings で使う)。
+///
+/// @param tagFiles 読み込むタグファイル
+/// @param libraries 読み込んだライブラリを返す変数へのポインタ
+/// @param fileData ファイルをキーとするタグリストへのポインタ
+/// @param tagData タグをキーとするファイルリストへのポインタ
+/// @param searchData 検索条件へのポインタ
+/// @param tagParents タグの親子関係へのポインタ
+/// @param tagRules タグの規則へのポインタ
+/// @param groups ファイルのグループへのポインタ
+/// @param hashCache 記録されたハッシュ値を登録するキャッシュへのポインタ
+/// @param progress 進み具合を数える変数へのポインタ(nullptr なら数えない)
+/// @return 移動・名前変更先を見つけてタグを付け直したファイル数
+/// @exception std::runtime_error 読み込めないタグファイルがある場合、ルートパスが重なる場合
+std::size_t ReadLibraries( const std::vector< std::string >& tagFiles, Libraries* libraries, FileData* fileData, TagData* tagData, SearchData* searchData, TagParents* tagParents, TagRuleData* tagRules, GroupData* groups, HashCache* hashCache, ReadProgress* progress = nullptr );
+
+/// @brief ライブラリのタグファイルに書き込む設定を返す
+///
+/// 書き込むのは own にあったキーと、まとめた後に追加したキーだけとする(追加したキーは全てのライブラリに書き込む)。
+/// own にあったキーのうち、まとめた後に値を変えなかったものは own の値のまま(重なって隠れていた値も残す)、
+/// 値を変えたものは変更後の値にし、削除したものは除く。
+///
+/// @param own ライブラリのタグファイルの設定
+/// @param merged 全てのライブラリの設定をまとめたもの(読み込み・保存の時点)
+/// @param current 現在の設定
+/// @return ライブラリのタグファイルに書き込む設定
+LibrarySettings LibraryOwnSettings( const LibrarySettings& own, const LibrarySettings& merged, const LibrarySettings& current );
+
+/// @brief file が属するライブラリを返す
+///
+/// @param libraries ライブラリ
+/// @param file ファイルの識別番号
+/// @return ライブラリへのポインタ(どのライブラリにも属さなければ nullptr)
+const LibraryRoot* FindLibrary( const Libraries& libraries, FileId file );
+
+/// @brief 表示用にファイルのパスを返す
+///
+/// ライブラリのルートパスからの相対パスを返す。ライブラリが複数あれば、ルートパスの名前を前に付ける。
+///
+/// @param libraries ライブラリ
+/// @param fileData ファイルをキーとするタグリスト
+/// @param file ファイルの識別番号
+/// @return 表示用のパス
+std::string LibraryPath( const Libraries& libraries, const FileData& fileData, FileId file );
+
+#endif
@@ -0,0 +1,244 @@
+/**
+   pathtable.cpp : ファイルパスの表
+**/
+#include "pathtable.hpp"
+
+#include <algorithm>
+#include <unordered_map>
+
+using std::string;
+using std::vector;
+
+namespace fs = boost::filesystem;
+
+/*
+  PathTable::assign : files をパスの順に並べ、識別番号を振り直す
+*/
+void PathTable::assign( vector< fs::path > files )
+{
+  clear();
+
+  std::sort( files.begin(), files.end() );
+  files.erase( std::unique( files.begin(), files.end() ), files.end() );
+
+  std::unordered_map< string, DirId > dirIndex; // 登録時のみ使うディレクトリ名の索引
+  files_.reserve( files.size() );
+  for ( auto f = files.begin() ; f != files.end() ; ++f ) {
+    auto d = dirIndex.emplace( f->parent_path().native(), static_cast< DirId >( dirs_.size() ) );
+    if ( d.second )
+      dirs_.push_back( ( d.first )->first );
+    files_.push_back( Entry{ ( d.first )->second, static_cast< std::uint32_t >( names_.length() ) } );
+    names_ += f->filename().native();
+    names_ += '\0';
+  }
+
+  dirs_.shrink_to_fit();
+  names_.shrink_to_fit();
+}
+
+/*
+  PathTable::append : other のディレクトリ番号とファイル名の位置をずらして末尾に加える
+
+  ディレクトリ名は表毎に持つため、other と同じディレクトリ名があっても別の番号になる。
+  範囲を予約した表には使えない
+*/
+void PathTable::append( const PathTable& other )
+{
+  DirId dirs = static_cast< DirId >( dirs_.size() );
+  std::uint32_t names = static_cast< std::uint32_t >( names_.length() );
+
+  dirs_.insert( dirs_.end(), other.dirs_.begin(), other.dirs_.end() );
+  files_.reserve( files_.size() + other.files_.size() );
+  for ( auto f = other.files_.begin() ; f != other.files_.end() ; ++f )
+    files_.push_back( Entry{ f->dir + dirs, f->name + names } );
+  names_ += other.names_;
+}
+
+/*
+  PathTable::clear : 表を空にする
+*/
+void PathTable::clear()
+{
+  dirs_.clear();
+  files_.clear();
+  names_.clear();
+  ranges_.reset();
+  blocks_.clear();
+  bases_.clear();
+  reserved_ = 0;
+  count_ = 0;
+  nextDir_ = 0;
+}
+
+/*
+  PathTable::reserve : 範囲を順に並べて識別番号を割り当て、空きのための名前が空のディレクトリを 0 番にする
+*/
+void PathTable::reserve( const vector< fs::path >& dirs, const vector< FileId >& capacities )
+{
+  clear();
+
+  auto ranges = std::make_shared< vector< Range > >();
+  ranges->reserve( dirs.size() );
+  FileId first = 0;
+  for ( size_t r = 0 ; r < dirs.size() ; ++r ) {
+    ranges->push_back( Range{ dirs[r], first, capacities[r] } );
+    first += capacities[r];
+  }
+  ranges_ = std::move( ranges );
+  blocks_.assign( dirs.size(), Block{ nullptr, 0 } );
+  reserved_ = first;
+  dirs_.assign( 1, string() );
+  nextDir_ = 1;
+}
+
+/*
+  PathTable::fill : files で範囲の表を作り、ディレクトリ番号に足す値を新たに割り当てて入れ替える
+
+  入れ替える前の範囲の表は、この表のコピーが持つ間は残る
+*/
+bool PathTable::fill( size_t range, vector< fs::path > files )
+{
+  auto table = std::make_shared< PathTable >();
+  table->assign( std::move( files ) );
+  if ( table->size() > rangeCapacity( range ) ) return( false );
+
+  Block& block = blocks_[range];
+  if ( block.files ) {
+    count_ -= block.files->size();
+    bases_.erase( std::find( bases_.begin(), bases_.end(), std::make_pair( block.dirs, static_cast< std::uint32_t >( range ) ) ) );
+  }
+  if ( table->size() == 0 ) {
+    block = Block{ nullptr, 0 };
+    return( true );
+  }
+
+  block = Block{ table, nextDir_ };
+  bases_.emplace_back( nextDir_, static_cast< std::uint32_t >( range ) );
+  nextDir_ += static_cast< DirId >( table->dirs_.size() );
+  count_ += table->size();
+
+  return( true );
+}
+
+/*
+  PathTable::path : 識別番号 id のファイルのパスを組み立てる
+*/
+fs::path PathTable::path( FileId id ) const
+{
+  if ( ranges_ ) {
+    size_t r = range( id );
+    FileId offset = id - rangeFirst( r );
+    return( ( offset < rangeFiles( r ) ) ? blocks_[r].files->path( offset ) : fs::path() );
+  }
+
+  return( fs::path( dirs_[files_[id].dir] ) / name( id ) );
+}
+
+/*
+  PathTable::find : file 以上の最初のファイルが file か調べる
+
+  範囲を予約した表では、ファイルを入れる範囲の表から探す
+*/
+FileId PathTable::find( const fs::path& file ) const
+{
+  if ( ranges_ ) {
+    size_t r = locate( file.parent_path() );
+    if ( r == ranges_->size() || ! blocks_[r].files ) return( NO_FILE );
+    FileId offset = blocks_[r].files->find( file );
+    return( ( offset == NO_FILE ) ? NO_FILE : rangeFirst( r ) + offset );
+  }
+
+  FileId first = lowerBound( file );
+
+  return( ( first < files_.size() && path( first ) == file ) ? first : NO_FILE );
+}
+
+/*
+  PathTable::lowerBound : パスが file 以上の最初のファイルを二分探索で求める
+*/
+FileId PathTable::lowerBound( const fs::path& file ) const
+{
+  FileId first = 0;
+  FileId count = static_cast< FileId >( files_.size() );
+  while ( count > 0 ) {
+    FileId half = count / 2;
+    if ( path( first + half ) < file ) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+
+  return( first );
+}
+
+/*
+  PathTable::range : 先頭の識別番号が id 以下の最後の範囲を二分探索で求める
+*/
+size_t PathTable::range( FileId id ) const
+{
+  auto r = std::upper_bound( ranges_->begin(), ranges_->end(), id,
+                             []( FileId i, const Range& a ) { return( i < a.first ); } );
+
+  return( static_cast< size_t >( r - ranges_->begin() ) - 1 );
+}
+
+/*
+  PathTable::locate : 範囲のディレクトリはパスの順のため、dir から親をたどりながら二分探索で求める
+*/
+size_t PathTable::locate( const fs::path& dir ) const
+{
+  if ( ! ranges_ ) return( 0 );
+
+  const vector< Range >& ranges = *ranges_;
+  for ( fs::path p = dir ; ! p.empty() ; p = p.parent_path() ) {
+    auto r = std::lower_bound( ranges.begin(), ranges.end(), p, []( const Range& a, const fs::path& b ) { return( a.dir < b ); } );
+    if ( r != ranges.end() && r->dir == p ) return( static_cast< size_t >( r - ranges.begin() ) );
+  }
+
+  return( ranges.size() );
+}
+
+/*
+  PathTable::rangeUsed : 範囲の先頭からの位置が、範囲に入れたファイル数より小さいか調べる
+*/
+bool PathTable::rangeUsed( FileId id ) const
+{
+  size_t r = range( id );
+
+  return( id - rangeFirst( r ) < rangeFiles( r ) );
+}
+
+/*
+  PathTable::rangeName : 範囲の表からファイル名を返す
+*/
+const char* PathTable::rangeName( FileId id ) const
+{
+  size_t r = range( id );
+  FileId offset = id - rangeFirst( r );
+
+  return( ( offset < rangeFiles( r ) ) ? blocks_[r].files->name( offset ) : "" );
+}
+
+/*
+  PathTable::rangeDir : 範囲の表のディレクトリ番号に、範囲のディレクトリ番号に足す値を足す
+*/
+DirId PathTable::rangeDir( FileId id ) const
+{
+  size_t r = range( id );
+  FileId offset = id - rangeFirst( r );
+
+  return( ( offset < rangeFiles( r ) ) ? blocks_[r].dirs + blocks_[r].files->dir( offset ) : 0 );
+}
+
+/*
+  PathTable::rangeDirectory : ディレクトリ番号に足す値が dir 以下の最後の範囲の表から、ディレクトリ名を返す
+*/
+const string& PathTable::rangeDirectory( DirId dir ) const
+{
+  auto b = std::upper_bound( bases_.begin(), bases_.end(), dir,
+                             []( DirId d, const std::pair< DirId, std::uint32_t >& a ) { return( d < a.first ); } ) - 1;
+
+  return( blocks_[b->second].files->directory( dir - b->first ) );
+}
@@ -0,0 +1,218 @@
+/**
+  @file pathtable.hpp
+  @brief ファイルパスの表
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef PATHTABLE_HPP_20261018
+#define PATHTABLE_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstdint>
+
+#include <boost/filesystem.hpp>
+
+/// @brief ファイルの識別番号(パスの順に 0 から振る)
+using FileId = std::uint32_t;
+
+/// @brief ディレクトリの識別番号
+using DirId = std::uint32_t;
+
+/// @brief 該当するファイルがないことを表す識別番号
+const FileId NO_FILE = static_cast< FileId >( -1 );
+
+/**
+   @brief ファイルパスの表
+
+   ディレクトリ名は一度だけ保持し、ファイルは(ディレクトリ番号、ファイル名の位置)の組で表す。
+   ファイル名は '\0' で区切って一つの領域に詰める。
+   識別番号はパスの順に振るため、識別番号の大小はパスの大小と一致する。
+
+   遅延読み込みでは、reserve() でディレクトリ毎に識別番号の範囲を予約し、読み込んだディレクトリのファイルを
+   fill() で範囲の先頭から入れる。範囲は索引の行きがけ順に並ぶため、ディレクトリ以下のファイルは連続した範囲のままだが、
+   直接のファイルは子のディレクトリより前になり、範囲の末尾には空き(パスが空の識別番号)が残る。
+   範囲毎のファイルは別の表として共有するため、コピーして 1 つの範囲を入れ替えても、複製するのは範囲の表だけで済む。
+**/
+class PathTable
+{
+public:
+
+  /// @brief デフォルト・コンストラクタ(ファイルなし)
+  PathTable()
+    : dirs_(), files_(), names_(), ranges_(), blocks_(), bases_(), reserved_( 0 ), count_( 0 ), nextDir_( 0 ) {}
+
+  /// @brief 表を作り直す
+  ///
+  /// @param files 登録するファイル(順不同、重複は除く)
+  void assign( std::vector< boost::filesystem::path > files );
+
+  /// @brief other のファイルを末尾に加え、続きの識別番号を振る
+  ///
+  /// @param other 加える表(全てのパスがこの表のパスより大きいこと)
+  void append( const PathTable& other );
+
+  /// @brief ディレクトリ毎に識別番号の範囲を予約した、ファイルのない表にする
+  ///
+  /// @param dirs 範囲毎のディレクトリ(パスの順、先頭は他の全てのディレクトリの祖先)
+  /// @param capacities 範囲毎に予約するファイル数
+  void reserve( const std::vector< boost::filesystem::path >& dirs, const std::vector< FileId >& capacities );
+
+  /// @brief 予約した範囲のファイルを入れ替える
+  ///
+  /// 範囲のディレクトリ以下で、他の範囲のディレクトリ以下でないファイルを入れる。
+  /// 識別番号は範囲の先頭からパスの順に振る。
+  ///
+  /// @param range 範囲の番号
+  /// @param files 入れるファイル(順不同、重複は除く。空なら範囲を空にする)
+  /// @return ファイルが予約したファイル数より多ければ、何もせずに false を返す
+  bool fill( std::size_t range, std::vector< boost::filesystem::path > files );
+
+  /// @brief 表を空にする
+  void clear();
+
+  /// @brief 識別番号の数を返す(予約した範囲の空きを含む)
+  ///
+  /// @return 識別番号の数
+  std::size_t size() const
+  { return( ( ranges_ ) ? reserved_ : files_.size() ); }
+
+  /// @brief 登録されているファイル数を返す(予約した範囲の空きを含まない)
+  ///
+  /// @return ファイル数
+  std::size_t count() const
+  { return( ( ranges_ ) ? count_ : files_.size() ); }
+
+  /// @brief 識別番号にファイルがあるか？(予約した範囲の空きなら false)
+  ///
+  /// @param id 識別番号
+  /// @return ファイルがあれば true を返す
+  bool used( FileId id ) const
+  { return( ! ranges_ || rangeUsed( id ) ); }
+
+  /// @brief ファイルのパスを返す
+  ///
+  /// @param id ファイルの識別番号
+  /// @return パス(予約した範囲の空きなら空)
+  boost::filesystem::path path( FileId id ) const;
+
+  /// @brief ファイル名だけを返す
+  ///
+  /// @param id ファイルの識別番号
+  /// @return ファイル名(予約した範囲の空きなら空)
+  const char* name( FileId id ) const
+  { return( ( ranges_ ) ? rangeName( id ) : names_.c_str() + files_[id].name ); }
+
+  /// @brief ファイルのディレクトリ番号を返す
+  ///
+  /// @param id ファイルの識別番号
+  /// @return ディレクトリ番号(予約した範囲の空きなら、名前が空のディレクトリの番号)
+  DirId dir( FileId id ) const
+  { return( ( ranges_ ) ? rangeDir( id ) : files_[id].dir ); }
+
+  /// @brief ディレクトリ名を返す
+  ///
+  /// @param dir ディレクトリ番号
+  /// @return ディレクトリ名
+  const std::string& directory( DirId dir ) const
+  { return( ( dir < dirs_.size() ) ? dirs_[dir] : rangeDirectory( dir ) ); }
+
+  /// @brief パスからファイルの識別番号を求める
+  ///
+  /// @param file 対象のパス
+  /// @return 識別番号(なければ NO_FILE)
+  FileId find( const boost::filesystem::path& file ) const;
+
+  /// @brief パスが file 以上の最初のファイルの識別番号を求める
+  ///
+  /// 範囲を予約した表では使えない(識別番号の順がパスの順と一致しないため)。
+  ///
+  /// @param file 対象のパス
+  /// @return 識別番号(全てのパスが file より小さければ size())
+  FileId lowerBound( const boost::filesystem::path& file ) const;
+
+  /// @brief 予約した範囲の数を返す
+  ///
+  /// @return 範囲の数(予約していなければ 0)
+  std::size_t ranges() const
+  { return( ( ranges_ ) ? ranges_->size() : 0 ); }
+
+  /// @brief 識別番号を含む範囲を返す
+  ///
+  /// @param id 識別番号
+  /// @return 範囲の番号
+  std::size_t range( FileId id ) const;
+
+  /// @brief ディレクトリのファイルを入れる範囲を返す
+  ///
+  /// @param dir ディレクトリのパス
+  /// @return dir か、dir の最も近い祖先のディレクトリの範囲の番号(どの範囲のディレクトリ以下でもなければ ranges())
+  std::size_t locate( const boost::filesystem::path& dir ) const;
+
+  /// @brief 範囲の先頭の識別番号を返す
+  ///
+  /// @param range 範囲の番号
+  /// @return 識別番号
+  FileId rangeFirst( std::size_t range ) const
+  { return( ( *ranges_ )[range].first ); }
+
+  /// @brief 範囲に予約したファイル数を返す
+  ///
+  /// @param range 範囲の番号
+  /// @return ファイル数
+  FileId rangeCapacity( std::size_t range ) const
+  { return( ( *ranges_ )[range].capacity ); }
+
+  /// @brief 範囲に入れたファイル数を返す
+  ///
+  /// @param range 範囲の番号
+  /// @return ファイル数
+  std::size_t rangeFiles( std::size_t range ) const
+  { return( ( blocks_[range].files ) ? blocks_[range].files->size() : 0 ); }
+
+private:
+
+  /// @brief ファイルの情報
+  struct Entry
+  {
+    DirId dir;          // ディレクトリ番号
+    std::uint32_t name; // names_ 内のファイル名の開始位置
+  };
+
+  /// @brief 予約した範囲(作った後は変わらないため、コピーと共有する)
+  struct Range
+  {
+    boost::filesystem::path dir; // ディレクトリ
+    FileId first;                // 先頭の識別番号
+    FileId capacity;             // 予約したファイル数
+  };
+
+  /// @brief 範囲に入れたファイル
+  struct Block
+  {
+    std::shared_ptr< const PathTable > files; // ファイル(nullptr なら空)
+    DirId dirs;                               // files のディレクトリ番号に足す値
+  };
+
+  bool rangeUsed( FileId id ) const;                    // 範囲を予約した表の識別番号にファイルがあるか？
+  const char* rangeName( FileId id ) const;             // 範囲を予約した表のファイル名
+  DirId rangeDir( FileId id ) const;                    // 範囲を予約した表のディレクトリ番号
+  const std::string& rangeDirectory( DirId dir ) const; // 範囲を予約した表のディレクトリ名
+
+  std::vector< std::string > dirs_; // ディレクトリ名(範囲を予約した表では、空きの名前が空のディレクトリだけ)
+  std::vector< Entry > files_;      // 識別番号をインデックスとするファイルの情報
+  std::string names_;               // ファイル名を '\0' で区切って並べた領域
+
+  std::shared_ptr< const std::vector< Range > > ranges_; // 予約した範囲(予約していなければ nullptr)
+  std::vector< Block > blocks_;                          // 範囲の番号をインデックスとする、範囲に入れたファイル
+  std::vector< std::pair< DirId, std::uint32_t > > bases_; // ファイルを入れた範囲の、ディレクトリ番号に足す値と範囲の番号(値の順)
+  std::size_t reserved_;                                 // 予約した識別番号の数
+  std::size_t count_;                                    // 範囲に入れたファイル数
+  DirId nextDir_;                                        // 次に入れる範囲のディレクトリ番号に足す値
+};
+
+#endif
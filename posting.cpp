@@ -0,0 +1,124 @@
+/**
+   posting.cpp : タグの付いたファイルの識別番号の集合(コピー・オン・ライト)
+**/
+#include "posting.hpp"
+
+#include <algorithm>
+
+using std::size_t;
+
+const Posting::size_type Posting::CHUNK;
+
+namespace
+{
+  /*
+    Unshare : p が他の複製と共有されていれば複製して置き換える
+
+    他の参照がなくなったことを見てから書き込むため、参照を手放したスレッドの読み込みより後になるよう同期する
+  */
+  template< typename T > T& Unshare( std::shared_ptr< T >* p )
+  {
+    if ( p->use_count() > 1 )
+      *p = std::make_shared< T >( **p );
+    else
+      std::atomic_thread_fence( std::memory_order_acquire );
+
+    return( **p );
+  }
+} // namespace
+
+/*
+  Posting::chunkOf : 末尾が id 以上の最初のチャンクの位置を返す(なければ最後のチャンク)
+*/
+Posting::size_type Posting::chunkOf( FileId id ) const
+{
+  auto c = std::lower_bound( chunks_->begin(), chunks_->end(), id,
+                             []( const std::shared_ptr< Chunk >& chunk, FileId v ) { return( chunk->back() < v ); } );
+  if ( c == chunks_->end() ) --c;
+
+  return( c - chunks_->begin() );
+}
+
+/*
+  Posting::writable : チャンクの一覧が他の複製と共有されていれば複製して置き換える(一覧がなければ作る)
+*/
+Posting::Chunks& Posting::writable()
+{
+  if ( ! chunks_ ) {
+    chunks_ = std::make_shared< Chunks >();
+    return( *chunks_ );
+  }
+
+  return( Unshare( &chunks_ ) );
+}
+
+/*
+  Posting::writable : chunk が他の複製と共有されていれば複製して置き換える
+*/
+Posting::Chunk& Posting::writable( size_type chunk )
+{
+  return( Unshare( &( writable()[chunk] ) ) );
+}
+
+/*
+  Posting::find : チャンクを二分探索し、チャンク内を二分探索する
+*/
+Posting::const_iterator Posting::find( FileId id ) const
+{
+  if ( empty() ) return( end() );
+
+  size_type c = chunkOf( id );
+  const Chunk& chunk = *( *chunks_ )[c];
+  auto i = std::lower_bound( chunk.begin(), chunk.end(), id );
+  if ( i == chunk.end() || *i != id ) return( end() );
+
+  return( const_iterator( this, c, i - chunk.begin() ) );
+}
+
+/*
+  Posting::insert : id をチャンクに挿入し、大きくなりすぎたチャンクは二つに分ける
+*/
+bool Posting::insert( FileId id )
+{
+  if ( empty() || ( chunks_->back()->back() < id && chunks_->back()->size() >= CHUNK ) ) {
+    writable().push_back( std::make_shared< Chunk >( 1, id ) );
+    ++size_;
+    return( true );
+  }
+
+  size_type c = chunkOf( id );
+  const Chunk& current = *( *chunks_ )[c];
+  auto i = std::lower_bound( current.begin(), current.end(), id );
+  if ( i != current.end() && *i == id ) return( false );
+
+  size_type pos = i - current.begin();
+  Chunk& chunk = writable( c );
+  chunk.insert( chunk.begin() + pos, id );
+  ++size_;
+
+  if ( chunk.size() >= 2 * CHUNK ) {
+    auto upper = std::make_shared< Chunk >( chunk.begin() + CHUNK, chunk.end() );
+    chunk.resize( CHUNK );
+    chunks_->insert( chunks_->begin() + c + 1, std::move( upper ) );
+  }
+
+  return( true );
+}
+
+/*
+  Posting::erase : id をチャンクから取り除き、空になったチャンクは捨てる
+*/
+Posting::size_type Posting::erase( FileId id )
+{
+  const_iterator i = find( id );
+  if ( i == end() ) return( 0 );
+
+  Chunk& chunk = writable( i.chunk_ );
+  chunk.erase( chunk.begin() + i.pos_ );
+  if ( chunk.empty() )
+    chunks_->erase( chunks_->begin() + i.chunk_ );
+  if ( --size_ == 0 )
+    chunks_.reset();
+
+  return( 1 );
+}
@@ -0,0 +1,188 @@
+/**
+  @file posting.hpp
+  @brief タグの付いたファイルの識別番号の集合(コピー・オン・ライト)
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef POSTING_HPP_20261018
+#define POSTING_HPP_20261018
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <iterator>
+#include <cstddef>
+
+#include "pathtable.hpp"
+
+/**
+   @brief 昇順に並んだ識別番号の集合
+
+   識別番号は CHUNK 件程度ずつの整列済みの配列(チャンク)に分けて持ち、チャンクとその一覧は複製間で共有する。
+   複製はポインタ 1 つのコピーで済み、変更するときに共有中の一覧と変更するチャンクだけを複製する。
+   そのため、公開済みの版を読むスレッドがあっても、その内容が変わることはない。
+
+   std::set< FileId > のうち、索引で使う操作だけを持つ。
+**/
+class Posting
+{
+public:
+
+  using value_type = FileId;
+  using size_type = std::size_t;
+
+  /// @brief 1 チャンクの識別番号の数(途中への挿入では 2 倍まで伸ばしてから分割する)
+  static const size_type CHUNK = 256;
+
+  /// @brief 昇順に辿る反復子
+  class const_iterator
+  {
+  public:
+
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = FileId;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const FileId*;
+    using reference = const FileId&;
+
+    const_iterator() : posting_( nullptr ), chunk_( 0 ), pos_( 0 ) {}
+
+    reference operator*() const
+    { return( ( *( *posting_->chunks_ )[chunk_] )[pos_] ); }
+
+    pointer operator->() const
+    { return( &**this ); }
+
+    const_iterator& operator++()
+    {
+      if ( ++pos_ == ( *posting_->chunks_ )[chunk_]->size() ) {
+        ++chunk_;
+        pos_ = 0;
+      }
+      return( *this );
+    }
+
+    const_iterator operator++( int )
+    {
+      const_iterator prev = *this;
+      ++*this;
+      return( prev );
+    }
+
+    bool operator==( const const_iterator& other ) const
+    { return( chunk_ == other.chunk_ && pos_ == other.pos_ ); }
+
+    bool operator!=( const const_iterator& other ) const
+    { return( ! ( *this == other ) ); }
+
+  private:
+
+    friend class Posting;
+
+    const_iterator( const Posting* posting, size_type chunk, size_type pos )
+      : posting_( posting ), chunk_( chunk ), pos_( pos ) {}
+
+    const Posting* posting_; // 対象の集合
+    size_type chunk_;        // チャンクの位置
+    size_type pos_;          // チャンク内の位置
+  };
+
+  using iterator = const_iterator;
+
+  /// @brief デフォルト・コンストラクタ
+  Posting() : chunks_(), size_( 0 ) {}
+
+  /// @brief 要素数を返す
+  ///
+  /// @return 要素数
+  size_type size() const
+  { return( size_ ); }
+
+  /// @brief 空か？
+  ///
+  /// @return 空なら true を返す
+  bool empty() const
+  { return( size_ == 0 ); }
+
+  /// @brief 先頭の位置を返す
+  ///
+  /// @return 先頭の位置
+  const_iterator begin() const
+  { return( const_iterator( this, 0, 0 ) ); }
+
+  /// @brief 末尾の次の位置を返す
+  ///
+  /// @return 末尾の次の位置
+  const_iterator end() const
+  { return( const_iterator( this, ( chunks_ ) ? chunks_->size() : 0, 0 ) ); }
+
+  /// @brief 識別番号を探す
+  ///
+  /// @param id 識別番号
+  /// @return 見つかった位置(なければ end())
+  const_iterator find( FileId id ) const;
+
+  /// @brief 識別番号の数を返す
+  ///
+  /// @param id 識別番号
+  /// @return あれば 1、なければ 0
+  size_type count( FileId id ) const
+  { return( ( find( id ) != end() ) ? 1 : 0 ); }
+
+  /// @brief 識別番号を加える
+  ///
+  /// 末尾より大きい識別番号は、最後のチャンクへの追加(満杯なら新しいチャンク)になる。
+  ///
+  /// @param id 識別番号
+  /// @return 加えた場合は true、すでにあった場合は false を返す
+  bool insert( FileId id );
+
+  /// @brief 識別番号を取り除く
+  ///
+  /// @param id 識別番号
+  /// @return 取り除いた数
+  size_type erase( FileId id );
+
+  /// @brief 昇順に並んだ識別番号の列で置き換える
+  ///
+  /// 集合演算の結果をまとめて設定するときに使う。チャンクは全て作り直す。
+  ///
+  /// @param first, last 昇順に並んだ重複のない識別番号の範囲
+  template< typename InputIterator > void assign( InputIterator first, InputIterator last )
+  {
+    auto chunks = std::make_shared< Chunks >();
+    size_type n = 0;
+    for ( ; first != last ; ++first, ++n ) {
+      if ( chunks->empty() || chunks->back()->size() >= CHUNK ) {
+        chunks->push_back( std::make_shared< Chunk >() );
+        chunks->back()->reserve( CHUNK );
+      }
+      chunks->back()->push_back( *first );
+    }
+    chunks_ = ( n == 0 ) ? nullptr : std::move( chunks );
+    size_ = n;
+  }
+
+  /// @brief 空にする
+  void clear()
+  {
+    chunks_.reset();
+    size_ = 0;
+  }
+
+private:
+
+  using Chunk = std::vector< FileId >;
+  using Chunks = std::vector< std::shared_ptr< Chunk > >;
+
+  size_type chunkOf( FileId id ) const; // id が入るべきチャンクの位置を返す
+  Chunks& writable();                   // 変更できるチャンクの一覧を返す(共有中なら複製する)
+  Chunk& writable( size_type chunk );   // 変更できるチャンクを返す(共有中なら複製する)
+
+  std::shared_ptr< Chunks > chunks_; // チャンクの一覧(空の集合では null、空のチャンクは持たない)
+  size_type size_;                   // 要素数
+};
+
+#endif
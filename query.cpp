@@ -0,0 +1,403 @@
+/**
+   query.cpp : タグによるファイルの絞り込み
+**/
+#include "query.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+using std::string;
+using std::vector;
+using std::set;
+
+namespace
+{
+  const FileList::size_type CHECK_INTERVAL = 4096; // 中断判定を行う間隔
+
+  /*
+    MatchPostings : term に前方一致するタグのファイルリストを集める
+
+    子を持つタグは、子孫のタグのファイルも含めた集約したファイルリストを使う。
+    規則があれば、別名に一致した正式なタグも加え、一致したタグと子孫のタグについて、
+    そのタグを含意するタグとそれらの別名のファイルリストも集める(閉包の表を引くだけで済む)
+  */
+  vector< const Posting* > MatchPostings( const string& term, const TagData& tagData, const TagTree& tagTree, const TagRules& tagRules )
+  {
+    auto prefix = [&term]( const string& tag ) { return( Casefold( tag ).compare( 0, term.length(), term ) == 0 ); };
+
+    vector< const Posting* > res;
+    if ( tagRules.empty() ) {
+      tagTree.forEachRollup( [&]( const string& tag, const Posting& files ) {
+          if ( prefix( tag ) ) res.push_back( &files );
+        } );
+      for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+        if ( prefix( t->first ) && tagTree.files( t->first ) == nullptr )
+          res.push_back( &( t->second ) );
+      return( res );
+    }
+
+    TagRules::Names matched; // 語に一致した正式なタグ
+    for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+      if ( prefix( t->first ) ) matched.insert( tagRules.canonical( t->first ) );
+    tagTree.forEachRollup( [&]( const string& tag, const Posting& files ) {
+        if ( prefix( tag ) ) matched.insert( tagRules.canonical( tag ) );
+      } );
+    tagRules.forEachAlias( [&]( const string& alias, const string& tag ) {
+        if ( prefix( alias ) ) matched.insert( tag );
+      } );
+
+    TagRules::Names sources; // ファイルリストを集めるタグ
+    auto add = [&]( const string& tag ) {
+      sources.insert( tag );
+      const TagRules::Names& aliases = tagRules.aliases( tag );
+      sources.insert( aliases.begin(), aliases.end() );
+    };
+    for ( auto m = matched.begin() ; m != matched.end() ; ++m ) {
+      vector< string > subtree = tagTree.subtree( *m );
+      for ( auto d = subtree.begin() ; d != subtree.end() ; ++d ) {
+        add( *d );
+        const TagRules::Names& implying = tagRules.implying( *d );
+        for ( auto i = implying.begin() ; i != implying.end() ; ++i )
+          add( *i );
+      }
+    }
+    for ( auto s = sources.begin() ; s != sources.end() ; ++s ) {
+      auto t = tagData.find( *s );
+      if ( t != tagData.end() ) res.push_back( &( t->second ) );
+    }
+
+    return( res );
+  }
+
+  /*
+    FoldEffective : tag が付いたファイルに付いているとみなすタグを casefold して folded に加える
+
+    正式なタグと含意されるタグ、それらの祖先のタグと、その別名を加える
+  */
+  void FoldEffective( const string& tag, const TagTree& tagTree, const TagRules& tagRules, vector< string >* folded )
+  {
+    vector< string > expanded = tagRules.expand( tag );
+    for ( auto e = expanded.begin() ; e != expanded.end() ; ++e ) {
+      vector< string > lineage = tagTree.lineage( *e );
+      for ( auto a = lineage.begin() ; a != lineage.end() ; ++a ) {
+        folded->push_back( Casefold( *a ) );
+        const TagRules::Names& aliases = tagRules.aliases( *a );
+        for ( auto n = aliases.begin() ; n != aliases.end() ; ++n )
+          folded->push_back( Casefold( *n ) );
+      }
+    }
+  }
+
+  /*
+    Contains : postings のいずれかに file が含まれているか
+  */
+  bool Contains( const vector< const Posting* >& postings, FileId file )
+  {
+    for ( auto p = postings.begin() ; p != postings.end() ; ++p )
+      if ( ( *p )->find( file ) != ( *p )->end() )
+        return( true );
+
+    return( false );
+  }
+
+  /*
+    Filter : candidates のうち、各語の条件を満たすものを result に登録する
+
+    include の各要素のいずれかに含まれ、exclude のいずれにも含まれないファイルを残す
+  */
+  bool Filter( const FileList& candidates,
+               const vector< vector< const Posting* > >& include,
+               const vector< vector< const Posting* > >& exclude,
+               FileList* result, const CancelToken& cancel )
+  {
+    result->clear();
+    for ( FileList::size_type i = 0 ; i < candidates.size() ; ++i ) {
+      if ( i % CHECK_INTERVAL == 0 && cancel.canceled() )
+        return( false );
+      FileId f = candidates[i];
+      bool match = true;
+      for ( auto t = include.begin() ; match && t != include.end() ; ++t )
+        match = Contains( *t, f );
+      for ( auto t = exclude.begin() ; match && t != exclude.end() ; ++t )
+        match = ! Contains( *t, f );
+      if ( match )
+        result->push_back( f );
+    }
+
+    return( true );
+  }
+} // namespace
+
+/*
+  Query コンストラクタ : 検索文字列を語に分解する
+*/
+Query::Query( const string& text )
+{
+  std::istringstream iss( text );
+  string term;
+  while ( iss >> term ) {
+    if ( term[0] == '-' ) {
+      if ( term.length() > 1 )
+        exclude_.push_back( Casefold( term.substr( 1 ) ) );
+    } else {
+      include_.push_back( Casefold( term ) );
+    }
+  }
+}
+
+/*
+  Query::refines : prev の結果を絞り込んだ条件か判定する
+
+  prev の含むべき語が全て、より長い(または同じ)語に置き換わっており、
+  prev の除外する語が全て残っていれば、結果は prev の結果の部分集合になる
+*/
+bool Query::refines( const Query& prev ) const
+{
+  for ( auto p = prev.include_.begin() ; p != prev.include_.end() ; ++p ) {
+    auto i = std::find_if( include_.begin(), include_.end(),
+                           [&p]( const string& s ) { return( s.compare( 0, p->length(), *p ) == 0 ); } );
+    if ( i == include_.end() ) return( false );
+  }
+  for ( auto p = prev.exclude_.begin() ; p != prev.exclude_.end() ; ++p )
+    if ( std::find( exclude_.begin(), exclude_.end(), *p ) == exclude_.end() )
+      return( false );
+
+  return( true );
+}
+
+/*
+  Query::evaluate : 全ファイルを対象に条件を評価する
+
+  含むべき語のうち該当ファイル数が最も少ないものを候補とし、残りの語で絞り込む
+*/
+bool Query::evaluate( const FileData& fileData, const TagData& tagData, const TagTree& tagTree, const TagRules& tagRules,
+                      FileList* result, const CancelToken& cancel ) const
+{
+  vector< vector< const Posting* > > include;
+  vector< vector< const Posting* > > exclude;
+  for ( auto t = include_.begin() ; t != include_.end() ; ++t )
+    include.push_back( MatchPostings( *t, tagData, tagTree, tagRules ) );
+  for ( auto t = exclude_.begin() ; t != exclude_.end() ; ++t )
+    exclude.push_back( MatchPostings( *t, tagData, tagTree, tagRules ) );
+
+  FileList candidates;
+  if ( include.empty() ) {
+    // 予約した範囲の空きの識別番号は除く
+    const PathTable& paths = fileData.paths();
+    candidates.reserve( paths.count() );
+    for ( FileId id = 0 ; id < fileData.size() ; ++id )
+      if ( paths.used( id ) ) candidates.push_back( id );
+  } else {
+    // 該当ファイル数が最小の語を選ぶ
+    auto count = []( const vector< const Posting* >& v ) {
+      Posting::size_type n = 0;
+      for ( auto p = v.begin() ; p != v.end() ; ++p ) n += ( *p )->size();
+      return( n );
+    };
+    auto smallest = std::min_element( include.begin(), include.end(),
+                                      [&count]( const vector< const Posting* >& a, const vector< const Posting* >& b )
+                                      { return( count( a ) < count( b ) ); } );
+    // 候補の和集合を作成する
+    for ( auto p = smallest->begin() ; p != smallest->end() ; ++p ) {
+      if ( cancel.canceled() ) return( false );
+      FileList merged;
+      merged.reserve( candidates.size() + ( *p )->size() );
+      std::set_union( candidates.begin(), candidates.end(), ( *p )->begin(), ( *p )->end(),
+                      std::back_inserter( merged ) );
+      candidates.swap( merged );
+    }
+    include.erase( smallest );
+  }
+
+  return( Filter( candidates, include, exclude, result, cancel ) );
+}
+
+/*
+  Query::refine : 以前の結果 current を対象に条件を評価する
+*/
+bool Query::refine( const FileList& current, const TagData& tagData, const TagTree& tagTree, const TagRules& tagRules,
+                    FileList* result, const CancelToken& cancel ) const
+{
+  vector< vector< const Posting* > > include;
+  vector< vector< const Posting* > > exclude;
+  for ( auto t = include_.begin() ; t != include_.end() ; ++t )
+    include.push_back( MatchPostings( *t, tagData, tagTree, tagRules ) );
+  for ( auto t = exclude_.begin() ; t != exclude_.end() ; ++t )
+    exclude.push_back( MatchPostings( *t, tagData, tagTree, tagRules ) );
+
+  return( Filter( current, include, exclude, result, cancel ) );
+}
+
+/*
+  Query::concerns : タグ tag が付いているとみなすタグが条件のいずれかの語に前方一致するか判定する
+*/
+bool Query::concerns( const string& tag, const TagTree& tagTree, const TagRules& tagRules ) const
+{
+  vector< string > folded;
+  FoldEffective( tag, tagTree, tagRules, &folded );
+  for ( auto a = folded.begin() ; a != folded.end() ; ++a ) {
+    auto prefix = [&a]( const string& term ) { return( a->compare( 0, term.length(), term ) == 0 ); };
+    if ( std::any_of( include_.begin(), include_.end(), prefix ) ||
+         std::any_of( exclude_.begin(), exclude_.end(), prefix ) )
+      return( true );
+  }
+
+  return( false );
+}
+
+/*
+  Query::match : タグリスト tags が条件を満たすか判定する
+
+  各タグの祖先のタグ、含意されるタグ(とその祖先)も付いているものとみなし、別名も語と比較する
+*/
+bool Query::match( const TagSet& tags, const TagTree& tagTree, const TagRules& tagRules ) const
+{
+  vector< string > folded;
+  folded.reserve( tags.size() );
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    FoldEffective( *t, tagTree, tagRules, &folded );
+
+  auto found = [&folded]( const string& term ) {
+    return( std::any_of( folded.begin(), folded.end(),
+                         [&term]( const string& s ) { return( s.compare( 0, term.length(), term ) == 0 ); } ) );
+  };
+
+  return( std::all_of( include_.begin(), include_.end(), found ) &&
+          std::none_of( exclude_.begin(), exclude_.end(), found ) );
+}
+
+/*
+  Query::mayMatch : タグリスト tags が含むべき語を全て満たすか判定する
+
+  タグを増やして満たさなくなる語はないため、tags の一部を持つファイルが条件を満たすなら tags も満たす
+*/
+bool Query::mayMatch( const TagSet& tags, const TagTree& tagTree, const TagRules& tagRules ) const
+{
+  if ( include_.empty() ) return( true );
+
+  vector< string > folded;
+  folded.reserve( tags.size() );
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t )
+    FoldEffective( *t, tagTree, tagRules, &folded );
+
+  return( std::all_of( include_.begin(), include_.end(), [&folded]( const string& term ) {
+        return( std::any_of( folded.begin(), folded.end(),
+                             [&term]( const string& s ) { return( s.compare( 0, term.length(), term ) == 0 ); } ) ); } ) );
+}
+
+/*
+  UpdateResult : 結果リスト files のファイル file の有無を切り替える
+
+  戻り値 : 変更した位置(変更がなければ -1)
+*/
+long UpdateResult( std::shared_ptr< FileList >* files, FileId file, bool contain )
+{
+  auto pos = std::lower_bound( ( *files )->begin(), ( *files )->end(), file );
+  bool found = ( pos != ( *files )->end() && *pos == file );
+  if ( found == contain )
+    return( -1 );
+
+  long index = pos - ( *files )->begin();
+  if ( files->use_count() > 1 )
+    *files = std::make_shared< FileList >( **files );
+  if ( contain )
+    ( *files )->insert( ( *files )->begin() + index, file );
+  else
+    ( *files )->erase( ( *files )->begin() + index );
+
+  return( index );
+}
+
+/*
+  SavedSearches::assign : searchData の全ての検索条件を評価し直す
+*/
+void SavedSearches::assign( const SearchData& searchData, const FileData& fileData, const TagData& tagData, const TagTree& tagTree,
+                            const TagRules& tagRules )
+{
+  entries_.clear();
+  for ( auto s = searchData.begin() ; s != searchData.end() ; ++s ) {
+    Entry& entry = entries_[s->first];
+    entry.text = s->second;
+    entry.query = Query( s->second );
+    entry.files = std::make_shared< FileList >();
+    entry.query.evaluate( fileData, tagData, tagTree, tagRules, entry.files.get(), CancelToken{ nullptr, 0 } );
+  }
+}
+
+/*
+  SavedSearches::insert : 検索結果 files とともに検索条件を登録する
+*/
+void SavedSearches::insert( const string& name, const string& text, std::shared_ptr< FileList > files )
+{
+  Entry& entry = entries_[name];
+  entry.text = text;
+  entry.query = Query( text );
+  entry.files = files;
+}
+
+/*
+  SavedSearches::find : 検索名 name の検索条件を返す
+*/
+const SavedSearches::Entry* SavedSearches::find( const string& name ) const
+{
+  auto i = entries_.find( name );
+
+  return( ( i == entries_.end() ) ? nullptr : &( i->second ) );
+}
+
+/*
+  SavedSearches::update : file に対する tag の追加・削除を、関係する検索条件の結果に反映する
+*/
+void SavedSearches::update( FileId file, const string& tag, const TagSet& tags, const TagTree& tagTree, const TagRules& tagRules )
+{
+  for ( auto e = entries_.begin() ; e != entries_.end() ; ++e ) {
+    Entry& entry = e->second;
+    if ( entry.query.concerns( tag, tagTree, tagRules ) )
+      UpdateResult( &( entry.files ), file, entry.query.match( tags, tagTree, tagRules ) );
+  }
+}
+
+/*
+  SavedSearches::add : 検索条件毎に files から条件を満たすファイルを選び、結果とマージする
+*/
+void SavedSearches::add( const FileList& files, const FileData& fileData, const TagTree& tagTree, const TagRules& tagRules )
+{
+  for ( auto e = entries_.begin() ; e != entries_.end() ; ++e ) {
+    Entry& entry = e->second;
+    FileList matched;
+    for ( auto f = files.begin() ; f != files.end() ; ++f )
+      if ( entry.query.match( fileData[*f], tagTree, tagRules ) ) matched.push_back( *f );
+    if ( matched.empty() ) continue;
+
+    auto merged = std::make_shared< FileList >();
+    merged->reserve( entry.files->size() + matched.size() );
+    std::set_union( entry.files->begin(), entry.files->end(), matched.begin(), matched.end(), std::back_inserter( *merged ) );
+    entry.files = merged;
+  }
+}
+
+/*
+  SavedSearches::remove : 検索条件毎に、結果から files を差し引く
+*/
+void SavedSearches::remove( const FileList& files )
+{
+  for ( auto e = entries_.begin() ; e != entries_.end() ; ++e ) {
+    Entry& entry = e->second;
+    auto rest = std::make_shared< FileList >();
+    rest->reserve( entry.files->size() );
+    std::set_difference( entry.files->begin(), entry.files->end(), files.begin(), files.end(), std::back_inserter( *rest ) );
+    if ( rest->size() != entry.files->size() ) entry.files = rest;
+  }
+}
+
+/*
+  SavedSearches::data : 保存用に検索名をキーとする検索文字列を返す
+*/
+SearchData SavedSearches::data() const
+{
+  SearchData res;
+  for ( auto e = entries_.begin() ; e != entries_.end() ; ++e )
+    res[e->first] = e->second.text;
+
+  return( res );
+}
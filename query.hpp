@@ -0,0 +1,249 @@
+/**
+  @file query.hpp
+  @brief タグによるファイルの絞り込み
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef QUERY_HPP_20261018
+#define QUERY_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+
+#include "file.hpp"
+#include "tagtree.hpp"
+#include "tagrules.hpp"
+
+/// @brief 絞り込み結果のファイルリスト(識別番号の順に並ぶ)
+using FileList = std::vector< FileId >;
+
+/**
+   @brief 処理の中断判定
+
+   世代番号が開始時から変わっていれば中断されたとみなす。
+**/
+struct CancelToken
+{
+  const std::atomic< unsigned >* generation; // 現在の世代番号
+  unsigned id;                               // 処理開始時の世代番号
+
+  /// @brief 中断されたか？
+  ///
+  /// @return 中断されていれば true を返す
+  bool canceled() const
+  { return( generation != nullptr && generation->load( std::memory_order_relaxed ) != id ); }
+};
+
+/**
+   @brief タグ検索の条件
+
+   空白で区切った語の AND 条件とする。先頭に '-' を付けた語は除外条件になる。
+   各語はタグの先頭部分と比較するため(大文字と小文字は区別しない)、
+   入力途中の語でも絞り込みができる。
+   語が親タグに一致する場合は、子孫のタグの付いたファイルも一致するものとする。
+   規則があれば、語は別名にも一致し、一致したタグを含意するタグ・別名の付いたファイルも一致するものとする。
+**/
+class Query
+{
+public:
+
+  /// @brief デフォルト・コンストラクタ
+  ///
+  /// 条件なし(全ファイルが対象)とする
+  Query() {}
+
+  /// @brief 検索文字列から条件を作成する
+  ///
+  /// @param text 検索文字列
+  explicit Query( const std::string& text );
+
+  /// @brief 条件がないか？
+  ///
+  /// @return 条件がなければ true を返す
+  bool empty() const
+  { return( include_.empty() && exclude_.empty() ); }
+
+  /// @brief prev の結果を絞り込んだ条件か？
+  ///
+  /// true の場合、この条件の結果は prev の結果の部分集合になる。
+  ///
+  /// @param prev 以前の条件
+  /// @return 絞り込みになっていれば true を返す
+  bool refines( const Query& prev ) const;
+
+  /// @brief タグ tag の追加・削除で結果が変わりうるか？
+  ///
+  /// @param tag 対象のタグ
+  /// @param tagTree タグの階層(祖先のタグが語に一致する場合も変わりうる)
+  /// @param tagRules タグの規則(含意されるタグ・別名が語に一致する場合も変わりうる)
+  /// @return 結果が変わりうる場合は true を返す
+  bool concerns( const std::string& tag, const TagTree& tagTree, const TagRules& tagRules ) const;
+
+  /// @brief タグリスト tags を持つファイルが条件を満たすか？
+  ///
+  /// @param tags ファイルのタグリスト
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  /// @return 条件を満たせば true を返す
+  bool match( const TagSet& tags, const TagTree& tagTree, const TagRules& tagRules ) const;
+
+  /// @brief タグリスト tags の一部を持つファイルが条件を満たしうるか？
+  ///
+  /// 除外する語は見ずに、含むべき語だけを調べる。ディレクトリのファイルに付いたタグの和集合に対して呼べば、
+  /// false のディレクトリには条件を満たすファイルがない。
+  ///
+  /// @param tags タグリスト(複数のファイルのタグリストの和集合でもよい)
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  /// @return 条件を満たしうれば true を返す
+  bool mayMatch( const TagSet& tags, const TagTree& tagTree, const TagRules& tagRules ) const;
+
+  /// @brief 同じ条件か？
+  ///
+  /// @param query 比較対象の条件
+  /// @return 同じ条件なら true を返す
+  bool operator==( const Query& query ) const
+  { return( include_ == query.include_ && exclude_ == query.exclude_ ); }
+
+  /// @brief 全ファイルを対象に条件を評価する
+  ///
+  /// @param fileData ファイルをキーとするタグリスト
+  /// @param tagData タグをキーとするファイルリスト
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  /// @param result 結果を保持する変数へのポインタ
+  /// @param cancel 中断判定
+  /// @return 中断された場合は false を返す
+  bool evaluate( const FileData& fileData, const TagData& tagData, const TagTree& tagTree, const TagRules& tagRules,
+                 FileList* result, const CancelToken& cancel ) const;
+
+  /// @brief 以前の結果を対象に条件を評価する
+  ///
+  /// @param current 以前の結果(refines() が true になる条件の結果)
+  /// @param tagData タグをキーとするファイルリスト
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  /// @param result 結果を保持する変数へのポインタ
+  /// @param cancel 中断判定
+  /// @return 中断された場合は false を返す
+  bool refine( const FileList& current, const TagData& tagData, const TagTree& tagTree, const TagRules& tagRules,
+               FileList* result, const CancelToken& cancel ) const;
+
+private:
+
+  std::vector< std::string > include_; // 含むべきタグの先頭部分(casefold 済み)
+  std::vector< std::string > exclude_; // 除外するタグの先頭部分(casefold 済み)
+};
+
+/// @brief 結果リスト files のファイル file の有無を切り替える
+///
+/// files が他と共有されている場合は複製してから変更する。
+///
+/// @param files 結果リストへのポインタ
+/// @param file 対象のファイル
+/// @param contain ファイルを含める場合は true
+/// @return 変更があった場合は、変更した位置を返す(なければ -1)
+long UpdateResult( std::shared_ptr< FileList >* files, FileId file, bool contain );
+
+/**
+   @brief 保存した検索条件
+
+   検索条件ごとに結果を保持し、タグの追加・削除のたびに対象ファイル1件分だけ更新する。
+   検索条件の切り替え時に再評価は行わない。
+**/
+class SavedSearches
+{
+public:
+
+  /// @brief 保存した検索条件
+  struct Entry
+  {
+    std::string text;                  // 検索文字列
+    Query query;                       // 検索条件
+    std::shared_ptr< FileList > files; // 結果
+  };
+
+  using container = std::map< std::string, Entry, StrLess >;
+  using const_iterator = container::const_iterator;
+
+  /// @brief 全ての検索条件を作り直す
+  ///
+  /// @param searchData 検索名をキーとする検索文字列
+  /// @param fileData ファイルをキーとするタグリスト
+  /// @param tagData タグをキーとするファイルリスト
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  void assign( const SearchData& searchData, const FileData& fileData, const TagData& tagData, const TagTree& tagTree,
+               const TagRules& tagRules );
+
+  /// @brief 検索条件を登録する
+  ///
+  /// 同名の検索条件がある場合は置き換える。
+  ///
+  /// @param name 検索名
+  /// @param text 検索文字列
+  /// @param files 検索結果
+  void insert( const std::string& name, const std::string& text, std::shared_ptr< FileList > files );
+
+  /// @brief 検索条件を削除する
+  ///
+  /// @param name 検索名
+  void erase( const std::string& name )
+  { entries_.erase( name ); }
+
+  /// @brief 検索条件を返す
+  ///
+  /// @param name 検索名
+  /// @return 検索条件へのポインタ(なければ nullptr)
+  const Entry* find( const std::string& name ) const;
+
+  /// @brief ファイルに対するタグの追加・削除を結果に反映する
+  ///
+  /// @param file タグが変更されたファイル
+  /// @param tag 追加・削除されたタグ
+  /// @param tags 変更後のファイルのタグリスト
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  void update( FileId file, const std::string& tag, const TagSet& tags, const TagTree& tagTree, const TagRules& tagRules );
+
+  /// @brief 加わったファイルのうち条件を満たすものを結果に加える(遅延読み込みで読み込んだ場合など)
+  ///
+  /// @param files 加わったファイル(昇順)
+  /// @param fileData ファイルをキーとするタグリスト
+  /// @param tagTree タグの階層
+  /// @param tagRules タグの規則
+  void add( const FileList& files, const FileData& fileData, const TagTree& tagTree, const TagRules& tagRules );
+
+  /// @brief 除いたファイルを結果から除く(遅延読み込みで追い出した場合など)
+  ///
+  /// @param files 除いたファイル(昇順)
+  void remove( const FileList& files );
+
+  /// @brief 検索名をキーとする検索文字列を返す
+  ///
+  /// @return 検索名をキーとする検索文字列
+  SearchData data() const;
+
+  /// @brief 検索条件の開始位置を返す
+  ///
+  /// @return 検索条件の開始位置
+  const_iterator begin() const
+  { return( entries_.begin() ); }
+
+  /// @brief 検索条件の末尾の次の位置を返す
+  ///
+  /// @return 検索条件の末尾の次の位置
+  const_iterator end() const
+  { return( entries_.end() ); }
+
+private:
+
+  container entries_; // 検索名をキーとする検索条件
+};
+
+#endif
@@ -0,0 +1,312 @@
+/**
+   server.cpp : UNIX ドメインソケットによる索引の検索・編集
+**/
+#include "server.hpp"
+
+#include <stdexcept>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "query.hpp"
+
+using std::string;
+using std::size_t;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const size_t MAX_REQUEST = 1 << 16; // 1 件の要求の最大バイト数
+  const size_t RECV_SIZE = 1 << 12;   // 一度に受信するバイト数
+
+  /*
+    ErrorResponse : message をエラーの応答にする
+  */
+  string ErrorResponse( const string& message )
+  {
+    return( "{\"error\":" + JsonString( message ) + "}\n\n" );
+  }
+
+  /*
+    AppendFile : ファイル 1 件のパスとタグを JSON の 1 行として out に加える
+  */
+  void AppendFile( const fs::path& file, const TagSet& tags, string* out )
+  {
+    *out += "{\"path\":" + JsonString( file.native() ) + ",\"tags\":[";
+    for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+      if ( t != tags.begin() ) *out += ',';
+      *out += JsonString( *t );
+    }
+    *out += "]}\n";
+  }
+
+  /*
+    SendAll : data をすべて送信する(相手が切断していても SIGPIPE は発生させない)
+
+    戻り値 : 送信できなければ false を返す
+  */
+  bool SendAll( int fd, const string& data )
+  {
+    for ( size_t sent = 0 ; sent < data.size() ; ) {
+      ssize_t n = ::send( fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL );
+      if ( n < 0 && errno == EINTR ) continue;
+      if ( n <= 0 ) return( false );
+      sent += n;
+    }
+
+    return( true );
+  }
+
+  /*
+    SplitFirst : s を最初の空白で命令と引数に分ける
+  */
+  void SplitFirst( const string& s, string* first, string* rest )
+  {
+    string::size_type space = s.find( ' ' );
+    *first = s.substr( 0, space );
+    *rest = ( space == string::npos ) ? string() : s.substr( space + 1 );
+  }
+} // namespace
+
+/*
+  JsonString : s の '"'・'\'・制御文字をエスケープし、'"' で囲む
+*/
+string JsonString( const string& s )
+{
+  string json = "\"";
+  for ( auto c = s.begin() ; c != s.end() ; ++c ) {
+    switch ( *c ) {
+    case '"'  : json += "\\\""; break;
+    case '\\' : json += "\\\\"; break;
+    case '\n' : json += "\\n"; break;
+    case '\r' : json += "\\r"; break;
+    case '\t' : json += "\\t"; break;
+    default :
+      if ( static_cast< unsigned char >( *c ) < 0x20 ) {
+        char buffer[8];
+        std::snprintf( buffer, sizeof( buffer ), "\\u%04x", static_cast< unsigned >( *c ) );
+        json += buffer;
+      } else {
+        json += *c;
+      }
+    }
+  }
+
+  return( json + "\"" );
+}
+
+/*
+  TagServer::TagServer : コンストラクタ
+*/
+TagServer::TagServer( const IndexVersions& versions, EditFunction edit, SaveFunction save, PrepareFunction prepare )
+  : versions_( versions ), edit_( edit ), save_( save ), prepare_( prepare ),
+    socketPath_(), listenFd_( -1 ), acceptor_(), clientsMutex_(), clients_(), workers_( 0 )
+{}
+
+/*
+  TagServer::start : socketPath にソケットを作成し、受け付けスレッドを開始する
+
+  同名のソケットがあっても、接続できなければ前回の残りとみなして置き換える。
+  ソケット以外のファイルは削除しない。
+*/
+void TagServer::start( const string& socketPath )
+{
+  stop();
+
+  sockaddr_un address;
+  std::memset( &address, 0, sizeof( address ) );
+  address.sun_family = AF_UNIX;
+  if ( socketPath.size() >= sizeof( address.sun_path ) )
+    throw std::runtime_error( "ソケットのパスが長すぎます。" );
+  std::strcpy( address.sun_path, socketPath.c_str() );
+
+  struct stat st;
+  if ( ::lstat( socketPath.c_str(), &st ) == 0 ) {
+    if ( ! S_ISSOCK( st.st_mode ) )
+      throw std::runtime_error( "ソケットのパスに別のファイルがあります。" );
+    int probe = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+    bool alive = probe >= 0 && ::connect( probe, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) == 0;
+    if ( probe >= 0 ) ::close( probe );
+    if ( alive )
+      throw std::runtime_error( "ソケットはすでに使われています。" );
+    ::unlink( socketPath.c_str() );
+  }
+
+  int fd = ::socket( AF_UNIX, SOCK_STREAM, 0 );
+  if ( fd < 0 )
+    throw std::runtime_error( "ソケットを作成できません。" );
+  if ( ::bind( fd, reinterpret_cast< sockaddr* >( &address ), sizeof( address ) ) != 0 ||
+       ::chmod( socketPath.c_str(), S_IRUSR | S_IWUSR ) != 0 ||
+       ::listen( fd, SOMAXCONN ) != 0 ) {
+    ::close( fd );
+    throw std::runtime_error( "ソケットで待ち受けできません。" );
+  }
+
+  socketPath_ = socketPath;
+  listenFd_ = fd;
+  acceptor_ = std::thread( &TagServer::acceptLoop, this );
+}
+
+/*
+  TagServer::stop : 受け付けスレッドと接続スレッドの終了を待ち、ソケットを削除する
+
+  接続スレッドは、ソケットを shutdown して受信待ちから戻らせる
+*/
+void TagServer::stop()
+{
+  if ( listenFd_ < 0 ) return;
+
+  ::shutdown( listenFd_, SHUT_RDWR );
+  acceptor_.join();
+  ::close( listenFd_ );
+  listenFd_ = -1;
+
+  {
+    std::lock_guard< std::mutex > lock( clientsMutex_ );
+    for ( auto c = clients_.begin() ; c != clients_.end() ; ++c )
+      ::shutdown( *c, SHUT_RDWR );
+  }
+  while ( workers_ > 0 )
+    std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+
+  ::unlink( socketPath_.c_str() );
+}
+
+/*
+  TagServer::acceptLoop : 接続毎にスレッドを作成する(受け付け用のソケットが閉じられると終了する)
+*/
+void TagServer::acceptLoop()
+{
+  for ( ;; ) {
+    int fd = ::accept( listenFd_, nullptr, nullptr );
+    if ( fd < 0 ) {
+      if ( errno == EINTR || errno == ECONNABORTED ) continue;
+      break;
+    }
+
+    {
+      std::lock_guard< std::mutex > lock( clientsMutex_ );
+      clients_.insert( fd );
+    }
+    ++workers_;
+    std::thread( [this, fd]() {
+        serve( fd );
+        {
+          std::lock_guard< std::mutex > lock( clientsMutex_ );
+          clients_.erase( fd );
+        }
+        ::close( fd );
+        --workers_;
+      } ).detach();
+  }
+}
+
+/*
+  TagServer::serve : 受信した行毎に応答し、届いた分の応答はまとめて送信する
+*/
+void TagServer::serve( int fd )
+{
+  string buffer;
+  char chunk[RECV_SIZE];
+  for ( ;; ) {
+    ssize_t n = ::recv( fd, chunk, sizeof( chunk ), 0 );
+    if ( n < 0 && errno == EINTR ) continue;
+    if ( n <= 0 ) return;
+    buffer.append( chunk, n );
+
+    string out;
+    string::size_type start = 0, end;
+    while ( ( end = buffer.find( '\n', start ) ) != string::npos ) {
+      string request = buffer.substr( start, end - start );
+      if ( ! request.empty() && request.back() == '\r' ) request.pop_back();
+      out += respond( request );
+      start = end + 1;
+    }
+    buffer.erase( 0, start );
+
+    bool tooLong = buffer.size() > MAX_REQUEST;
+    if ( tooLong ) out += ErrorResponse( "request too long" );
+    if ( ( ! out.empty() && ! SendAll( fd, out ) ) || tooLong ) return;
+  }
+}
+
+/*
+  TagServer::respond : 要求 1 件を処理し、空行で終わる応答を返す
+*/
+string TagServer::respond( const string& request )
+{
+  string command, argument;
+  SplitFirst( request, &command, &argument );
+
+  if ( command == "add" || command == "remove" ) {
+    string tag, file;
+    SplitFirst( argument, &tag, &file );
+    if ( tag.empty() || ! fs::path( file ).is_absolute() )
+      return( ErrorResponse( "usage : " + command + " tag /absolute/path" ) );
+    bool changed = false;
+    string error;
+    if ( ! edit_( command == "add", tag, fs::path( file ), &changed, &error ) )
+      return( ErrorResponse( error ) );
+    return( string( "{\"changed\":" ) + ( changed ? "1" : "0" ) + "}\n\n" );
+  }
+
+  if ( command == "save" ) {
+    string error = "save is not supported";
+    if ( ! ( save_ && save_( &error ) ) )
+      return( ErrorResponse( error ) );
+    return( "{\"saved\":true}\n\n" );
+  }
+
+  if ( command == "ping" )
+    return( "{\"ok\":true}\n\n" );
+
+  return( readResponse( command, argument ) );
+}
+
+/*
+  TagServer::readResponse : 必要なファイルを読み込ませてから最新の版を取って索引を読み、応答を作る
+*/
+string TagServer::readResponse( const string& command, const string& argument )
+{
+  string out;
+  bool complete = true; // 答えに関係しうるファイルが揃っているか？
+  if ( prepare_ && ( command == "query" || command == "tags" || command == "stats" ) )
+    complete = prepare_( command, argument );
+  std::shared_ptr< const IndexSnapshot > snapshot = versions_.current();
+  const FileData& fileData = snapshot->fileData;
+  const TagData& tagData = snapshot->tagData;
+
+  if ( command == "query" ) {
+    FileList result;
+    Query( argument ).evaluate( fileData, tagData, snapshot->tagTree, snapshot->tagRules, &result, CancelToken{ nullptr, 0 } );
+    for ( auto f = result.begin() ; f != result.end() ; ++f )
+      AppendFile( fileData.path( *f ), fileData[*f], &out );
+    if ( ! complete )
+      out += "{\"partial\":true}\n";
+  } else if ( command == "tags" ) {
+    FileId file = fileData.find( fs::path( argument ) );
+    if ( file == NO_FILE )
+      return( ErrorResponse( ( complete ? "not found : " : "not loaded : " ) + argument ) );
+    AppendFile( fileData.path( file ), fileData[file], &out );
+  } else if ( command == "stats" ) {
+    size_t tagged = 0;
+    for ( FileId f = 0 ; f < fileData.size() ; ++f )
+      if ( ! fileData[f].empty() ) ++tagged;
+    size_t tags = 0;
+    for ( auto t = tagData.begin() ; t != tagData.end() ; ++t )
+      if ( ! t->second.empty() ) ++tags;
+    out = "{\"files\":" + std::to_string( fileData.paths().count() ) + ",\"tagged\":" + std::to_string( tagged ) +
+      ",\"tags\":" + std::to_string( tags ) + ( complete ? "" : ",\"partial\":true" ) + "}\n";
+  } else {
+    return( ErrorResponse( "unknown command : " + command ) );
+  }
+
+  return( out + "\n" );
+}
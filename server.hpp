@@ -0,0 +1,124 @@
+/**
+  @file server.hpp
+  @brief UNIX ドメインソケットによる索引の検索・編集
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef SERVER_HPP_20261018
+#define SERVER_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include <boost/filesystem.hpp>
+
+#include "file.hpp"
+#include "snapshot.hpp"
+
+/// @brief 文字列を JSON の文字列リテラルにする
+///
+/// @param s 対象の文字列
+/// @return 両端の '"' を含む文字列
+std::string JsonString( const std::string& s );
+
+/**
+   @brief 読み込み済みの索引をローカルのソケットで提供するサーバ
+
+   要求は 1 行 1 件、応答は 1 行 1 件の JSON を並べ、空行で終わる。
+   1 つの接続で複数の要求を続けて送ってよい(応答は要求の順に返す)。
+
+     query 検索文字列     {"path":"...","tags":[...]} を該当ファイル数だけ返す
+     tags パス            {"path":"...","tags":[...]} を返す
+     add タグ パス        {"changed":0|1} を返す
+     remove タグ パス     {"changed":0|1} を返す
+     stats                {"files":n,"tagged":n,"tags":n} を返す(読み込んでいないファイルがあれば "partial":true を加える)
+     save                 {"saved":true} を返す
+     ping                 {"ok":true} を返す
+
+   パスは絶対パスで指定する。失敗した場合は {"error":"..."} を返す。
+   query は、読み込んでいないファイルが結果に関係しうる場合は最後に {"partial":true} を返す。
+
+   読み込みは接続毎のスレッドで要求時点の最新の版に対して行い、編集を待つことはない。
+   編集と保存は呼び出し側の関数に任せる(GUI では GUI スレッドで行う)。
+   編集の結果は、呼び出し側が新しい版を公開した後の要求から見える。
+**/
+class TagServer
+{
+public:
+
+  /// @brief タグを付ける・外す関数
+  ///
+  /// add が true なら付け、false なら外す。
+  /// 変更があれば *changed を true にし、失敗した場合は *error にメッセージを入れて false を返す。
+  using EditFunction = std::function< bool( bool add, const std::string& tag, const boost::filesystem::path& file,
+                                            bool* changed, std::string* error ) >;
+
+  /// @brief タグファイルに保存する関数(失敗した場合は *error にメッセージを入れて false を返す)
+  using SaveFunction = std::function< bool( std::string* error ) >;
+
+  /// @brief 読み込みの要求(query・tags・stats)に答える前に、必要なファイルを読み込む関数
+  ///
+  /// 遅延読み込み中の GUI では、要求に関係する読み込んでいないディレクトリを読み込む。
+  /// 読み込んでいないファイルが答えに関係しうる場合は false を返す。
+  using PrepareFunction = std::function< bool( const std::string& command, const std::string& argument ) >;
+
+  /// @brief コンストラクタ
+  ///
+  /// @param versions 索引の最新の版
+  /// @param edit タグを付ける・外す関数
+  /// @param save 保存する関数(空なら save は失敗を返す)
+  /// @param prepare 読み込みの要求の前に呼ぶ関数(空なら読み込み済みの索引だけで答える)
+  TagServer( const IndexVersions& versions, EditFunction edit, SaveFunction save = SaveFunction(),
+             PrepareFunction prepare = PrepareFunction() );
+
+  TagServer( const TagServer& ) = delete;
+  TagServer& operator=( const TagServer& ) = delete;
+
+  /// @brief デストラクタ(実行中なら停止する)
+  ~TagServer()
+  { stop(); }
+
+  /// @brief ソケットを作成し、接続の受け付けを開始する
+  ///
+  /// ソケットは所有者だけが読み書きできる。作成に失敗した場合は例外 runtime_error を投げる。
+  ///
+  /// @param socketPath ソケットのパス(同名のソケットがあれば置き換える)
+  void start( const std::string& socketPath );
+
+  /// @brief 受け付けを止め、全ての接続を閉じてソケットを削除する
+  void stop();
+
+  /// @brief 実行中か？
+  ///
+  /// @return 受け付け中なら true を返す
+  bool running() const
+  { return( listenFd_ >= 0 ); }
+
+private:
+
+  void acceptLoop();                                   // 接続を受け付ける
+  void serve( int fd );                                // 1 つの接続の要求に応答する
+  std::string respond( const std::string& request );   // 要求 1 件の応答を返す
+  std::string readResponse( const std::string& command, const std::string& argument ); // 読み込みの要求に応答する
+
+  const IndexVersions& versions_; // 索引の最新の版
+  EditFunction edit_;          // タグを付ける・外す関数
+  SaveFunction save_;          // 保存する関数
+  PrepareFunction prepare_;    // 読み込みの要求の前に呼ぶ関数
+
+  std::string socketPath_;     // ソケットのパス
+  int listenFd_;               // 受け付け用のソケット(停止中は -1)
+  std::thread acceptor_;       // 受け付けスレッド
+  std::mutex clientsMutex_;    // clients_ の排他制御
+  std::set< int > clients_;    // 接続中のソケット
+  std::atomic< int > workers_; // 実行中の接続スレッドの数
+};
+
+#endif
@@ -0,0 +1,205 @@
+/**
+   similar.cpp : 知覚ハッシュによる類似画像の検索
+**/
+#include "similar.hpp"
+
+#include <algorithm>
+
+using std::vector;
+using std::pair;
+using std::size_t;
+
+namespace
+{
+  const int HASH_COLUMNS = 9; // 区画の列数(隣り合う列の比較で 8 ビット)
+  const int HASH_ROWS = 8;    // 区画の行数
+
+  const std::uint32_t CHUNK_VALUES = 1u << MultiIndexHash::CHUNK_BITS; // 区間の値の数
+
+  /*
+    ChunkOf : hash の k 番目の区間の値を返す
+  */
+  inline std::uint32_t ChunkOf( ImageHash hash, unsigned k )
+  { return( static_cast< std::uint32_t >( hash >> ( k * MultiIndexHash::CHUNK_BITS ) ) & ( CHUNK_VALUES - 1 ) ); }
+
+  /*
+    NeighborKeys : key からの距離が radius 以下の区間の値を keys に追加する
+
+    from 番目以降のビットだけを反転の対象にし、同じ値を二度数えない
+  */
+  void NeighborKeys( std::uint32_t key, unsigned radius, vector< std::uint32_t >* keys, unsigned from = 0 )
+  {
+    keys->push_back( key );
+    if ( radius == 0 ) return;
+    for ( unsigned b = from ; b < MultiIndexHash::CHUNK_BITS ; ++b )
+      NeighborKeys( key ^ ( 1u << b ), radius - 1, keys, b + 1 );
+  }
+}
+
+/*
+  DHash : pixels の dHash を求める
+
+  1 行ずつ輝度(整数の重み 77:150:29)を求め、列毎の区画に足し込む。
+  内側のループは分岐を持たないため、コンパイラのベクトル化が効く。
+*/
+ImageHash DHash( const unsigned char* pixels, int width, int height, int rowstride, int channels )
+{
+  vector< std::uint32_t > luma( width ); // 1 行の輝度
+  vector< int > column( width );         // 画素の列 -> 区画の列
+  for ( int x = 0 ; x < width ; ++x )
+    column[x] = x * HASH_COLUMNS / width;
+
+  std::uint64_t sums[HASH_ROWS][HASH_COLUMNS] = {};
+  std::uint64_t counts[HASH_ROWS][HASH_COLUMNS] = {};
+  for ( int y = 0 ; y < height ; ++y ) {
+    const unsigned char* p = pixels + static_cast< size_t >( y ) * rowstride;
+    for ( int x = 0 ; x < width ; ++x )
+      luma[x] = 77u * p[x * channels] + 150u * p[x * channels + 1] + 29u * p[x * channels + 2];
+
+    int row = y * HASH_ROWS / height;
+    for ( int x = 0 ; x < width ; ++x ) {
+      sums[row][column[x]] += luma[x];
+      ++counts[row][column[x]];
+    }
+  }
+
+  ImageHash hash = 0;
+  for ( int r = 0 ; r < HASH_ROWS ; ++r ) {
+    for ( int c = 0 ; c + 1 < HASH_COLUMNS ; ++c ) {
+      // 平均の大小を、割り算をせずに比べる
+      std::uint64_t left = sums[r][c] * counts[r][c + 1];
+      std::uint64_t right = sums[r][c + 1] * counts[r][c];
+      hash = ( hash << 1 ) | ( ( left < right ) ? 1 : 0 );
+    }
+  }
+
+  return( hash );
+}
+
+/*
+  MultiIndexHash::clear : 索引を空にする
+*/
+void MultiIndexHash::clear()
+{
+  entries_.clear();
+  for ( unsigned k = 0 ; k < CHUNKS ; ++k )
+    tables_[k].clear();
+  erased_ = 0;
+}
+
+/*
+  MultiIndexHash::insert : hash を各区間の値のバケットに追加する
+*/
+void MultiIndexHash::insert( ImageHash hash, FileId file )
+{
+  std::uint32_t entry = static_cast< std::uint32_t >( entries_.size() );
+  entries_.emplace_back( hash, file );
+  for ( unsigned k = 0 ; k < CHUNKS ; ++k ) {
+    if ( tables_[k].empty() ) tables_[k].resize( CHUNK_VALUES );
+    tables_[k][ChunkOf( hash, k )].push_back( entry );
+  }
+}
+
+/*
+  MultiIndexHash::erase : 先頭の区間のバケットから登録を探し、各区間のバケットから外す
+
+  entries_ の要素はバケットの位置を変えないよう残す
+*/
+void MultiIndexHash::erase( ImageHash hash, FileId file )
+{
+  if ( entries_.empty() ) return;
+
+  const Bucket& first = tables_[0][ChunkOf( hash, 0 )];
+  auto e = std::find_if( first.begin(), first.end(),
+                         [&]( std::uint32_t i ) { return( entries_[i] == std::make_pair( hash, file ) ); } );
+  if ( e == first.end() ) return;
+
+  std::uint32_t entry = *e;
+  for ( unsigned k = 0 ; k < CHUNKS ; ++k ) {
+    Bucket& bucket = tables_[k][ChunkOf( hash, k )];
+    bucket.erase( std::find( bucket.begin(), bucket.end(), entry ) );
+  }
+  ++erased_;
+}
+
+/*
+  MultiIndexHash::find : 距離が radius 以下のハッシュを集める
+
+  区間 k で見つかった候補は、それより前の区間の距離がすべて r / CHUNKS を超える場合だけ採る。
+  これで同じ候補を二度数えることはない。
+*/
+void MultiIndexHash::find( ImageHash hash, unsigned radius, vector< pair< unsigned, FileId > >* result ) const
+{
+  if ( entries_.empty() ) return;
+
+  unsigned chunkRadius = radius / CHUNKS;
+  vector< std::uint32_t > keys; // 区間の距離が chunkRadius 以下の値
+  for ( unsigned k = 0 ; k < CHUNKS ; ++k ) {
+    keys.clear();
+    NeighborKeys( ChunkOf( hash, k ), chunkRadius, &keys );
+    for ( auto key = keys.begin() ; key != keys.end() ; ++key ) {
+      const Bucket& bucket = tables_[k][*key];
+      for ( auto e = bucket.begin() ; e != bucket.end() ; ++e ) {
+        ImageHash other = entries_[*e].first;
+        unsigned j = 0;
+        while ( j < k && HammingDistance( ChunkOf( hash, j ), ChunkOf( other, j ) ) > chunkRadius )
+          ++j;
+        if ( j < k ) continue; // 前の区間で見つかっている
+        unsigned d = HammingDistance( hash, other );
+        if ( d <= radius )
+          result->emplace_back( d, entries_[*e].second );
+      }
+    }
+  }
+}
+
+/*
+  SimilarIndex::assign : files 件のファイルを対象に索引を空にする
+*/
+void SimilarIndex::assign( size_t files )
+{
+  hashes_.assign( files, 0 );
+  indexed_.assign( files, false );
+  index_.clear();
+}
+
+/*
+  SimilarIndex::insert : file のハッシュを登録する(登録済みなら無視する)
+*/
+void SimilarIndex::insert( FileId file, ImageHash hash )
+{
+  if ( file >= hashes_.size() || indexed_[file] ) return;
+
+  hashes_[file] = hash;
+  indexed_[file] = true;
+  index_.insert( hash, file );
+}
+
+/*
+  SimilarIndex::erase : file のハッシュの登録を取り消す
+*/
+void SimilarIndex::erase( FileId file )
+{
+  if ( ! indexed( file ) ) return;
+
+  index_.erase( hashes_[file], file );
+  hashes_[file] = 0;
+  indexed_[file] = false;
+}
+
+/*
+  SimilarIndex::find : file に似たファイルを距離の近い順に返す
+*/
+vector< FileId > SimilarIndex::find( FileId file, unsigned radius ) const
+{
+  vector< FileId > files;
+  if ( ! indexed( file ) ) return( files );
+
+  vector< pair< unsigned, FileId > > found;
+  index_.find( hashes_[file], radius, &found );
+  std::sort( found.begin(), found.end() );
+  for ( auto f = found.begin() ; f != found.end() ; ++f )
+    if ( f->second != file ) files.push_back( f->second );
+
+  return( files );
+}
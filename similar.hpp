@@ -0,0 +1,150 @@
+/**
+  @file similar.hpp
+  @brief 知覚ハッシュによる類似画像の検索
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef SIMILAR_HPP_20261018
+#define SIMILAR_HPP_20261018
+
+#include <vector>
+#include <utility>
+#include <bitset>
+#include <cstdint>
+
+#include "pathtable.hpp"
+
+/// @brief 画像の知覚ハッシュ(dHash、64 ビット)
+using ImageHash = std::uint64_t;
+
+/// @brief 二つのハッシュのハミング距離を返す
+///
+/// @param a, b 対象のハッシュ
+/// @return 異なるビットの数
+inline unsigned HammingDistance( ImageHash a, ImageHash b )
+{ return( static_cast< unsigned >( std::bitset< 64 >( a ^ b ).count() ) ); }
+
+/// @brief 画素から dHash を求める
+///
+/// 輝度を 9x8 の区画に平均し、各行で左右に隣り合う区画の大小をビットにする。
+///
+/// @param pixels 画素(8 ビットの RGB または RGBA)
+/// @param width, height 画像の幅と高さ
+/// @param rowstride 1 行のバイト数
+/// @param channels 1 画素のバイト数(3 または 4)
+/// @return ハッシュ
+ImageHash DHash( const unsigned char* pixels, int width, int height, int rowstride, int channels );
+
+/**
+   @brief ハミング距離による多重索引ハッシュ
+
+   64 ビットを CHUNKS 個の区間に分け、区間毎に値をキーとするバケットを持つ。
+   距離が r 以下なら、いずれかの区間の距離は r / CHUNKS 以下になるため、
+   各区間でその範囲のキーのバケットだけを調べればよい。
+**/
+class MultiIndexHash
+{
+public:
+
+  static const unsigned CHUNKS = 4;      // 区間の数
+  static const unsigned CHUNK_BITS = 16; // 区間のビット数
+
+  /// @brief 空にする
+  void clear();
+
+  /// @brief 登録数を返す
+  ///
+  /// @return 登録数
+  std::size_t size() const
+  { return( entries_.size() - erased_ ); }
+
+  /// @brief ハッシュを登録する
+  ///
+  /// @param hash ハッシュ
+  /// @param file ファイルの識別番号
+  void insert( ImageHash hash, FileId file );
+
+  /// @brief ハッシュの登録を取り消す
+  ///
+  /// @param hash 登録したハッシュ
+  /// @param file ファイルの識別番号
+  void erase( ImageHash hash, FileId file );
+
+  /// @brief 距離が radius 以下のファイルを探す
+  ///
+  /// @param hash 基準のハッシュ
+  /// @param radius 距離の上限
+  /// @param result (距離、ファイルの識別番号)を追加する変数へのポインタ
+  void find( ImageHash hash, unsigned radius, std::vector< std::pair< unsigned, FileId > >* result ) const;
+
+private:
+
+  using Bucket = std::vector< std::uint32_t >; // entries_ の位置
+
+  std::vector< std::pair< ImageHash, FileId > > entries_; // 登録されたハッシュとファイル
+  std::vector< Bucket > tables_[CHUNKS];                  // 区間毎の値をキーとするバケット
+  std::size_t erased_ = 0;                                // 取り消した登録の数(entries_ には残る)
+};
+
+/**
+   @brief ファイル毎の知覚ハッシュと類似画像の索引
+
+   ハッシュはバックグラウンドで求めたものを GUI スレッドで登録する。
+**/
+class SimilarIndex
+{
+public:
+
+  /// @brief files 件のファイルを対象に空の索引を作る
+  ///
+  /// @param files ファイル数
+  void assign( std::size_t files );
+
+  /// @brief ハッシュを登録する
+  ///
+  /// @param file ファイルの識別番号
+  /// @param hash ハッシュ
+  void insert( FileId file, ImageHash hash );
+
+  /// @brief ハッシュの登録を取り消す(登録していなければ何もしない)
+  ///
+  /// @param file ファイルの識別番号
+  void erase( FileId file );
+
+  /// @brief ハッシュが登録済みか？
+  ///
+  /// @param file ファイルの識別番号
+  /// @return 登録済みなら true を返す
+  bool indexed( FileId file ) const
+  { return( file < indexed_.size() && indexed_[file] ); }
+
+  /// @brief 登録済みのファイル数を返す
+  ///
+  /// @return ファイル数
+  std::size_t size() const
+  { return( index_.size() ); }
+
+  /// @brief 登録されたハッシュを返す
+  ///
+  /// @param file ファイルの識別番号
+  /// @return ハッシュ
+  ImageHash hash( FileId file ) const
+  { return( hashes_[file] ); }
+
+  /// @brief file に似たファイルを探す
+  ///
+  /// @param file 基準のファイル(登録済みであること)
+  /// @param radius 距離の上限
+  /// @return 似たファイル(file 自身を除く、距離の近い順)
+  std::vector< FileId > find( FileId file, unsigned radius ) const;
+
+private:
+
+  std::vector< ImageHash > hashes_; // 識別番号をインデックスとするハッシュ
+  std::vector< bool > indexed_;     // 登録済みか？
+  MultiIndexHash index_;            // 類似検索用の索引
+};
+
+#endif
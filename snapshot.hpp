@@ -0,0 +1,98 @@
+/**
+  @file snapshot.hpp
+  @brief 索引の公開済みの版(スナップショット)
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef SNAPSHOT_HPP_20261018
+#define SNAPSHOT_HPP_20261018
+
+#include <memory>
+#include <atomic>
+
+#include "file.hpp"
+#include "tagtree.hpp"
+#include "tagrules.hpp"
+
+/**
+   @brief 索引のある時点の版
+
+   タグリスト・タグ毎のファイルリスト・タグの階層はどれもチャンクや表を編集中の索引と共有し、
+   公開にかかるのはチャンクの表のコピーだけになる。編集中の索引は、共有中のチャンクを変更するときに複製する。
+   タグの規則も表を共有する。
+   公開後は変更しないため、どのスレッドからでもロックなしで読める。
+**/
+struct IndexSnapshot
+{
+  unsigned long version; // 版の番号(公開の度に増える)
+  FileData fileData;     // ファイルをキーとするタグリスト
+  TagData tagData;       // タグをキーとするファイルリスト
+  TagTree tagTree;       // タグの階層
+  TagRules tagRules;     // タグの規則
+
+  /// @brief コンストラクタ
+  ///
+  /// @param v 版の番号
+  /// @param f 編集中のタグリスト
+  /// @param t 編集中のファイルリスト
+  /// @param tree 編集中のタグの階層
+  /// @param rules 編集中のタグの規則
+  IndexSnapshot( unsigned long v, const FileData& f, const TagData& t, const TagTree& tree, const TagRules& rules )
+    : version( v ), fileData( f ), tagData( t ), tagTree( tree ), tagRules( rules ) {}
+
+  IndexSnapshot( const IndexSnapshot& ) = delete;
+  IndexSnapshot& operator=( const IndexSnapshot& ) = delete;
+};
+
+/**
+   @brief 索引の最新の版
+
+   編集するスレッドは自分の索引を変更し、区切りで publish() して新しい版に置き換える。
+   読むスレッドは current() で取った版を使い終わるまで持つ。古い版は最後の参照がなくなった時点で解放される。
+   版の取得・置き換えは shared_ptr のアトミック操作だけで行い、読む側が編集を待つことはない。
+**/
+class IndexVersions
+{
+public:
+
+  /// @brief デフォルト・コンストラクタ(空の版を公開する)
+  IndexVersions() : version_( 0 )
+  {
+    FileData fileData;
+    TagData tagData;
+    current_ = std::make_shared< const IndexSnapshot >( 0, fileData, tagData, TagTree(), TagRules() );
+  }
+
+  IndexVersions( const IndexVersions& ) = delete;
+  IndexVersions& operator=( const IndexVersions& ) = delete;
+
+  /// @brief 最新の版を返す
+  ///
+  /// @return 最新の版
+  std::shared_ptr< const IndexSnapshot > current() const
+  { return( std::atomic_load( &current_ ) ); }
+
+  /// @brief 編集中の索引を新しい版として公開する
+  ///
+  /// 編集するスレッドから呼ぶこと(複数のスレッドで編集する場合は、編集と公開をまとめて排他制御すること)。
+  ///
+  /// @param fileData 編集中のタグリスト
+  /// @param tagData 編集中のファイルリスト
+  /// @param tagTree 編集中のタグの階層
+  /// @param tagRules 編集中のタグの規則
+  void publish( const FileData& fileData, const TagData& tagData, const TagTree& tagTree, const TagRules& tagRules )
+  {
+    std::shared_ptr< const IndexSnapshot > next =
+      std::make_shared< const IndexSnapshot >( ++version_, fileData, tagData, tagTree, tagRules );
+    std::atomic_store( &current_, next );
+  }
+
+private:
+
+  std::shared_ptr< const IndexSnapshot > current_; // 最新の版
+  std::atomic< unsigned long > version_;           // 最新の版の番号
+};
+
+#endif
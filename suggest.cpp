@@ -0,0 +1,175 @@
+/**
+   suggest.cpp : 共起に基づくタグの候補
+**/
+#include "suggest.hpp"
+
+#include <algorithm>
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+namespace
+{
+  const size_t SIBLING_LIMIT = 32;     // 前後それぞれに調べる同じディレクトリのファイル数
+  const double SIBLING_WEIGHT = 1.0;   // 同じディレクトリのファイルに付いている割合の重み
+
+  /*
+    Decrement : row の key の値を 1 減らす(0 になったら削除する)
+  */
+  void Decrement( TagSuggester::Row* row, const string& key )
+  {
+    auto i = row->find( key );
+    if ( i == row->end() ) return;
+
+    if ( --( i->second ) == 0 )
+      row->erase( i );
+  }
+} // namespace
+
+/*
+  TagSuggester::assign : fileData の全ファイルから共起行列を作り直す
+*/
+void TagSuggester::assign( const FileData& fileData )
+{
+  matrix_.clear();
+  for ( FileId id = 0 ; id < fileData.size() ; ++id )
+    add( fileData[id] );
+}
+
+/*
+  TagSuggester::add : ファイル 1 件のタグの全ての組(同じタグ同士を含む)を数える
+*/
+void TagSuggester::add( const TagSet& tags )
+{
+  for ( auto t1 = tags.begin() ; t1 != tags.end() ; ++t1 ) {
+    Row& row = matrix_[*t1];
+    for ( auto t2 = tags.begin() ; t2 != tags.end() ; ++t2 )
+      ++row[*t2];
+  }
+}
+
+/*
+  TagSuggester::remove : ファイル 1 件のタグの全ての組を差し引く
+*/
+void TagSuggester::remove( const TagSet& tags )
+{
+  for ( auto t1 = tags.begin() ; t1 != tags.end() ; ++t1 ) {
+    auto r = matrix_.find( *t1 );
+    if ( r == matrix_.end() ) continue;
+    for ( auto t2 = tags.begin() ; t2 != tags.end() ; ++t2 )
+      Decrement( &( r->second ), *t2 );
+    if ( ( r->second ).empty() )
+      matrix_.erase( r );
+  }
+}
+
+/*
+  TagSuggester::insert : tag とファイルの他のタグ tags との組を数える
+*/
+void TagSuggester::insert( const string& tag, const TagSet& tags )
+{
+  Row& row = matrix_[tag];
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+    ++row[*t];
+    if ( *t != tag )
+      ++matrix_[*t][tag];
+  }
+}
+
+/*
+  TagSuggester::erase : tag とファイルの残りのタグ tags との組を差し引く
+*/
+void TagSuggester::erase( const string& tag, const TagSet& tags )
+{
+  auto r = matrix_.find( tag );
+  if ( r == matrix_.end() ) return;
+
+  Decrement( &( r->second ), tag );
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+    Decrement( &( r->second ), *t );
+    auto other = matrix_.find( *t );
+    if ( other != matrix_.end() )
+      Decrement( &( other->second ), tag );
+  }
+
+  if ( ( r->second ).empty() )
+    matrix_.erase( r );
+}
+
+/*
+  TagSuggester::count : tag1 と tag2 が同時に付いたファイル数を返す
+*/
+unsigned TagSuggester::count( const string& tag1, const string& tag2 ) const
+{
+  auto r = matrix_.find( tag1 );
+  if ( r == matrix_.end() ) return( 0 );
+  auto i = ( r->second ).find( tag2 );
+
+  return( ( i == ( r->second ).end() ) ? 0 : i->second );
+}
+
+/*
+  TagSuggester::suggest : file に付ける候補のタグを、スコアの大きい順に最大 limit 件返す
+
+  スコアは、付いている各タグ t について「t の付いたファイルのうち候補も付いている割合」の和と、
+  同じディレクトリの近傍のファイルのうち候補が付いている割合を加えたもの
+*/
+vector< string > TagSuggester::suggest( FileId file, const FileData& fileData, size_t limit ) const
+{
+  vector< string > res;
+  if ( file >= fileData.size() ) return( res );
+
+  const TagSet& tags = fileData[file];
+  std::map< string, double, StrLess > score;
+
+  // 付いているタグとの共起
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+    auto r = matrix_.find( *t );
+    if ( r == matrix_.end() ) continue;
+    double n = count( *t, *t );
+    for ( auto c = ( r->second ).begin() ; c != ( r->second ).end() ; ++c )
+      if ( tags.find( c->first ) == tags.end() )
+        score[c->first] += c->second / n;
+  }
+
+  // 同じディレクトリのファイル(識別番号はパスの順のため、サブディレクトリを含めて連続する)
+  const PathTable& paths = fileData.paths();
+  DirId dir = paths.dir( file );
+  const string& parent = paths.directory( dir );
+  string prefix = parent;
+  if ( prefix.empty() || prefix.back() != '/' ) prefix += '/';
+  auto under = [&]( FileId id ) {
+    const string& d = paths.directory( paths.dir( id ) );
+    return( d == parent || d.compare( 0, prefix.length(), prefix ) == 0 );
+  };
+  std::map< string, unsigned, StrLess > siblingTags;
+  unsigned siblings = 0;
+  auto visit = [&]( FileId id ) {
+    if ( paths.dir( id ) != dir ) return;
+    ++siblings;
+    for ( auto t = fileData[id].begin() ; t != fileData[id].end() ; ++t )
+      if ( tags.find( *t ) == tags.end() )
+        ++siblingTags[*t];
+  };
+  for ( FileId id = file, n = 0 ; n < SIBLING_LIMIT && id > 0 ; ++n ) {
+    if ( ! under( --id ) ) break;
+    visit( id );
+  }
+  for ( FileId id = file, n = 0 ; n < SIBLING_LIMIT && ++id < fileData.size() ; ++n ) {
+    if ( ! under( id ) ) break;
+    visit( id );
+  }
+  for ( auto t = siblingTags.begin() ; t != siblingTags.end() ; ++t )
+    score[t->first] += SIBLING_WEIGHT * t->second / siblings;
+
+  // スコアの大きい順(同点はタグの順)
+  vector< std::pair< string, double > > ranked( score.begin(), score.end() );
+  std::stable_sort( ranked.begin(), ranked.end(),
+                    []( const std::pair< string, double >& a, const std::pair< string, double >& b )
+                    { return( a.second > b.second ); } );
+  for ( auto r = ranked.begin() ; r != ranked.end() && res.size() < limit ; ++r )
+    res.push_back( r->first );
+
+  return( res );
+}
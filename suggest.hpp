@@ -0,0 +1,79 @@
+/**
+  @file suggest.hpp
+  @brief 共起に基づくタグの候補
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef SUGGEST_HPP_20261018
+#define SUGGEST_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include "file.hpp"
+
+/**
+   @brief タグの共起行列と候補の抽出
+
+   同じファイルに付いたタグの組ごとに、そのファイル数を疎行列として持つ。
+   対角成分はタグの付いたファイル数になる。
+   タグの追加・削除のたびに、そのファイルの他のタグとの組だけを更新する。
+**/
+class TagSuggester
+{
+public:
+
+  using Row = std::map< std::string, unsigned, StrLess >; // 相手のタグをキーとするファイル数
+
+  /// @brief 共起行列を作り直す
+  ///
+  /// @param fileData ファイルをキーとするタグリスト
+  void assign( const FileData& fileData );
+
+  /// @brief ファイルが加わった(遅延読み込みで読み込んだ場合など)
+  ///
+  /// @param tags 加わったファイルのタグリスト
+  void add( const TagSet& tags );
+
+  /// @brief ファイルが除かれた(遅延読み込みで追い出した場合など)
+  ///
+  /// @param tags 除かれたファイルのタグリスト
+  void remove( const TagSet& tags );
+
+  /// @brief ファイルにタグが追加された
+  ///
+  /// @param tag 追加されたタグ
+  /// @param tags 追加後のファイルのタグリスト
+  void insert( const std::string& tag, const TagSet& tags );
+
+  /// @brief ファイルからタグが削除された
+  ///
+  /// @param tag 削除されたタグ
+  /// @param tags 削除後のファイルのタグリスト
+  void erase( const std::string& tag, const TagSet& tags );
+
+  /// @brief 二つのタグが同時に付いたファイル数を返す
+  ///
+  /// @param tag1, tag2 対象のタグ(同じタグならタグの付いたファイル数)
+  /// @return ファイル数
+  unsigned count( const std::string& tag1, const std::string& tag2 ) const;
+
+  /// @brief ファイルに付ける候補のタグを返す
+  ///
+  /// 付いているタグと共起する割合と、同じディレクトリのファイルに付いている割合の和が大きい順に返す。
+  ///
+  /// @param file 対象のファイル
+  /// @param fileData ファイルをキーとするタグリスト
+  /// @param limit 返すタグの上限
+  /// @return 候補のタグ
+  std::vector< std::string > suggest( FileId file, const FileData& fileData, std::size_t limit ) const;
+
+private:
+
+  std::map< std::string, Row, StrLess > matrix_; // 共起行列(対称)
+};
+
+#endif
@@ -1,5 +1,7 @@
 #include "tag.hpp"
 
+#include <stdexcept>
+
 using std::string;
 using std::unordered_map;
 using std::pair;
@@ -9,99 +11,98 @@ namespace fs = boost::filesystem;
 namespace
 {
   /*
-    getPointer : map1[key] で ID を取得し、ID と map2[ID] へのポインタを返す
+    getValue : map1[key] で ID を取得し、ID と map2[ID] へのポインタを返す
   */
-  template< class Res, class Key, class Id,
-            template< class, class > class Map >
-  pair< Id, Res* > getValue( const Map< Key, Id >& map1, const Map< Id, Res >& map2, const Key& key )
+  template< class Map1, class Map2 >
+  pair< typename Map1::mapped_type, typename Map2::mapped_type* >
+  getValue( const Map1& map1, Map2* map2, const typename Map1::key_type& key )
   {
     auto i = map1.find( key );
     if ( i == map1.end() )
       throw std::runtime_error( FORMAT( error_message::KEY_0_NOT_FOUND, key ) );
 
-    auto j = map2.find( i->second );
-    assert( j != map2.end() );
+    auto j = map2->find( i->second );
+    assert( j != map2->end() );
 
     return( std::make_pair( j->first, &( j->second ) ) );
   }
 } // namespace
 
 /*
-  TagList< TagId, ImageId >::getImageP : path にリンクした Image へのポインタを返す
+  TagList::getImage : path にリンクした Image の ID とポインタを返す
 */
-template< typename TagId, typename ImageId >
-pair< ImageId, typename TagList< TagId, ImageId >::image_type* >
-TagList< TagId, ImageId >::getImage( const fs::path& path ) const
-{ return( getValue( imagePath_, imageList_, path ) ); }
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+pair< ImageId, typename TagList< TagId, ImageId, TagPolicy, ImagePolicy >::image_type* >
+TagList< TagId, ImageId, TagPolicy, ImagePolicy >::getImage( const fs::path& path )
+{ return( getValue( imagePath_, &imageList_, path ) ); }
 
 /*
-  TagList< TagId, ImageId >::getTagP : content にリンクした Tag へのポインタを返す
+  TagList::getTag : content にリンクした Tag の ID とポインタを返す
 */
-template< typename TagId, typename ImageId >
-pair< TagId, typename TagList< TagId, ImageId >::tag_type* >
-TagList< TagId, ImageId >::getTag( const string& content ) const
-{ return( getValue( tagContents_, tagList_, content ) ); }
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+pair< TagId, typename TagList< TagId, ImageId, TagPolicy, ImagePolicy >::tag_type* >
+TagList< TagId, ImageId, TagPolicy, ImagePolicy >::getTag( const string& content )
+{ return( getValue( tagContents_, &tagList_, content ) ); }
 
 namespace
 {
-  template< class Res, class Key, class Id,
-            template< class, class > class Map, class Op >
-  Res* createValue( const Key& key, Map< Key, Id >* map1, Map< Id, Res >* map2, Id* nextId, Op op )
+  /*
+    createValue : key に新しい ID を振り、map2[ID] に op( ID ) を登録して ID とポインタを返す
+  */
+  template< class Map1, class Map2, class Op >
+  pair< typename Map1::mapped_type, typename Map2::mapped_type* >
+  createValue( const typename Map1::key_type& key, Map1* map1, Map2* map2, typename Map1::mapped_type* nextId, Op op )
   {
     auto i = map1->find( key );
     if ( i != map1->end() )
       throw std::runtime_error( FORMAT( error_message::KEY_0_EXIST, key ) );
 
     ( *map1 )[key] = ++( *nextId );
-    auto j = map2->insert( std::make_pair( *nextId, op( *nextId ) ) ).first;
+    auto j = map2->emplace( *nextId, op( *nextId ) ).first;
 
-    return( &( j->second ) );
+    return( std::make_pair( j->first, &( j->second ) ) );
   }
-
 } // namespace
 
 /*
-  TagList< TagId, ImageId >::getTag : タグを返す(なければ新規作成)
+  TagList::createTag : タグを新規作成する
 */
-template< typename TagId, typename ImageId >
-typename TagList< TagId, ImageId >::tag_type*
-TagList< TagId, ImageId >::createTag( const string& content )
-{ return( createValue( content, &tagContents_, &tagList_, &nextTagId_, []( TagId id )->Tag{ retern( Tag{} ); } ) ); }
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+typename TagList< TagId, ImageId, TagPolicy, ImagePolicy >::tag_type*
+TagList< TagId, ImageId, TagPolicy, ImagePolicy >::createTag( const string& content )
+{ return( createValue( content, &tagContents_, &tagList_, &nextTagId_, []( TagId id ){ return( tag_type( id ) ); } ).second ); }
 
 /*
-  TagList< TagId, ImageId >::getImage : 画像を返す(なければ新規作成)
+  TagList::addImage : 画像を新規登録する
 */
-template< typename TagId, typename ImageId >
-typename TagList< TagId, ImageId >::image_type*
-TagList< TagId, ImageId >::addImage( const boost::filesystem::path& path )
-{ return( createValue( path, &imagePath_, &imageList_, &nextImageId_, []( ImageId id )->Image{ return( Image( id ) ); } ) ); }
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+typename TagList< TagId, ImageId, TagPolicy, ImagePolicy >::image_type*
+TagList< TagId, ImageId, TagPolicy, ImagePolicy >::addImage( const fs::path& path )
+{ return( createValue( path, &imagePath_, &imageList_, &nextImageId_, []( ImageId id ){ return( image_type( id ) ); } ).second ); }
 
 /*
-  TagList< TagId, ImageId >::addTag : path にリンクした Image に content にリンクした Tag を追加する
+  TagList::addTag : path にリンクした Image に content にリンクした Tag を追加する(Tag がなければ作成する)
 */
-template< typename TagId, typename ImageId >
-void TagList< TagId, ImageId >::addTag( const fs::path& path, const string& content )
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+void TagList< TagId, ImageId, TagPolicy, ImagePolicy >::addTag( const fs::path& path, const string& content )
 {
   pair< ImageId, image_type* > image = getImage( path ); // path にリンクした Image の ID とポインタ
-  pair< TagId, tag_type* > tag = createTag( content ); // content にリンクした Tag の ID とポインタ
-  
+  pair< TagId, tag_type* > tag = ( tagContents_.find( content ) == tagContents_.end() ) ?
+    createValue( content, &tagContents_, &tagList_, &nextTagId_, []( TagId id ){ return( tag_type( id ) ); } ) :
+    getTag( content ); // content にリンクした Tag の ID とポインタ
+
   ( image.second )->addTag( tag.first );
   ( tag.second )->addImage( image.first );
 }
 
 /*
-  TagList< TagId, ImageId >::eraseTag : path にリンクした Image から content にリンクした Tag を削除する
+  TagList::eraseTag : path にリンクした Image から content にリンクした Tag を削除する
 */
-template< typename TagId, typename ImageId >
-void TagList< TagId, ImageId >::eraseTag( const fs::path& path, const string& content )
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+void TagList< TagId, ImageId, TagPolicy, ImagePolicy >::eraseTag( const fs::path& path, const string& content )
 {
   pair< ImageId, image_type* > image = getImage( path ); // path にリンクした Image の ID とポインタ
-  if ( image.first == ImageId{} )
-    throw std::runtime_error( FORMAT( error_message::KEY_0_NOT_FOUND, path ) );
-
-  pair< TagId, tag_type* > tag = getTag( content );
-  if ( tag.first == TagId{} )
-    throw std::runtime_error( FORMAT( error_message::KEY_0_NOT_FOUND, content ) );
+  pair< TagId, tag_type* > tag = getTag( content );      // content にリンクした Tag の ID とポインタ
 
   ( image.second )->eraseTag( tag.first );
   ( tag.second )->eraseImage( image.first );
@@ -112,8 +113,8 @@ namespace
   /*
     RenewMapKey : map の oldKey を newKey に入れ替える
   */
-  template< class Key, class Value, template< class, class > class Map  >
-  void RenewMapKey( Map< Key, Value >* map, const Key& oldKey, const Key& newKey )
+  template< class Map >
+  void RenewMapKey( Map* map, const typename Map::key_type& oldKey, const typename Map::key_type& newKey )
   {
     auto it = map->find( oldKey );
     if ( it == map->end() )
@@ -122,24 +123,26 @@ namespace
     if ( map->find( newKey ) != map->end() )
       throw std::runtime_error( FORMAT( error_message::KEY_0_EXIST, newKey ) );
 
-    Value value = it->second;
+    auto value = it->second;
     map->erase( it );
-    (*map)[newKey] = value;
+    ( *map )[newKey] = value;
   }
 } // namespace
 
 /*
-  TagList< TagId, ImageId >::renewTag : タグの内容を変更する
+  TagList::renewTag : タグの内容を変更する
 */
-template< typename TagId, typename ImageId >
-void TagList< TagId, ImageId >::renewTag( const string& oldContent, const string& newContent )
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+void TagList< TagId, ImageId, TagPolicy, ImagePolicy >::renewTag( const string& oldContent, const string& newContent )
 { RenewMapKey( &tagContents_, oldContent, newContent ); }
 
 /*
-  TagList< TagId, ImageId >::renewPath : 画像のパスの内容を変更する
+  TagList::renewPath : 画像のパスの内容を変更する
 */
-template< typename TagId, typename ImageId >
-void TagList< TagId, ImageId >::renewPath( const boost::filesystem::path& oldPath, const boost::filesystem::path& newPath )
+template< typename TagId, typename ImageId, typename TagPolicy, typename ImagePolicy >
+void TagList< TagId, ImageId, TagPolicy, ImagePolicy >::renewPath( const fs::path& oldPath, const fs::path& newPath )
 { RenewMapKey( &imagePath_, oldPath, newPath ); }
 
-
+// タグ ID が 16 ビット・32 ビットのものを実体化する
+template class TagList< std::uint16_t, std::uint32_t >;
+template class TagList< std::uint32_t, std::uint32_t >;
@@ -11,8 +11,10 @@
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <cstdint>
 
 #include <boost/filesystem.hpp>
 
@@ -22,22 +24,35 @@
 
 #include "global.hpp"
 #include "constant.hpp"
+#include "container.hpp"
+#include "file.hpp"
+
+/// @brief Image が持つタグ ID の集合の既定の方針
+///
+/// 画像のタグは数個なので、8 個までヒープを使わない配列とする(bench containers で選んだ)。
+using DefaultTagPolicy = container_policy::SmallSet< 8 >;
+
+/// @brief Tag が持つ画像 ID の集合の既定の方針
+///
+/// ハッシュ集合の 1/6 程度のメモリで済み、読み込み時は ID の昇順に追加するので構築も速い。
+using DefaultImagePolicy = container_policy::FlatSet;
 
 /**
  * @brief 画像タグ
  * 
  * @tparam TagId タグIDの型
  * @tparam ImageId 画像IDの型
+ * @tparam ImagePolicy 画像IDの集合に使うコンテナの方針(container_policy)
  */
-template< typename TagId, typename ImageId >
+template< typename TagId, typename ImageId, typename ImagePolicy = DefaultImagePolicy >
 class Tag
 {
   public:
 
   using tag_id = TagId;
   using image_id = ImageId;
-  using container = typename std::unordered_set< image_id >;
-  using const_iterator = container::const_iterator;
+  using container = typename ImagePolicy::template container< image_id >;
+  using const_iterator = typename container::const_iterator;
 
   /// @brief デフォルト・コンストラクタ
   Tag( tag_id tagId )
@@ -47,7 +62,7 @@ class Tag
   /// @brief タグ ID を返す
   ///
   /// @return タグ ID
-  teg_id id() const
+  tag_id id() const
   { return( id_ ); }
 
   /// @brief 親タグのタグ ID を設定する
@@ -100,15 +115,22 @@ class Tag
   container images_; // タグに属する画像
 };
 
-template< typename TagId, typename ImageId >
+/**
+ * @brief 画像
+ *
+ * @tparam TagId タグIDの型
+ * @tparam ImageId 画像IDの型
+ * @tparam TagPolicy タグIDの集合に使うコンテナの方針(container_policy)
+ */
+template< typename TagId, typename ImageId, typename TagPolicy = DefaultTagPolicy >
 class Image
 {
   public:
 
   using tag_id = TagId;
   using image_id = ImageId;
-  using container = typename std::unordered_set< tag_id >;
-  using const_iterator = container::const_iterator;
+  using container = typename TagPolicy::template container< tag_id >;
+  using const_iterator = typename container::const_iterator;
 
   /// @brief ID を指定して構築
   ///
@@ -222,7 +244,7 @@ namespace std
     ///
     /// @param path ハッシュ値計算対象
     /// @return ハッシュ値
-    result_type operator()( const ::boost::filesystem::path& path )
+    result_type operator()( const ::boost::filesystem::path& path ) const
     { return( ::boost::filesystem::hash_value( path ) ); }
 
   };
@@ -230,43 +252,25 @@ namespace std
 } // namespace std
 
 /**
-   @brief 文字列の比較
-
-   大文字と小文字・全角と半角を区別しない比較を行う。
-   内部では、gtk+の関数 g_utf8_collate を利用している。
-**/
-template< class String >
-struct StrLess
-{
-  /// @brief 文字列の比較
-  ///
-  /// @param s1, s2 対象の文字列
-  /// @return s1 の方が小さければ true を返す
-  bool operator()( const String& s1, const String& s2 ) const
-  {
-    using value_type = typename String::value_type;
-
-    value_type* gc1 = g_utf8_casefold( s1.c_str(), -1 );
-    value_type* gc2 = g_utf8_casefold( s2.c_str(), -1 );
-
-    gint res = g_utf8_collate( gc1, gc2 );
-
-    g_free( gc1 );
-    g_free( gc2 );
-
-    return( res < 0 );
-  }
-};
-
-template< typename TagId, typename ImageId >
+ * @brief タグと画像のリスト
+ *
+ * メンバ関数の定義は tag.cpp にあり、TagList16・TagList32 を明示的にインスタンス化している。
+ *
+ * @tparam TagId タグIDの型
+ * @tparam ImageId 画像IDの型
+ * @tparam TagPolicy 画像が持つタグIDの集合の方針
+ * @tparam ImagePolicy タグが持つ画像IDの集合の方針
+ */
+template< typename TagId, typename ImageId,
+          typename TagPolicy = DefaultTagPolicy, typename ImagePolicy = DefaultImagePolicy >
 class TagList
 {
   public:
 
-  using tag_type = Tag< TagId, ImageId >;
-  using image_type = Image< TagId, ImageId >;
-  using tag_contents = std::map< std::string, TagId, StrLess< std::string > >;
-  using image_path = std::map< boost::filesystem::path, ImageId, StrLess< boost::filesystem::path > >;
+  using tag_type = Tag< TagId, ImageId, ImagePolicy >;
+  using image_type = Image< TagId, ImageId, TagPolicy >;
+  using tag_contents = std::map< std::string, TagId, StrLess >;
+  using image_path = std::map< boost::filesystem::path, ImageId >;
   using contents_iterator = typename tag_contents::iterator;
   using const_contents_iterator = typename tag_contents::const_iterator;
   using path_iterator = typename image_path::iterator;
@@ -325,10 +329,16 @@ class TagList
   std::unordered_map< ImageId, image_type > imageList_;             // 画像のリスト
 
   // 指定した path をキーとする ID と Image へのポインタを返す
-  std::pair< ImageId, image_type* > getImage( const boost::filesystem::path& path ) const;
+  std::pair< ImageId, image_type* > getImage( const boost::filesystem::path& path );
 
   // 指定した content をキーとする ID と Tag へのポインタを返す
-  std::pair< TagId, tag_type* > getTag( const std::string& content ) const;
+  std::pair< TagId, tag_type* > getTag( const std::string& content );
 };
 
+/// @brief タグ ID を 16 ビットとするリスト(タグの種類が 65535 以下の場合)
+using TagList16 = TagList< std::uint16_t, std::uint32_t >;
+
+/// @brief タグ ID を 32 ビットとするリスト
+using TagList32 = TagList< std::uint32_t, std::uint32_t >;
+
 #endif
\ No newline at end of file
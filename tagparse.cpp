@@ -0,0 +1,360 @@
+/**
+   tagparse.cpp : タグファイルのファイルのレコードの並列読み込み
+**/
+#include "tagparse.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::vector;
+using std::size_t;
+
+namespace fs = boost::filesystem;
+
+namespace
+{
+  const size_t PROGRESS_STEP = 4096; // 読んだレコード数を進み具合に足し込む間隔
+  const size_t TAG_CHUNK = 64;       // マージでスレッドに一度に割り当てるタグ数
+
+  /*
+    RunThreads : work( 0 ) から work( threads - 1 ) を並列に実行する(work( 0 ) は呼び出し側のスレッド)
+
+    スレッド内で送出された例外は、全てのスレッドの終わりを待ってから呼び出し側のスレッドで送出し直す
+  */
+  template< typename Work > void RunThreads( unsigned threads, Work work )
+  {
+    vector< std::exception_ptr > errors( std::max( threads, 1u ) );
+    auto run = [&work, &errors]( unsigned i ) {
+      try {
+        work( i );
+      } catch ( ... ) {
+        errors[i] = std::current_exception();
+      }
+    };
+
+    vector< std::thread > workers;
+    for ( unsigned i = 1 ; i < threads ; ++i )
+      workers.emplace_back( run, i );
+    run( 0 );
+    for ( auto w = workers.begin() ; w != workers.end() ; ++w )
+      w->join();
+
+    for ( auto e = errors.begin() ; e != errors.end() ; ++e )
+      if ( *e ) std::rethrow_exception( *e );
+  }
+
+  /*
+    HasKey : 行 [line, eol) のキーが key であるか判定する
+  */
+  bool HasKey( const char* line, const char* eol, const string& key )
+  {
+    return( static_cast< size_t >( eol - line ) >= key.size() && std::memcmp( line, key.data(), key.size() ) == 0 );
+  }
+
+  /*
+    ParseChunk : [first, last) のレコードを records に読む(dir= の行に達したら終わる)
+
+    最初の file= より前の行は無視する
+  */
+  void ParseChunk( const char* first, const char* last, RecordChunk* records, ReadProgress* progress )
+  {
+    size_t counted = 0; // 進み具合に足し込んでいないレコード数
+    for ( const char* line = first ; line < last ; ) {
+      const char* eol = static_cast< const char* >( std::memchr( line, '\n', last - line ) );
+      if ( eol == nullptr ) eol = last;
+
+      if ( HasKey( line, eol, FILE_KEY ) ) {
+        records->emplace_back();
+        records->back().file.assign( line + FILE_KEY.size(), eol );
+        if ( progress != nullptr && ++counted == PROGRESS_STEP ) {
+          progress->parsed += counted;
+          counted = 0;
+        }
+      } else if ( HasKey( line, eol, DIR_KEY ) ) {
+        break;
+      } else if ( ! records->empty() ) {
+        PendingRecord& record = records->back();
+        if ( HasKey( line, eol, TAG_KEY ) ) {
+          record.tags.emplace_back( line + TAG_KEY.size(), eol );
+        } else if ( HasKey( line, eol, HASH_KEY ) ) {
+          record.hash.assign( line + HASH_KEY.size(), eol );
+        } else if ( HasKey( line, eol, GROUP_KEY ) ) {
+          unsigned group = 0;
+          std::from_chars( line + GROUP_KEY.size(), eol, group );
+          record.group = group;
+        }
+      }
+      line = eol + 1;
+    }
+    if ( progress != nullptr ) progress->parsed += counted;
+  }
+
+  // マージ中のファイルリストの位置
+  struct Cursor
+  {
+    const FileId* current; // 次に取り出す識別番号
+    const FileId* end;     // 末尾の次
+  };
+
+  // マージ中の区間のタグの位置
+  struct TagCursor
+  {
+    size_t partial;                                 // 区間の番号
+    PartialIndex::Postings::const_iterator current; // 次に取り出すタグ
+    PartialIndex::Postings::const_iterator end;     // 末尾の次
+  };
+
+  // マージしたタグ
+  struct MergedTag
+  {
+    const string* name;                      // 表記(最も前の区間のもの)
+    size_t partial;                          // 表記を取った区間の番号
+    vector< const vector< FileId >* > files; // 区間毎のファイルリスト(区間の順)
+  };
+} // namespace
+
+/*
+  MappedFile::MappedFile : ファイルを開いて写像する(写像後はファイル記述子を閉じても写像は残る)
+*/
+MappedFile::MappedFile( const string& fileName )
+  : data_( nullptr ), size_( 0 )
+{
+  int fd = ::open( fileName.c_str(), O_RDONLY );
+  if ( fd < 0 )
+    throw std::runtime_error( "タグファイルのオープンに失敗しました。" );
+
+  struct stat st;
+  if ( ::fstat( fd, &st ) != 0 ) {
+    ::close( fd );
+    throw std::runtime_error( "タグファイルのオープンに失敗しました。" );
+  }
+  size_ = static_cast< size_t >( st.st_size );
+  if ( size_ > 0 ) {
+    void* data = ::mmap( nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( data == MAP_FAILED ) {
+      ::close( fd );
+      throw std::runtime_error( "タグファイルの読み込みに失敗しました。" );
+    }
+    ::madvise( data, size_, MADV_SEQUENTIAL );
+    data_ = static_cast< const char* >( data );
+  }
+  ::close( fd );
+}
+
+/*
+  MappedFile::~MappedFile : 写像を解除する
+*/
+MappedFile::~MappedFile()
+{
+  if ( data_ != nullptr )
+    ::munmap( const_cast< char* >( data_ ), size_ );
+}
+
+/*
+  ParseThreads : コア数を返す
+*/
+unsigned ParseThreads()
+{
+  return( std::max( 1u, std::thread::hardware_concurrency() ) );
+}
+
+/*
+  ParseRecords : threads 等分した位置を "\nfile=" の直後まで進めて区切り、区間毎に 1 つのスレッドで読む
+
+  区切りの位置を探すのは等分した位置からの数行だけのため、区切るための読み込みは全体に比べて無視できる
+*/
+vector< RecordChunk > ParseRecords( const char* first, const char* last, unsigned threads, ReadProgress* progress )
+{
+  threads = std::max( threads, 1u );
+  size_t size = static_cast< size_t >( last - first );
+  std::string_view text( first, size );
+  string separator = "\n" + FILE_KEY; // レコードの区切り
+
+  vector< size_t > bounds( 1, 0 ); // 区間の開始位置(末尾に size を加える)
+  for ( unsigned i = 1 ; i < threads ; ++i ) {
+    size_t pos = size * i / threads;
+    size_t at = text.find( separator, ( pos > 0 ) ? pos - 1 : 0 );
+    bounds.push_back( std::max( bounds.back(), ( at == std::string_view::npos ) ? size : at + 1 ) );
+  }
+  bounds.push_back( size );
+
+  vector< RecordChunk > res( threads );
+  RunThreads( threads, [&]( unsigned i ) {
+      ParseChunk( first + bounds[i], first + bounds[i + 1], &( res[i] ), progress ); } );
+
+  return( res );
+}
+
+/*
+  IndexRecords : 区間毎に、直前の次を手掛かりにパスを識別番号にし、タグ毎のファイルを部分的な索引に集める
+
+  ファイルはパスの順に書かれているため、ファイルリストは通常そのまま昇順になる。
+  順が乱れている場合(手で編集したタグファイルなど)だけ並べ直す。
+  StrLess の比較は大文字・小文字の畳み込みを伴って重いため、同じ表記のタグは表記のハッシュで引く
+*/
+vector< PartialIndex > IndexRecords( const vector< RecordChunk >& chunks, const string& rootPath, const FileData& fileData, unsigned threads )
+{
+  vector< PartialIndex > res( chunks.size() );
+  std::atomic< size_t > next( 0 );
+  auto work = [&]( unsigned ) {
+    for ( ;; ) {
+      size_t i = next.fetch_add( 1 );
+      if ( i >= chunks.size() ) break;
+
+      PartialIndex& partial = res[i];
+      partial.ids.reserve( chunks[i].size() );
+      FileId hint = 0; // 次に現れると予想されるファイルの識別番号
+      std::unordered_map< string, vector< FileId >* > spelled; // 表記をキーとする postings の値(StrLess の比較を避ける)
+      for ( auto r = chunks[i].begin() ; r != chunks[i].end() ; ++r ) {
+        fs::path path = fs::path( rootPath + "/" + r->file ).lexically_normal();
+        FileId id = ( hint < fileData.size() && fileData.path( hint ) == path ) ? hint : fileData.find( path );
+        partial.ids.push_back( id );
+        if ( id == NO_FILE ) continue;
+
+        hint = id + 1;
+        for ( auto t = r->tags.begin() ; t != r->tags.end() ; ++t ) {
+          vector< FileId >*& files = spelled[*t];
+          if ( files == nullptr ) files = &( partial.postings[*t] );
+          files->push_back( id );
+        }
+      }
+
+      for ( auto p = partial.postings.begin() ; p != partial.postings.end() ; ++p ) {
+        vector< FileId >& files = p->second;
+        if ( ! std::is_sorted( files.begin(), files.end() ) )
+          std::sort( files.begin(), files.end() );
+        files.erase( std::unique( files.begin(), files.end() ), files.end() );
+      }
+    }
+  };
+  RunThreads( std::min< size_t >( std::max( threads, 1u ), chunks.size() ), work );
+
+  return( res );
+}
+
+/*
+  FillTagSets : 識別番号からレコードを引く表を作り、ファイルのチャンク単位でスレッドに割り当ててタグを付ける
+
+  同じファイルのレコードが複数ある場合、2 つ目以降は最後に呼び出し側のスレッドで付ける
+*/
+void FillTagSets( const vector< RecordChunk >& chunks, const vector< PartialIndex >& partials, FileData* fileData, unsigned threads )
+{
+  vector< const PendingRecord* > records( fileData->size(), nullptr ); // 識別番号をインデックスとするレコード
+  vector< std::pair< FileId, const PendingRecord* > > duplicates;     // 2 つ目以降のレコード
+  for ( size_t i = 0 ; i < chunks.size() ; ++i ) {
+    for ( size_t j = 0 ; j < chunks[i].size() ; ++j ) {
+      FileId id = partials[i].ids[j];
+      if ( id == NO_FILE || chunks[i][j].tags.empty() ) continue;
+      if ( records[id] == nullptr )
+        records[id] = &( chunks[i][j] );
+      else
+        duplicates.emplace_back( id, &( chunks[i][j] ) );
+    }
+  }
+
+  size_t count = ( records.size() + FileData::CHUNK - 1 ) / FileData::CHUNK; // ファイルのチャンク数
+  std::atomic< size_t > next( 0 );
+  auto work = [&]( unsigned ) {
+    for ( ;; ) {
+      size_t c = next.fetch_add( 1 );
+      if ( c >= count ) break;
+      FileId first = static_cast< FileId >( c * FileData::CHUNK );
+      FileId last = static_cast< FileId >( std::min( records.size(), ( c + 1 ) * FileData::CHUNK ) );
+      for ( FileId id = first ; id < last ; ++id ) {
+        if ( records[id] == nullptr ) continue;
+        fileData->edit( id ).insert( records[id]->tags.begin(), records[id]->tags.end() );
+      }
+    }
+  };
+  RunThreads( std::min< size_t >( std::max( threads, 1u ), count ), work );
+
+  for ( auto d = duplicates.begin() ; d != duplicates.end() ; ++d )
+    fileData->edit( d->first ).insert( d->second->tags.begin(), d->second->tags.end() );
+}
+
+/*
+  MergePostings : 区間毎のタグ(どれも StrLess の順)をヒープで k-way マージしてタグ毎に区間のファイルリストを集め、
+                  それをタグ毎にヒープで k-way マージする
+
+  StrLess で等しいタグは、タグファイルで先に現れた区間の表記を残す。
+  タグ毎のファイル数の偏りが大きいため、タグを TAG_CHUNK 件ずつ空いたスレッドに割り当てる。
+  tagData への登録はタグの順に末尾へ加えるだけのため、呼び出し側のスレッドでまとめて行う
+*/
+void MergePostings( const vector< PartialIndex >& partials, TagData* tagData, unsigned threads )
+{
+  StrLess less;
+  auto laterTag = [&less]( const TagCursor& a, const TagCursor& b ) { return( less( b.current->first, a.current->first ) ); };
+  vector< TagCursor > tagHeap; // 取り出していないタグが残る区間
+  for ( size_t p = 0 ; p < partials.size() ; ++p )
+    if ( ! partials[p].postings.empty() )
+      tagHeap.push_back( TagCursor{ p, partials[p].postings.begin(), partials[p].postings.end() } );
+  std::make_heap( tagHeap.begin(), tagHeap.end(), laterTag );
+
+  vector< MergedTag > tags;
+  while ( ! tagHeap.empty() ) {
+    std::pop_heap( tagHeap.begin(), tagHeap.end(), laterTag );
+    TagCursor& c = tagHeap.back();
+    // 取り出すタグは昇順のため、直前のタグより大きくなければ等しい
+    if ( tags.empty() || less( *( tags.back().name ), c.current->first ) )
+      tags.push_back( MergedTag{ &( c.current->first ), c.partial, vector< const vector< FileId >* >() } );
+    else if ( c.partial < tags.back().partial ) {
+      tags.back().name = &( c.current->first );
+      tags.back().partial = c.partial;
+    }
+    if ( ! c.current->second.empty() )
+      tags.back().files.push_back( &( c.current->second ) );
+    if ( ++( c.current ) == c.end )
+      tagHeap.pop_back();
+    else
+      std::push_heap( tagHeap.begin(), tagHeap.end(), laterTag );
+  }
+
+  vector< Posting > merged( tags.size() );
+  std::atomic< size_t > next( 0 );
+  auto work = [&]( unsigned ) {
+    auto later = []( const Cursor& a, const Cursor& b ) { return( *( a.current ) > *( b.current ) ); };
+    vector< Cursor > heap;  // 取り出していない識別番号が残る区間
+    vector< FileId > files; // マージしたファイルリスト
+    for ( ;; ) {
+      size_t first = next.fetch_add( TAG_CHUNK );
+      if ( first >= tags.size() ) break;
+      size_t last = std::min( first + TAG_CHUNK, tags.size() );
+      for ( size_t i = first ; i < last ; ++i ) {
+        heap.clear();
+        files.clear();
+        for ( auto f = tags[i].files.begin() ; f != tags[i].files.end() ; ++f )
+          heap.push_back( Cursor{ ( *f )->data(), ( *f )->data() + ( *f )->size() } );
+        std::make_heap( heap.begin(), heap.end(), later );
+        while ( ! heap.empty() ) {
+          std::pop_heap( heap.begin(), heap.end(), later );
+          Cursor& c = heap.back();
+          if ( files.empty() || files.back() != *( c.current ) )
+            files.push_back( *( c.current ) );
+          if ( ++( c.current ) == c.end )
+            heap.pop_back();
+          else
+            std::push_heap( heap.begin(), heap.end(), later );
+        }
+        merged[i].assign( files.begin(), files.end() );
+      }
+    }
+  };
+  RunThreads( std::min< size_t >( std::max( threads, 1u ), ( tags.size() + TAG_CHUNK - 1 ) / TAG_CHUNK ), work );
+
+  for ( size_t i = 0 ; i < tags.size() ; ++i )
+    tagData->append( *( tags[i].name ), std::move( merged[i] ) );
+}
@@ -0,0 +1,127 @@
+/**
+  @file tagparse.hpp
+  @brief タグファイルのファイルのレコードの並列読み込み
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef TAGPARSE_HPP_20261018
+#define TAGPARSE_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstddef>
+
+#include "file.hpp"
+
+/**
+   @brief ディレクトリの走査と突き合わせるまで保留する、タグファイルのファイルのレコード
+**/
+struct PendingRecord
+{
+  std::string file;                // ルートパスからの相対パス
+  std::string hash;                // hash= の値(なければ空)
+  unsigned group = 0;              // グループの番号
+  std::vector< std::string > tags; // タグ
+};
+
+/// @brief 1 つの区間から読んだレコード(タグファイルの順)
+using RecordChunk = std::vector< PendingRecord >;
+
+/**
+   @brief 1 つの区間のレコードから作った部分的な索引
+
+   区間毎に別のスレッドで作るため、共有するデータには書き込まない。
+**/
+struct PartialIndex
+{
+  /// @brief タグをキーとする、昇順で重複のないファイル
+  using Postings = std::map< std::string, std::vector< FileId >, StrLess >;
+
+  std::vector< FileId > ids; // レコード毎のファイルの識別番号(パスが見つからなければ NO_FILE)
+  Postings postings;         // タグ毎のファイル
+};
+
+/**
+   @brief 読み込み専用でメモリに写像したファイル
+
+   空のファイルは写像せず、begin() と end() はどちらも nullptr になる。
+**/
+class MappedFile
+{
+public:
+
+  /// @brief ファイルを写像する
+  ///
+  /// @param fileName ファイル名
+  /// @exception std::runtime_error 開けない場合、写像できない場合
+  explicit MappedFile( const std::string& fileName );
+
+  /// @brief 写像を解除する
+  ~MappedFile();
+
+  MappedFile( const MappedFile& ) = delete;
+  MappedFile& operator=( const MappedFile& ) = delete;
+
+  /// @brief 先頭を返す
+  const char* begin() const
+  { return( data_ ); }
+
+  /// @brief 末尾の次を返す
+  const char* end() const
+  { return( data_ + size_ ); }
+
+  /// @brief バイト数を返す
+  std::size_t size() const
+  { return( size_ ); }
+
+private:
+
+  const char* data_; // 写像した先頭(空なら nullptr)
+  std::size_t size_; // バイト数
+};
+
+/// @brief 並列に読み込むときのスレッド数を返す(コア数、不明なら 1)
+unsigned ParseThreads();
+
+/// @brief ファイルのレコードの範囲を file= の行の前で区切り、区間毎に並列に読む
+///
+/// 区間は threads 等分した位置から次の file= の行まで進めた位置で区切るため、レコードが区間をまたぐことはない。
+/// dir= の行(末尾の索引)に達したら読むのをやめる。file=・hash=・group=・tag= 以外の行は無視する。
+///
+/// @param first レコードの範囲の先頭(行の先頭)
+/// @param last レコードの範囲の末尾の次
+/// @param threads スレッド数(区間の数)
+/// @param progress 進み具合を数える変数へのポインタ(nullptr なら数えない)
+/// @return 区間毎のレコード(タグファイルの順)
+std::vector< RecordChunk > ParseRecords( const char* first, const char* last, unsigned threads, ReadProgress* progress = nullptr );
+
+/// @brief 区間毎に、レコードのパスを識別番号にしてタグ毎のファイルを集める
+///
+/// @param chunks 区間毎のレコード
+/// @param rootPath ルートパス
+/// @param fileData ファイルをキーとするタグリスト(パスの表だけを読む)
+/// @param threads スレッド数
+/// @return 区間毎の部分的な索引
+std::vector< PartialIndex > IndexRecords( const std::vector< RecordChunk >& chunks, const std::string& rootPath, const FileData& fileData, unsigned threads );
+
+/// @brief 識別番号の見つかったレコードのタグを、ファイルのタグリストに付ける
+///
+/// ファイルのチャンク毎にスレッドを割り当てるため、同じチャンクを複数のスレッドが変更することはない。
+///
+/// @param chunks 区間毎のレコード
+/// @param partials 区間毎の部分的な索引
+/// @param fileData ファイルをキーとするタグリスト(他のスレッドから読まれていないこと)
+/// @param threads スレッド数
+void FillTagSets( const std::vector< RecordChunk >& chunks, const std::vector< PartialIndex >& partials, FileData* fileData, unsigned threads );
+
+/// @brief 部分的な索引のファイルリストを、タグ毎に k-way マージして tagData に登録する
+///
+/// @param partials 区間毎の部分的な索引
+/// @param tagData タグをキーとするファイルリスト(空であること)
+/// @param threads スレッド数
+void MergePostings( const std::vector< PartialIndex >& partials, TagData* tagData, unsigned threads );
+
+#endif
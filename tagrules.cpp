@@ -0,0 +1,211 @@
+/**
+   tagrules.cpp : タグの別名と含意の規則
+**/
+#include "tagrules.hpp"
+
+using std::string;
+using std::vector;
+
+namespace
+{
+  /*
+    Same : 大文字と小文字・全角と半角を区別せずに等しいか判定する
+  */
+  bool Same( const string& s1, const string& s2 )
+  {
+    StrLess less;
+
+    return( ! less( s1, s2 ) && ! less( s2, s1 ) );
+  }
+} // namespace
+
+/*
+  TagRules コンストラクタ : 空の表を作る
+*/
+TagRules::TagRules()
+  : table_( std::make_shared< Table >() )
+{}
+
+/*
+  TagRules::assign : data の別名を正式なタグまでたどって登録し、含意を 1 件ずつ加えて閉包を作る
+*/
+void TagRules::assign( const TagRuleData& data )
+{
+  auto table = std::make_shared< Table >();
+
+  for ( auto a = data.aliases.begin() ; a != data.aliases.end() ; ++a ) {
+    // 別名の連鎖をたどる(自分に戻れば循環、別名の数を超えてたどれば他の循環に入っている)
+    string tag = a->second;
+    bool cycle = Same( tag, a->first );
+    for ( std::size_t n = 0 ; ! cycle && n <= data.aliases.size() ; ++n ) {
+      auto next = data.aliases.find( tag );
+      if ( next == data.aliases.end() ) break;
+      tag = next->second;
+      cycle = Same( tag, a->first ) || n == data.aliases.size();
+    }
+    if ( cycle ) continue;
+
+    table->aliases[a->first] = tag;
+    table->names[tag].insert( a->first );
+  }
+
+  auto canonical = [&table]( const string& tag ) -> const string& {
+    auto a = table->aliases.find( tag );
+    return( ( a == table->aliases.end() ) ? tag : a->second );
+  };
+  for ( auto i = data.implies.begin() ; i != data.implies.end() ; ++i )
+    insertEdge( table.get(), canonical( i->first ), canonical( i->second ) );
+
+  table_ = table;
+}
+
+/*
+  TagRules::clear : 規則を全て捨てる
+*/
+void TagRules::clear()
+{
+  table_ = std::make_shared< Table >();
+}
+
+/*
+  TagRules::setAlias : alias を tag の別名にする(tag が空なら別名を削除する)
+
+  既存の含意や別名の付け替えが伴うため、表は作り直す
+*/
+bool TagRules::setAlias( const string& alias, const string& tag )
+{
+  TagRuleData rules = data();
+  if ( tag.empty() ) {
+    if ( rules.aliases.erase( alias ) == 0 ) return( true );
+  } else {
+    const string& target = canonical( tag );
+    if ( Same( target, alias ) ) return( false );
+    rules.aliases[alias] = target;
+  }
+  assign( rules );
+
+  return( true );
+}
+
+/*
+  TagRules::imply : tag が implied を含意する規則を加える(閉包は差分だけ更新する)
+*/
+bool TagRules::imply( const string& tag, const string& implied )
+{
+  const string from = canonical( tag );
+  const string to = canonical( implied );
+  if ( Same( from, to ) || this->implied( to ).count( from ) > 0 ) return( false );
+  if ( implies( from ).count( to ) > 0 ) return( true );
+
+  return( insertEdge( &writable(), from, to ) );
+}
+
+/*
+  TagRules::unimply : tag が implied を含意する規則を削除する
+
+  他の経路で含意が残る場合があるため、閉包は作り直す
+*/
+bool TagRules::unimply( const string& tag, const string& implied )
+{
+  const string from = canonical( tag );
+  const string to = canonical( implied );
+  if ( implies( from ).count( to ) == 0 ) return( false );
+
+  TagRuleData rules = data();
+  for ( auto i = rules.implies.lower_bound( from ) ; i != rules.implies.upper_bound( from ) ; ++i ) {
+    if ( Same( i->second, to ) ) {
+      rules.implies.erase( i );
+      break;
+    }
+  }
+  assign( rules );
+
+  return( true );
+}
+
+/*
+  TagRules::canonical : tag の正式なタグを返す
+*/
+const string& TagRules::canonical( const string& tag ) const
+{
+  auto a = table_->aliases.find( tag );
+
+  return( ( a == table_->aliases.end() ) ? tag : a->second );
+}
+
+/*
+  TagRules::expand : tag の正式なタグと、それが含意するタグを返す
+*/
+vector< string > TagRules::expand( const string& tag ) const
+{
+  const string& c = canonical( tag );
+  const Names& more = implied( c );
+  vector< string > res;
+  res.reserve( 1 + more.size() );
+  res.push_back( c );
+  res.insert( res.end(), more.begin(), more.end() );
+
+  return( res );
+}
+
+/*
+  TagRules::data : 保存用に別名と直接の含意を返す
+*/
+TagRuleData TagRules::data() const
+{
+  TagRuleData res;
+  res.aliases.insert( table_->aliases.begin(), table_->aliases.end() );
+  for ( auto e = table_->edges.begin() ; e != table_->edges.end() ; ++e )
+    for ( auto t = e->second.begin() ; t != e->second.end() ; ++t )
+      res.implies.emplace( e->first, *t );
+
+  return( res );
+}
+
+/*
+  TagRules::lookup : map の tag の集合を返す(なければ空の集合)
+*/
+const TagRules::Names& TagRules::lookup( const NameMap& map, const string& tag )
+{
+  static const Names none;
+  auto i = map.find( tag );
+
+  return( ( i == map.end() ) ? none : i->second );
+}
+
+/*
+  TagRules::insertEdge : tag → implied の含意を加え、閉包を更新する
+
+  tag と tag を含意するタグは、implied と implied が含意するタグを新たに含意する
+
+  戻り値 : 循環する場合は false を返す
+*/
+bool TagRules::insertEdge( Table* table, const string& tag, const string& implied )
+{
+  if ( Same( tag, implied ) || lookup( table->implied, implied ).count( tag ) > 0 )
+    return( false );
+  if ( ! table->edges[tag].insert( implied ).second )
+    return( true );
+
+  Names sources = lookup( table->implying, tag );
+  sources.insert( tag );
+  Names targets = lookup( table->implied, implied );
+  targets.insert( implied );
+  for ( auto s = sources.begin() ; s != sources.end() ; ++s )
+    table->implied[*s].insert( targets.begin(), targets.end() );
+  for ( auto t = targets.begin() ; t != targets.end() ; ++t )
+    table->implying[*t].insert( sources.begin(), sources.end() );
+
+  return( true );
+}
+
+/*
+  TagRules::writable : 変更できる表を返す(他の複製と共有中なら複製する)
+*/
+TagRules::Table& TagRules::writable()
+{
+  if ( table_.use_count() > 1 )
+    table_ = std::make_shared< Table >( *table_ );
+
+  return( *table_ );
+}
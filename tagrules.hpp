@@ -0,0 +1,155 @@
+/**
+  @file tagrules.hpp
+  @brief タグの別名と含意の規則
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef TAGRULES_HPP_20261018
+#define TAGRULES_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <memory>
+
+#include "file.hpp"
+
+/**
+   @brief タグの別名と含意
+
+   別名(nyc → new_york)は正式なタグに読み替え、含意(heron → bird)は含意されるタグも付いているものとみなす。
+   タグの追加時には expand() で正式なタグと含意されるタグに展開し、検索時には implying() で
+   含意するタグのファイルも対象にする。
+
+   含意は推移的にたどった結果(推移閉包)を、含意される側・する側の両方向の表として持つ。
+   規則を適用するときは表を引くだけで、含意の連鎖はたどらない。
+   含意の追加では表を差分だけ更新し、規則の削除・別名の変更では表を作り直す。
+
+   表は複製間で共有し(規則を変更するときだけ複製する)、IndexSnapshot に含めて公開する。
+**/
+class TagRules
+{
+public:
+
+  /// @brief タグの集合
+  using Names = std::set< std::string, StrLess >;
+
+  /// @brief デフォルト・コンストラクタ(規則なし)
+  TagRules();
+
+  /// @brief 規則がないか？
+  ///
+  /// @return 別名も含意もなければ true を返す
+  bool empty() const
+  { return( table_->aliases.empty() && table_->edges.empty() ); }
+
+  /// @brief 規則を作り直す
+  ///
+  /// 別名の連鎖は正式なタグまでたどる。循環する別名・含意は読み飛ばす。
+  ///
+  /// @param data 保存された規則
+  void assign( const TagRuleData& data );
+
+  /// @brief 規則を全て捨てる
+  void clear();
+
+  /// @brief 別名を設定する
+  ///
+  /// @param alias 別名
+  /// @param tag 正式なタグ(空なら別名を削除する)
+  /// @return tag が alias 自身か alias の別名の場合(循環する場合)は false を返す
+  bool setAlias( const std::string& alias, const std::string& tag );
+
+  /// @brief 含意を追加する
+  ///
+  /// @param tag 含意するタグ
+  /// @param implied 含意されるタグ
+  /// @return tag と implied が同じか、implied が tag を含意している場合(循環する場合)は false を返す
+  bool imply( const std::string& tag, const std::string& implied );
+
+  /// @brief 含意を削除する
+  ///
+  /// @param tag 含意するタグ
+  /// @param implied 含意されるタグ
+  /// @return 含意がなかった場合は false を返す
+  bool unimply( const std::string& tag, const std::string& implied );
+
+  /// @brief 正式なタグを返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return tag が別名なら正式なタグ、そうでなければ tag 自身
+  const std::string& canonical( const std::string& tag ) const;
+
+  /// @brief 正式なタグ tag の別名を返す
+  ///
+  /// @param tag 正式なタグ
+  /// @return 別名の集合
+  const Names& aliases( const std::string& tag ) const
+  { return( lookup( table_->names, tag ) ); }
+
+  /// @brief 正式なタグ tag が直接含意するタグを返す
+  ///
+  /// @param tag 正式なタグ
+  /// @return 直接含意されるタグの集合
+  const Names& implies( const std::string& tag ) const
+  { return( lookup( table_->edges, tag ) ); }
+
+  /// @brief 正式なタグ tag が推移的に含意するタグを返す
+  ///
+  /// @param tag 正式なタグ
+  /// @return 含意されるタグの集合(tag 自身は含まない)
+  const Names& implied( const std::string& tag ) const
+  { return( lookup( table_->implied, tag ) ); }
+
+  /// @brief 正式なタグ tag を推移的に含意するタグを返す
+  ///
+  /// @param tag 正式なタグ
+  /// @return 含意するタグの集合(tag 自身は含まない)
+  const Names& implying( const std::string& tag ) const
+  { return( lookup( table_->implying, tag ) ); }
+
+  /// @brief 追加するタグを、正式なタグと含意されるタグに展開する
+  ///
+  /// @param tag 追加するタグ
+  /// @return 正式なタグ(先頭)と含意されるタグ
+  std::vector< std::string > expand( const std::string& tag ) const;
+
+  /// @brief 別名ごとに、別名と正式なタグを渡して f を呼ぶ
+  ///
+  /// @param f 別名と正式なタグを受け取る関数
+  template< typename Function > void forEachAlias( Function f ) const
+  {
+    for ( auto a = table_->aliases.begin() ; a != table_->aliases.end() ; ++a )
+      f( a->first, a->second );
+  }
+
+  /// @brief 保存用に規則を返す
+  ///
+  /// @return 別名と直接の含意
+  TagRuleData data() const;
+
+private:
+
+  using NameMap = std::map< std::string, Names, StrLess >;
+
+  // 規則の表
+  struct Table
+  {
+    std::map< std::string, std::string, StrLess > aliases; // 別名をキーとする正式なタグ
+    NameMap names;    // 正式なタグをキーとする別名
+    NameMap edges;    // タグをキーとする直接含意されるタグ
+    NameMap implied;  // タグをキーとする推移的に含意されるタグ
+    NameMap implying; // タグをキーとする推移的に含意するタグ
+  };
+
+  static const Names& lookup( const NameMap& map, const std::string& tag ); // tag の集合を返す(なければ空)
+  static bool insertEdge( Table* table, const std::string& tag, const std::string& implied ); // 含意を加え、閉包を更新する
+  Table& writable(); // 変更できる表を返す(共有中なら複製する)
+
+  std::shared_ptr< Table > table_; // 規則の表(複製間で共有する)
+};
+
+#endif
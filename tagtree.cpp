@@ -0,0 +1,382 @@
+/**
+   tagtree.cpp : タグの階層(親子関係)
+**/
+#include "tagtree.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <atomic>
+
+using std::string;
+using std::vector;
+
+/*
+  TagTree::assign : parents の親子関係で作り直し、番号と集約したファイルリストを求める
+
+  親を辿って自分に戻る関係(循環)は読み飛ばす
+*/
+void TagTree::assign( const TagParents& parents, const TagData& tagData )
+{
+  nodes_ = std::make_shared< container >();
+  for ( auto p = parents.begin() ; p != parents.end() ; ++p ) {
+    if ( p->second.empty() ) continue;
+
+    // 親から根まで辿り、自分が現れれば循環する
+    StrLess less;
+    bool cycle = false;
+    for ( string a = p->second ; ! a.empty() && ! cycle ; ) {
+      cycle = ( ! less( a, p->first ) && ! less( p->first, a ) );
+      auto n = nodes_->find( a );
+      a = ( n == nodes_->end() ) ? string() : n->second.parent;
+    }
+    if ( cycle ) continue;
+
+    auto child = nodes_->emplace( p->first, Node() ).first;
+    auto parent = nodes_->emplace( p->second, Node() ).first;
+    if ( ! child->second.parent.empty() ) detach( child );
+    child->second.parent = parent->first;
+    parent->second.children.push_back( child->first );
+  }
+
+  relabel();
+  rollupAll( tagData );
+}
+
+/*
+  TagTree::setParent : tag の親を parent にし、変わった祖先の集約したファイルリストを作り直す
+
+  戻り値 : 循環する場合は false を返す
+*/
+bool TagTree::setParent( const string& tag, const string& parent, const TagData& tagData )
+{
+  edit();
+  auto node = nodes_->find( tag );
+  string old = ( node == nodes_->end() ) ? string() : node->second.parent;
+
+  if ( parent.empty() ) {
+    if ( old.empty() ) return( true );
+    detach( node );
+    node->second.parent.clear();
+    prune( node->first );
+  } else {
+    if ( contains( tag, parent ) ) return( false );
+    auto p = nodes_->emplace( parent, Node() ).first;
+    if ( p->first == old ) return( true );
+    if ( node == nodes_->end() )
+      node = nodes_->emplace( tag, Node() ).first;
+    else if ( ! old.empty() )
+      detach( node );
+    node->second.parent = p->first;
+    p->second.children.push_back( node->first );
+  }
+
+  relabel();
+  if ( ! old.empty() ) {
+    rollup( old, tagData );
+    prune( old );
+  }
+  if ( ! parent.empty() )
+    rollup( parent, tagData );
+
+  return( true );
+}
+
+/*
+  TagTree::parent : tag の親タグを返す
+*/
+string TagTree::parent( const string& tag ) const
+{
+  auto n = nodes_->find( tag );
+
+  return( ( n == nodes_->end() ) ? string() : n->second.parent );
+}
+
+/*
+  TagTree::children : tag の子タグを返す
+*/
+vector< string > TagTree::children( const string& tag ) const
+{
+  auto n = nodes_->find( tag );
+
+  return( ( n == nodes_->end() ) ? vector< string >() : n->second.children );
+}
+
+/*
+  TagTree::contains : ancestor が tag 自身か祖先か、番号の比較で判定する
+
+  子孫の行きがけ順の番号は祖先より大きく、帰りがけ順の番号は祖先より小さい
+*/
+bool TagTree::contains( const string& ancestor, const string& tag ) const
+{
+  auto a = nodes_->find( ancestor );
+  auto t = nodes_->find( tag );
+  if ( a == nodes_->end() || t == nodes_->end() ) {
+    StrLess less;
+    return( ! less( ancestor, tag ) && ! less( tag, ancestor ) );
+  }
+
+  return( a->second.pre <= t->second.pre && t->second.post <= a->second.post );
+}
+
+/*
+  TagTree::lineage : tag から根までのタグを返す
+*/
+vector< string > TagTree::lineage( const string& tag ) const
+{
+  vector< string > res( 1, tag );
+  for ( auto n = nodes_->find( tag ) ; n != nodes_->end() && ! n->second.parent.empty() ; ) {
+    res.push_back( n->second.parent );
+    n = nodes_->find( n->second.parent );
+  }
+
+  return( res );
+}
+
+/*
+  TagTree::subtree : tag から深さ優先で辿り、tag と子孫のタグを返す
+*/
+vector< string > TagTree::subtree( const string& tag ) const
+{
+  vector< string > res( 1, tag );
+  for ( std::size_t i = 0 ; i < res.size() ; ++i ) {
+    auto n = nodes_->find( res[i] );
+    if ( n != nodes_->end() )
+      res.insert( res.begin() + i + 1, n->second.children.begin(), n->second.children.end() );
+  }
+
+  return( res );
+}
+
+/*
+  TagTree::files : tag が子を持てば、集約したファイルリストを返す
+*/
+const Posting* TagTree::files( const string& tag ) const
+{
+  auto n = nodes_->find( tag );
+  if ( n == nodes_->end() || n->second.children.empty() ) return( nullptr );
+
+  return( &( n->second.files ) );
+}
+
+/*
+  TagTree::update : file への tag の追加・削除を、tag と祖先の集約したファイルリストに反映する
+
+  削除では、ファイルに残ったタグのうち祖先の子孫であるものがあれば、その祖先とさらに外側の祖先には残す
+*/
+void TagTree::update( FileId file, const string& tag, bool added, const TagSet& tags )
+{
+  auto n = nodes_->find( tag );
+  if ( n == nodes_->end() ) return;
+  if ( n->second.children.empty() && n->second.parent.empty() ) return;
+
+  // 集約したファイルリストを変更するため、共有中なら複製してから探し直す
+  n = edit().find( tag );
+  if ( n->second.children.empty() )
+    n = nodes_->find( n->second.parent );
+
+  if ( added ) {
+    for ( ; ; n = nodes_->find( n->second.parent ) ) {
+      n->second.files.insert( file );
+      if ( n->second.parent.empty() ) break;
+    }
+    return;
+  }
+
+  vector< const Node* > rest; // ファイルに残ったタグのうち節であるもの
+  for ( auto t = tags.begin() ; t != tags.end() ; ++t ) {
+    auto r = nodes_->find( *t );
+    if ( r != nodes_->end() ) rest.push_back( &( r->second ) );
+  }
+  for ( ; ; n = nodes_->find( n->second.parent ) ) {
+    const Node& a = n->second;
+    if ( std::any_of( rest.begin(), rest.end(),
+                      [&a]( const Node* r ) { return( a.pre <= r->pre && r->post <= a.post ); } ) )
+      break;
+    n->second.files.erase( file );
+    if ( a.parent.empty() ) break;
+  }
+}
+
+/*
+  TagTree::rename : 節のキーを newTag に付け替える(newTag がすでに節なら、oldTag の子を移してまとめる)
+*/
+void TagTree::rename( const string& oldTag, const string& newTag, const TagData& tagData )
+{
+  if ( nodes_->count( oldTag ) == 0 && nodes_->count( newTag ) == 0 ) return;
+
+  edit();
+  auto o = nodes_->find( oldTag );
+  auto n = nodes_->find( newTag );
+  if ( o == nodes_->end() ) {
+    // 節でないタグをまとめた場合は、まとめ先の祖先のファイルが増える
+    if ( n != nodes_->end() ) rollup( n->first, tagData );
+    return;
+  }
+
+  if ( n == nodes_->end() || n == o ) {
+    // 親の子タグと子の親タグを新しいキーに書き換える
+    auto node = nodes_->extract( o );
+    string oldKey = node.key();
+    node.key() = newTag;
+    Node& moved = node.mapped();
+    if ( ! moved.parent.empty() ) {
+      auto& siblings = nodes_->find( moved.parent )->second.children;
+      std::replace( siblings.begin(), siblings.end(), oldKey, newTag );
+    }
+    for ( auto c = moved.children.begin() ; c != moved.children.end() ; ++c )
+      nodes_->find( *c )->second.parent = newTag;
+    nodes_->insert( std::move( node ) );
+    rollup( newTag, tagData );
+    return;
+  }
+
+  // newTag が oldTag の子孫なら、oldTag の位置に移す
+  if ( contains( o->first, n->first ) ) {
+    detach( n );
+    n->second.parent = o->second.parent;
+    if ( ! n->second.parent.empty() )
+      nodes_->find( n->second.parent )->second.children.push_back( n->first );
+  }
+  if ( ! o->second.parent.empty() ) detach( o );
+  for ( auto c = o->second.children.begin() ; c != o->second.children.end() ; ++c ) {
+    nodes_->find( *c )->second.parent = n->first;
+    n->second.children.push_back( *c );
+  }
+  nodes_->erase( o );
+  prune( n->first );
+
+  relabel();
+  rollupAll( tagData );
+}
+
+/*
+  TagTree::data : 親を持つタグをキーとする親タグを返す
+*/
+TagParents TagTree::data() const
+{
+  TagParents res;
+  for ( auto n = nodes_->begin() ; n != nodes_->end() ; ++n )
+    if ( ! n->second.parent.empty() )
+      res.emplace( n->first, n->second.parent );
+
+  return( res );
+}
+
+/*
+  TagTree::edit : 節の map が他のコピーと共有中なら複製してから返す
+
+  FileData::edit と同様に、参照を手放したスレッドの読み込みより後になるよう同期する
+*/
+TagTree::container& TagTree::edit()
+{
+  if ( nodes_.use_count() > 1 )
+    nodes_ = std::make_shared< container >( *nodes_ );
+  else
+    std::atomic_thread_fence( std::memory_order_acquire );
+
+  return( *nodes_ );
+}
+
+/*
+  TagTree::detach : node を親の子タグから外す(node の親タグは呼び出し側で書き換える)
+*/
+void TagTree::detach( container::iterator node )
+{
+  auto& siblings = nodes_->find( node->second.parent )->second.children;
+  siblings.erase( std::find( siblings.begin(), siblings.end(), node->first ) );
+}
+
+/*
+  TagTree::prune : tag が親も子も持たなければ節を捨てる
+*/
+void TagTree::prune( const string& tag )
+{
+  auto n = nodes_->find( tag );
+  if ( n != nodes_->end() && n->second.parent.empty() && n->second.children.empty() )
+    nodes_->erase( n );
+}
+
+/*
+  TagTree::relabel : 根から深さ優先で辿り、行きがけ順・帰りがけ順の番号を振り直す
+*/
+void TagTree::relabel()
+{
+  unsigned pre = 0;
+  unsigned post = 0;
+  vector< std::pair< Node*, std::size_t > > stack; // 辿っている節と次に辿る子の位置
+  for ( auto r = nodes_->begin() ; r != nodes_->end() ; ++r ) {
+    if ( ! r->second.parent.empty() ) continue;
+    r->second.pre = pre++;
+    stack.emplace_back( &( r->second ), 0 );
+    while ( ! stack.empty() ) {
+      Node* node = stack.back().first;
+      if ( stack.back().second < node->children.size() ) {
+        Node& child = nodes_->find( node->children[stack.back().second++] )->second;
+        child.pre = pre++;
+        stack.emplace_back( &child, 0 );
+      } else {
+        node->post = post++;
+        stack.pop_back();
+      }
+    }
+  }
+}
+
+/*
+  TagTree::collect : node 自身と子のファイルリストの和集合を、node の集約したファイルリストにする
+
+  子が子を持てば子の集約したファイルリストを使うため、子から先に求めておくこと
+*/
+void TagTree::collect( container::iterator node, const TagData& tagData )
+{
+  if ( node->second.children.empty() ) {
+    node->second.files.clear();
+    return;
+  }
+
+  vector< FileId > merged;
+  auto own = tagData.find( node->first );
+  if ( own != tagData.end() )
+    merged.assign( own->second.begin(), own->second.end() );
+  for ( auto c = node->second.children.begin() ; c != node->second.children.end() ; ++c ) {
+    const Node& child = nodes_->find( *c )->second;
+    const Posting* files = &( child.files );
+    if ( child.children.empty() ) {
+      auto t = tagData.find( *c );
+      if ( t == tagData.end() ) continue;
+      files = &( t->second );
+    }
+    vector< FileId > next;
+    next.reserve( merged.size() + files->size() );
+    std::set_union( merged.begin(), merged.end(), files->begin(), files->end(), std::back_inserter( next ) );
+    merged.swap( next );
+  }
+  node->second.files.assign( merged.begin(), merged.end() );
+}
+
+/*
+  TagTree::rollup : tag から根までの集約したファイルリストを、内側から作り直す
+*/
+void TagTree::rollup( const string& tag, const TagData& tagData )
+{
+  for ( auto n = nodes_->find( tag ) ; n != nodes_->end() ; n = nodes_->find( n->second.parent ) ) {
+    collect( n, tagData );
+    if ( n->second.parent.empty() ) break;
+  }
+}
+
+/*
+  TagTree::rollupAll : 帰りがけ順(子が先)に全ての集約したファイルリストを作り直す
+*/
+void TagTree::rollupAll( const TagData& tagData )
+{
+  vector< container::iterator > order;
+  order.reserve( nodes_->size() );
+  for ( auto n = nodes_->begin() ; n != nodes_->end() ; ++n )
+    order.push_back( n );
+  std::sort( order.begin(), order.end(),
+             []( container::iterator a, container::iterator b ) { return( a->second.post < b->second.post ); } );
+
+  for ( auto n = order.begin() ; n != order.end() ; ++n )
+    collect( *n, tagData );
+}
@@ -0,0 +1,162 @@
+/**
+  @file tagtree.hpp
+  @brief タグの階層(親子関係)
+
+  @author tadah_fussy
+  @date 2026/10/18 新規作成
+**/
+
+#ifndef TAGTREE_HPP_20261018
+#define TAGTREE_HPP_20261018
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+
+#include "file.hpp"
+
+/**
+   @brief タグの階層
+
+   親子関係のあるタグだけを節として持つ(animal - bird - heron など)。
+   親タグのファイルには、子孫のタグの付いたファイルも含める。
+
+   節には行きがけ順・帰りがけ順の番号を振り、祖先の判定は番号の比較だけで行う。
+   子を持つ節は、自分と子孫のタグのファイルリストの和集合(集約したファイルリスト)を持つ。
+   集約したファイルリストはタグの追加・削除の度に祖先の分だけ更新し、作り直すのは親子関係を変えたときだけとする。
+
+   節の map はコピーで共有し、変更するときに共有中なら複製する(コピー・オン・ライト)。
+   IndexSnapshot に含めて公開しても、複製するのは公開後に階層を変更した場合だけになる。
+   複製しても、集約したファイルリストは Posting なので共有するだけで済む。
+**/
+class TagTree
+{
+public:
+
+  /// @brief デフォルト・コンストラクタ
+  TagTree() : nodes_( std::make_shared< container >() ) {}
+
+  /// @brief 階層がないか？
+  ///
+  /// @return 親子関係がなければ true を返す
+  bool empty() const
+  { return( nodes_->empty() ); }
+
+  /// @brief 親子関係を作り直す
+  ///
+  /// 循環する親子関係は読み飛ばす。
+  ///
+  /// @param parents タグをキーとする親タグ
+  /// @param tagData タグをキーとするファイルリスト
+  void assign( const TagParents& parents, const TagData& tagData );
+
+  /// @brief 親子関係を全て捨てる
+  void clear()
+  { nodes_ = std::make_shared< container >(); }
+
+  /// @brief 親タグを設定する
+  ///
+  /// 集約したファイルリストは、変更前と変更後の祖先の分だけ作り直す。
+  ///
+  /// @param tag 対象のタグ
+  /// @param parent 親タグ(空なら親子関係を解く)
+  /// @param tagData タグをキーとするファイルリスト
+  /// @return parent が tag 自身か子孫の場合(循環する場合)は false を返す
+  bool setParent( const std::string& tag, const std::string& parent, const TagData& tagData );
+
+  /// @brief 親タグを返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return 親タグ(なければ空)
+  std::string parent( const std::string& tag ) const;
+
+  /// @brief 子タグを返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return 子タグ
+  std::vector< std::string > children( const std::string& tag ) const;
+
+  /// @brief ancestor が tag 自身か祖先か？
+  ///
+  /// @param ancestor 祖先か調べるタグ
+  /// @param tag 対象のタグ
+  /// @return ancestor が tag 自身か祖先なら true を返す
+  bool contains( const std::string& ancestor, const std::string& tag ) const;
+
+  /// @brief tag と祖先のタグを、tag から順に返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return tag と祖先のタグ
+  std::vector< std::string > lineage( const std::string& tag ) const;
+
+  /// @brief tag と子孫のタグを返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return tag と子孫のタグ(行きがけ順)
+  std::vector< std::string > subtree( const std::string& tag ) const;
+
+  /// @brief 子孫のタグも含めたファイルリストを返す
+  ///
+  /// @param tag 対象のタグ
+  /// @return 集約したファイルリストへのポインタ(子タグがなければ nullptr)
+  const Posting* files( const std::string& tag ) const;
+
+  /// @brief 子を持つタグごとに、集約したファイルリストを渡して f を呼ぶ
+  ///
+  /// @param f タグと集約したファイルリストを受け取る関数
+  template< typename Function > void forEachRollup( Function f ) const
+  {
+    for ( auto n = nodes_->begin() ; n != nodes_->end() ; ++n )
+      if ( ! n->second.children.empty() ) f( n->first, n->second.files );
+  }
+
+  /// @brief ファイルに対するタグの追加・削除を集約したファイルリストに反映する
+  ///
+  /// @param file タグが変更されたファイル
+  /// @param tag 追加・削除されたタグ
+  /// @param added 追加の場合は true
+  /// @param tags 変更後のファイルのタグリスト
+  void update( FileId file, const std::string& tag, bool added, const TagSet& tags );
+
+  /// @brief タグ名の変更を反映する
+  ///
+  /// newTag がすでに節なら oldTag の子を newTag に移してまとめる。
+  /// tagData は変更後のものを渡すこと。
+  ///
+  /// @param oldTag 変更前のタグ
+  /// @param newTag 変更後のタグ
+  /// @param tagData タグをキーとするファイルリスト
+  void rename( const std::string& oldTag, const std::string& newTag, const TagData& tagData );
+
+  /// @brief 保存用にタグをキーとする親タグを返す
+  ///
+  /// @return タグをキーとする親タグ
+  TagParents data() const;
+
+private:
+
+  // 節
+  struct Node
+  {
+    std::string parent;                 // 親タグ(なければ空)
+    std::vector< std::string > children; // 子タグ
+    unsigned pre;                       // 行きがけ順の番号
+    unsigned post;                      // 帰りがけ順の番号
+    Posting files;                      // 自分と子孫のタグのファイルリスト(子がなければ空)
+  };
+
+  using container = std::map< std::string, Node, StrLess >;
+
+  container& edit();                                                 // 共有中なら複製してから節を返す
+  void detach( container::iterator node );                           // 親の子タグから外す
+  void prune( const std::string& tag );                              // 親も子もない節を捨てる
+  void relabel();                                                    // 行きがけ順・帰りがけ順の番号を振り直す
+  void collect( container::iterator node, const TagData& tagData );  // 節の集約したファイルリストを作り直す
+  void rollup( const std::string& tag, const TagData& tagData );     // tag と祖先の集約したファイルリストを作り直す
+  void rollupAll( const TagData& tagData );                          // 全ての集約したファイルリストを作り直す
+
+  std::shared_ptr< container > nodes_; // タグをキーとする節(コピーと共有する)
+};
+
+#endif